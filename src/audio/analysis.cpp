@@ -0,0 +1,88 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the AnalysisPass class, and the other non-template parts
+ * of background analysis.
+ * @see audio/analysis.h
+ */
+
+#include "analysis.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "../errors.h"
+#include "../log.h"
+#include "dsp.h"
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+bool DecodeAll(Source &source, const std::function<void(gsl::span<const float>)> &meter,
+               const std::function<bool()> &stopped)
+{
+	const auto fmt = source.OutputSampleFormat();
+	const auto bps = sample_format_bps[static_cast<std::size_t>(fmt)];
+
+	std::vector<float> samples;
+	while (!stopped()) {
+		auto [state, bytes] = source.Decode();
+		if (state == Source::DecodeState::END_OF_FILE) return true;
+
+		samples.resize(bytes.size() / bps);
+		ToFloat(gsl::span<const std::byte>{bytes}.first(samples.size() * bps), fmt, samples);
+		meter(samples);
+	}
+	return false;
+}
+
+//
+// AnalysisPass
+//
+
+AnalysisPass::AnalysisPass(std::string_view path, OpenFn open) : open{std::move(open)}
+{
+	try {
+		this->id = FileIdentity::Of(path);
+	} catch (FileError &e) {
+		PLAYD_LOG(WARNING) << "analysis: not analysing:" << e.Message();
+	}
+}
+
+void AnalysisPass::Start(WorkerPool &pool)
+{
+	if (!this->id || this->parts.empty()) return;
+
+	pool.Submit([id = std::move(*this->id), open = std::move(this->open),
+	             parts = std::move(this->parts)](const std::atomic<bool> &stop) {
+		const auto wanted = [&parts] {
+			return std::any_of(parts.begin(), parts.end(), [](const auto &part) { return part->Wanted(); });
+		};
+		if (!wanted()) return;
+
+		try {
+			auto source = open();
+			if (source == nullptr) return;
+
+			for (auto &part : parts) part->Begin(source->SampleRate(), source->ChannelCount());
+			const auto finished = DecodeAll(
+			        *source,
+			        [&parts](gsl::span<const float> samples) {
+				        for (auto &part : parts) part->Add(samples);
+			        },
+			        [&stop, &wanted] { return stop || !wanted(); });
+			if (!finished) return;
+
+			// Even results no longer wanted are worth caching, now
+			// that we have them.
+			for (auto &part : parts) part->Finish(id);
+		} catch (Error &e) {
+			PLAYD_LOG(ERROR) << "analysis: failed:" << e.Message();
+		}
+	});
+	this->id.reset();
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,279 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Analysis class template, and the AnalysisPass class.
+ * @see audio/analysis.cpp
+ */
+
+#ifndef PLAYD_AUDIO_ANALYSIS_H
+#define PLAYD_AUDIO_ANALYSIS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "../cache.h"
+#include "../metrics.h"
+#include "../worker.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/**
+ * Decodes the rest of a source into a meter.
+ * @param source The source.
+ * @param meter Called with each decoded frame, as interleaved floats.
+ * @param stopped Checked before each decode; decoding gives up once true.
+ * @return Whether decoding reached the end of the source.
+ */
+bool DecodeAll(Source &source, const std::function<void(gsl::span<const float>)> &meter,
+               const std::function<bool()> &stopped);
+
+/**
+ * The result of an analysis of a whole file, which arrives in the
+ * background.
+ *
+ * Analyses are made by an AnalysisPass, which decodes the file once for
+ * all of the analyses added to it.  Results are cached on the file's
+ * identity, so files only get analysed once; files that can't be identified
+ * (such as streams) aren't analysed, and their results never arrive.
+ *
+ * @tparam Traits Describes the analysis, with members:
+ *   Value, the (default-constructible) type of results;
+ *   Meter, constructed from a sample rate and channel count, with
+ *   Add(gsl::span<const float>) to feed it and Result() to get a Value;
+ *   KIND, the kind of Cache results go in;
+ *   Pack and Unpack, to turn Values into cache entries and back;
+ *   ANALYSES_METRIC and HITS_METRIC, the names of counters of analyses
+ *   run and cache hits, with ANALYSES_HELP and HITS_HELP describing them.
+ */
+template <typename Traits>
+class Analysis
+{
+public:
+	/// Type of results.
+	using Value = typename Traits::Value;
+
+	/// The state an Analysis shares with the pass producing its result.
+	struct State {
+		std::atomic<bool> cancelled{false}; ///< Whether the result is unwanted.
+		std::atomic<bool> done{false};      ///< Whether the result is ready.
+		Value result{};                     ///< The result; read only once done.
+	};
+
+	/**
+	 * Constructs an Analysis.
+	 * @param state The state shared with the pass producing the result.
+	 */
+	explicit Analysis(std::shared_ptr<State> state) : state{std::move(state)}, taken{false}
+	{
+	}
+
+	/// Destructs an Analysis, abandoning it if unfinished.
+	~Analysis()
+	{
+		this->state->cancelled = true;
+	}
+
+	/// Deleted copy constructor.
+	Analysis(const Analysis &) = delete;
+
+	/// Deleted copy-assignment.
+	Analysis &operator=(const Analysis &) = delete;
+
+	/// @return The result if the analysis has finished; otherwise, nullptr.
+	const Value *Result() const
+	{
+		return this->state->done.load(std::memory_order_acquire) ? &this->state->result : nullptr;
+	}
+
+	/**
+	 * Gets the result the first time it is available, for announcing.
+	 * @return The result, if the analysis has finished and this is the
+	 *   first call to see it; otherwise, nullptr.
+	 */
+	const Value *Take()
+	{
+		if (this->taken) return nullptr;
+
+		const auto *result = this->Result();
+		this->taken = result != nullptr;
+		return result;
+	}
+
+private:
+	std::shared_ptr<State> state; ///< The shared state.
+	bool taken;                   ///< Whether Take has returned the result.
+};
+
+/**
+ * One background decode of a whole file, feeding several analyses at once.
+ *
+ * Each analysis added looks for its result in its own cache first.  Once
+ * started, the pass decodes the file from the start with its own Source, on
+ * a low-priority worker, feeding every analysis that missed; so a file is
+ * read and decoded at most once however many analyses want it, and never
+ * takes time from (or moves) playback.
+ */
+class AnalysisPass
+{
+public:
+	/// Type of functions that open new sources for the file.
+	using OpenFn = std::function<std::unique_ptr<Source>()>;
+
+	/**
+	 * Constructs an AnalysisPass.
+	 * @param path The path of the file.
+	 * @param open Opens a fresh Source on the file; called on the worker.
+	 */
+	AnalysisPass(std::string_view path, OpenFn open);
+
+	/// Deleted copy constructor.
+	AnalysisPass(const AnalysisPass &) = delete;
+
+	/// Deleted copy-assignment.
+	AnalysisPass &operator=(const AnalysisPass &) = delete;
+
+	/**
+	 * Adds an analysis to the pass, unless its result is already cached.
+	 * @tparam Traits Describes the analysis; see Analysis.
+	 * @param cache The cache of results.
+	 * @return The analysis, which has its result at once if cached.
+	 */
+	template <typename Traits>
+	std::unique_ptr<Analysis<Traits>> Add(Cache cache = Cache::Default(Traits::KIND));
+
+	/**
+	 * Starts decoding, if any analysis added needs it.
+	 * @param pool The pool on which to decode.
+	 */
+	void Start(WorkerPool &pool = WorkerPool::Background());
+
+	/// An analysis waiting on the pass, with its meter.
+	class Part
+	{
+	public:
+		/// Virtual, empty destructor for Part.
+		virtual ~Part() = default;
+
+		/// @return Whether the analysis's result is still wanted.
+		virtual bool Wanted() const = 0;
+
+		/**
+		 * Makes the meter, now that the file's format is known.
+		 * @param rate The sample rate, in Hz.
+		 * @param channels The number of channels.
+		 */
+		virtual void Begin(std::uint32_t rate, std::uint8_t channels) = 0;
+
+		/**
+		 * Feeds the meter.
+		 * @param samples Decoded samples, as interleaved floats.
+		 */
+		virtual void Add(gsl::span<const float> samples) = 0;
+
+		/**
+		 * Finishes the analysis, caching and publishing its result.
+		 * @param id The identity of the file.
+		 */
+		virtual void Finish(const FileIdentity &id) = 0;
+	};
+
+private:
+	/// The file's identity, if it could be established.
+	std::optional<FileIdentity> id;
+
+	/// Opens a fresh Source on the file.
+	OpenFn open;
+
+	/// The analyses that missed the cache.
+	std::vector<std::shared_ptr<Part>> parts;
+};
+
+/**
+ * An AnalysisPass::Part for one kind of analysis.
+ * @tparam Traits Describes the analysis; see Analysis.
+ */
+template <typename Traits>
+class MeteredPart : public AnalysisPass::Part
+{
+public:
+	/**
+	 * Constructs a MeteredPart.
+	 * @param state The state shared with the Analysis.
+	 * @param cache The cache in which to store the result.
+	 */
+	MeteredPart(std::shared_ptr<typename Analysis<Traits>::State> state, Cache cache)
+	    : state{std::move(state)}, cache{std::move(cache)}
+	{
+	}
+
+	bool Wanted() const override
+	{
+		return !this->state->cancelled;
+	}
+
+	void Begin(std::uint32_t rate, std::uint8_t channels) override
+	{
+		this->meter.emplace(rate, channels);
+	}
+
+	void Add(gsl::span<const float> samples) override
+	{
+		this->meter->Add(samples);
+	}
+
+	void Finish(const FileIdentity &id) override
+	{
+		static auto &analyses = Metrics::Global().GetCounter(Traits::ANALYSES_METRIC, Traits::ANALYSES_HELP);
+
+		this->state->result = this->meter->Result();
+		this->cache.Store(id, Traits::Pack(this->state->result));
+		analyses.Add();
+		this->state->done.store(true, std::memory_order_release);
+	}
+
+private:
+	std::shared_ptr<typename Analysis<Traits>::State> state; ///< The shared state.
+	Cache cache;                                             ///< The cache of results.
+	std::optional<typename Traits::Meter> meter;             ///< The meter, once begun.
+};
+
+template <typename Traits>
+std::unique_ptr<Analysis<Traits>> AnalysisPass::Add(Cache cache)
+{
+	static auto &hits = Metrics::Global().GetCounter(Traits::HITS_METRIC, Traits::HITS_HELP);
+
+	auto state = std::make_shared<typename Analysis<Traits>::State>();
+	auto analysis = std::make_unique<Analysis<Traits>>(state);
+
+	// Without an identity there's nowhere to keep the result, and anything
+	// we can't identify can't be re-read; the result never arrives.
+	if (!this->id) return analysis;
+
+	if (auto data = cache.Load(*this->id); data) {
+		if (auto value = Traits::Unpack(*data); value) {
+			state->result = std::move(*value);
+			state->done = true;
+			hits.Add();
+			return analysis;
+		}
+	}
+
+	this->parts.push_back(std::make_shared<MeteredPart<Traits>>(std::move(state), std::move(cache)));
+	return analysis;
+}
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_ANALYSIS_H
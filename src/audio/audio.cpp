@@ -10,15 +10,33 @@
 #include "audio.h"
 
 #include <chrono>
+#include <memory>
+#include <optional>
 #include <gsl/gsl>
 
 #include "../errors.h"
 #include "../messages.h"
+#include "../metrics.h"
+#include "../trace.h"
+#include "dsp.h"
+#include "limiter.h"
+#include "sample_format.h"
 #include "sink.h"
 #include "source.h"
 
 namespace Playd::Audio
 {
+/// The time over which gain changes ramp; short, but long enough not to click.
+constexpr std::chrono::milliseconds GAIN_RAMP{10};
+
+/// @return The histogram of how long each decode took.
+static Histogram &DecodeHistogram()
+{
+	static auto &histogram = Metrics::Global().GetHistogram(
+	        "playd_decode_us", "Microseconds taken to decode each frame of audio.", Histogram::Doubling(16, 14));
+	return histogram;
+}
+
 //
 // NullAudio
 //
@@ -39,6 +57,11 @@ Audio::State NullAudio::CurrentState() const
 	return State::NONE;
 }
 
+bool NullAudio::IsLive() const
+{
+	return false;
+}
+
 void NullAudio::SetPlaying(bool)
 {
 	throw NotSupportedInNullAudio();
@@ -49,6 +72,11 @@ void NullAudio::SetPosition(std::chrono::microseconds)
 	throw NotSupportedInNullAudio();
 }
 
+void NullAudio::SetGain(float, bool)
+{
+	throw NotSupportedInNullAudio();
+}
+
 std::chrono::microseconds NullAudio::Position() const
 {
 	throw NotSupportedInNullAudio();
@@ -64,13 +92,36 @@ std::string_view NullAudio::File() const
 	throw NotSupportedInNullAudio();
 }
 
+bool NullAudio::CueCrossfade(Audio *, std::chrono::microseconds, std::chrono::microseconds, FadeCurve)
+{
+	return false;
+}
+
+std::optional<Levels> NullAudio::TakeLevels()
+{
+	return std::nullopt;
+}
+
+std::optional<Audio::Dropout> NullAudio::TakeUnderrun()
+{
+	return std::nullopt;
+}
+
+std::optional<std::chrono::microseconds> NullAudio::Headroom() const
+{
+	return std::nullopt;
+}
+
 //
 // BasicAudio
 //
 
-BasicAudio::BasicAudio(std::unique_ptr<Source> src, std::unique_ptr<Sink> sink)
-    : src{std::move(src)}, sink{std::move(sink)}
+BasicAudio::BasicAudio(std::unique_ptr<Source> src, std::unique_ptr<Sink> sink, std::optional<float> ceiling)
+    : src{std::move(src)}, sink{std::move(sink)}, limiter{nullptr}, drained{false}, source_out{false}
 {
+	if (ceiling) {
+		this->limiter = std::make_unique<Limiter>(this->src->SampleRate(), this->src->ChannelCount(), *ceiling);
+	}
 	this->ClearFrame();
 }
 
@@ -117,6 +168,13 @@ std::chrono::microseconds BasicAudio::Length() const
 	return this->src->MicrosFromSamples(this->src->Length());
 }
 
+bool BasicAudio::IsLive() const
+{
+	Expects(this->src != nullptr);
+
+	return this->src->IsLive();
+}
+
 void BasicAudio::SetPosition(std::chrono::microseconds position)
 {
 	Expects(this->sink != nullptr);
@@ -129,6 +187,69 @@ void BasicAudio::SetPosition(std::chrono::microseconds position)
 	// We might still have decoded samples from the old position in
 	// our frame, so clear them out.
 	this->ClearFrame();
+	this->source_out = false;
+
+	// The same goes for the limiter's delay line.
+	if (this->limiter) {
+		this->limiter->Reset();
+		this->drained = false;
+	}
+}
+
+void BasicAudio::SetGain(float new_gain, bool ramp)
+{
+	Expects(this->src != nullptr);
+
+	const auto frames = ramp ? this->src->SamplesFromMicros(GAIN_RAMP) : 0;
+	this->gain.Set(new_gain, frames);
+}
+
+bool BasicAudio::CueCrossfade(Audio *next, std::chrono::microseconds at, std::chrono::microseconds length,
+                              FadeCurve curve)
+{
+	Expects(this->sink != nullptr);
+	Expects(this->src != nullptr);
+
+	// Only our own sinks know how to crossfade with each other.
+	auto *basic = dynamic_cast<BasicAudio *>(next);
+	if (next != nullptr && basic == nullptr) return false;
+
+	auto *next_sink = basic == nullptr ? nullptr : basic->sink.get();
+	return this->sink->CueCrossfade(next_sink, this->src->SamplesFromMicros(at),
+	                                this->src->SamplesFromMicros(length), curve);
+}
+
+std::optional<Levels> BasicAudio::TakeLevels()
+{
+	Expects(this->sink != nullptr);
+
+	return this->sink->TakeLevels();
+}
+
+std::optional<Audio::Dropout> BasicAudio::TakeUnderrun()
+{
+	Expects(this->sink != nullptr);
+	Expects(this->src != nullptr);
+
+	const auto underrun = this->sink->TakeUnderrun();
+	if (!underrun) return std::nullopt;
+	return Dropout{this->src->MicrosFromSamples(underrun->position),
+	               this->src->MicrosFromSamples(underrun->frames), underrun->at};
+}
+
+std::optional<std::chrono::microseconds> BasicAudio::Headroom() const
+{
+	Expects(this->sink != nullptr);
+	Expects(this->src != nullptr);
+
+	if (this->sink->CurrentState() != Sink::State::PLAYING) return std::nullopt;
+
+	// With everything in the sink, it plays out without us.
+	if (this->source_out && this->FrameFinished()) return std::nullopt;
+
+	const auto buffered = this->sink->Buffered();
+	if (!buffered) return std::nullopt;
+	return this->src->MicrosFromSamples(*buffered);
 }
 
 void BasicAudio::ClearFrame()
@@ -143,7 +264,10 @@ Audio::State BasicAudio::Update()
 	Expects(this->src != nullptr);
 
 	const auto more_available = this->DecodeIfFrameEmpty();
-	if (!more_available) this->sink->SourceOut();
+	if (!more_available) {
+		this->sink->SourceOut();
+		this->source_out = true;
+	}
 
 	if (!this->FrameFinished()) this->TransferFrame();
 
@@ -156,7 +280,9 @@ void BasicAudio::TransferFrame()
 	Expects(this->sink != nullptr);
 	Expects(this->src != nullptr);
 
+	TraceSpan span{TraceEvent::TRANSFER};
 	auto written = this->sink->Transfer(this->frame_span);
+	span.SetArg(written);
 	this->frame_span = this->frame_span.last(this->frame_span.size() - written);
 
 	// We empty the frame once we're done with it.  This
@@ -181,12 +307,46 @@ bool BasicAudio::DecodeIfFrameEmpty()
 	if (!this->FrameFinished()) return true;
 
 	Expects(this->src != nullptr);
+	const auto start = std::chrono::steady_clock::now();
 	auto result = this->src->Decode();
+	const auto took = std::chrono::steady_clock::now() - start;
+	DecodeHistogram().Observe(std::chrono::duration_cast<std::chrono::microseconds>(took).count());
+	Tracer::Global().Record(TraceEvent::DECODE, start, start + took, result.second.size());
 
 	this->frame = result.second;
+	this->gain.Apply(this->frame, this->src->OutputSampleFormat(), this->src->ChannelCount());
+
+	auto more = result.first != Source::DecodeState::END_OF_FILE;
+	if (this->limiter) more = this->Limit(!more);
 	this->frame_span = this->frame;
 
-	return result.first != Source::DecodeState::END_OF_FILE;
+	return more;
+}
+
+bool BasicAudio::Limit(bool end)
+{
+	Expects(this->limiter != nullptr);
+
+	const auto fmt = this->src->OutputSampleFormat();
+	const auto samples = this->frame.size() / sample_format_bps[static_cast<std::size_t>(fmt)];
+
+	// At the end of the file, a latency's worth of silence pushes the
+	// last of the audio out of the limiter.
+	const auto flush = end && !this->drained;
+	const auto tail = flush ? this->limiter->Latency() * this->src->ChannelCount() : 0;
+	if (samples + tail == 0) return !end;
+
+	this->limit_buf.assign(samples + tail, 0.0f);
+	ToFloat(this->frame, fmt, gsl::span<float>(this->limit_buf).first(samples));
+	this->limiter->Process(this->limit_buf);
+
+	this->frame.resize(this->limit_buf.size() * sample_format_bps[static_cast<std::size_t>(fmt)]);
+	FromFloat(this->limit_buf, fmt, this->frame);
+
+	// Flushing is the last thing the limiter does, but it still needs
+	// this update to reach the sink before the sink hears we're out.
+	if (flush) this->drained = true;
+	return !end || flush;
 }
 
 inline bool BasicAudio::FrameFinished() const
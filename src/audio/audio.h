@@ -13,6 +13,7 @@
 #include <chrono>
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -21,6 +22,8 @@
 #include <gsl/gsl>
 
 #include "../response.h"
+#include "dsp.h"
+#include "limiter.h"
 #include "sink.h"
 #include "source.h"
 
@@ -43,6 +46,13 @@ public:
 	/// Enumeration of possible states for Audio.
 	using State = Sink::State;
 
+	/// An Underrun, timed in microseconds rather than samples.
+	struct Dropout {
+		std::chrono::microseconds position;       ///< Where the sink ran dry.
+		std::chrono::microseconds length;         ///< How long it was dry.
+		std::chrono::steady_clock::time_point at; ///< When it ran dry.
+	};
+
 	/// Virtual, empty destructor for Audio.
 	virtual ~Audio() = default;
 
@@ -77,10 +87,62 @@ public:
 	 */
 	virtual void SetPosition(std::chrono::microseconds position) = 0;
 
+	/**
+	 * Sets the gain applied to this Audio's samples as they are decoded.
+	 * As the gain is applied before the sink, changes take effect once
+	 * the sink has played out what it has already been given.
+	 * @param gain The linear gain (1 is unity).
+	 * @param ramp Whether to ramp to the new gain, rather than jumping to
+	 *   it (which is only safe before any audio has played).
+	 * @exception NoAudioError if the current state is NONE.
+	 * @see GainRamp
+	 */
+	virtual void SetGain(float gain, bool ramp) = 0;
+
+	/**
+	 * Cues another Audio to start when this one reaches a given position,
+	 * and crossfades between the two.
+	 * @param next The Audio to start, or nullptr to cancel any cue not yet
+	 *   reached.
+	 * @param at The position at which @a next starts.
+	 * @param length The length of the crossfade.
+	 * @param curve The shape of both fades.
+	 * @return Whether the crossfade was cued (or cancelled); false if the
+	 *   two can't be crossfaded (eg, they play out on separate devices).
+	 * @see Sink::CueCrossfade
+	 */
+	virtual bool CueCrossfade(Audio *next, std::chrono::microseconds at, std::chrono::microseconds length,
+	                          FadeCurve curve) = 0;
+
+	/**
+	 * Takes the levels of the audio played out since the last call.
+	 * @return The levels, or nothing if none are ready (or the sink
+	 *   doesn't meter).
+	 * @see Sink::TakeLevels
+	 */
+	virtual std::optional<Levels> TakeLevels() = 0;
+
+	/**
+	 * Takes the oldest underrun of this Audio's sink not yet taken.
+	 * @return The underrun, or nothing if there are none (or the sink
+	 *   doesn't detect them).
+	 * @see Sink::TakeUnderrun
+	 */
+	virtual std::optional<Dropout> TakeUnderrun() = 0;
+
 	//
 	// Property access
 	//
 
+	/**
+	 * How long this Audio could play on, were it not updated.
+	 * @return The audio buffered in the sink, or nothing if this Audio
+	 *   isn't playing (or its sink doesn't know), or has nothing left to
+	 *   decode and so can play to the end without updates.
+	 * @see Sink::Buffered
+	 */
+	virtual std::optional<std::chrono::microseconds> Headroom() const = 0;
+
 	/**
 	 * This Audio's current file.
 	 * @return The filename of this current file.
@@ -114,6 +176,14 @@ public:
 	 * @see Seek
 	 */
 	virtual std::chrono::microseconds Length() const = 0;
+
+	/**
+	 * Whether this Audio is a live stream, which has no length and can't
+	 * be seeked.
+	 * @return True if this Audio is live; false otherwise.
+	 * @see Source::IsLive
+	 */
+	virtual bool IsLive() const = 0;
 };
 
 /**
@@ -132,17 +202,32 @@ public:
 
 	Audio::State CurrentState() const override;
 
+	bool IsLive() const override;
+
 	// The following all raise an exception:
 
 	void SetPlaying(bool playing) override;
 
 	void SetPosition(std::chrono::microseconds position) override;
 
+	void SetGain(float gain, bool ramp) override;
+
 	std::chrono::microseconds Position() const override;
 
 	std::chrono::microseconds Length() const override;
 
 	std::string_view File() const override;
+
+	// These do nothing, and return false (or nothing):
+
+	bool CueCrossfade(Audio *next, std::chrono::microseconds at, std::chrono::microseconds length,
+	                  FadeCurve curve) override;
+
+	std::optional<Levels> TakeLevels() override;
+
+	std::optional<Dropout> TakeUnderrun() override;
+
+	std::optional<std::chrono::microseconds> Headroom() const override;
 };
 
 /**
@@ -163,9 +248,13 @@ public:
 	 * Constructs audio from a source and a sink.
 	 * @param src The source of decoded audio frames.
 	 * @param sink The target of decoded audio frames.
+	 * @param ceiling If given, the true peak, as a linear amplitude, past
+	 *   which a Limiter holds the audio after gain.  The limiter delays
+	 *   the audio by its latency, which positions don't account for.
 	 * @see AudioSystem::Load
 	 */
-	BasicAudio(std::unique_ptr<Source> src, std::unique_ptr<Sink> sink);
+	BasicAudio(std::unique_ptr<Source> src, std::unique_ptr<Sink> sink,
+	           std::optional<float> ceiling = std::nullopt);
 
 	Audio::State Update() override;
 
@@ -177,10 +266,23 @@ public:
 
 	void SetPosition(std::chrono::microseconds position) override;
 
+	void SetGain(float gain, bool ramp) override;
+
+	bool CueCrossfade(Audio *next, std::chrono::microseconds at, std::chrono::microseconds length,
+	                  FadeCurve curve) override;
+
+	std::optional<Levels> TakeLevels() override;
+
+	std::optional<Dropout> TakeUnderrun() override;
+
 	std::chrono::microseconds Position() const override;
 
 	std::chrono::microseconds Length() const override;
 
+	bool IsLive() const override;
+
+	std::optional<std::chrono::microseconds> Headroom() const override;
+
 private:
 	/// The source of audio data.
 	std::unique_ptr<Source> src;
@@ -194,6 +296,21 @@ private:
 	/// A span representing the unclaimed part of the decoded frame.
 	gsl::span<const std::byte> frame_span;
 
+	/// The gain applied to each frame as it is decoded.
+	GainRamp gain;
+
+	/// The limiter applied to each frame after gain, if any.
+	std::unique_ptr<Limiter> limiter;
+
+	/// Scratch space for limiting frames as floats.
+	std::vector<float> limit_buf;
+
+	/// Whether the limiter's delay line has been flushed at end of file.
+	bool drained;
+
+	/// Whether the source has run out, until the next seek.
+	bool source_out;
+
 	/// Clears the current frame and its iterator.
 	void ClearFrame();
 
@@ -204,6 +321,15 @@ private:
 	 */
 	bool DecodeIfFrameEmpty();
 
+	/**
+	 * Runs the current frame through the limiter.
+	 * @param end Whether the source has run out; if so, and the limiter
+	 *   hasn't already been drained, its delay line is flushed onto the
+	 *   end of the frame.
+	 * @return Whether there is still audio to come out of the limiter.
+	 */
+	bool Limit(bool end);
+
 	/**
 	 * Returns whether the current frame has been finished.
 	 * If this is true, then either the frame is empty, or all of the
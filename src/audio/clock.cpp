@@ -0,0 +1,62 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the SampleClock class.
+ * @see audio/clock.h
+ */
+
+#include "clock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace Playd::Audio
+{
+SampleClock::SampleClock(std::uint32_t rate) : rate{rate}, sequence{0}, position{0}, frames{0}, at{0}
+{
+}
+
+void SampleClock::Publish(Samples new_position, Samples new_frames, Clock::time_point new_at)
+{
+	// There is only one writer, so nothing else moves the sequence.
+	const auto seq = this->sequence.load(std::memory_order_relaxed);
+	this->sequence.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	this->position.store(new_position, std::memory_order_relaxed);
+	this->frames.store(new_frames, std::memory_order_relaxed);
+	this->at.store(new_at.time_since_epoch().count(), std::memory_order_relaxed);
+
+	this->sequence.store(seq + 2, std::memory_order_release);
+}
+
+SampleClock::Reading SampleClock::Read() const
+{
+	while (true) {
+		const auto before = this->sequence.load(std::memory_order_acquire);
+		if (before % 2 != 0) continue;
+
+		Reading reading{this->position.load(std::memory_order_relaxed),
+		                this->frames.load(std::memory_order_relaxed),
+		                Clock::time_point{Clock::duration{this->at.load(std::memory_order_relaxed)}}};
+
+		// If the sequence hasn't moved, nothing was published under us.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (this->sequence.load(std::memory_order_relaxed) == before) return reading;
+	}
+}
+
+Samples SampleClock::Estimate(Clock::time_point now, Samples latency) const
+{
+	const auto reading = this->Read();
+
+	const auto elapsed = std::chrono::duration<double>(std::max(now - reading.at, Clock::duration::zero()));
+	const auto played = std::min(static_cast<Samples>(elapsed.count() * this->rate), reading.frames);
+	const auto handed = reading.position + played;
+	return handed < latency ? 0 : handed - latency;
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,105 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the SampleClock class.
+ * @see audio/clock.cpp
+ */
+
+#ifndef PLAYD_AUDIO_CLOCK_H
+#define PLAYD_AUDIO_CLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/**
+ * A clock of how far through its audio a device has played, precise to
+ * the sample however large the device's blocks are.
+ *
+ * The audio callback Publishes, with each block it hands over, where the
+ * block starts, how long it is, and when it was handed over.  Any other
+ * thread can then Estimate the sample being heard at any moment, by
+ * interpolating from the latest block, less the device's own latency.
+ *
+ * Publishing and reading go through a sequence lock, so the callback never
+ * waits, and a reader retries only if it catches the callback mid-publish.
+ * Only one thread may Publish.
+ */
+class SampleClock
+{
+public:
+	/// The clock's timebase.
+	using Clock = std::chrono::steady_clock;
+
+	/// What the callback last published.
+	struct Reading {
+		Samples position;     ///< The position at the start of the block.
+		Samples frames;       ///< The number of frames in the block.
+		Clock::time_point at; ///< When the block was handed to the device.
+	};
+
+	/**
+	 * Constructs a SampleClock at position 0, with nothing yet published.
+	 * @param rate The sample rate of the audio, in Hz.
+	 */
+	explicit SampleClock(std::uint32_t rate);
+
+	/// Deleted copy constructor.
+	SampleClock(const SampleClock &) = delete;
+
+	/// Deleted copy-assignment.
+	SampleClock &operator=(const SampleClock &) = delete;
+
+	/**
+	 * Publishes a block handed to the device.  Call from one thread only
+	 * (the audio callback).
+	 * @param position The position of the block's first frame.
+	 * @param frames The number of frames in the block; 0 if the device
+	 *   got silence.
+	 * @param at When the block was handed over.
+	 */
+	void Publish(Samples position, Samples frames, Clock::time_point at);
+
+	/**
+	 * Reads what was last published, consistently.
+	 * @return The reading; before anything is published, a block of
+	 *   nothing at position 0, at the start of the clock's epoch.
+	 */
+	Reading Read() const;
+
+	/**
+	 * Estimates the position being heard at a given moment.  Playback is
+	 * assumed to move at the sample rate from the start of the last block,
+	 * but never past its end; the device's latency is then taken off.
+	 * @param now The moment, no earlier than the last publication.
+	 * @param latency The frames the device holds before they're heard.
+	 * @return The estimated position, in samples.
+	 */
+	Samples Estimate(Clock::time_point now, Samples latency) const;
+
+private:
+	/// The sample rate of the audio, in Hz.
+	std::uint32_t rate;
+
+	/// Bumped before and after each publication: odd means mid-publish.
+	std::atomic<std::uint64_t> sequence;
+
+	/// Reading::position of the last publication.
+	std::atomic<Samples> position;
+
+	/// Reading::frames of the last publication.
+	std::atomic<Samples> frames;
+
+	/// Reading::at of the last publication, in clock ticks since the epoch.
+	std::atomic<Clock::rep> at;
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_CLOCK_H
@@ -0,0 +1,306 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Device class and its implementations.
+ * @see audio/device.h
+ */
+
+#include "device.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../errors.h"
+#include "../trace.h"
+#include "SDL.h"
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+//
+// DeviceSpec
+//
+
+std::size_t DeviceSpec::BytesPerFrame() const
+{
+	return sample_format_bps[static_cast<int>(this->format)] * this->channels;
+}
+
+//
+// Device
+//
+
+bool Device::IsRealTime() const
+{
+	return true;
+}
+
+//
+// SDLDevice
+//
+
+/* static */ const std::array<SDL_AudioFormat, SAMPLE_FORMAT_COUNT> SDLDevice::formats{{
+        AUDIO_U8,  // UINT8
+        AUDIO_S8,  // SINT8
+        AUDIO_S16, // SINT16
+        AUDIO_S32, // SINT32
+        AUDIO_F32  // FLOAT32
+}};
+
+/**
+ * The callback used by SDL_Audio.
+ * Trampolines back into vcallback, which must point to a Device::Callback.
+ */
+static void SDLCallback(void *vcallback, unsigned char *data, int len)
+{
+	Expects(vcallback != nullptr);
+	Expects(data != nullptr);
+
+	auto &callback = *static_cast<Device::Callback *>(vcallback);
+	callback(gsl::span<std::byte>(reinterpret_cast<std::byte *>(data), len));
+}
+
+SDLDevice::SDLDevice(int device_id, const DeviceSpec &spec, Callback callback)
+    : callback{std::move(callback)}, device{0}, block{0}
+{
+	auto name = SDL_GetAudioDeviceName(device_id, 0);
+	if (name == nullptr) {
+		throw ConfigError(std::string("invalid device id: ") + std::to_string(device_id));
+	}
+
+	SDL_AudioSpec want;
+	SDL_zero(want);
+	want.freq = spec.rate;
+	want.format = formats[static_cast<int>(spec.format)];
+	want.channels = spec.channels;
+	// If 0, SDL picks a buffer size that suits the device.
+	want.samples = spec.block;
+	want.callback = &SDLCallback;
+	want.userdata = static_cast<void *>(&this->callback);
+
+	SDL_AudioSpec have;
+	SDL_zero(have);
+
+	this->device = SDL_OpenAudioDevice(name, 0, &want, &have, 0);
+	if (this->device == 0) {
+		throw ConfigError(std::string("couldn't open device: ") + SDL_GetError());
+	}
+
+	// SDL plays each block we give it after the one it's playing now.
+	this->block = have.samples;
+}
+
+SDLDevice::~SDLDevice()
+{
+	if (this->device == 0) return;
+
+	// Silence any currently playing audio; closing waits for any running
+	// callback to finish.
+	SDL_PauseAudioDevice(this->device, SDL_TRUE);
+	SDL_CloseAudioDevice(this->device);
+}
+
+/* static */ std::unique_ptr<Device> SDLDevice::Open(int device_id, const DeviceSpec &spec, Callback callback)
+{
+	return std::make_unique<SDLDevice>(device_id, spec, std::move(callback));
+}
+
+void SDLDevice::Pause(bool paused)
+{
+	SDL_PauseAudioDevice(this->device, paused ? 1 : 0);
+}
+
+Samples SDLDevice::Latency() const
+{
+	return this->block;
+}
+
+/* static */ void SDLDevice::InitLibrary()
+{
+	if (SDL_Init(SDL_INIT_AUDIO) != 0) {
+		throw ConfigError(std::string("could not initialise SDL: ") + SDL_GetError());
+	}
+}
+
+/* static */ void SDLDevice::CleanupLibrary()
+{
+	SDL_Quit();
+}
+
+/* static */ std::vector<std::pair<int, std::string>> SDLDevice::GetDevicesInfo()
+{
+	std::vector<std::pair<int, std::string>> list;
+
+	// The 0 in SDL_GetNumAudioDevices tells SDL we want playback devices.
+	const auto is = SDL_GetNumAudioDevices(0);
+	for (auto i = 0; i < is; i++) {
+		auto n = SDL_GetAudioDeviceName(i, 0);
+		if (n != nullptr) list.emplace_back(i, std::string(n));
+	}
+
+	return list;
+}
+
+/* static */ bool SDLDevice::IsOutputDevice(int id)
+{
+	const auto ids = SDL_GetNumAudioDevices(0);
+
+	// See comment in GetDevicesInfo for why this is sufficient.
+	return 0 <= id && id < ids;
+}
+
+//
+// ClockDevice
+//
+
+ClockDevice::ClockDevice(const DeviceSpec &spec, Callback callback, std::shared_ptr<WavWriter> writer)
+    : spec{spec}, callback{std::move(callback)}, writer{std::move(writer)}, paused{true}, quit{false}
+{
+	if (this->spec.block == 0) this->spec.block = DEFAULT_BLOCK;
+	Expects(0 < this->spec.rate);
+
+	this->thread = std::thread{&ClockDevice::Run, this};
+}
+
+ClockDevice::~ClockDevice()
+{
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		this->quit = true;
+	}
+	this->wake.notify_all();
+	this->thread.join();
+}
+
+void ClockDevice::Pause(bool paused)
+{
+	{
+		// Taking the lock waits out any running callback.
+		std::lock_guard<std::mutex> guard{this->lock};
+		this->paused = paused;
+	}
+	this->wake.notify_all();
+}
+
+Samples ClockDevice::Latency() const
+{
+	return this->spec.block;
+}
+
+void ClockDevice::Run()
+{
+	Tracer::Global().NameThread("device");
+
+	std::vector<std::byte> block(this->spec.block * this->spec.BytesPerFrame());
+	const auto rate = this->spec.rate;
+	const auto period = std::chrono::nanoseconds(this->spec.block * UINT64_C(1000000000) / rate);
+
+	std::unique_lock<std::mutex> guard{this->lock};
+	while (!this->quit) {
+		this->wake.wait(guard, [this] { return !this->paused || this->quit; });
+		if (this->quit) break;
+
+		// Blocks are due when the frames before them would have played
+		// since we (re)started, so that rounding doesn't add up to drift.
+		auto epoch = Clock::now();
+		std::uint64_t frames = 0;
+		while (!this->paused && !this->quit) {
+			this->callback(block);
+			if (this->writer) this->writer->Write(block);
+			frames += this->spec.block;
+
+			auto due = epoch + std::chrono::nanoseconds(frames * UINT64_C(1000000000) / rate);
+			if (const auto now = Clock::now(); due + period < now) {
+				// We've fallen behind; drop the missed time.
+				epoch = due = now;
+				frames = 0;
+			}
+
+			this->wake.wait_until(guard, due, [this] { return this->paused || this->quit; });
+		}
+	}
+}
+
+//
+// RenderDevice
+//
+
+RenderDevice::RenderDevice(const DeviceSpec &spec, Callback callback, std::shared_ptr<Renderer> renderer,
+                           std::shared_ptr<WavWriter> writer)
+    : spec{spec},
+      callback{std::move(callback)},
+      renderer{std::move(renderer)},
+      writer{std::move(writer)},
+      paused{true},
+      played{0},
+      frames{0}
+{
+	Expects(this->renderer != nullptr);
+	if (this->spec.block == 0) this->spec.block = ClockDevice::DEFAULT_BLOCK;
+	this->block.resize(this->spec.block * this->spec.BytesPerFrame());
+
+	this->renderer->devices.push_back(this);
+}
+
+RenderDevice::~RenderDevice()
+{
+	auto &devices = this->renderer->devices;
+	devices.erase(std::remove(devices.begin(), devices.end(), this), devices.end());
+}
+
+void RenderDevice::Pause(bool paused)
+{
+	// We only call back from Advance, which can't be running now.
+	this->paused = paused;
+}
+
+Samples RenderDevice::Latency() const
+{
+	// Everything handed over has been played by the time we return.
+	return 0;
+}
+
+bool RenderDevice::IsRealTime() const
+{
+	return false;
+}
+
+void RenderDevice::Advance(std::chrono::nanoseconds time)
+{
+	if (this->paused) return;
+	this->played += time;
+
+	// Split the time up so that days of audio at high rates don't overflow.
+	constexpr std::uint64_t second = 1000000000;
+	const auto ns = static_cast<std::uint64_t>(this->played.count());
+	const auto due = (ns / second) * this->spec.rate + (ns % second) * this->spec.rate / second;
+
+	const auto bpf = this->spec.BytesPerFrame();
+	while (this->frames < due) {
+		const auto count = std::min<Samples>(due - this->frames, this->spec.block);
+		auto dest = gsl::span<std::byte>(this->block).first(count * bpf);
+
+		this->callback(dest);
+		if (this->writer) this->writer->Write(dest);
+		this->frames += count;
+	}
+}
+
+//
+// Renderer
+//
+
+void Renderer::Advance(std::chrono::nanoseconds time)
+{
+	for (auto *device : this->devices) device->Advance(time);
+}
+
+} // namespace Playd::Audio
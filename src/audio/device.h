@@ -0,0 +1,330 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Device class and its implementations.
+ * @see audio/device.cpp
+ */
+
+#ifndef PLAYD_AUDIO_DEVICE_H
+#define PLAYD_AUDIO_DEVICE_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "SDL.h"
+#include "sample_format.h"
+#include "wav.h"
+
+namespace Playd::Audio
+{
+/// The shape of the audio a Device plays.
+struct DeviceSpec {
+	std::uint32_t rate;    ///< The sample rate, in Hz.
+	SampleFormat format;   ///< The format of each sample.
+	std::uint8_t channels; ///< The number of channels.
+	std::uint16_t block;   ///< Frames per callback, or 0 to let the device pick.
+
+	/// @return The number of bytes in one frame.
+	std::size_t BytesPerFrame() const;
+};
+
+/**
+ * An audio output, which pulls blocks of audio from a callback running on a
+ * thread of its own, at the rate it plays them.
+ *
+ * Devices start paused.  Pausing waits for any running callback to finish,
+ * and no callback runs while paused, so whatever the callback reads may be
+ * changed safely then.
+ */
+class Device
+{
+public:
+	/// Type of device callbacks, which fill the span they're given.
+	using Callback = std::function<void(gsl::span<std::byte>)>;
+
+	/// Virtual, empty destructor for Device.
+	virtual ~Device() = default;
+
+	/**
+	 * Pauses or resumes the device.
+	 * @param paused Whether the device should be paused.
+	 */
+	virtual void Pause(bool paused) = 0;
+
+	/**
+	 * Gets how far behind the callback the listener is.
+	 * @return The number of frames the device holds after each callback.
+	 */
+	virtual Samples Latency() const = 0;
+
+	/**
+	 * Does the device play in real time?
+	 * If not, it plays each block the moment it calls back, and the time
+	 * between callbacks says nothing about how much has played.
+	 * @return True by default.
+	 */
+	virtual bool IsRealTime() const;
+};
+
+/**
+ * Type of functions that open Devices.
+ * These take the ID of the device (as given on the command line), the shape
+ * of the audio, and the callback, and throw ConfigError if the device can't
+ * be opened.
+ */
+using DeviceFn = std::function<std::unique_ptr<Device>(int, const DeviceSpec &, Device::Callback)>;
+
+/// A Device that plays through SDL.
+class SDLDevice : public Device
+{
+public:
+	/**
+	 * Opens an SDL device.
+	 * @param device_id The SDL ID of the device.
+	 * @param spec The shape of the audio; SDL converts it to whatever the
+	 *   device really wants behind our backs.
+	 * @param callback The callback.
+	 * @exception ConfigError if the device can't be opened.
+	 */
+	SDLDevice(int device_id, const DeviceSpec &spec, Callback callback);
+
+	/// Destructs an SDLDevice, closing the device.
+	~SDLDevice() override;
+
+	/// Deleted copy constructor.
+	SDLDevice(const SDLDevice &) = delete;
+
+	/// Deleted copy-assignment.
+	SDLDevice &operator=(const SDLDevice &) = delete;
+
+	/**
+	 * Opens an SDL device; a DeviceFn.
+	 * @param device_id The SDL ID of the device.
+	 * @param spec The shape of the audio.
+	 * @param callback The callback.
+	 * @return The device.
+	 * @exception ConfigError if the device can't be opened.
+	 */
+	static std::unique_ptr<Device> Open(int device_id, const DeviceSpec &spec, Callback callback);
+
+	void Pause(bool paused) override;
+
+	Samples Latency() const override;
+
+	/**
+	 * Gets the number and name of each output device SDL knows of.
+	 * @return List of output devices, as strings.
+	 */
+	static std::vector<std::pair<int, std::string>> GetDevicesInfo();
+
+	/**
+	 * Can a sound device output sound?
+	 * @param id Device ID.
+	 * @return If the device can handle outputting sound.
+	 */
+	static bool IsOutputDevice(int id);
+
+	/**
+	 * Initialises SDL's audio, if not initialised already.
+	 * @exception ConfigError if SDL has no audio to offer.
+	 */
+	static void InitLibrary();
+
+	/// Cleans up SDL, if not cleaned up already.
+	static void CleanupLibrary();
+
+private:
+	/// Mapping from SampleFormats to their equivalent SDL_AudioFormats.
+	static const std::array<SDL_AudioFormat, SAMPLE_FORMAT_COUNT> formats;
+
+	/// The callback; SDL calls it through a pointer to this.
+	Callback callback;
+
+	/// The SDL device.
+	SDL_AudioDeviceID device;
+
+	/// The number of frames in each block SDL asks for.
+	Samples block;
+};
+
+/**
+ * A Device with no hardware behind it.
+ *
+ * A thread calls back once per block, paced by the monotonic clock so that
+ * blocks go at the sample rate, just as a device would take them; each
+ * block can then be written to a WavWriter.  This lets playd run, and be
+ * timed, where there's no audio device at all.
+ *
+ * If the thread falls more than a block behind (say, the machine stalls),
+ * it starts counting again from now, as a device would drop the missed
+ * time rather than play it faster.
+ */
+class ClockDevice : public Device
+{
+public:
+	/// The number of frames per block if the spec doesn't say.
+	static constexpr std::uint16_t DEFAULT_BLOCK = 1024;
+
+	/**
+	 * Constructs a ClockDevice, and starts its thread.
+	 * @param spec The shape of the audio.
+	 * @param callback The callback.
+	 * @param writer If given, the writer each block played goes to.
+	 */
+	ClockDevice(const DeviceSpec &spec, Callback callback, std::shared_ptr<WavWriter> writer = nullptr);
+
+	/// Destructs a ClockDevice, stopping its thread.
+	~ClockDevice() override;
+
+	/// Deleted copy constructor.
+	ClockDevice(const ClockDevice &) = delete;
+
+	/// Deleted copy-assignment.
+	ClockDevice &operator=(const ClockDevice &) = delete;
+
+	void Pause(bool paused) override;
+
+	Samples Latency() const override;
+
+private:
+	/// The clock pacing the blocks.
+	using Clock = std::chrono::steady_clock;
+
+	/// The shape of the audio, with the block size filled in.
+	DeviceSpec spec;
+
+	/// The callback.
+	Callback callback;
+
+	/// The writer, if any.
+	std::shared_ptr<WavWriter> writer;
+
+	/// Lock over the flags below, held by the thread while it calls back.
+	std::mutex lock;
+
+	/// Wakes the thread to pause, resume or quit.
+	std::condition_variable wake;
+
+	/// Whether the device is paused.
+	bool paused;
+
+	/// Whether the thread should quit.
+	bool quit;
+
+	/// The thread; started last, as it uses everything above.
+	std::thread thread;
+
+	/// The body of the thread.
+	void Run();
+};
+
+class Renderer;
+
+/**
+ * A Device that plays whenever its Renderer says time has passed, rather
+ * than in real time, for rendering offline.
+ *
+ * While unpaused, it calls back for as many frames as would have played in
+ * the time that passed, on the thread that told it so, and writes them to
+ * a WavWriter.  How fast that goes is up to how fast the callback can keep
+ * up.
+ */
+class RenderDevice : public Device
+{
+public:
+	/**
+	 * Constructs a RenderDevice, paused.
+	 * @param spec The shape of the audio.
+	 * @param callback The callback.
+	 * @param renderer The renderer whose time the device plays by.
+	 * @param writer If given, the writer each block played goes to.
+	 */
+	RenderDevice(const DeviceSpec &spec, Callback callback, std::shared_ptr<Renderer> renderer,
+	             std::shared_ptr<WavWriter> writer = nullptr);
+
+	/// Destructs a RenderDevice, taking it off its renderer.
+	~RenderDevice() override;
+
+	/// Deleted copy constructor.
+	RenderDevice(const RenderDevice &) = delete;
+
+	/// Deleted copy-assignment.
+	RenderDevice &operator=(const RenderDevice &) = delete;
+
+	void Pause(bool paused) override;
+
+	Samples Latency() const override;
+
+	bool IsRealTime() const override;
+
+	/**
+	 * Plays the frames due, if unpaused, after some time has passed.
+	 * @param time The time that has passed.
+	 */
+	void Advance(std::chrono::nanoseconds time);
+
+private:
+	/// The shape of the audio, with the block size filled in.
+	DeviceSpec spec;
+
+	/// The callback.
+	Callback callback;
+
+	/// The renderer whose time the device plays by.
+	std::shared_ptr<Renderer> renderer;
+
+	/// The writer, if any.
+	std::shared_ptr<WavWriter> writer;
+
+	/// Whether the device is paused.
+	bool paused;
+
+	/// The time for which the device has been unpaused.
+	std::chrono::nanoseconds played;
+
+	/// The frames played in that time.
+	Samples frames;
+
+	/// The buffer the callback fills.
+	std::vector<std::byte> block;
+};
+
+/**
+ * The clock RenderDevices play by, in which time only passes when Advance
+ * says so.
+ * Use from one thread only (the main loop, which also opens and closes the
+ * devices).
+ */
+class Renderer
+{
+public:
+	/**
+	 * Makes time pass for every RenderDevice, which play whatever is due.
+	 * @param time The time that has passed.
+	 */
+	void Advance(std::chrono::nanoseconds time);
+
+private:
+	friend class RenderDevice;
+
+	/// The devices playing by this renderer.
+	std::vector<RenderDevice *> devices;
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_DEVICE_H
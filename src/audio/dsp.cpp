@@ -0,0 +1,807 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of playd's sample-processing kernels.
+ *
+ * Each kernel has a scalar version, which is what's compiled everywhere, and
+ * (where it pays) an SSE2 version that handles all but the last few samples.
+ *
+ * @see audio/dsp.h
+ */
+
+#include "dsp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#ifdef PLAYD_DSP_SSE2
+#include <emmintrin.h>
+#endif // PLAYD_DSP_SSE2
+
+namespace Playd::Audio
+{
+/**
+ * Converts packed integer samples into floats.
+ * @tparam T The integer sample type.
+ * @param src The samples.
+ * @param dest The span to fill with floats.
+ * @param offset The value to subtract from each sample to centre it on 0.
+ * @param scale The value by which to multiply each centred sample.
+ */
+template <typename T>
+static void IntToFloat(gsl::span<const std::byte> src, gsl::span<float> dest, float offset, float scale)
+{
+	// Sample bytes from decoders needn't be aligned for T, so copy them out.
+	const auto *in = src.data();
+	for (auto &out : dest) {
+		T x;
+		std::memcpy(&x, in, sizeof(T));
+		in += sizeof(T);
+		out = (static_cast<float>(x) - offset) * scale;
+	}
+}
+
+void ToFloat(gsl::span<const std::byte> src, SampleFormat fmt, gsl::span<float> dest)
+{
+	Expects(static_cast<std::size_t>(src.size()) ==
+	        dest.size() * sample_format_bps[static_cast<std::size_t>(fmt)]);
+
+	switch (fmt) {
+		case SampleFormat::UINT8:
+			IntToFloat<std::uint8_t>(src, dest, 128.0f, 1.0f / 128.0f);
+			break;
+		case SampleFormat::SINT8:
+			IntToFloat<std::int8_t>(src, dest, 0.0f, 1.0f / 128.0f);
+			break;
+		case SampleFormat::SINT16:
+			IntToFloat<std::int16_t>(src, dest, 0.0f, 1.0f / 32768.0f);
+			break;
+		case SampleFormat::SINT32:
+			IntToFloat<std::int32_t>(src, dest, 0.0f, 1.0f / 2147483648.0f);
+			break;
+		case SampleFormat::FLOAT32:
+			std::memcpy(dest.data(), src.data(), src.size());
+			break;
+	}
+}
+
+void MixInto(gsl::span<float> dest, gsl::span<const float> src, float gain)
+{
+	Expects(dest.size() == src.size());
+
+	const auto n = static_cast<std::size_t>(dest.size());
+	auto *out = dest.data();
+	const auto *in = src.data();
+	std::size_t i = 0;
+
+#ifdef PLAYD_DSP_SSE2
+	const auto g = _mm_set1_ps(gain);
+	for (; i + 4 <= n; i += 4) {
+		const auto x = _mm_mul_ps(_mm_loadu_ps(in + i), g);
+		_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), x));
+	}
+#endif // PLAYD_DSP_SSE2
+
+	for (; i < n; i++) out[i] += in[i] * gain;
+}
+
+/**
+ * Evaluates a fade curve.
+ * @param curve The curve.
+ * @param t Where on the curve to look, clamped into [0, 1].
+ * @return The gain at @a t.
+ */
+static float FadeShape(FadeCurve curve, float t)
+{
+	// The SSE2 version must agree with this exactly, operation for operation.
+	const auto c = t < 1.0f ? t : 1.0f;
+	const auto x = c > 0.0f ? c : 0.0f;
+	if (curve == FadeCurve::LINEAR) return x;
+
+	// sin(x * pi/2), from its Taylor series; good to about 4e-6 over [0, 1].
+	const auto y = x * 1.57079633f;
+	const auto y2 = y * y;
+	return y * (1.0f + y2 * (-1.0f / 6.0f + y2 * (1.0f / 120.0f + y2 * (-1.0f / 5040.0f + y2 * (1.0f / 362880.0f)))));
+}
+
+#ifdef PLAYD_DSP_SSE2
+/**
+ * Evaluates a fade curve at four points at once.
+ * @param curve The curve.
+ * @param t Where on the curve to look, clamped into [0, 1].
+ * @return The gains at @a t.
+ * @see FadeShape
+ */
+static __m128 FadeShape4(FadeCurve curve, __m128 t)
+{
+	const auto x = _mm_max_ps(_mm_min_ps(t, _mm_set1_ps(1.0f)), _mm_setzero_ps());
+	if (curve == FadeCurve::LINEAR) return x;
+
+	const auto y = _mm_mul_ps(x, _mm_set1_ps(1.57079633f));
+	const auto y2 = _mm_mul_ps(y, y);
+	auto p = _mm_mul_ps(y2, _mm_set1_ps(1.0f / 362880.0f));
+	p = _mm_mul_ps(y2, _mm_add_ps(_mm_set1_ps(-1.0f / 5040.0f), p));
+	p = _mm_mul_ps(y2, _mm_add_ps(_mm_set1_ps(1.0f / 120.0f), p));
+	p = _mm_mul_ps(y2, _mm_add_ps(_mm_set1_ps(-1.0f / 6.0f), p));
+	return _mm_mul_ps(y, _mm_add_ps(_mm_set1_ps(1.0f), p));
+}
+#endif // PLAYD_DSP_SSE2
+
+void MixFade(gsl::span<float> dest, gsl::span<const float> src, std::uint8_t channels, float gain,
+             FadeCurve curve, float t, float dt)
+{
+	Expects(dest.size() == src.size());
+	Expects(0 < channels);
+	Expects(dest.size() % channels == 0);
+
+	const auto frames = static_cast<std::size_t>(dest.size()) / channels;
+	auto *out = dest.data();
+	const auto *in = src.data();
+	std::size_t f = 0;
+
+#ifdef PLAYD_DSP_SSE2
+	// Stereo is all the mixer uses, and two stereo frames fill a vector.
+	// Each frame's t is worked out afresh rather than accumulated, so long
+	// fades don't drift.
+	if (channels == 2) {
+		const auto g = _mm_set1_ps(gain);
+		for (; f + 2 <= frames; f += 2) {
+			const auto t0 = t + static_cast<float>(f) * dt;
+			const auto t1 = t + static_cast<float>(f + 1) * dt;
+			const auto env = _mm_mul_ps(FadeShape4(curve, _mm_set_ps(t1, t1, t0, t0)), g);
+			const auto x = _mm_mul_ps(_mm_loadu_ps(in + 2 * f), env);
+			_mm_storeu_ps(out + 2 * f, _mm_add_ps(_mm_loadu_ps(out + 2 * f), x));
+		}
+	}
+#endif // PLAYD_DSP_SSE2
+
+	for (; f < frames; f++) {
+		const auto env = FadeShape(curve, t + static_cast<float>(f) * dt) * gain;
+		for (std::size_t c = 0; c < channels; c++) {
+			out[f * channels + c] += in[f * channels + c] * env;
+		}
+	}
+}
+
+/**
+ * Traits of each sample format, for ScaleSamples and MeasureLevels.
+ * @tparam F The sample format.
+ */
+template <SampleFormat F>
+struct ScaleTraits;
+
+template <>
+struct ScaleTraits<SampleFormat::UINT8> {
+	using Type = std::uint8_t;              ///< The type of one sample.
+	static constexpr float OFFSET = 128.0f; ///< The value of silence.
+	static constexpr float LOW = -128.0f;   ///< The lowest centred value.
+	static constexpr float HIGH = 127.0f;   ///< The highest centred value.
+	static constexpr float FULL = 128.0f;   ///< The size of full scale.
+};
+
+template <>
+struct ScaleTraits<SampleFormat::SINT8> {
+	using Type = std::int8_t;             ///< The type of one sample.
+	static constexpr float OFFSET = 0.0f; ///< The value of silence.
+	static constexpr float LOW = -128.0f; ///< The lowest centred value.
+	static constexpr float HIGH = 127.0f; ///< The highest centred value.
+	static constexpr float FULL = 128.0f; ///< The size of full scale.
+};
+
+template <>
+struct ScaleTraits<SampleFormat::SINT16> {
+	using Type = std::int16_t;              ///< The type of one sample.
+	static constexpr float OFFSET = 0.0f;   ///< The value of silence.
+	static constexpr float LOW = -32768.0f; ///< The lowest centred value.
+	static constexpr float HIGH = 32767.0f; ///< The highest centred value.
+	static constexpr float FULL = 32768.0f; ///< The size of full scale.
+};
+
+template <>
+struct ScaleTraits<SampleFormat::SINT32> {
+	using Type = std::int32_t;                   ///< The type of one sample.
+	static constexpr float OFFSET = 0.0f;        ///< The value of silence.
+	static constexpr float LOW = -2147483648.0f; ///< The lowest centred value.
+	/// The highest centred value; 2^31 - 1 isn't a float, so the one below.
+	static constexpr float HIGH = 2147483520.0f;
+	static constexpr float FULL = 2147483648.0f; ///< The size of full scale.
+};
+
+template <>
+struct ScaleTraits<SampleFormat::FLOAT32> {
+	using Type = float;                   ///< The type of one sample.
+	static constexpr float OFFSET = 0.0f; ///< The value of silence.
+	static constexpr float FULL = 1.0f;   ///< The size of full scale.
+};
+
+/**
+ * Scales the frames of a buffer from a given frame onwards, one at a time.
+ * @tparam F The sample format.
+ * @param buf The samples.
+ * @param from The first frame to scale.
+ * @param channels The number of channels in each frame.
+ * @param gain The gain for frame 0.
+ * @param step How much the gain changes each frame.
+ */
+template <SampleFormat F>
+static void ScaleFrames(gsl::span<std::byte> buf, std::size_t from, std::uint8_t channels, float gain, float step)
+{
+	using Traits = ScaleTraits<F>;
+	using T = typename Traits::Type;
+
+	const auto frames = static_cast<std::size_t>(buf.size()) / (sizeof(T) * channels);
+	auto *p = buf.data() + from * channels * sizeof(T);
+	for (auto f = from; f < frames; f++) {
+		const auto g = gain + static_cast<float>(f) * step;
+		for (std::size_t c = 0; c < channels; c++, p += sizeof(T)) {
+			// As in IntToFloat, samples needn't be aligned.
+			T x;
+			std::memcpy(&x, p, sizeof(T));
+			if constexpr (F == SampleFormat::FLOAT32) {
+				x *= g;
+			} else {
+				// The SSE2 versions must agree with this exactly.
+				const auto y = (static_cast<float>(x) - Traits::OFFSET) * g;
+				const auto lo = y < Traits::LOW ? Traits::LOW : y;
+				const auto hi = lo > Traits::HIGH ? Traits::HIGH : lo;
+				x = static_cast<T>(std::nearbyint(hi) + Traits::OFFSET);
+			}
+			std::memcpy(p, &x, sizeof(T));
+		}
+	}
+}
+
+/**
+ * Scales as many of the frames of a buffer as possible with SSE2.
+ * The default, for formats without an SSE2 version, scales none.
+ * @tparam F The sample format.
+ * @param buf The samples.
+ * @param channels The number of channels in each frame.
+ * @param gain The gain for frame 0.
+ * @param step How much the gain changes each frame.
+ * @return The number of frames scaled, from the start of @a buf.
+ */
+template <SampleFormat F>
+static std::size_t ScaleVectors(gsl::span<std::byte>, std::uint8_t, float, float)
+{
+	return 0;
+}
+
+#ifdef PLAYD_DSP_SSE2
+/**
+ * Works out the gains for four consecutive samples.
+ * @param sample The index of the first sample, which must be a multiple of 4.
+ * @param channels The number of channels in each frame (1 or 2).
+ * @param gain The gain for frame 0.
+ * @param step How much the gain changes each frame.
+ * @return The gains.
+ */
+static __m128 Gains4(std::size_t sample, std::uint8_t channels, float gain, float step)
+{
+	// This is the same sum as in ScaleFrames, so the two agree exactly.
+	const auto f = static_cast<float>(sample / channels);
+	const auto frames =
+	        channels == 1 ? _mm_set_ps(f + 3.0f, f + 2.0f, f + 1.0f, f) : _mm_set_ps(f + 1.0f, f + 1.0f, f, f);
+	return _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(frames, _mm_set1_ps(step)));
+}
+
+/**
+ * Scales, rounds and clamps four integer samples held as floats.
+ * @tparam F The sample format.
+ * @param x The samples.
+ * @param g The gains.
+ * @return The scaled samples, converted to 32-bit integers.
+ */
+template <SampleFormat F>
+static __m128i ScaleInts4(__m128 x, __m128 g)
+{
+	const auto y = _mm_mul_ps(x, g);
+	const auto lo = _mm_max_ps(y, _mm_set1_ps(ScaleTraits<F>::LOW));
+	return _mm_cvtps_epi32(_mm_min_ps(lo, _mm_set1_ps(ScaleTraits<F>::HIGH)));
+}
+
+template <>
+std::size_t ScaleVectors<SampleFormat::FLOAT32>(gsl::span<std::byte> buf, std::uint8_t channels, float gain,
+                                                float step)
+{
+	if (2 < channels) return 0;
+
+	auto *p = reinterpret_cast<float *>(buf.data());
+	const auto n = static_cast<std::size_t>(buf.size()) / sizeof(float);
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(p + i, _mm_mul_ps(_mm_loadu_ps(p + i), Gains4(i, channels, gain, step)));
+	}
+	return i / channels;
+}
+
+template <>
+std::size_t ScaleVectors<SampleFormat::SINT32>(gsl::span<std::byte> buf, std::uint8_t channels, float gain,
+                                               float step)
+{
+	if (2 < channels) return 0;
+
+	auto *p = reinterpret_cast<__m128i *>(buf.data());
+	const auto n = static_cast<std::size_t>(buf.size()) / sizeof(std::int32_t);
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4, p++) {
+		const auto x = _mm_cvtepi32_ps(_mm_loadu_si128(p));
+		_mm_storeu_si128(p, ScaleInts4<SampleFormat::SINT32>(x, Gains4(i, channels, gain, step)));
+	}
+	return i / channels;
+}
+
+template <>
+std::size_t ScaleVectors<SampleFormat::SINT16>(gsl::span<std::byte> buf, std::uint8_t channels, float gain,
+                                               float step)
+{
+	if (2 < channels) return 0;
+
+	auto *p = reinterpret_cast<__m128i *>(buf.data());
+	const auto n = static_cast<std::size_t>(buf.size()) / sizeof(std::int16_t);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8, p++) {
+		// Sign-extend each half of the eight samples into 32 bits by
+		// putting them in the top of each lane and shifting back down.
+		const auto v = _mm_loadu_si128(p);
+		const auto lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		const auto hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+		const auto slo = ScaleInts4<SampleFormat::SINT16>(_mm_cvtepi32_ps(lo), Gains4(i, channels, gain, step));
+		const auto shi =
+		        ScaleInts4<SampleFormat::SINT16>(_mm_cvtepi32_ps(hi), Gains4(i + 4, channels, gain, step));
+
+		// The values are already clamped, so this saturation never bites.
+		_mm_storeu_si128(p, _mm_packs_epi32(slo, shi));
+	}
+	return i / channels;
+}
+#endif // PLAYD_DSP_SSE2
+
+/**
+ * Scales all of the frames of a buffer.
+ * @tparam F The sample format.
+ * @param buf The samples.
+ * @param channels The number of channels in each frame.
+ * @param gain The gain for frame 0.
+ * @param step How much the gain changes each frame.
+ */
+template <SampleFormat F>
+static void Scale(gsl::span<std::byte> buf, std::uint8_t channels, float gain, float step)
+{
+	const auto done = ScaleVectors<F>(buf, channels, gain, step);
+	ScaleFrames<F>(buf, done, channels, gain, step);
+}
+
+void ScaleSamples(gsl::span<std::byte> buf, SampleFormat fmt, std::uint8_t channels, float gain, float step)
+{
+	Expects(0 < channels);
+	Expects(buf.size() % (sample_format_bps[static_cast<std::size_t>(fmt)] * channels) == 0);
+
+	switch (fmt) {
+		case SampleFormat::UINT8:
+			Scale<SampleFormat::UINT8>(buf, channels, gain, step);
+			break;
+		case SampleFormat::SINT8:
+			Scale<SampleFormat::SINT8>(buf, channels, gain, step);
+			break;
+		case SampleFormat::SINT16:
+			Scale<SampleFormat::SINT16>(buf, channels, gain, step);
+			break;
+		case SampleFormat::SINT32:
+			Scale<SampleFormat::SINT32>(buf, channels, gain, step);
+			break;
+		case SampleFormat::FLOAT32:
+			Scale<SampleFormat::FLOAT32>(buf, channels, gain, step);
+			break;
+	}
+}
+
+/**
+ * Converts floats into packed samples.
+ * @tparam F The sample format.
+ * @param src The floats.
+ * @param dest The span to fill with samples.
+ */
+template <SampleFormat F>
+static void FloatToSamples(gsl::span<const float> src, gsl::span<std::byte> dest)
+{
+	using Traits = ScaleTraits<F>;
+	using T = typename Traits::Type;
+
+	auto *out = dest.data();
+	for (const auto x : src) {
+		// NaN fails every comparison, so check for it first.
+		const auto y = x == x ? x * Traits::FULL : 0.0f;
+		const auto lo = y < Traits::LOW ? Traits::LOW : y;
+		const auto hi = lo > Traits::HIGH ? Traits::HIGH : lo;
+		const auto s = static_cast<T>(std::nearbyint(hi) + Traits::OFFSET);
+		std::memcpy(out, &s, sizeof(T));
+		out += sizeof(T);
+	}
+}
+
+void FromFloat(gsl::span<const float> src, SampleFormat fmt, gsl::span<std::byte> dest)
+{
+	Expects(static_cast<std::size_t>(dest.size()) ==
+	        src.size() * sample_format_bps[static_cast<std::size_t>(fmt)]);
+
+	switch (fmt) {
+		case SampleFormat::UINT8:
+			FloatToSamples<SampleFormat::UINT8>(src, dest);
+			break;
+		case SampleFormat::SINT8:
+			FloatToSamples<SampleFormat::SINT8>(src, dest);
+			break;
+		case SampleFormat::SINT16:
+			FloatToSamples<SampleFormat::SINT16>(src, dest);
+			break;
+		case SampleFormat::SINT32:
+			FloatToSamples<SampleFormat::SINT32>(src, dest);
+			break;
+		case SampleFormat::FLOAT32: {
+			auto *out = dest.data();
+			for (const auto x : src) {
+				const auto y = x == x ? x : 0.0f;
+				std::memcpy(out, &y, sizeof(float));
+				out += sizeof(float);
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * Measures the levels of a buffer from a given frame onwards, one at a time.
+ * @tparam F The sample format.
+ * @param buf The samples.
+ * @param from The first frame to measure.
+ * @param channels The number of channels in each frame.
+ * @param levels The levels to add to.
+ */
+template <SampleFormat F>
+static void MeasureFrames(gsl::span<const std::byte> buf, std::size_t from, std::uint8_t channels, Levels &levels)
+{
+	using Traits = ScaleTraits<F>;
+	using T = typename Traits::Type;
+
+	const auto measured = std::min<std::size_t>(channels, Levels::MAX_CHANNELS);
+	const auto frames = static_cast<std::size_t>(buf.size()) / (sizeof(T) * channels);
+	const auto *p = buf.data() + from * channels * sizeof(T);
+	for (auto f = from; f < frames; f++, p += channels * sizeof(T)) {
+		for (std::size_t c = 0; c < measured; c++) {
+			T x;
+			std::memcpy(&x, p + c * sizeof(T), sizeof(T));
+			const auto y = (static_cast<float>(x) - Traits::OFFSET) * (1.0f / Traits::FULL);
+			levels.peak[c] = std::max(levels.peak[c], std::abs(y));
+			levels.energy[c] += y * y;
+		}
+	}
+}
+
+/**
+ * Measures as many of the frames of a buffer as possible with SSE2.
+ * The default, for formats without an SSE2 version, measures none.
+ * @tparam F The sample format.
+ * @param buf The samples.
+ * @param channels The number of channels in each frame.
+ * @param levels The levels to add to.
+ * @return The number of frames measured, from the start of @a buf.
+ */
+template <SampleFormat F>
+static std::size_t MeasureVectors(gsl::span<const std::byte>, std::uint8_t, Levels &)
+{
+	return 0;
+}
+
+#ifdef PLAYD_DSP_SSE2
+/**
+ * Accumulates peaks and energies over vectors of four samples.
+ *
+ * Lane i holds channel i % channels; with one or two channels, that's the
+ * same channel in every vector.
+ */
+struct LevelLanes {
+	__m128 peak = _mm_setzero_ps();   ///< Highest |sample| in each lane.
+	__m128 energy = _mm_setzero_ps(); ///< Sum of squares in each lane.
+
+	/**
+	 * Adds four samples.
+	 * @param x The samples, with full scale at 1.
+	 */
+	void Add(__m128 x)
+	{
+		const auto abs = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+		this->peak = _mm_max_ps(this->peak, abs);
+		this->energy = _mm_add_ps(this->energy, _mm_mul_ps(x, x));
+	}
+
+	/**
+	 * Folds the lanes into running levels.
+	 * @param channels The number of channels (1 or 2).
+	 * @param levels The levels to add to.
+	 */
+	void Fold(std::uint8_t channels, Levels &levels) const
+	{
+		alignas(16) float peaks[4], energies[4];
+		_mm_store_ps(peaks, this->peak);
+		_mm_store_ps(energies, this->energy);
+		for (std::size_t i = 0; i < 4; i++) {
+			levels.peak[i % channels] = std::max(levels.peak[i % channels], peaks[i]);
+			levels.energy[i % channels] += energies[i];
+		}
+	}
+};
+
+template <>
+std::size_t MeasureVectors<SampleFormat::FLOAT32>(gsl::span<const std::byte> buf, std::uint8_t channels,
+                                                  Levels &levels)
+{
+	if (2 < channels) return 0;
+
+	const auto *p = reinterpret_cast<const float *>(buf.data());
+	const auto n = static_cast<std::size_t>(buf.size()) / sizeof(float);
+	LevelLanes lanes;
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4) lanes.Add(_mm_loadu_ps(p + i));
+	lanes.Fold(channels, levels);
+	return i / channels;
+}
+
+template <>
+std::size_t MeasureVectors<SampleFormat::SINT32>(gsl::span<const std::byte> buf, std::uint8_t channels,
+                                                 Levels &levels)
+{
+	if (2 < channels) return 0;
+
+	const auto *p = reinterpret_cast<const __m128i *>(buf.data());
+	const auto n = static_cast<std::size_t>(buf.size()) / sizeof(std::int32_t);
+	const auto unit = _mm_set1_ps(1.0f / ScaleTraits<SampleFormat::SINT32>::FULL);
+	LevelLanes lanes;
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4, p++) lanes.Add(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(p)), unit));
+	lanes.Fold(channels, levels);
+	return i / channels;
+}
+
+template <>
+std::size_t MeasureVectors<SampleFormat::SINT16>(gsl::span<const std::byte> buf, std::uint8_t channels,
+                                                 Levels &levels)
+{
+	if (2 < channels) return 0;
+
+	const auto *p = reinterpret_cast<const __m128i *>(buf.data());
+	const auto n = static_cast<std::size_t>(buf.size()) / sizeof(std::int16_t);
+	const auto unit = _mm_set1_ps(1.0f / ScaleTraits<SampleFormat::SINT16>::FULL);
+	LevelLanes lanes;
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8, p++) {
+		// As in ScaleVectors, sign-extend each half into 32 bits.
+		const auto v = _mm_loadu_si128(p);
+		const auto lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		const auto hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		lanes.Add(_mm_mul_ps(_mm_cvtepi32_ps(lo), unit));
+		lanes.Add(_mm_mul_ps(_mm_cvtepi32_ps(hi), unit));
+	}
+	lanes.Fold(channels, levels);
+	return i / channels;
+}
+#endif // PLAYD_DSP_SSE2
+
+/**
+ * Measures all of the frames of a buffer.
+ * @tparam F The sample format.
+ * @param buf The samples.
+ * @param channels The number of channels in each frame.
+ * @param levels The levels to add to.
+ */
+template <SampleFormat F>
+static void Measure(gsl::span<const std::byte> buf, std::uint8_t channels, Levels &levels)
+{
+	const auto done = MeasureVectors<F>(buf, channels, levels);
+	MeasureFrames<F>(buf, done, channels, levels);
+}
+
+void MeasureLevels(gsl::span<const std::byte> buf, SampleFormat fmt, std::uint8_t channels, Levels &levels)
+{
+	Expects(0 < channels);
+	const auto frame_bytes = sample_format_bps[static_cast<std::size_t>(fmt)] * channels;
+	Expects(buf.size() % frame_bytes == 0);
+
+	switch (fmt) {
+		case SampleFormat::UINT8:
+			Measure<SampleFormat::UINT8>(buf, channels, levels);
+			break;
+		case SampleFormat::SINT8:
+			Measure<SampleFormat::SINT8>(buf, channels, levels);
+			break;
+		case SampleFormat::SINT16:
+			Measure<SampleFormat::SINT16>(buf, channels, levels);
+			break;
+		case SampleFormat::SINT32:
+			Measure<SampleFormat::SINT32>(buf, channels, levels);
+			break;
+		case SampleFormat::FLOAT32:
+			Measure<SampleFormat::FLOAT32>(buf, channels, levels);
+			break;
+	}
+
+	levels.frames += static_cast<std::size_t>(buf.size()) / frame_bytes;
+	levels.channels = static_cast<std::uint8_t>(std::min<std::size_t>(channels, Levels::MAX_CHANNELS));
+}
+
+//
+// GainRamp
+//
+
+GainRamp::GainRamp() : current{1.0f}, target{1.0f}, ramping{0}
+{
+}
+
+void GainRamp::Set(float gain, Samples frames)
+{
+	this->target = gain;
+	this->ramping = frames;
+	if (frames == 0) this->current = gain;
+}
+
+void GainRamp::Apply(gsl::span<std::byte> buf, SampleFormat fmt, std::uint8_t channels)
+{
+	const auto frame_bytes = sample_format_bps[static_cast<std::size_t>(fmt)] * channels;
+	auto rest = buf;
+
+	if (0 < this->ramping) {
+		const auto n = std::min<Samples>(this->ramping, static_cast<std::size_t>(rest.size()) / frame_bytes);
+		const auto step = (this->target - this->current) / static_cast<float>(this->ramping);
+
+		// The ramp ends, rather than starts, on a step, so that its last
+		// frame is exactly at the target.
+		ScaleSamples(rest.first(n * frame_bytes), fmt, channels, this->current + step, step);
+		this->current += static_cast<float>(n) * step;
+		this->ramping -= n;
+		if (this->ramping == 0) this->current = this->target;
+
+		rest = rest.last(rest.size() - n * frame_bytes);
+	}
+
+	if (rest.empty() || this->current == 1.0f) return;
+	ScaleSamples(rest, fmt, channels, this->current, 0.0f);
+}
+
+void Clip(gsl::span<float> buf)
+{
+	const auto n = static_cast<std::size_t>(buf.size());
+	auto *x = buf.data();
+	std::size_t i = 0;
+
+#ifdef PLAYD_DSP_SSE2
+	// minps and maxps are 'a < b ? a : b' and 'a > b ? a : b', which is
+	// what the scalar version does too; in both, NaNs end up at 1.
+	const auto lo = _mm_set1_ps(-1.0f);
+	const auto hi = _mm_set1_ps(1.0f);
+	for (; i + 4 <= n; i += 4) {
+		const auto v = _mm_loadu_ps(x + i);
+		_mm_storeu_ps(x + i, _mm_max_ps(_mm_min_ps(v, hi), lo));
+	}
+#endif // PLAYD_DSP_SSE2
+
+	for (; i < n; i++) {
+		const auto y = x[i] < 1.0f ? x[i] : 1.0f;
+		x[i] = y > -1.0f ? y : -1.0f;
+	}
+}
+
+void MinMax(gsl::span<const float> buf, float &low, float &high)
+{
+	const auto n = static_cast<std::size_t>(buf.size());
+	const auto *x = buf.data();
+	std::size_t i = 0;
+
+#ifdef PLAYD_DSP_SSE2
+	// Two sets of accumulators keep two minps/maxps chains in flight.  With
+	// the accumulator second, a NaN sample leaves it as it was.
+	auto lo0 = _mm_set1_ps(low), lo1 = lo0;
+	auto hi0 = _mm_set1_ps(high), hi1 = hi0;
+	for (; i + 8 <= n; i += 8) {
+		const auto a = _mm_loadu_ps(x + i);
+		const auto b = _mm_loadu_ps(x + i + 4);
+		lo0 = _mm_min_ps(a, lo0);
+		hi0 = _mm_max_ps(a, hi0);
+		lo1 = _mm_min_ps(b, lo1);
+		hi1 = _mm_max_ps(b, hi1);
+	}
+
+	alignas(16) float lows[4], highs[4];
+	_mm_store_ps(lows, _mm_min_ps(lo0, lo1));
+	_mm_store_ps(highs, _mm_max_ps(hi0, hi1));
+	for (std::size_t j = 0; j < 4; j++) {
+		low = std::min(low, lows[j]);
+		high = std::max(high, highs[j]);
+	}
+#endif // PLAYD_DSP_SSE2
+
+	for (; i < n; i++) {
+		low = x[i] < low ? x[i] : low;
+		high = x[i] > high ? x[i] : high;
+	}
+}
+
+std::size_t FirstAbove(gsl::span<const float> buf, float threshold)
+{
+	const auto n = static_cast<std::size_t>(buf.size());
+	const auto *x = buf.data();
+	std::size_t i = 0;
+
+#ifdef PLAYD_DSP_SSE2
+	// Skip quiet vectors; the scalar loop below pins down where in the
+	// first loud one the loud sample is.
+	const auto sign = _mm_set1_ps(-0.0f);
+	const auto t = _mm_set1_ps(threshold);
+	for (; i + 4 <= n; i += 4) {
+		const auto abs = _mm_andnot_ps(sign, _mm_loadu_ps(x + i));
+		if (_mm_movemask_ps(_mm_cmpgt_ps(abs, t)) != 0) break;
+	}
+#endif // PLAYD_DSP_SSE2
+
+	for (; i < n; i++) {
+		if (std::abs(x[i]) > threshold) return i;
+	}
+	return n;
+}
+
+std::size_t LastAbove(gsl::span<const float> buf, float threshold)
+{
+	const auto n = static_cast<std::size_t>(buf.size());
+	const auto *x = buf.data();
+
+	// Vectors line up with the end, leaving the odd samples at the start.
+	auto i = n;
+
+#ifdef PLAYD_DSP_SSE2
+	const auto sign = _mm_set1_ps(-0.0f);
+	const auto t = _mm_set1_ps(threshold);
+	for (; 4 <= i; i -= 4) {
+		const auto abs = _mm_andnot_ps(sign, _mm_loadu_ps(x + i - 4));
+		if (_mm_movemask_ps(_mm_cmpgt_ps(abs, t)) != 0) break;
+	}
+#endif // PLAYD_DSP_SSE2
+
+	for (; 0 < i; i--) {
+		if (std::abs(x[i - 1]) > threshold) return i;
+	}
+	return 0;
+}
+
+//
+// True peaks
+//
+
+std::vector<float> DesignTruePeakInterpolator(std::size_t taps, std::size_t oversample, PhaseLayout layout)
+{
+	Expects(0 < taps);
+	Expects(0 < oversample);
+
+	constexpr double pi = 3.14159265358979323846;
+
+	const auto length = taps * oversample;
+	const auto centre = static_cast<double>(length / 2);
+	std::vector<float> coefficients(length);
+	for (std::size_t i = 0; i < length; i++) {
+		const auto x = static_cast<double>(i) - centre;
+		const auto t = x / static_cast<double>(oversample);
+		const auto sinc = t == 0 ? 1.0 : std::sin(pi * t) / (pi * t);
+		const auto window = 0.5 * (1.0 + std::cos(pi * x / (centre + 1)));
+
+		const auto phase = i % oversample;
+		const auto tap = i / oversample;
+		const auto at = layout == PhaseLayout::PHASE_MAJOR ? phase * taps + tap : tap * oversample + phase;
+		coefficients[at] = static_cast<float>(sinc * window);
+	}
+	return coefficients;
+}
+
+} // namespace Playd::Audio
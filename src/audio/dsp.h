@@ -0,0 +1,218 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of playd's sample-processing kernels.
+ * @see audio/dsp.cpp
+ */
+
+#ifndef PLAYD_AUDIO_DSP_H
+#define PLAYD_AUDIO_DSP_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "sample_format.h"
+
+// SSE2 is part of every x86-64 processor, so we can use it unconditionally
+// there; on 32-bit x86, only if the compiler has been told it's available.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PLAYD_DSP_SSE2
+#endif
+
+namespace Playd::Audio
+{
+/// The shapes a fade can take.
+enum class FadeCurve : std::uint8_t {
+	LINEAR,      ///< Gain moves in a straight line; crossfades dip midway.
+	EQUAL_POWER, ///< Gain follows a quarter sine; crossfades keep their loudness.
+};
+
+/**
+ * Converts packed samples into floats in the range [-1, 1].
+ * @param src The samples, in format @a fmt.
+ * @param fmt The format of @a src.
+ * @param dest The span to fill with floats; it must have exactly one float
+ *   for each mono sample in @a src.
+ */
+void ToFloat(gsl::span<const std::byte> src, SampleFormat fmt, gsl::span<float> dest);
+
+/**
+ * Converts floats in the range [-1, 1] into packed samples, the reverse of
+ * ToFloat.  Integer samples are rounded, and saturate rather than wrap;
+ * NaNs become silence.
+ * @param src The floats.
+ * @param fmt The format of @a dest.
+ * @param dest The span to fill with samples; it must have exactly one
+ *   mono sample for each float in @a src.
+ */
+void FromFloat(gsl::span<const float> src, SampleFormat fmt, gsl::span<std::byte> dest);
+
+/**
+ * Adds the samples in one buffer, scaled by a gain, to those in another.
+ * @param dest The buffer to add to.
+ * @param src The buffer to add; it must be the same size as @a dest.
+ * @param gain The linear gain by which to multiply @a src.
+ */
+void MixInto(gsl::span<float> dest, gsl::span<const float> src, float gain);
+
+/**
+ * Adds the frames in one buffer, scaled by a gain and a fade envelope, to
+ * those in another.
+ *
+ * The envelope for frame i is @a curve evaluated at t + i * dt, clamped into
+ * [0, 1].  A fade in runs t up from 0 to 1; a fade out runs it down from 1.
+ * The equal-power curve for a fade out is then the cosine of the fade in, so
+ * the two sum to constant power.
+ *
+ * @param dest The buffer of interleaved frames to add to.
+ * @param src The buffer to add; it must be the same size as @a dest.
+ * @param channels The number of channels in each frame.
+ * @param gain The linear gain by which to multiply @a src.
+ * @param curve The shape of the envelope.
+ * @param t The envelope's position at the first frame.
+ * @param dt How far the envelope moves each frame.
+ */
+void MixFade(gsl::span<float> dest, gsl::span<const float> src, std::uint8_t channels, float gain,
+             FadeCurve curve, float t, float dt);
+
+/**
+ * Scales packed samples in place by a gain, which may ramp linearly.
+ *
+ * The gain for frame i is @a gain + i * @a step.  Integer samples are
+ * rounded, and saturate rather than wrap around if the gain is too high.
+ *
+ * @param buf The samples, in format @a fmt.  Its size must be a whole
+ *   number of frames.
+ * @param fmt The format of @a buf.
+ * @param channels The number of channels in each frame.
+ * @param gain The linear gain for the first frame.
+ * @param step How much the gain changes each frame.
+ */
+void ScaleSamples(gsl::span<std::byte> buf, SampleFormat fmt, std::uint8_t channels, float gain, float step);
+
+/**
+ * Running per-channel levels of some audio, as MeasureLevels adds them up.
+ * Only the first MAX_CHANNELS channels are measured.
+ */
+struct Levels {
+	/// The most channels measured.
+	static constexpr std::size_t MAX_CHANNELS{8};
+
+	std::array<float, MAX_CHANNELS> peak{};    ///< Highest |sample|, with full scale at 1.
+	std::array<double, MAX_CHANNELS> energy{}; ///< Sum of squared samples.
+	std::uint64_t frames{0};                   ///< Number of frames measured.
+	std::uint8_t channels{0};                  ///< Number of channels measured.
+};
+
+/**
+ * Measures the peak and energy of each channel of some packed samples, and
+ * adds them to running levels.
+ * @param buf The samples, in format @a fmt.  Its size must be a whole
+ *   number of frames.
+ * @param fmt The format of @a buf.
+ * @param channels The number of channels in each frame.
+ * @param levels The levels to add to.
+ */
+void MeasureLevels(gsl::span<const std::byte> buf, SampleFormat fmt, std::uint8_t channels, Levels &levels);
+
+/**
+ * A gain for packed samples which, rather than jumping to each new value,
+ * ramps there linearly, so that changes don't 'zipper' (click).
+ */
+class GainRamp
+{
+public:
+	/// Constructs a GainRamp at unity gain.
+	GainRamp();
+
+	/**
+	 * Sets a new gain.
+	 * @param gain The linear gain (1 is unity).
+	 * @param frames The number of frames over which to ramp to @a gain;
+	 *   0 to jump there at once.
+	 */
+	void Set(float gain, Samples frames);
+
+	/**
+	 * Applies the gain to packed samples in place, moving the ramp on.
+	 * Samples at unity gain are left untouched.
+	 * @param buf The samples, in format @a fmt.
+	 * @param fmt The format of @a buf.
+	 * @param channels The number of channels in each frame.
+	 * @see ScaleSamples
+	 */
+	void Apply(gsl::span<std::byte> buf, SampleFormat fmt, std::uint8_t channels);
+
+private:
+	float current;   ///< The gain at the next frame to apply.
+	float target;    ///< The gain at the end of the ramp.
+	Samples ramping; ///< The number of frames left on the ramp.
+};
+
+/**
+ * Clamps samples into the range [-1, 1], so that overloaded mixes clip
+ * rather than wrap around when converted to integers downstream.
+ * NaNs become 1.
+ * @param buf The buffer to clamp in place.
+ */
+void Clip(gsl::span<float> buf);
+
+/**
+ * Widens a running range of samples to take in some more samples.
+ * NaNs are ignored.
+ * @param buf The samples.
+ * @param low The lowest sample so far, lowered if @a buf goes lower.
+ * @param high The highest sample so far, raised if @a buf goes higher.
+ */
+void MinMax(gsl::span<const float> buf, float &low, float &high);
+
+/**
+ * Finds the first sample louder than a threshold.
+ * NaNs count as quiet.
+ * @param buf The samples.
+ * @param threshold The threshold, which |sample| must exceed.
+ * @return The index of the first such sample, or the size of @a buf if
+ *   there is none.
+ */
+std::size_t FirstAbove(gsl::span<const float> buf, float threshold);
+
+/**
+ * Finds the last sample louder than a threshold, searching backwards.
+ * NaNs count as quiet.
+ * @param buf The samples.
+ * @param threshold The threshold, which |sample| must exceed.
+ * @return One past the index of the last such sample, or 0 if there is
+ *   none.
+ */
+std::size_t LastAbove(gsl::span<const float> buf, float threshold);
+
+/// The ways the coefficients of a polyphase interpolator can be laid out.
+enum class PhaseLayout : std::uint8_t {
+	PHASE_MAJOR, ///< All of phase 0's taps, then all of phase 1's, and so on.
+	TAP_MAJOR,   ///< Tap 0 of every phase, then tap 1 of every phase, and so on.
+};
+
+/**
+ * Designs the interpolator used to find true (inter-sample) peaks: a
+ * Hann-windowed sinc, split into one filter per output phase.  Phase 0
+ * lands on the input samples themselves, half the taps back.
+ * The limiter and loudness analysis both use this, so that they agree on
+ * what the true peak of any piece of audio is.
+ * @param taps The number of taps in each phase's filter.
+ * @param oversample The number of phases (interpolated points per input
+ *   sample).
+ * @param layout How to lay out the coefficients.
+ * @return The taps * oversample coefficients.
+ */
+std::vector<float> DesignTruePeakInterpolator(std::size_t taps, std::size_t oversample, PhaseLayout layout);
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_DSP_H
@@ -0,0 +1,334 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Input and FileInput classes.
+ * @see audio/input.h
+ */
+
+#include "input.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#else
+#include <sys/param.h>
+#include <sys/mount.h>
+#endif // __linux__
+#endif // _WIN32
+
+#include "../errors.h"
+#include "../log.h"
+
+namespace Playd::Audio
+{
+//
+// Input
+//
+
+Input::Input(std::string_view path) : path{path}
+{
+}
+
+std::string_view Input::Path() const
+{
+	return this->path;
+}
+
+/* static */ std::unique_ptr<Input> Input::Open(std::string_view path)
+{
+#ifndef _WIN32
+	try {
+		return std::make_unique<MappedInput>(path);
+	} catch (FileError &e) {
+		// If the file really can't be opened, FileInput will say so.
+		PLAYD_LOG(DEBUG) << "input: not mapping:" << e.Message();
+	}
+#endif // _WIN32
+
+	return std::make_unique<FileInput>(path);
+}
+
+void Input::Prefetch(std::uint64_t, std::uint64_t)
+{
+}
+
+std::uint64_t Input::SeekTarget(std::int64_t offset, int whence) const
+{
+	std::int64_t base = 0;
+	switch (whence) {
+		case SEEK_SET:
+			base = 0;
+			break;
+		case SEEK_CUR:
+			base = static_cast<std::int64_t>(this->Tell());
+			break;
+		case SEEK_END:
+			base = static_cast<std::int64_t>(this->Length());
+			break;
+		default:
+			throw FileError("invalid seek origin");
+	}
+
+	// Seeking past the end is allowed (reads there just return nothing),
+	// but seeking before the start isn't.
+	const auto target = base + offset;
+	if (target < 0) throw FileError("seek before start of " + this->path);
+	return static_cast<std::uint64_t>(target);
+}
+
+//
+// FileInput
+//
+
+/**
+ * Moves a FILE to an absolute position.
+ * std::fseek takes a long, which is 32 bits on Windows (and 32-bit POSIX
+ * systems), so couldn't reach past 2GiB into a file.
+ * @param file The file.
+ * @param pos The position, in bytes from the start of the file.
+ * @return Whether the seek succeeded.
+ */
+static bool SeekFile(std::FILE *file, std::uint64_t pos)
+{
+#ifdef _WIN32
+	return _fseeki64(file, static_cast<__int64>(pos), SEEK_SET) == 0;
+#else
+	// Without large file support, off_t may still be 32 bits; better to
+	// fail the seek than to land somewhere else.
+	if (static_cast<std::uint64_t>(std::numeric_limits<off_t>::max()) < pos) return false;
+	return fseeko(file, static_cast<off_t>(pos), SEEK_SET) == 0;
+#endif // _WIN32
+}
+
+FileInput::FileInput(std::string_view path)
+    : Input{path}, file{nullptr}, head(HEAD_SIZE), length{0}, pos{0}, file_pos{0}
+{
+	std::error_code ec;
+	this->length = std::filesystem::file_size(this->path, ec);
+	if (ec) throw FileError("can't open " + this->path + ": " + ec.message());
+
+	this->file = std::fopen(this->path.c_str(), "rb");
+	if (this->file == nullptr) throw FileError("can't open " + this->path + ": " + std::strerror(errno));
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+	// This is only advice, so we don't care if it fails.
+	posix_fadvise(fileno(this->file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif // !_WIN32 && !__APPLE__
+
+	const auto nread = std::fread(this->head.data(), 1, this->head.size(), this->file);
+	if (nread < this->head.size() && std::ferror(this->file)) {
+		std::fclose(this->file);
+		throw FileError("can't read " + this->path);
+	}
+	this->head.resize(nread);
+	this->file_pos = nread;
+}
+
+FileInput::~FileInput()
+{
+	if (this->file != nullptr) std::fclose(this->file);
+}
+
+std::size_t FileInput::Read(gsl::span<std::byte> dest)
+{
+	const auto want = static_cast<std::size_t>(dest.size());
+	std::size_t done = 0;
+
+	// Anything in the head has already been read, so don't read it again.
+	if (this->pos < this->head.size()) {
+		done = std::min(want, static_cast<std::size_t>(this->head.size() - this->pos));
+		std::copy_n(this->head.cbegin() + this->pos, done, dest.begin());
+		this->pos += done;
+	}
+	if (want <= done || this->length <= this->pos) return done;
+
+	if (this->file_pos != this->pos) {
+		if (!SeekFile(this->file, this->pos)) {
+			throw FileError("can't seek in " + this->path);
+		}
+		this->file_pos = this->pos;
+	}
+
+	const auto nread = std::fread(dest.data() + done, 1, want - done, this->file);
+	if (nread < want - done && std::ferror(this->file)) throw FileError("can't read " + this->path);
+	this->pos += nread;
+	this->file_pos += nread;
+
+	return done + nread;
+}
+
+std::uint64_t FileInput::Seek(std::int64_t offset, int whence)
+{
+	// We only move the FILE when we next need to read from it: most seeks
+	// mpg123 and libsndfile do are probing around the head.
+	this->pos = this->SeekTarget(offset, whence);
+	return this->pos;
+}
+
+std::uint64_t FileInput::Tell() const
+{
+	return this->pos;
+}
+
+std::uint64_t FileInput::Length() const
+{
+	return this->length;
+}
+
+gsl::span<const std::byte> FileInput::Head() const
+{
+	return this->head;
+}
+
+void FileInput::Prefetch([[maybe_unused]] std::uint64_t offset, [[maybe_unused]] std::uint64_t length)
+{
+#if !defined(_WIN32) && !defined(__APPLE__)
+	posix_fadvise(fileno(this->file), static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+#endif // !_WIN32 && !__APPLE__
+}
+
+#ifndef _WIN32
+
+//
+// MappedInput
+//
+
+/**
+ * Works out whether an open file is on a local filesystem.
+ * Reading a mapping of a file over the network raises SIGBUS, rather than
+ * failing the read, whenever the network does; so we only map local files.
+ * @param fd The file's descriptor.
+ * @return Whether the file is local; false if we can't tell.
+ */
+static bool IsLocalFile(int fd)
+{
+#if defined(__linux__)
+	struct statfs fs {};
+	if (fstatfs(fd, &fs) != 0) return false;
+
+	// Linux has no 'is local' flag, so we list the remote filesystems
+	// (and FUSE, under which most user-space network filesystems run).
+	switch (static_cast<std::uint32_t>(fs.f_type)) {
+		case 0x6969:     // NFS
+		case 0x517B:     // SMB
+		case 0xFF534D42: // CIFS
+		case 0xFE534D42: // SMB2
+		case 0x65735546: // FUSE
+		case 0x564C:     // NCP
+		case 0x73757245: // Coda
+		case 0x5346414F: // AFS
+		case 0x01021997: // 9P
+		case 0x00C36400: // Ceph
+		case 0x47504653: // GPFS
+		case 0x0BD00BD0: // Lustre
+			return false;
+		default:
+			return true;
+	}
+#elif defined(MNT_LOCAL)
+	struct statfs fs {};
+	return fstatfs(fd, &fs) == 0 && (fs.f_flags & MNT_LOCAL) != 0;
+#else
+	return false;
+#endif // __linux__
+}
+
+MappedInput::MappedInput(std::string_view path) : Input{path}, data{nullptr}, length{0}, pos{0}
+{
+	const auto fd = open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) throw FileError("can't open " + this->path + ": " + std::strerror(errno));
+
+	struct stat st {};
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+		close(fd);
+		throw FileError("can't map " + this->path + ": not a non-empty regular file");
+	}
+	this->length = static_cast<std::uint64_t>(st.st_size);
+
+	if (!IsLocalFile(fd)) {
+		close(fd);
+		throw FileError("can't map " + this->path + ": not on a local filesystem");
+	}
+
+	auto *map = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+	const auto map_errno = errno;
+
+#ifndef __APPLE__
+	// The page cache, as well as the mapping, should expect sequential
+	// access.  This is only advice, so we don't care if it fails.
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif // __APPLE__
+
+	// The mapping keeps the file alive; we don't need the descriptor.
+	close(fd);
+	if (map == MAP_FAILED) throw FileError("can't map " + this->path + ": " + std::strerror(map_errno));
+
+	this->data = static_cast<const std::byte *>(map);
+	madvise(map, this->length, MADV_SEQUENTIAL);
+}
+
+MappedInput::~MappedInput()
+{
+	if (this->data != nullptr) munmap(const_cast<std::byte *>(this->data), this->length);
+}
+
+std::size_t MappedInput::Read(gsl::span<std::byte> dest)
+{
+	if (this->length <= this->pos) return 0;
+
+	const auto count = std::min(static_cast<std::uint64_t>(dest.size()), this->length - this->pos);
+	std::copy_n(this->data + this->pos, count, dest.begin());
+	this->pos += count;
+	return static_cast<std::size_t>(count);
+}
+
+std::uint64_t MappedInput::Seek(std::int64_t offset, int whence)
+{
+	this->pos = this->SeekTarget(offset, whence);
+	return this->pos;
+}
+
+std::uint64_t MappedInput::Tell() const
+{
+	return this->pos;
+}
+
+std::uint64_t MappedInput::Length() const
+{
+	return this->length;
+}
+
+gsl::span<const std::byte> MappedInput::Head() const
+{
+	return gsl::make_span(this->data, static_cast<std::size_t>(std::min<std::uint64_t>(HEAD_SIZE, this->length)));
+}
+
+void MappedInput::Prefetch(std::uint64_t offset, std::uint64_t length)
+{
+	if (this->length <= offset) return;
+	length = std::min(length, this->length - offset);
+
+	// madvise wants a page-aligned start.
+	static const auto page_size = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+	const auto start = offset - (offset % page_size);
+	madvise(const_cast<std::byte *>(this->data) + start, length + (offset - start), MADV_WILLNEED);
+}
+
+#endif // _WIN32
+
+} // namespace Playd::Audio
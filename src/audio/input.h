@@ -0,0 +1,227 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Input and FileInput classes.
+ * @see audio/input.cpp
+ */
+
+#ifndef PLAYD_AUDIO_INPUT_H
+#define PLAYD_AUDIO_INPUT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+namespace Playd::Audio
+{
+/**
+ * A seekable stream of raw bytes from an audio file.
+ *
+ * Sources decode from Inputs, rather than opening files themselves.  This
+ * lets playd look at the start of a file (the 'head') to work out its format
+ * before choosing a Source, without the Source having to open and read the
+ * file all over again.
+ *
+ * @see Source
+ */
+class Input
+{
+public:
+	/// The number of bytes read into the head of an Input when opening it.
+	static constexpr std::size_t HEAD_SIZE = 4096;
+
+	/// Virtual, empty destructor for Input.
+	virtual ~Input() = default;
+
+	/// Deleted copy constructor.
+	Input(const Input &) = delete;
+
+	/// Deleted copy-assignment.
+	Input &operator=(const Input &) = delete;
+
+	/**
+	 * Reads bytes from the current position, advancing it.
+	 * @param dest The span to fill with bytes.
+	 * @return The number of bytes read; this is only less than the size
+	 *   of @a dest at the end of the file.
+	 * @exception FileError if the read fails.
+	 */
+	virtual std::size_t Read(gsl::span<std::byte> dest) = 0;
+
+	/**
+	 * Moves the current position.
+	 * @param offset The offset to move to, relative to @a whence.
+	 * @param whence One of SEEK_SET, SEEK_CUR or SEEK_END.
+	 * @return The new position, in bytes from the start of the file.
+	 * @exception FileError if the new position would be out of range.
+	 */
+	virtual std::uint64_t Seek(std::int64_t offset, int whence) = 0;
+
+	/**
+	 * Gets the current position.
+	 * @return The position, in bytes from the start of the file.
+	 */
+	virtual std::uint64_t Tell() const = 0;
+
+	/**
+	 * Gets the length of the file.
+	 * @return The length, in bytes.
+	 */
+	virtual std::uint64_t Length() const = 0;
+
+	/**
+	 * Gets the head of the file: its first HEAD_SIZE bytes (or all of it,
+	 * if it is shorter).  Getting the head does not change the position.
+	 * @return A span over the head.
+	 */
+	virtual gsl::span<const std::byte> Head() const = 0;
+
+	/**
+	 * Hints that a range of the file will be read soon, so that the
+	 * operating system can start bringing it into memory now.
+	 * This never blocks on I/O, and does nothing by default.
+	 * @param offset The start of the range, in bytes.
+	 * @param length The length of the range, in bytes.
+	 */
+	virtual void Prefetch(std::uint64_t offset, std::uint64_t length);
+
+	/**
+	 * Gets the path of the file this Input is reading.
+	 * @return The file's path.
+	 */
+	std::string_view Path() const;
+
+	/**
+	 * Opens the file at the given path as an Input.
+	 *
+	 * Files on local filesystems are mapped into memory (see MappedInput);
+	 * anything else, or anything that can't be mapped, is read through C
+	 * standard I/O (see FileInput), so that a failing network share
+	 * fails reads rather than raising SIGBUS.
+	 * Either way, the operating system is told that the file will be read
+	 * sequentially, so it can read ahead aggressively.
+	 *
+	 * @param path The path to the file.
+	 * @return A unique pointer to an Input positioned at the start of the
+	 *   file.
+	 * @exception FileError if the file can't be opened.
+	 */
+	static std::unique_ptr<Input> Open(std::string_view path);
+
+protected:
+	/**
+	 * Constructs an Input.
+	 * @param path The path to the file being read.
+	 */
+	explicit Input(std::string_view path);
+
+	/**
+	 * Works out the target of a seek, checking that it is in range.
+	 * @param offset The offset to move to, relative to @a whence.
+	 * @param whence One of SEEK_SET, SEEK_CUR or SEEK_END.
+	 * @return The target, in bytes from the start of the file.
+	 * @exception FileError if the target would be out of range.
+	 */
+	std::uint64_t SeekTarget(std::int64_t offset, int whence) const;
+
+	/// The path of the file being read.
+	std::string path;
+};
+
+/**
+ * An Input that reads files through C standard I/O.
+ *
+ * The head is read once, when opening, and served from memory afterwards.
+ */
+class FileInput : public Input
+{
+public:
+	/**
+	 * Opens a FileInput.
+	 * @param path The path to the file.
+	 * @exception FileError if the file can't be opened.
+	 */
+	explicit FileInput(std::string_view path);
+
+	/// Destructs a FileInput, closing its file.
+	~FileInput() override;
+
+	std::size_t Read(gsl::span<std::byte> dest) override;
+
+	std::uint64_t Seek(std::int64_t offset, int whence) override;
+
+	std::uint64_t Tell() const override;
+
+	std::uint64_t Length() const override;
+
+	gsl::span<const std::byte> Head() const override;
+
+	void Prefetch(std::uint64_t offset, std::uint64_t length) override;
+
+private:
+	std::FILE *file;             ///< The underlying file.
+	std::vector<std::byte> head; ///< The first bytes of the file.
+	std::uint64_t length;        ///< The length of the file.
+	std::uint64_t pos;           ///< The position as seen by readers.
+	std::uint64_t file_pos;      ///< The position of the FILE itself.
+};
+
+#ifndef _WIN32
+/**
+ * An Input that maps files into memory.
+ *
+ * Reads are copies out of the mapping, so they cost no system calls, and
+ * the head is just the start of the mapping.  Prefetching maps onto
+ * madvise(MADV_WILLNEED).
+ *
+ * Only files on local filesystems are mapped, as a failed read of a mapped
+ * file raises SIGBUS rather than returning an error, and that would take
+ * down every channel.  Over the network, reads fail whenever the network
+ * does; locally, only truncating a file while it is mapped can do it, as
+ * touching the lost pages raises SIGBUS.  Replacing a file by renaming over
+ * it is safe.
+ */
+class MappedInput : public Input
+{
+public:
+	/**
+	 * Opens a MappedInput.
+	 * @param path The path to the file.
+	 * @exception FileError if the file can't be opened or mapped (for
+	 *   example, if it is empty, not a regular file, or not on a local
+	 *   filesystem).
+	 */
+	explicit MappedInput(std::string_view path);
+
+	/// Destructs a MappedInput, unmapping its file.
+	~MappedInput() override;
+
+	std::size_t Read(gsl::span<std::byte> dest) override;
+
+	std::uint64_t Seek(std::int64_t offset, int whence) override;
+
+	std::uint64_t Tell() const override;
+
+	std::uint64_t Length() const override;
+
+	gsl::span<const std::byte> Head() const override;
+
+	void Prefetch(std::uint64_t offset, std::uint64_t length) override;
+
+private:
+	const std::byte *data; ///< The start of the mapping.
+	std::uint64_t length;  ///< The length of the file (and mapping).
+	std::uint64_t pos;     ///< The current position.
+};
+#endif // _WIN32
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_INPUT_H
@@ -0,0 +1,91 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the LevelMeter class.
+ * @see audio/levels.h
+ */
+
+#include "levels.h"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "../metrics.h"
+
+namespace Playd::Audio
+{
+/// The fraction of a block's playing time that metering it may take.
+constexpr std::uint64_t METER_BUDGET_DIVISOR = 100;
+
+/// @return The counter of nanoseconds spent metering in audio callbacks.
+static Counter &MeterNanosCounter()
+{
+	static auto &counter = Metrics::Global().GetCounter("playd_meter_ns_total",
+	                                                    "Nanoseconds spent metering levels in audio callbacks.");
+	return counter;
+}
+
+/// @return The counter of blocks metered in audio callbacks.
+static Counter &MeterBlocksCounter()
+{
+	static auto &counter =
+	        Metrics::Global().GetCounter("playd_meter_blocks_total", "Blocks of audio metered in audio callbacks.");
+	return counter;
+}
+
+/// @return The counter of blocks whose metering went over budget.
+static Counter &MeterOverBudgetCounter()
+{
+	static auto &counter = Metrics::Global().GetCounter(
+	        "playd_meter_over_budget_total", "Blocks whose metering took over 1% of their playing time.");
+	return counter;
+}
+
+LevelMeter::LevelMeter(std::uint32_t sample_rate) : sample_rate{sample_rate}, full{false}
+{
+	// Registering metrics takes a lock, which the callback mustn't.
+	MeterNanosCounter();
+	MeterBlocksCounter();
+	MeterOverBudgetCounter();
+}
+
+void LevelMeter::Measure(gsl::span<const std::byte> buf, SampleFormat fmt, std::uint8_t channels)
+{
+	if (buf.empty()) return;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	MeasureLevels(buf, fmt, channels, this->pending);
+
+	// Hand over only once the loop has taken the last lot; otherwise keep
+	// adding to what we have.
+	if (!this->full.load(std::memory_order_acquire)) {
+		this->published = this->pending;
+		this->pending = Levels{};
+		this->full.store(true, std::memory_order_release);
+	}
+
+	const auto ns = static_cast<std::uint64_t>(
+	        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	MeterNanosCounter().Add(ns);
+	MeterBlocksCounter().Add();
+
+	const auto frames = static_cast<std::uint64_t>(buf.size()) /
+	                    (sample_format_bps[static_cast<std::size_t>(fmt)] * channels);
+	const auto block_ns = frames * 1'000'000'000 / this->sample_rate;
+	if (block_ns < ns * METER_BUDGET_DIVISOR) MeterOverBudgetCounter().Add();
+}
+
+std::optional<Levels> LevelMeter::Take()
+{
+	if (!this->full.load(std::memory_order_acquire)) return std::nullopt;
+
+	auto levels = this->published;
+	this->full.store(false, std::memory_order_release);
+	return levels;
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,84 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the LevelMeter class.
+ * @see audio/levels.cpp
+ */
+
+#ifndef PLAYD_AUDIO_LEVELS_H
+#define PLAYD_AUDIO_LEVELS_H
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+#undef max
+#include <gsl/gsl>
+
+#include "dsp.h"
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/**
+ * Live peak and energy meters for audio as it goes out to a device.
+ *
+ * A sink's audio callback Measures each block it plays, and the main loop
+ * Takes the levels since it last looked.  The two sides hand over through
+ * one atomic flag, so the callback never blocks or allocates: while the
+ * loop hasn't taken the last levels, the callback keeps adding to its own.
+ *
+ * Measuring is timed, and the time reported through the metrics registry,
+ * so that the cost it adds to the callback can be watched.
+ */
+class LevelMeter
+{
+public:
+	/**
+	 * Constructs a LevelMeter.
+	 * @param sample_rate The sample rate of the audio to be measured.
+	 */
+	explicit LevelMeter(std::uint32_t sample_rate);
+
+	/// Deleted copy constructor.
+	LevelMeter(const LevelMeter &) = delete;
+
+	/// Deleted copy-assignment.
+	LevelMeter &operator=(const LevelMeter &) = delete;
+
+	/**
+	 * Measures a block of audio.  Call from the audio callback only.
+	 * @param buf The samples, in format @a fmt.  Its size must be a whole
+	 *   number of frames.
+	 * @param fmt The format of @a buf.
+	 * @param channels The number of channels in each frame.
+	 */
+	void Measure(gsl::span<const std::byte> buf, SampleFormat fmt, std::uint8_t channels);
+
+	/**
+	 * Takes the levels measured since the last Take.  Call from one
+	 * thread only (the main loop).
+	 * @return The levels, or nothing if the callback hasn't handed any
+	 *   over since the last Take.
+	 */
+	std::optional<Levels> Take();
+
+private:
+	/// The sample rate of the audio, used to work out each block's budget.
+	std::uint32_t sample_rate;
+
+	/// Levels the callback is adding to, not yet handed over.
+	Levels pending;
+
+	/// Levels handed over to the loop; owned by the loop while full is set.
+	Levels published;
+
+	/// Whether published holds levels the loop hasn't taken.
+	std::atomic<bool> full;
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_LEVELS_H
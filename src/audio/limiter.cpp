@@ -0,0 +1,196 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Limiter class.
+ * @see audio/limiter.h
+ */
+
+#include "limiter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "../metrics.h"
+#include "dsp.h"
+
+#ifdef PLAYD_DSP_SSE2
+#include <emmintrin.h>
+#endif // PLAYD_DSP_SSE2
+
+namespace Playd::Audio
+{
+/// Interpolation filter taps per phase, for true peaks.
+constexpr std::size_t LIMITER_TAPS{12};
+
+/// Interpolated points per input sample; the SSE2 detector does all at once.
+constexpr std::size_t LIMITER_OVERSAMPLE{4};
+
+/// @return The counter of frames the limiter turned down.
+static Counter &LimitedFramesCounter()
+{
+	static auto &counter = Metrics::Global().GetCounter("playd_limiter_frames_total",
+	                                                    "Frames of audio whose gain the limiter reduced.");
+	return counter;
+}
+
+Limiter::Limiter(std::uint32_t rate, std::uint8_t channels, float ceiling)
+    : channels{channels},
+      ceiling{ceiling},
+      lookahead{std::max<std::size_t>(1, rate * LOOKAHEAD.count() / 1000000)},
+      delay_frames{lookahead + LIMITER_TAPS / 2},
+      release{static_cast<float>(
+              1.0 - std::exp(-1.0 / (std::chrono::duration<double>(RELEASE).count() * rate)))},
+      phases(DesignTruePeakInterpolator(LIMITER_TAPS, LIMITER_OVERSAMPLE, PhaseLayout::TAP_MAJOR)),
+      history(2 * LIMITER_TAPS * channels),
+      history_pos{0},
+      delay(delay_frames * channels),
+      delay_pos{0},
+      minima(lookahead + 3),
+      minima_head{0},
+      minima_count{0},
+      frame{0},
+      held{1.0f},
+      smooth(lookahead),
+      smooth_pos{0},
+      smooth_sum{0}
+{
+	Expects(0 < channels);
+	Expects(0 < ceiling);
+
+	// Registering takes a lock, so get it out of the way of the audio thread.
+	LimitedFramesCounter();
+
+	this->Reset();
+}
+
+std::uint32_t Limiter::Latency() const
+{
+	return static_cast<std::uint32_t>(this->delay_frames);
+}
+
+void Limiter::Reset()
+{
+	std::fill(this->history.begin(), this->history.end(), 0.0f);
+	std::fill(this->delay.begin(), this->delay.end(), 0.0f);
+	std::fill(this->smooth.begin(), this->smooth.end(), 1.0f);
+	this->history_pos = 0;
+	this->delay_pos = 0;
+	this->minima_head = 0;
+	this->minima_count = 0;
+	this->frame = 0;
+	this->held = 1.0f;
+	this->smooth_pos = 0;
+	this->smooth_sum = static_cast<double>(this->lookahead);
+}
+
+void Limiter::Process(gsl::span<float> samples)
+{
+	Expects(static_cast<std::size_t>(samples.size()) % this->channels == 0);
+
+	std::uint64_t limited = 0;
+	const auto *end = samples.data() + samples.size();
+	for (auto *in = samples.data(); in != end; in += this->channels) {
+		for (std::uint8_t c = 0; c < this->channels; c++) {
+			if (!std::isfinite(in[c])) in[c] = 0.0f;
+		}
+
+		const auto gain = this->Gain(this->Detect(in));
+		if (gain < 1.0f) limited++;
+
+		// Swap the frame for the one it displaces from the delay line.
+		auto *delayed = this->delay.data() + this->delay_pos * this->channels;
+		for (std::uint8_t c = 0; c < this->channels; c++) {
+			const auto out = delayed[c] * gain;
+			delayed[c] = in[c];
+			in[c] = std::clamp(out, -this->ceiling, this->ceiling);
+		}
+		this->delay_pos = (this->delay_pos + 1) % this->delay_frames;
+	}
+
+	if (limited != 0) LimitedFramesCounter().Add(limited);
+}
+
+float Limiter::Detect(const float *in)
+{
+	// Keeping each sample twice means the last LIMITER_TAPS samples are
+	// always contiguous, newest first, without wrapping.
+	this->history_pos = (this->history_pos + LIMITER_TAPS - 1) % LIMITER_TAPS;
+	const auto *h = this->phases.data();
+
+#ifdef PLAYD_DSP_SSE2
+	// Each tap's coefficients for all four phases sit together, so one
+	// vector works out every interpolated point between two samples.
+	static_assert(LIMITER_OVERSAMPLE == 4, "the SSE2 detector does four phases per vector");
+	const auto abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	auto peak = _mm_setzero_ps();
+	for (std::uint8_t c = 0; c < this->channels; c++) {
+		auto *hist = this->history.data() + c * 2 * LIMITER_TAPS;
+		hist[this->history_pos] = hist[this->history_pos + LIMITER_TAPS] = in[c];
+		const auto *recent = hist + this->history_pos;
+
+		auto y = _mm_setzero_ps();
+		for (std::size_t k = 0; k < LIMITER_TAPS; k++) {
+			const auto coeffs = _mm_loadu_ps(h + k * LIMITER_OVERSAMPLE);
+			y = _mm_add_ps(y, _mm_mul_ps(coeffs, _mm_set1_ps(recent[k])));
+		}
+		peak = _mm_max_ps(peak, _mm_and_ps(y, abs_mask));
+	}
+	peak = _mm_max_ps(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(1, 0, 3, 2)));
+	peak = _mm_max_ps(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(peak);
+#else
+	float peak = 0.0f;
+	for (std::uint8_t c = 0; c < this->channels; c++) {
+		auto *hist = this->history.data() + c * 2 * LIMITER_TAPS;
+		hist[this->history_pos] = hist[this->history_pos + LIMITER_TAPS] = in[c];
+		const auto *recent = hist + this->history_pos;
+
+		for (std::size_t p = 0; p < LIMITER_OVERSAMPLE; p++) {
+			float y = 0;
+			for (std::size_t k = 0; k < LIMITER_TAPS; k++) y += h[k * LIMITER_OVERSAMPLE + p] * recent[k];
+			peak = std::max(peak, std::abs(y));
+		}
+	}
+	return peak;
+#endif // PLAYD_DSP_SSE2
+}
+
+float Limiter::Gain(float peak)
+{
+	const auto target = this->ceiling < peak ? this->ceiling / peak : 1.0f;
+
+	// Hold the lowest gain wanted over the look-ahead, plus the two frames
+	// either side of a sample that its interpolated peaks can come from.
+	// The candidates rise from oldest to newest; anything no lower than
+	// the new target can never be the minimum again.
+	const auto window = this->lookahead + 2;
+	const auto capacity = this->minima.size();
+	while (this->minima_count != 0 &&
+	       target <= this->minima[(this->minima_head + this->minima_count - 1) % capacity].second) {
+		this->minima_count--;
+	}
+	this->minima[(this->minima_head + this->minima_count) % capacity] = {this->frame, target};
+	this->minima_count++;
+	while (this->minima[this->minima_head].first + window <= this->frame) {
+		this->minima_head = (this->minima_head + 1) % capacity;
+		this->minima_count--;
+	}
+	this->frame++;
+
+	// Going down is instant; coming back up is exponential.
+	const auto hold = this->minima[this->minima_head].second;
+	this->held = std::min(hold, this->held + (1.0f - this->held) * this->release);
+
+	// Averaging over the look-ahead turns the instant drops into ramps,
+	// which still reach the held gain by the time its peak leaves the
+	// delay line.
+	this->smooth_sum += this->held - this->smooth[this->smooth_pos];
+	this->smooth[this->smooth_pos] = this->held;
+	this->smooth_pos = (this->smooth_pos + 1) % this->lookahead;
+	return static_cast<float>(this->smooth_sum / static_cast<double>(this->lookahead));
+}
+
+} // namespace Playd::Audio
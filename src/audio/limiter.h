@@ -0,0 +1,162 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Limiter class.
+ * @see audio/limiter.cpp
+ */
+
+#ifndef PLAYD_AUDIO_LIMITER_H
+#define PLAYD_AUDIO_LIMITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+namespace Playd::Audio
+{
+/**
+ * A look-ahead brickwall limiter, which keeps the true (inter-sample) peak
+ * of audio passing through it at or below a ceiling.
+ *
+ * The limiter watches audio LOOKAHEAD ahead of what it outputs, through a
+ * 4x oversampling true-peak detector, and brings its gain down smoothly
+ * before any peak over the ceiling arrives.  After the peak, the gain
+ * recovers over about RELEASE.  As a last resort, every output sample is
+ * also clamped to the ceiling, so nothing can get through a limiter
+ * hotter than the ceiling.
+ *
+ * Like the true-peak meters of ITU-R BS.1770, 4x oversampling can read
+ * peaks near the Nyquist frequency a fraction of a decibel low; a ceiling
+ * of -1dBTP leaves room for that, and for lossy encoders downstream.
+ *
+ * All channels share one gain, so the stereo image doesn't shift.
+ *
+ * The look-ahead delays audio by a fixed Latency, which also accounts for
+ * the detector's filter.  Processing doesn't allocate, so it is safe on an
+ * audio thread.
+ */
+class Limiter
+{
+public:
+	/// How far ahead the limiter looks for peaks.
+	static constexpr std::chrono::microseconds LOOKAHEAD{2000};
+
+	/// Roughly how long the gain takes to recover after a peak.
+	static constexpr std::chrono::milliseconds RELEASE{100};
+
+	/**
+	 * Constructs a Limiter.
+	 * @param rate The sample rate of the audio, in Hz.
+	 * @param channels The number of interleaved channels in the audio.
+	 * @param ceiling The highest true peak allowed out, as a linear
+	 *   amplitude (1 is full scale).
+	 */
+	Limiter(std::uint32_t rate, std::uint8_t channels, float ceiling);
+
+	/// Deleted copy constructor.
+	Limiter(const Limiter &) = delete;
+
+	/// Deleted copy-assignment.
+	Limiter &operator=(const Limiter &) = delete;
+
+	/**
+	 * Limits audio in place.  Each sample out is a sample in from
+	 * Latency frames ago (or silence, for the first Latency frames).
+	 * NaNs and infinities are treated as silence.
+	 * @param samples Interleaved samples.  Its size must be a whole
+	 *   number of frames.
+	 */
+	void Process(gsl::span<float> samples);
+
+	/**
+	 * Gets the delay the limiter adds.
+	 * @return The latency, in frames.
+	 */
+	std::uint32_t Latency() const;
+
+	/**
+	 * Forgets all audio seen so far, as if the limiter were new.
+	 * The next Latency frames out will be silence.
+	 */
+	void Reset();
+
+private:
+	/// The number of interleaved channels.
+	std::uint8_t channels;
+
+	/// The highest peak allowed out.
+	float ceiling;
+
+	/// The look-ahead, and the length of the gain smoothing, in frames.
+	std::size_t lookahead;
+
+	/// The delay applied to the audio, in frames.
+	std::size_t delay_frames;
+
+	/// Per-frame recovery coefficient for the gain.
+	float release;
+
+	/// The interpolator, tap-major: each tap's coefficients for every phase.
+	std::vector<float> phases;
+
+	/// Recent input for each channel, twice over; see history_pos.
+	std::vector<float> history;
+
+	/// Where the newest input goes in each channel's history.
+	std::size_t history_pos;
+
+	/// The delay line of interleaved frames awaiting output.
+	std::vector<float> delay;
+
+	/// Where the next frame goes in (and comes out of) the delay line.
+	std::size_t delay_pos;
+
+	/// Ring of (frame, gain) candidates for the running minimum gain.
+	std::vector<std::pair<std::uint64_t, float>> minima;
+
+	/// The index in minima of the oldest candidate.
+	std::size_t minima_head;
+
+	/// The number of candidates in minima.
+	std::size_t minima_count;
+
+	/// The number of frames seen so far.
+	std::uint64_t frame;
+
+	/// The gain after release, before smoothing.
+	float held;
+
+	/// Ring of recent held gains, for smoothing.
+	std::vector<float> smooth;
+
+	/// Where the next held gain goes in smooth.
+	std::size_t smooth_pos;
+
+	/// The sum of everything in smooth.
+	double smooth_sum;
+
+	/**
+	 * Feeds one frame to the true-peak detector.
+	 * @param in The frame, one sample per channel.
+	 * @return The highest true peak of any channel just after the frame
+	 *   fed in half the interpolator's length ago.
+	 */
+	float Detect(const float *in);
+
+	/**
+	 * Works out the gain for the frame leaving the delay line next.
+	 * @param peak The detected peak of the frame just fed in.
+	 * @return The gain.
+	 */
+	float Gain(float peak);
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_LIMITER_H
@@ -0,0 +1,260 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the LoudnessMeter class, and loudness analysis.
+ * @see audio/loudness.h
+ */
+
+#include "loudness.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "dsp.h"
+
+namespace Playd::Audio
+{
+/// Pi, which M_PI would give us if it were standard.
+constexpr double PI = 3.14159265358979323846;
+
+/// The gating threshold below which blocks are ignored, in LUFS.
+constexpr double ABSOLUTE_GATE{-70.0};
+
+/// How far below ungated loudness integrated loudness gates, in LU.
+constexpr double INTEGRATED_RELATIVE_GATE{-10.0};
+
+/// How far below ungated loudness the loudness range gates, in LU.
+constexpr double RANGE_RELATIVE_GATE{-20.0};
+
+/// 100ms blocks in each 400ms momentary block.
+constexpr std::size_t MOMENTARY_BLOCKS{4};
+
+/// 100ms blocks in each 3s short-term block.
+constexpr std::size_t SHORT_TERM_BLOCKS{30};
+
+/// 100ms blocks between the starts of short-term blocks in the range.
+constexpr std::size_t SHORT_TERM_HOP{10};
+
+/// Interpolation filter taps per phase, for true peaks.
+constexpr std::size_t PEAK_TAPS{12};
+
+/// Version of the cache entry format.
+constexpr std::uint32_t loudness_cache_version{1};
+
+/**
+ * Converts a mean-square energy into loudness.
+ * @param energy The energy.
+ * @return The loudness, in LUFS.
+ */
+static double EnergyToLoudness(double energy)
+{
+	return -0.691 + 10.0 * std::log10(energy);
+}
+
+/**
+ * Converts loudness into mean-square energy.
+ * @param lufs The loudness, in LUFS.
+ * @return The energy.
+ */
+static double LoudnessToEnergy(double lufs)
+{
+	return std::pow(10.0, (lufs + 0.691) / 10.0);
+}
+
+/**
+ * Finds the mean energy of the blocks above a gate.
+ * @param energies The energy of each block.
+ * @param gate The gate, as an energy.
+ * @return The mean energy, or 0 if no block gets through the gate.
+ */
+static double GatedMean(const std::vector<double> &energies, double gate)
+{
+	double sum = 0;
+	std::size_t count = 0;
+	for (const auto e : energies) {
+		if (e <= gate) continue;
+		sum += e;
+		count++;
+	}
+	return count == 0 ? 0 : sum / count;
+}
+
+/**
+ * Averages runs of 100ms block energies into longer, overlapping blocks.
+ * @param blocks The 100ms block energies.
+ * @param length The number of 100ms blocks in each longer block.
+ * @param hop The number of 100ms blocks between longer blocks.
+ * @return The energies of the longer blocks.
+ */
+static std::vector<double> Windows(const std::vector<double> &blocks, std::size_t length, std::size_t hop)
+{
+	std::vector<double> windows;
+	double sum = 0;
+	for (std::size_t i = 0; i < length && i < blocks.size(); i++) sum += blocks[i];
+	for (std::size_t start = 0; start + length <= blocks.size(); start += hop) {
+		windows.push_back(sum / length);
+		for (std::size_t i = 0; i < hop && start + length + i < blocks.size(); i++) {
+			sum += blocks[start + length + i] - blocks[start + i];
+		}
+	}
+	return windows;
+}
+
+//
+// LoudnessMeter
+//
+
+double LoudnessMeter::Biquad::Run(double x)
+{
+	const auto y = this->b0 * x + this->z1;
+	this->z1 = this->b1 * x - this->a1 * y + this->z2;
+	this->z2 = this->b2 * x - this->a2 * y;
+	return y;
+}
+
+LoudnessMeter::LoudnessMeter(std::uint32_t rate, std::uint8_t channels)
+    : channels{channels},
+      block_frames{std::max<std::uint32_t>(rate / 10, 1)},
+      block_fill{0},
+      oversample{rate < 96000 ? 4u : rate < 192000 ? 2u : 1u},
+      peak{0}
+{
+	Expects(0 < rate);
+	Expects(0 < channels);
+
+	// The K-weighting filters, as in BS.1770 but recalculated for any rate.
+	const auto fs = static_cast<double>(rate);
+
+	const auto shelf_k = std::tan(PI * 1681.974450955533 / fs);
+	const auto shelf_q = 0.7071752369554196;
+	const auto vh = std::pow(10.0, 3.999843853973347 / 20.0);
+	const auto vb = std::pow(vh, 0.4996667741545416);
+	const auto shelf_a0 = 1.0 + shelf_k / shelf_q + shelf_k * shelf_k;
+	const Biquad shelf{(vh + vb * shelf_k / shelf_q + shelf_k * shelf_k) / shelf_a0,
+	                   2.0 * (shelf_k * shelf_k - vh) / shelf_a0,
+	                   (vh - vb * shelf_k / shelf_q + shelf_k * shelf_k) / shelf_a0,
+	                   2.0 * (shelf_k * shelf_k - 1.0) / shelf_a0,
+	                   (1.0 - shelf_k / shelf_q + shelf_k * shelf_k) / shelf_a0,
+	                   0,
+	                   0};
+
+	const auto hp_k = std::tan(PI * 38.13547087602444 / fs);
+	const auto hp_q = 0.5003270373238773;
+	const auto hp_a0 = 1.0 + hp_k / hp_q + hp_k * hp_k;
+	const Biquad high_pass{1.0, -2.0, 1.0, 2.0 * (hp_k * hp_k - 1.0) / hp_a0,
+	                       (1.0 - hp_k / hp_q + hp_k * hp_k) / hp_a0, 0, 0};
+
+	// Surrounds count for more; in 5.1, the LFE doesn't count at all.
+	for (std::uint8_t i = 0; i < channels; i++) {
+		auto weight = 1.0;
+		if (channels == 5 && 3 <= i) weight = 1.41;
+		if (channels == 6) weight = i == 3 ? 0.0 : 4 <= i ? 1.41 : 1.0;
+		this->state.push_back(Channel{shelf, high_pass, weight, std::vector<float>(2 * PEAK_TAPS), 0, 0});
+	}
+
+	this->phases = DesignTruePeakInterpolator(PEAK_TAPS, this->oversample, PhaseLayout::PHASE_MAJOR);
+}
+
+void LoudnessMeter::PeakSample(Channel &ch, float x)
+{
+	// Keeping each sample twice means the last PEAK_TAPS samples are
+	// always contiguous, newest first, without wrapping.
+	ch.history_pos = (ch.history_pos + PEAK_TAPS - 1) % PEAK_TAPS;
+	ch.history[ch.history_pos] = ch.history[ch.history_pos + PEAK_TAPS] = x;
+	const auto *recent = ch.history.data() + ch.history_pos;
+
+	for (std::size_t p = 0; p < this->oversample; p++) {
+		const auto *h = this->phases.data() + p * PEAK_TAPS;
+		float y = 0;
+		for (std::size_t k = 0; k < PEAK_TAPS; k++) y += h[k] * recent[k];
+		this->peak = std::max(this->peak, std::abs(y));
+	}
+	this->peak = std::max(this->peak, std::abs(x));
+}
+
+void LoudnessMeter::Add(gsl::span<const float> samples)
+{
+	const auto frames = static_cast<std::size_t>(samples.size()) / this->channels;
+	const auto *in = samples.data();
+
+	for (std::size_t f = 0; f < frames; f++) {
+		for (auto &ch : this->state) {
+			const auto x = *in++;
+			this->PeakSample(ch, x);
+
+			const auto y = ch.high_pass.Run(ch.shelf.Run(x));
+			ch.energy += y * y;
+		}
+
+		if (++this->block_fill < this->block_frames) continue;
+
+		double energy = 0;
+		for (auto &ch : this->state) {
+			energy += ch.weight * ch.energy;
+			ch.energy = 0;
+		}
+		this->blocks.push_back(energy / this->block_frames);
+		this->block_fill = 0;
+	}
+}
+
+Loudness LoudnessMeter::Result() const
+{
+	constexpr auto ninf = -std::numeric_limits<double>::infinity();
+	const auto absolute = LoudnessToEnergy(ABSOLUTE_GATE);
+
+	const auto momentary = Windows(this->blocks, MOMENTARY_BLOCKS, 1);
+	const auto ungated = GatedMean(momentary, absolute);
+	const auto relative = LoudnessToEnergy(EnergyToLoudness(ungated) + INTEGRATED_RELATIVE_GATE);
+	const auto integrated = GatedMean(momentary, std::max(absolute, relative));
+
+	// The range is the spread between the 10th and 95th percentiles of
+	// short-term loudness, after gating.
+	auto short_term = Windows(this->blocks, SHORT_TERM_BLOCKS, SHORT_TERM_HOP);
+	const auto st_ungated = GatedMean(short_term, absolute);
+	const auto st_gate = std::max(absolute, LoudnessToEnergy(EnergyToLoudness(st_ungated) + RANGE_RELATIVE_GATE));
+	short_term.erase(std::remove_if(short_term.begin(), short_term.end(), [st_gate](double e) { return e <= st_gate; }),
+	                 short_term.end());
+	std::sort(short_term.begin(), short_term.end());
+
+	double range = 0;
+	if (!short_term.empty()) {
+		const auto last = static_cast<double>(short_term.size() - 1);
+		const auto low = short_term[static_cast<std::size_t>(last * 0.10 + 0.5)];
+		const auto high = short_term[static_cast<std::size_t>(last * 0.95 + 0.5)];
+		range = EnergyToLoudness(high) - EnergyToLoudness(low);
+	}
+
+	return Loudness{integrated == 0 ? ninf : EnergyToLoudness(integrated), range,
+	                this->peak == 0 ? ninf : 20.0 * std::log10(static_cast<double>(this->peak))};
+}
+
+//
+// LoudnessTraits
+//
+
+/* static */ std::vector<std::byte> LoudnessTraits::Pack(const Loudness &loudness)
+{
+	std::vector<std::byte> data;
+	AppendPod(data, loudness_cache_version);
+	AppendPod(data, loudness.integrated);
+	AppendPod(data, loudness.range);
+	AppendPod(data, loudness.true_peak);
+	return data;
+}
+
+/* static */ std::optional<Loudness> LoudnessTraits::Unpack(gsl::span<const std::byte> data)
+{
+	std::uint32_t version = 0;
+	Loudness loudness{};
+	if (!ReadPod(data, version) || version != loudness_cache_version) return std::nullopt;
+	if (!ReadPod(data, loudness.integrated) || !ReadPod(data, loudness.range) || !ReadPod(data, loudness.true_peak)) {
+		return std::nullopt;
+	}
+	return loudness;
+}
+
+} // namespace Playd::Audio
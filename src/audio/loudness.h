@@ -0,0 +1,147 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the LoudnessMeter class, and loudness analysis.
+ * @see audio/loudness.cpp
+ */
+
+#ifndef PLAYD_AUDIO_LOUDNESS_H
+#define PLAYD_AUDIO_LOUDNESS_H
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "analysis.h"
+
+namespace Playd::Audio
+{
+/**
+ * The loudness of a piece of audio, as EBU R128 measures it.
+ * Silent audio has an integrated loudness and true peak of -infinity.
+ */
+struct Loudness {
+	double integrated; ///< Integrated (programme) loudness, in LUFS.
+	double range;      ///< Loudness range, in LU.
+	double true_peak;  ///< True (inter-sample) peak, in dBTP.
+};
+
+/**
+ * Measures the loudness of audio fed to it, following ITU-R BS.1770-4 and
+ * EBU Tech 3342.
+ *
+ * The meter keeps the K-weighted energy of every 100ms of audio, so memory
+ * grows (slowly: about 300KiB for a day) with the length measured.
+ */
+class LoudnessMeter
+{
+public:
+	/**
+	 * Constructs a LoudnessMeter.
+	 * @param rate The sample rate of the audio, in Hz.
+	 * @param channels The number of interleaved channels in the audio.
+	 */
+	LoudnessMeter(std::uint32_t rate, std::uint8_t channels);
+
+	/**
+	 * Feeds some audio to the meter.
+	 * @param samples Interleaved samples, in [-1, 1].  Any partial frame at
+	 *   the end is ignored.
+	 */
+	void Add(gsl::span<const float> samples);
+
+	/**
+	 * Measures the audio fed so far.
+	 * Audio short of a whole 100ms block doesn't count towards loudness.
+	 * @return The loudness.
+	 */
+	Loudness Result() const;
+
+private:
+	/// A biquad filter, in transposed direct form II.
+	struct Biquad {
+		double b0, b1, b2, a1, a2; ///< Coefficients, normalised on a0.
+		double z1, z2;             ///< State.
+
+		/**
+		 * Filters one sample.
+		 * @param x The input sample.
+		 * @return The output sample.
+		 */
+		double Run(double x);
+	};
+
+	/// Per-channel filter state.
+	struct Channel {
+		Biquad shelf;                 ///< The K-weighting high shelf.
+		Biquad high_pass;             ///< The K-weighting high-pass.
+		double weight;                ///< BS.1770 channel weight.
+		std::vector<float> history;   ///< Recent input, twice over.
+		std::size_t history_pos;      ///< Where the next input goes.
+		double energy;                ///< Weighted energy this 100ms.
+	};
+
+	std::uint8_t channels;         ///< Number of channels.
+	std::uint32_t block_frames;    ///< Frames in 100ms.
+	std::uint32_t block_fill;      ///< Frames so far this 100ms.
+	std::size_t oversample;        ///< True-peak oversampling factor.
+	std::vector<float> phases;     ///< Interpolation filter, by phase.
+	std::vector<Channel> state;    ///< Per-channel state.
+	std::vector<double> blocks;    ///< Mean energy of each 100ms.
+	float peak;                    ///< Highest (interpolated) |sample|.
+
+	/**
+	 * Feeds one sample to the true-peak interpolator.
+	 * @param ch The channel state.
+	 * @param x The sample.
+	 */
+	void PeakSample(Channel &ch, float x);
+};
+
+/// Describes loudness analysis to Analysis.
+struct LoudnessTraits {
+	using Value = Loudness;      ///< Results are loudnesses.
+	using Meter = LoudnessMeter; ///< Loudness comes from a LoudnessMeter.
+
+	/// The kind of Cache in which results live.
+	static constexpr std::string_view KIND{"loud"};
+
+	/// The name of the counter of analyses run.
+	static constexpr std::string_view ANALYSES_METRIC{"playd_loudness_analyses_total"};
+
+	/// The description of the counter of analyses run.
+	static constexpr std::string_view ANALYSES_HELP{"Loudness analyses run to completion."};
+
+	/// The name of the counter of cache hits.
+	static constexpr std::string_view HITS_METRIC{"playd_loudness_cache_hits_total"};
+
+	/// The description of the counter of cache hits.
+	static constexpr std::string_view HITS_HELP{"Loudness results found in the cache."};
+
+	/**
+	 * Packs a loudness into a cache entry.
+	 * @param loudness The loudness.
+	 * @return The entry.
+	 */
+	static std::vector<std::byte> Pack(const Loudness &loudness);
+
+	/**
+	 * Unpacks a loudness from a cache entry.
+	 * @param data The entry.
+	 * @return The loudness, or nothing if the entry is malformed or outdated.
+	 */
+	static std::optional<Loudness> Unpack(gsl::span<const std::byte> data);
+};
+
+/// A loudness analysis of a file, run in the background.
+using LoudnessAnalysis = Analysis<LoudnessTraits>;
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_LOUDNESS_H
@@ -0,0 +1,386 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Mixer class and its strips.
+ * @see audio/mixer.h
+ */
+
+#include "mixer.h"
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "../errors.h"
+#include "../metrics.h"
+#include "../trace.h"
+#include "dsp.h"
+
+namespace Playd::Audio
+{
+/// @return The gauge of strips feeding all mixers.
+static Gauge &StripGauge()
+{
+	static auto &gauge = Metrics::Global().GetGauge("playd_mixer_strips", "Sources feeding software mixers.");
+	return gauge;
+}
+
+/// @return The gauge of bytes waiting in all strips' ring buffers.
+static Gauge &BufferedGauge()
+{
+	static auto &gauge = Metrics::Global().GetGauge("playd_mixer_buffered_bytes",
+	                                                "Bytes of float audio waiting in strips to be mixed.");
+	return gauge;
+}
+
+//
+// Mixer
+//
+
+Mixer::Mixer(std::uint32_t sample_rate, std::optional<float> ceiling)
+    : sample_rate{sample_rate}, device{nullptr}, scratch(BLOCK_FLOATS), limiter{nullptr}
+{
+	if (ceiling) this->limiter = std::make_unique<Limiter>(sample_rate, CHANNELS, *ceiling);
+}
+
+Mixer::~Mixer()
+{
+	// Closing waits for any running callback to finish.
+	this->device.reset();
+}
+
+void Mixer::Open(const DeviceFn &open, int device_id)
+{
+	Expects(this->device == nullptr);
+
+	const DeviceSpec spec{this->sample_rate, SampleFormat::FLOAT32, CHANNELS, 0};
+	this->device = open(device_id, spec, [this](gsl::span<std::byte> dest) {
+		this->Mix(gsl::span<float>(reinterpret_cast<float *>(dest.data()), dest.size() / sizeof(float)));
+	});
+
+	// The device plays (silence, if nothing else) for as long as we exist.
+	this->device->Pause(false);
+}
+
+std::unique_ptr<Mixer::Strip> Mixer::MakeStrip(const Source &source)
+{
+	return std::make_unique<Strip>(this->shared_from_this(), source);
+}
+
+std::uint32_t Mixer::SampleRate() const
+{
+	return this->sample_rate;
+}
+
+void Mixer::Mix(gsl::span<float> dest)
+{
+	TraceSpan span{TraceEvent::CALLBACK, static_cast<std::uint64_t>(dest.size_bytes())};
+
+	// Make sure anything no strip fills is silence.
+	std::fill(dest.begin(), dest.end(), 0.0f);
+
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+
+		// Mix in blocks no bigger than our scratch space, so that the
+		// audio thread never allocates.
+		for (auto rest = dest; !rest.empty();) {
+			const auto n = std::min(static_cast<size_t>(rest.size()), BLOCK_FLOATS);
+			auto block = rest.first(n);
+
+			// Cued strips must start before anything is mixed, so
+			// that they can come in partway through this block.
+			for (auto *strip : this->strips) strip->StartCued(n / CHANNELS);
+			for (auto *strip : this->strips) strip->MixInto(block, this->scratch);
+			rest = rest.last(rest.size() - n);
+		}
+	}
+
+	// The limiter already keeps everything within its ceiling (which is
+	// at most full scale), and silences NaNs.
+	if (this->limiter) {
+		this->limiter->Process(dest);
+	} else {
+		Clip(dest);
+	}
+}
+
+void Mixer::Add(Strip *strip)
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	this->strips.push_back(strip);
+	StripGauge().Add(1);
+}
+
+void Mixer::Remove(Strip *strip)
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	this->strips.erase(std::remove(this->strips.begin(), this->strips.end(), strip), this->strips.end());
+	StripGauge().Add(-1);
+
+	// Nothing can start a strip that isn't there, and a strip with nothing
+	// to hand over to shouldn't fade out.
+	for (auto *other : this->strips) {
+		if (other->cue != strip) continue;
+		other->cue = nullptr;
+		other->fade.reset();
+	}
+}
+
+//
+// Mixer::Strip
+//
+
+Mixer::Strip::Strip(std::shared_ptr<Mixer> mixer, const Source &source)
+    : mixer{std::move(mixer)},
+      format{source.OutputSampleFormat()},
+      channels{source.ChannelCount()},
+      bytes_per_sample{source.BytesPerSample()},
+      ring_buf{(1U << RINGBUF_POWER) * CHANNELS * sizeof(float), &BufferedGauge()},
+      meter{source.SampleRate()},
+      underruns{},
+      position{0},
+      gain{1.0f},
+      source_out{false},
+      state{Sink::State::STOPPED},
+      cue{nullptr},
+      cue_at{0},
+      start_offset{0}
+{
+	if (this->channels != 1 && this->channels != CHANNELS) {
+		throw ConfigError("can't mix audio with " + std::to_string(this->channels) + " channels");
+	}
+	if (source.SampleRate() != this->mixer->SampleRate()) {
+		throw ConfigError("can't mix " + std::to_string(source.SampleRate()) + "Hz audio into a " +
+		                  std::to_string(this->mixer->SampleRate()) + "Hz mixer");
+	}
+
+	this->mixer->Add(this);
+}
+
+Mixer::Strip::~Strip()
+{
+	this->mixer->Remove(this);
+}
+
+void Mixer::Strip::Start()
+{
+	if (this->state != Sink::State::STOPPED) return;
+	this->state = Sink::State::PLAYING;
+}
+
+void Mixer::Strip::Stop()
+{
+	if (this->state == Sink::State::STOPPED) return;
+	this->state = Sink::State::STOPPED;
+}
+
+Sink::State Mixer::Strip::CurrentState()
+{
+	return this->state;
+}
+
+void Mixer::Strip::SourceOut()
+{
+	// The strip should only be out if the source is.
+	Expects(this->source_out || this->state != Sink::State::AT_END);
+
+	this->source_out = true;
+}
+
+Samples Mixer::Strip::Position()
+{
+	return this->position;
+}
+
+void Mixer::Strip::SetPosition(Samples samples)
+{
+	// The mixer mustn't be reading from the ring while we flush it.
+	std::lock_guard<std::mutex> guard{this->mixer->lock};
+
+	this->position = samples;
+
+	// We might have been at the end of the file previously.
+	// If so, we might not be now, so clear the out flags.
+	this->source_out = false;
+	if (this->state == Sink::State::AT_END) this->state = Sink::State::STOPPED;
+
+	this->ring_buf.Flush();
+
+	// The flush will leave the strip dry until it refills.
+	this->underruns.Disarm();
+}
+
+void Mixer::Strip::SetGain(float new_gain)
+{
+	this->gain = new_gain;
+}
+
+size_t Mixer::Strip::Transfer(const gsl::span<const std::byte> src)
+{
+	// No point transferring 0 bytes.
+	if (src.empty()) return 0;
+
+	// There should be a whole number of samples being transferred.
+	Expects(src.size() % this->bytes_per_sample == 0);
+
+	// Only transfer as many samples as the ring buffer can take.
+	constexpr auto frame_bytes = CHANNELS * sizeof(float);
+	const auto count = std::min(src.size() / this->bytes_per_sample, this->ring_buf.WriteCapacity() / frame_bytes);
+	if (count == 0) return 0;
+
+	this->convert.resize(count * CHANNELS);
+	ToFloat(src.first(count * this->bytes_per_sample), this->format,
+	        gsl::make_span(this->convert).first(count * this->channels));
+
+	// Mono goes to both sides.  Working backwards lets us do this in place.
+	if (this->channels == 1) {
+		for (auto i = count; 0 < i--;) {
+			this->convert[2 * i] = this->convert[2 * i + 1] = this->convert[i];
+		}
+	}
+
+	auto bytes = gsl::as_bytes(gsl::make_span(this->convert));
+	const auto written = this->ring_buf.Write(bytes);
+	// We're the only writer, so the ring can't have filled up under us.
+	Ensures(written == count * frame_bytes);
+
+	return count * this->bytes_per_sample;
+}
+
+std::optional<Levels> Mixer::Strip::TakeLevels()
+{
+	return this->meter.Take();
+}
+
+std::optional<Underrun> Mixer::Strip::TakeUnderrun()
+{
+	return this->underruns.Take();
+}
+
+std::optional<Samples> Mixer::Strip::Buffered()
+{
+	return this->ring_buf.ReadCapacity() / (CHANNELS * sizeof(float));
+}
+
+bool Mixer::Strip::CueCrossfade(Sink *next, Samples at, Samples length, FadeCurve curve)
+{
+	auto *strip = dynamic_cast<Strip *>(next);
+	if (next != nullptr && (strip == nullptr || strip->mixer != this->mixer)) return false;
+	Expects(strip != this);
+
+	std::lock_guard<std::mutex> guard{this->mixer->lock};
+
+	// Whatever was cued before isn't any more.  A crossfade that has
+	// already started is left to finish, though.
+	if (this->cue != nullptr) {
+		this->cue->fade.reset();
+		this->fade.reset();
+	}
+	this->cue = strip;
+	if (strip == nullptr) return true;
+
+	this->cue_at = at;
+	this->fade = Fade{at, length, curve, true};
+	strip->fade = Fade{strip->position, length, curve, false};
+	return true;
+}
+
+void Mixer::Strip::StartCued(size_t frames)
+{
+	if (this->cue == nullptr) return;
+
+	// If we've played out early (eg, the length was an estimate), start the
+	// cued strip straight away.  Otherwise, see if we reach the cue point in
+	// this block, and if so where.
+	const Sink::State state = this->state;
+	if (state == Sink::State::STOPPED) return;
+
+	Samples offset = 0;
+	if (state == Sink::State::PLAYING) {
+		const auto avail = this->ring_buf.ReadCapacity() / (CHANNELS * sizeof(float));
+		if (this->position + std::min(frames, avail) <= this->cue_at) return;
+		if (this->position < this->cue_at) offset = this->cue_at - this->position;
+	}
+
+	this->cue->start_offset = offset;
+	this->cue->Start();
+	this->cue = nullptr;
+}
+
+void Mixer::Strip::MixInto(gsl::span<float> dest, gsl::span<float> scratch)
+{
+	// If we're not supposed to be playing, don't play anything.
+	if (this->state != Sink::State::PLAYING) return;
+
+	// If we've just been started by a cue, we come in partway through.
+	const auto skip = std::min(this->start_offset * CHANNELS, static_cast<size_t>(dest.size()));
+	this->start_offset = 0;
+	dest = dest.last(dest.size() - skip);
+	if (dest.empty()) return;
+
+	// As in DeviceSink, the decoder can only add to what's available, so this
+	// is a safe lower bound.
+	const auto avail = this->ring_buf.ReadCapacity() / sizeof(float);
+	const auto floats = std::min(static_cast<size_t>(dest.size()), avail - avail % CHANNELS);
+	const auto wanted = this->source_out ? floats : static_cast<size_t>(dest.size());
+	this->underruns.Played(this->position, wanted / CHANNELS, floats / CHANNELS);
+	if (floats == 0) {
+		// Is this a temporary condition, or have we genuinely played
+		// out all we can?  If the latter, we're now out too.
+		if (this->source_out) this->state = Sink::State::AT_END;
+		return;
+	}
+
+	auto in = scratch.first(floats);
+	const auto read = this->ring_buf.Read(gsl::as_writeable_bytes(in));
+	Ensures(read == floats * sizeof(float));
+
+	this->meter.Measure(gsl::as_bytes(in), SampleFormat::FLOAT32, CHANNELS);
+	this->MixFrames(dest.first(floats), in);
+	this->position += floats / CHANNELS;
+}
+
+void Mixer::Strip::MixFrames(gsl::span<float> dest, gsl::span<const float> src)
+{
+	const float gain = this->gain;
+	if (!this->fade) {
+		Audio::MixInto(dest, src, gain);
+		return;
+	}
+
+	// Split the frames into those before, during and after the fade.
+	// Fading out, we play at full gain before and are silent after;
+	// fading in, the reverse.
+	const auto &fading = *this->fade;
+	const auto fading_end = fading.start + fading.length;
+	const Samples first = this->position;
+	const auto frames = static_cast<Samples>(src.size() / CHANNELS);
+	Samples done = 0;
+
+	if (first < fading.start) {
+		done = std::min(frames, fading.start - first);
+		if (fading.out) Audio::MixInto(dest.first(done * CHANNELS), src.first(done * CHANNELS), gain);
+	}
+
+	if (done < frames && first + done < fading_end) {
+		const auto n = std::min(frames - done, fading_end - (first + done));
+		const auto step = 1.0f / static_cast<float>(fading.length);
+		const auto t = static_cast<float>(first + done - fading.start) * step;
+		MixFade(dest.subspan(done * CHANNELS, n * CHANNELS), src.subspan(done * CHANNELS, n * CHANNELS), CHANNELS,
+		        gain, fading.curve, fading.out ? 1.0f - t : t, fading.out ? -step : step);
+		done += n;
+	}
+
+	if (done < frames && !fading.out) {
+		Audio::MixInto(dest.last((frames - done) * CHANNELS), src.last((frames - done) * CHANNELS), gain);
+	}
+
+	// Once faded in, a strip is like any other.
+	if (!fading.out && fading_end <= first + frames) this->fade.reset();
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,297 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Mixer class and its inputs.
+ * @see audio/mixer.cpp
+ */
+
+#ifndef PLAYD_AUDIO_MIXER_H
+#define PLAYD_AUDIO_MIXER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "device.h"
+#include "dsp.h"
+#include "levels.h"
+#include "limiter.h"
+#include "ringbuffer.h"
+#include "sample_format.h"
+#include "sink.h"
+#include "source.h"
+#include "underrun.h"
+
+namespace Playd::Audio
+{
+/**
+ * A software mixer, which sums any number of inputs into one output device.
+ *
+ * Each input (a Strip) is a Sink, so a Player can output into a mixer
+ * exactly as it would into a DeviceSink.  Unlike a DeviceSink, though, a
+ * strip doesn't own a device: the mixer opens its device once and keeps it
+ * running, and strips come and go as files are loaded and ejected.  This lets, say, a jingle
+ * play over a music bed on one device.
+ *
+ * Mixing happens in 32-bit float stereo at a fixed sample rate.  Sources
+ * must be mono or stereo at that rate; playd doesn't resample.  The mix can
+ * go through a Limiter on its way out, so that however many strips sum at
+ * once, the device never clips.
+ *
+ * Mixers must be held by std::shared_ptr, as each strip keeps its mixer
+ * alive.
+ */
+class Mixer : public std::enable_shared_from_this<Mixer>
+{
+public:
+	/// The number of channels the mixer outputs.
+	static constexpr std::uint8_t CHANNELS = 2;
+
+	/**
+	 * A Sink that feeds one of a Mixer's inputs, like a channel strip on a
+	 * mixing desk.
+	 *
+	 * Each strip has its own float ring buffer, gain, state and position.
+	 * Its state machine is the same as DeviceSink's.
+	 */
+	class Strip : public Sink
+	{
+	public:
+		/**
+		 * Constructs a Strip.  Use Mixer::MakeStrip instead.
+		 * @param mixer The mixer into which this strip feeds.
+		 * @param source The source from which this strip will receive audio.
+		 * @exception ConfigError if the source's format can't be mixed.
+		 */
+		Strip(std::shared_ptr<Mixer> mixer, const Source &source);
+
+		/// Destructs a Strip, removing it from its mixer.
+		~Strip() override;
+
+		/// Deleted copy constructor.
+		Strip(const Strip &) = delete;
+
+		/// Deleted copy-assignment.
+		Strip &operator=(const Strip &) = delete;
+
+		void Start() override;
+
+		void Stop() override;
+
+		Sink::State CurrentState() override;
+
+		Samples Position() override;
+
+		void SetPosition(Samples samples) override;
+
+		void SourceOut() override;
+
+		size_t Transfer(gsl::span<const std::byte> src) override;
+
+		/**
+		 * @copydoc Sink::TakeLevels
+		 * Strips are metered as mixed, in stereo, but before their own
+		 * gain and fades.
+		 */
+		std::optional<Levels> TakeLevels() override;
+
+		std::optional<Underrun> TakeUnderrun() override;
+
+		std::optional<Samples> Buffered() override;
+
+		/**
+		 * @copydoc Sink::CueCrossfade
+		 * The mixer starts @a next on the exact frame at which this strip
+		 * reaches @a at, so only strips of the same mixer can be cued.
+		 */
+		bool CueCrossfade(Sink *next, Samples at, Samples length, FadeCurve curve) override;
+
+		/**
+		 * Sets the gain applied to this strip when mixing.
+		 * @param gain The linear gain (1 is unity).
+		 */
+		void SetGain(float gain);
+
+	private:
+		friend class Mixer;
+
+		/// n, where 2^n is the capacity of the ring buffer, in frames.
+		static constexpr size_t RINGBUF_POWER = 16;
+
+		/// The mixer into which this strip feeds.
+		std::shared_ptr<Mixer> mixer;
+
+		/// The format of samples from the source.
+		SampleFormat format;
+
+		/// The number of channels the source has (1 or 2).
+		std::uint8_t channels;
+
+		/// Number of bytes in one source sample.
+		size_t bytes_per_sample;
+
+		/// The ring buffer of float frames, awaiting mixing.
+		RingBuffer ring_buf;
+
+		/// Scratch space for converting source samples to float frames.
+		std::vector<float> convert;
+
+		/// Meters each block the strip mixes.
+		LevelMeter meter;
+
+		/// Spots the strip running out of audio mid-file.
+		UnderrunDetector underruns;
+
+		/// The current position, in samples.
+		std::atomic<Samples> position;
+
+		/// The linear gain applied to this strip.
+		std::atomic<float> gain;
+
+		/// Whether the source has run out of things to feed the strip.
+		std::atomic<bool> source_out;
+
+		/// The strip's current state.
+		std::atomic<Sink::State> state;
+
+		/// A fade applied to the strip over a span of its positions.
+		struct Fade {
+			Samples start;   ///< The position at which the fade begins.
+			Samples length;  ///< The length of the fade, in samples.
+			FadeCurve curve; ///< The shape of the fade.
+			bool out;        ///< True if fading out; false if fading in.
+		};
+
+		// The following are guarded by the mixer lock.
+
+		/// The strip's fade, if any.
+		std::optional<Fade> fade;
+
+		/// The strip to start when this one reaches cue_at, if any.
+		Strip *cue;
+
+		/// The position at which to start the cued strip.
+		Samples cue_at;
+
+		/// The number of frames into the next block at which to start.
+		size_t start_offset;
+
+		/**
+		 * Starts the cued strip, if this strip reaches its cue point in
+		 * the next block.
+		 * Called with the mixer lock held.
+		 * @param frames The number of frames in the block.
+		 */
+		void StartCued(size_t frames);
+
+		/**
+		 * Mixes this strip's next frames into a buffer.
+		 * Called with the mixer lock held.
+		 * @param dest The buffer of interleaved stereo frames to mix into.
+		 * @param scratch Scratch space at least as big as @a dest.
+		 */
+		void MixInto(gsl::span<float> dest, gsl::span<float> scratch);
+
+		/**
+		 * Mixes frames just read from the ring buffer, applying the fade.
+		 * Called with the mixer lock held, before the position moves on.
+		 * @param dest The buffer of interleaved stereo frames to mix into.
+		 * @param src The frames; the same size as @a dest.
+		 */
+		void MixFrames(gsl::span<float> dest, gsl::span<const float> src);
+	};
+
+	/**
+	 * Constructs a Mixer without an output device.
+	 * Nothing is heard until Open is called, but Mix still works.
+	 * @param sample_rate The sample rate at which the mixer runs.
+	 * @param ceiling If given, the true peak, as a linear amplitude, past
+	 *   which a Limiter holds the mix.  Strip positions don't account for
+	 *   the limiter's latency.
+	 */
+	explicit Mixer(std::uint32_t sample_rate, std::optional<float> ceiling = std::nullopt);
+
+	/// Destructs a Mixer, closing its device if open.
+	~Mixer();
+
+	/// Deleted copy constructor.
+	Mixer(const Mixer &) = delete;
+
+	/// Deleted copy-assignment.
+	Mixer &operator=(const Mixer &) = delete;
+
+	/**
+	 * Opens an output device, and starts mixing into it.
+	 * The device stays open (and playing, if only silence) until the
+	 * mixer is destroyed.
+	 * @param open The function that opens the device.
+	 * @param device_id The ID of the device.
+	 * @exception ConfigError if the device can't be opened.
+	 */
+	void Open(const DeviceFn &open, int device_id);
+
+	/**
+	 * Makes a new strip (input) into this mixer.
+	 * @param source The source from which this strip will receive audio.
+	 * @return The strip, which stays in the mixer until destroyed.
+	 * @exception ConfigError if the source's format can't be mixed.
+	 */
+	std::unique_ptr<Strip> MakeStrip(const Source &source);
+
+	/**
+	 * Mixes the next frames from every playing strip.
+	 * This is what the device callback does, but can be called directly
+	 * when there is no device (eg, to benchmark).
+	 * @param dest The buffer of interleaved stereo frames to fill.
+	 */
+	void Mix(gsl::span<float> dest);
+
+	/**
+	 * Gets the sample rate at which the mixer runs.
+	 * @return The sample rate, in Hz.
+	 */
+	std::uint32_t SampleRate() const;
+
+private:
+	/// The number of floats mixed at once.
+	static constexpr size_t BLOCK_FLOATS = 4096;
+
+	/// The sample rate at which the mixer runs.
+	std::uint32_t sample_rate;
+
+	/// The device, or nullptr if none is open.
+	std::unique_ptr<Device> device;
+
+	/// Lock over the strips (and their ring buffers' read ends).
+	std::mutex lock;
+
+	/// The strips currently in the mixer.
+	std::vector<Strip *> strips;
+
+	/// Scratch space for each strip's frames while mixing.
+	std::vector<float> scratch;
+
+	/// The limiter on the mix, if any; used only by Mix.
+	std::unique_ptr<Limiter> limiter;
+
+	/**
+	 * Adds a strip to the mixer.
+	 * @param strip The strip.
+	 */
+	void Add(Strip *strip);
+
+	/**
+	 * Removes a strip from the mixer.
+	 * @param strip The strip.
+	 */
+	void Remove(Strip *strip);
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_MIXER_H
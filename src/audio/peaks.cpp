@@ -0,0 +1,198 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the PeakPyramid and PeakMeter classes, and peak analysis.
+ * @see audio/peaks.h
+ */
+
+#include "peaks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include "dsp.h"
+
+namespace Playd::Audio
+{
+/// Version of the cache entry format.
+constexpr std::uint32_t peaks_cache_version{1};
+
+/// The value of a full-scale sample in a PeakPair.
+constexpr float PEAK_SCALE{32767.0f};
+
+/**
+ * Merges two pairs.
+ * @param a One pair.
+ * @param b The other pair.
+ * @return A pair covering both.
+ */
+static PeakPair Merge(PeakPair a, PeakPair b)
+{
+	return PeakPair{std::min(a.low, b.low), std::max(a.high, b.high)};
+}
+
+//
+// PeakPyramid
+//
+
+PeakPyramid::PeakPyramid() : rate{0}, frames{0}, levels{{}}
+{
+}
+
+PeakPyramid::PeakPyramid(std::uint32_t rate, std::uint64_t frames, std::vector<PeakPair> base)
+    : rate{rate}, frames{frames}, levels{std::move(base)}
+{
+	while (1 < this->levels.back().size()) {
+		const auto &below = this->levels.back();
+		std::vector<PeakPair> level((below.size() + 1) / 2);
+		for (std::size_t i = 0; i < level.size(); i++) {
+			const auto j = 2 * i;
+			level[i] = j + 1 < below.size() ? Merge(below[j], below[j + 1]) : below[j];
+		}
+		this->levels.push_back(std::move(level));
+	}
+}
+
+std::uint32_t PeakPyramid::SampleRate() const
+{
+	return this->rate;
+}
+
+std::uint64_t PeakPyramid::Frames() const
+{
+	return this->frames;
+}
+
+const std::vector<PeakPair> &PeakPyramid::Base() const
+{
+	return this->levels.front();
+}
+
+std::vector<PeakPair> PeakPyramid::Range(std::uint64_t start, std::uint64_t end, std::size_t count) const
+{
+	Expects(start < end);
+	Expects(0 < count);
+
+	// Use the coarsest level whose pairs are no wider than the peaks asked
+	// for, so each peak takes in only a couple of pairs.
+	const auto width = static_cast<double>(end - start) / count;
+	std::size_t level = 0;
+	while (level + 1 < this->levels.size() &&
+	       static_cast<double>(std::uint64_t{BASE_FRAMES} << (level + 1)) <= width) {
+		level++;
+	}
+	const auto &pairs = this->levels[level];
+	const auto pair_frames = static_cast<double>(std::uint64_t{BASE_FRAMES} << level);
+
+	std::vector<PeakPair> peaks(count, PeakPair{0, 0});
+	for (std::size_t i = 0; i < count; i++) {
+		const auto first = static_cast<std::size_t>((start + i * width) / pair_frames);
+		const auto last = std::max(first + 1, static_cast<std::size_t>(std::ceil((start + (i + 1) * width) / pair_frames)));
+		if (pairs.size() <= first) break;
+
+		auto peak = pairs[first];
+		for (auto j = first + 1; j < std::min(last, pairs.size()); j++) peak = Merge(peak, pairs[j]);
+		peaks[i] = peak;
+	}
+	return peaks;
+}
+
+//
+// PeakMeter
+//
+
+PeakMeter::PeakMeter(std::uint32_t rate, std::uint8_t channels)
+    : rate{rate},
+      channels{channels},
+      frames{0},
+      fill{0},
+      low{std::numeric_limits<float>::infinity()},
+      high{-std::numeric_limits<float>::infinity()}
+{
+	Expects(0 < channels);
+}
+
+PeakPair PeakMeter::Current() const
+{
+	// A stretch of nothing but NaNs has no peaks to speak of.
+	if (this->high < this->low) return PeakPair{0, 0};
+
+	const auto low = std::clamp(std::floor(this->low * PEAK_SCALE), -PEAK_SCALE, PEAK_SCALE);
+	const auto high = std::clamp(std::ceil(this->high * PEAK_SCALE), -PEAK_SCALE, PEAK_SCALE);
+	return PeakPair{static_cast<std::int16_t>(low), static_cast<std::int16_t>(high)};
+}
+
+void PeakMeter::Add(gsl::span<const float> samples)
+{
+	auto left = static_cast<std::size_t>(samples.size()) / this->channels;
+	this->frames += left;
+
+	auto pos = samples.data();
+	while (0 < left) {
+		const auto take = std::min<std::size_t>(left, PeakPyramid::BASE_FRAMES - this->fill);
+		const auto samples_taken = static_cast<std::ptrdiff_t>(take * this->channels);
+		MinMax(gsl::span<const float>{pos, samples_taken}, this->low, this->high);
+		pos += take * this->channels;
+		left -= take;
+
+		this->fill += static_cast<std::uint32_t>(take);
+		if (this->fill < PeakPyramid::BASE_FRAMES) break;
+
+		this->base.push_back(this->Current());
+		this->fill = 0;
+		this->low = std::numeric_limits<float>::infinity();
+		this->high = -std::numeric_limits<float>::infinity();
+	}
+}
+
+PeakPyramid PeakMeter::Result() const
+{
+	auto base = this->base;
+	if (0 < this->fill) base.push_back(this->Current());
+	return PeakPyramid{this->rate, this->frames, std::move(base)};
+}
+
+//
+// PeakTraits
+//
+
+/* static */ std::vector<std::byte> PeakTraits::Pack(const PeakPyramid &peaks)
+{
+	const auto &base = peaks.Base();
+
+	std::vector<std::byte> data;
+	data.reserve(24 + base.size() * sizeof(PeakPair));
+	AppendPod(data, peaks_cache_version);
+	AppendPod(data, peaks.SampleRate());
+	AppendPod(data, peaks.Frames());
+	AppendPod(data, static_cast<std::uint64_t>(base.size()));
+
+	const auto *bytes = reinterpret_cast<const std::byte *>(base.data());
+	data.insert(data.end(), bytes, bytes + base.size() * sizeof(PeakPair));
+	return data;
+}
+
+/* static */ std::optional<PeakPyramid> PeakTraits::Unpack(gsl::span<const std::byte> data)
+{
+	std::uint32_t version = 0;
+	std::uint32_t rate = 0;
+	std::uint64_t frames = 0;
+	std::uint64_t count = 0;
+	if (!ReadPod(data, version) || version != peaks_cache_version) return std::nullopt;
+	if (!ReadPod(data, rate) || !ReadPod(data, frames) || !ReadPod(data, count)) return std::nullopt;
+	// Check the count against the bytes left, rather than the other way
+	// round, so that a corrupt count can't overflow into a match.
+	const auto size = static_cast<std::uint64_t>(data.size());
+	if (size % sizeof(PeakPair) != 0 || count != size / sizeof(PeakPair)) return std::nullopt;
+
+	std::vector<PeakPair> base(count);
+	std::memcpy(base.data(), data.data(), data.size());
+	return PeakPyramid{rate, frames, std::move(base)};
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,173 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the PeakPyramid and PeakMeter classes, and peak analysis.
+ * @see audio/peaks.cpp
+ */
+
+#ifndef PLAYD_AUDIO_PEAKS_H
+#define PLAYD_AUDIO_PEAKS_H
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "analysis.h"
+
+namespace Playd::Audio
+{
+/**
+ * The lowest and highest samples in a stretch of audio, over all channels,
+ * scaled so that full scale is 32767.
+ */
+struct PeakPair {
+	std::int16_t low;  ///< The lowest sample.
+	std::int16_t high; ///< The highest sample.
+
+	/**
+	 * Compares two PeakPairs for equality.
+	 * @param other The other PeakPair.
+	 * @return Whether the pairs match.
+	 */
+	bool operator==(const PeakPair &other) const
+	{
+		return this->low == other.low && this->high == other.high;
+	}
+};
+
+/**
+ * A waveform overview of a file, as peaks at several resolutions.
+ *
+ * Level 0 has a PeakPair for every BASE_FRAMES frames of the file; each
+ * level above has half as many, each covering two of the level below, up
+ * to a level with just one.  This lets any stretch of the file be drawn at
+ * any width by touching only a few pairs per point drawn.
+ */
+class PeakPyramid
+{
+public:
+	/// Frames covered by each pair in level 0.
+	static constexpr std::uint32_t BASE_FRAMES{256};
+
+	/// Constructs an empty PeakPyramid.
+	PeakPyramid();
+
+	/**
+	 * Constructs a PeakPyramid, building its upper levels.
+	 * @param rate The sample rate of the file.
+	 * @param frames The length of the file, in frames.
+	 * @param base Level 0 of the pyramid.
+	 */
+	PeakPyramid(std::uint32_t rate, std::uint64_t frames, std::vector<PeakPair> base);
+
+	/// @return The sample rate of the file, in Hz.
+	std::uint32_t SampleRate() const;
+
+	/// @return The length of the file, in frames.
+	std::uint64_t Frames() const;
+
+	/// @return Level 0 of the pyramid.
+	const std::vector<PeakPair> &Base() const;
+
+	/**
+	 * Gets peaks for a stretch of the file.
+	 * Peaks past the end of the file are silent.
+	 * @param start The first frame of the stretch.
+	 * @param end The frame after the last frame of the stretch; it must
+	 *   be after @a start.
+	 * @param count The number of peaks into which to divide the stretch.
+	 * @return @a count pairs, each covering (at least) its share of the
+	 *   stretch.
+	 */
+	std::vector<PeakPair> Range(std::uint64_t start, std::uint64_t end, std::size_t count) const;
+
+private:
+	std::uint32_t rate;                       ///< The file's sample rate.
+	std::uint64_t frames;                     ///< The file's length.
+	std::vector<std::vector<PeakPair>> levels; ///< The levels, finest first.
+};
+
+/**
+ * Builds a PeakPyramid from audio fed to it.
+ */
+class PeakMeter
+{
+public:
+	/**
+	 * Constructs a PeakMeter.
+	 * @param rate The sample rate of the audio, in Hz.
+	 * @param channels The number of interleaved channels in the audio.
+	 */
+	PeakMeter(std::uint32_t rate, std::uint8_t channels);
+
+	/**
+	 * Feeds some audio to the meter.
+	 * @param samples Interleaved samples, in [-1, 1].  Any partial frame at
+	 *   the end is ignored.
+	 */
+	void Add(gsl::span<const float> samples);
+
+	/// @return The peaks of the audio fed so far.
+	PeakPyramid Result() const;
+
+private:
+	std::uint32_t rate;         ///< The sample rate.
+	std::uint8_t channels;      ///< The number of channels.
+	std::uint64_t frames;       ///< Frames fed so far.
+	std::uint32_t fill;         ///< Frames so far in the current pair.
+	float low;                  ///< Lowest sample in the current pair.
+	float high;                 ///< Highest sample in the current pair.
+	std::vector<PeakPair> base; ///< The finished pairs.
+
+	/// @return The current pair, as it stands.
+	PeakPair Current() const;
+};
+
+/// Describes peak analysis to Analysis.
+struct PeakTraits {
+	using Value = PeakPyramid; ///< Results are peak pyramids.
+	using Meter = PeakMeter;   ///< Peaks come from a PeakMeter.
+
+	/// The kind of Cache in which results live.
+	static constexpr std::string_view KIND{"peaks"};
+
+	/// The name of the counter of analyses run.
+	static constexpr std::string_view ANALYSES_METRIC{"playd_peaks_analyses_total"};
+
+	/// The description of the counter of analyses run.
+	static constexpr std::string_view ANALYSES_HELP{"Waveform peak analyses run to completion."};
+
+	/// The name of the counter of cache hits.
+	static constexpr std::string_view HITS_METRIC{"playd_peaks_cache_hits_total"};
+
+	/// The description of the counter of cache hits.
+	static constexpr std::string_view HITS_HELP{"Waveform peaks found in the cache."};
+
+	/**
+	 * Packs peaks into a cache entry.
+	 * Only level 0 is stored; the rest is quick to rebuild.
+	 * @param peaks The peaks.
+	 * @return The entry.
+	 */
+	static std::vector<std::byte> Pack(const PeakPyramid &peaks);
+
+	/**
+	 * Unpacks peaks from a cache entry.
+	 * @param data The entry.
+	 * @return The peaks, or nothing if the entry is malformed or outdated.
+	 */
+	static std::optional<PeakPyramid> Unpack(gsl::span<const std::byte> data);
+};
+
+/// A waveform peak analysis of a file, run in the background.
+using PeakAnalysis = Analysis<PeakTraits>;
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_PEAKS_H
@@ -0,0 +1,228 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the PrefetchInput class.
+ * @see audio/prefetch.h
+ */
+
+#include "prefetch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "../errors.h"
+#include "../metrics.h"
+
+namespace Playd::Audio
+{
+/// @return The gauge of bytes buffered across all PrefetchInputs.
+static Gauge &BufferedGauge()
+{
+	static auto &gauge = Metrics::Global().GetGauge("playd_prefetch_buffered_bytes",
+	                                                "Bytes read ahead of the decoder and held in memory.");
+	return gauge;
+}
+
+/// @return The counter of reads that had to wait for the prefetcher.
+static Counter &StallCounter()
+{
+	static auto &counter = Metrics::Global().GetCounter("playd_prefetch_stalls_total",
+	                                                    "Reads that waited for the prefetcher to catch up.");
+	return counter;
+}
+
+PrefetchInput::PrefetchInput(std::unique_ptr<Input> inner, WindowSize window)
+    : Input{inner->Path()},
+      inner{std::move(inner)},
+      start{0},
+      end{0},
+      pos{0},
+      window{std::move(window)},
+      generation{0},
+      published{0},
+      quit{false}
+{
+	this->reader = std::thread{&PrefetchInput::Run, this};
+}
+
+PrefetchInput::~PrefetchInput()
+{
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		this->quit = true;
+	}
+	this->wants.notify_one();
+	this->reader.join();
+
+	BufferedGauge().Add(-this->published);
+}
+
+std::size_t PrefetchInput::Read(gsl::span<std::byte> dest)
+{
+	const auto want = static_cast<std::size_t>(dest.size());
+	const auto length = this->Length();
+	std::size_t done = 0;
+
+	std::unique_lock<std::mutex> guard{this->lock};
+	if (this->pos < this->start || this->end < this->pos) this->Restart();
+
+	while (done < want && this->pos < length) {
+		if (this->end <= this->pos) {
+			if (this->error) throw FileError(*this->error);
+
+			StallCounter().Add();
+			this->has.wait(guard, [this] { return this->pos < this->end || this->error; });
+			continue;
+		}
+
+		// Copy out of whichever chunks overlap the position.
+		auto chunk_start = this->start;
+		for (const auto &chunk : this->chunks) {
+			const auto chunk_end = chunk_start + chunk.size();
+			if (this->pos < chunk_end) {
+				const auto offset = static_cast<std::size_t>(this->pos - chunk_start);
+				const auto count = std::min(chunk.size() - offset, want - done);
+				std::copy_n(chunk.begin() + offset, count, dest.begin() + done);
+				this->pos += count;
+				done += count;
+				if (done == want) break;
+			}
+			chunk_start = chunk_end;
+		}
+
+		this->Trim();
+		this->wants.notify_one();
+	}
+
+	return done;
+}
+
+std::uint64_t PrefetchInput::Seek(std::int64_t offset, int whence)
+{
+	// This takes the lock itself (through Tell), so do it first.
+	const auto target = this->SeekTarget(offset, whence);
+
+	std::lock_guard<std::mutex> guard{this->lock};
+	this->pos = target;
+
+	// We don't restart on seeks outside the window until the next read,
+	// as decoders often seek around before settling on a position.
+	if (this->start <= this->pos && this->pos <= this->end) this->Trim();
+	return this->pos;
+}
+
+std::uint64_t PrefetchInput::Tell() const
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	return this->pos;
+}
+
+std::uint64_t PrefetchInput::Length() const
+{
+	return this->inner->Length();
+}
+
+gsl::span<const std::byte> PrefetchInput::Head() const
+{
+	return this->inner->Head();
+}
+
+void PrefetchInput::Prefetch(std::uint64_t offset, std::uint64_t length)
+{
+	// Prefetch hints never read, so they're safe to pass on while the
+	// background thread is using the inner Input.
+	this->inner->Prefetch(offset, length);
+}
+
+std::uint64_t PrefetchInput::Buffered() const
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	return this->pos < this->end ? this->end - this->pos : 0;
+}
+
+void PrefetchInput::Run()
+{
+	const auto length = this->Length();
+	auto inner_pos = this->inner->Tell();
+
+	std::unique_lock<std::mutex> guard{this->lock};
+	while (!this->quit) {
+		if (this->error || this->IsFull()) {
+			this->wants.wait(guard);
+			continue;
+		}
+
+		const auto from = this->end;
+		const auto generation = this->generation;
+
+		// Don't hold the lock while reading: this is the bit that can
+		// take hundreds of milliseconds on a network filesystem.
+		guard.unlock();
+		std::vector<std::byte> chunk(static_cast<std::size_t>(std::min<std::uint64_t>(CHUNK_SIZE, length - from)));
+		std::optional<std::string> failure;
+		try {
+			if (inner_pos != from) this->inner->Seek(static_cast<std::int64_t>(from), SEEK_SET);
+			chunk.resize(this->inner->Read(chunk));
+			inner_pos = from + chunk.size();
+			if (chunk.empty()) failure = "unexpected end of " + this->path;
+		} catch (FileError &e) {
+			failure = std::string{e.Message()};
+			inner_pos = this->inner->Tell();
+		}
+		guard.lock();
+
+		// If the window was restarted while we were reading, this chunk
+		// is no longer wanted.
+		if (generation != this->generation) continue;
+
+		if (failure) {
+			this->error = failure;
+		} else {
+			this->chunks.push_back(std::move(chunk));
+			this->end += this->chunks.back().size();
+			this->Trim();
+		}
+		this->has.notify_all();
+	}
+}
+
+bool PrefetchInput::IsFull() const
+{
+	if (this->Length() <= this->end) return true;
+
+	// If the position has moved out of the window, wait for the next read
+	// to restart it rather than reading data that won't be wanted.
+	if (this->pos < this->start || this->end < this->pos) return true;
+
+	// Always keep at least some data past the position, even if the window
+	// is tiny, so that reads waiting on us make progress.
+	return this->pos < this->end && this->window->load(std::memory_order_relaxed) <= this->end - this->pos;
+}
+
+void PrefetchInput::Trim()
+{
+	while (!this->chunks.empty() && this->start + this->chunks.front().size() <= this->pos) {
+		this->start += this->chunks.front().size();
+		this->chunks.pop_front();
+	}
+
+	const auto buffered = static_cast<std::int64_t>(this->pos < this->end ? this->end - this->pos : 0);
+	BufferedGauge().Add(buffered - this->published);
+	this->published = buffered;
+}
+
+void PrefetchInput::Restart()
+{
+	this->chunks.clear();
+	this->start = this->end = this->pos;
+	this->generation++;
+	this->error.reset();
+	this->Trim();
+	this->wants.notify_one();
+}
+
+} // namespace Playd::Audio
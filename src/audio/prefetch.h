@@ -0,0 +1,129 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the PrefetchInput class.
+ * @see audio/prefetch.cpp
+ */
+
+#ifndef PLAYD_AUDIO_PREFETCH_H
+#define PLAYD_AUDIO_PREFETCH_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "input.h"
+
+namespace Playd::Audio
+{
+/**
+ * An Input that reads ahead of its reader on a background thread.
+ *
+ * A PrefetchInput keeps up to a 'window' of bytes, starting at the current
+ * position, in memory.  Reads inside the window never touch the underlying
+ * Input, so a decoder reading from a slow filesystem (such as NFS) only
+ * stalls if the filesystem stalls for longer than the window lasts.
+ *
+ * Seeking outside the window throws the window away and starts filling it
+ * again from the new position; the next read then waits for the refill.
+ *
+ * The amount of data buffered across all PrefetchInputs is published as the
+ * 'playd_prefetch_buffered_bytes' metric.
+ */
+class PrefetchInput : public Input
+{
+public:
+	/// The size of each read the background thread makes.
+	static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+	/**
+	 * Type of window sizes, in bytes.
+	 * These are shared, so that whoever made a PrefetchInput can resize its
+	 * window after handing it on (for example, once a Source has worked out
+	 * how many bytes of the file make up a second of audio).
+	 */
+	using WindowSize = std::shared_ptr<std::atomic<std::uint64_t>>;
+
+	/**
+	 * Constructs a PrefetchInput, and starts reading ahead.
+	 * @param inner The Input to read ahead from.  Once it is passed here,
+	 *   only the background thread reads from it.
+	 * @param window The size of the window.  Changes to it take effect
+	 *   the next time the PrefetchInput is read.
+	 */
+	PrefetchInput(std::unique_ptr<Input> inner, WindowSize window);
+
+	/// Destructs a PrefetchInput, stopping its background thread.
+	~PrefetchInput() override;
+
+	std::size_t Read(gsl::span<std::byte> dest) override;
+
+	std::uint64_t Seek(std::int64_t offset, int whence) override;
+
+	std::uint64_t Tell() const override;
+
+	std::uint64_t Length() const override;
+
+	gsl::span<const std::byte> Head() const override;
+
+	void Prefetch(std::uint64_t offset, std::uint64_t length) override;
+
+	/**
+	 * Gets the number of bytes currently buffered ahead of the position.
+	 * @return The number of bytes.
+	 */
+	std::uint64_t Buffered() const;
+
+private:
+	std::unique_ptr<Input> inner; ///< The Input being read ahead.
+	std::thread reader;           ///< The background reading thread.
+
+	mutable std::mutex lock;       ///< Guards everything below.
+	std::condition_variable wants; ///< Signals the reader to read more.
+	std::condition_variable has;   ///< Signals Read that data arrived.
+
+	std::deque<std::vector<std::byte>> chunks; ///< The buffered data.
+	std::uint64_t start;                       ///< Offset of chunks.front().
+	std::uint64_t end;                         ///< Offset past chunks.back().
+	std::uint64_t pos;                         ///< The reader-facing position.
+	WindowSize window;                         ///< The window size.
+	std::uint64_t generation;                  ///< Bumped on discarding chunks.
+	std::int64_t published;                    ///< Our share of the metric.
+	std::optional<std::string> error;          ///< A read error, if any.
+	bool quit;                                 ///< Whether to stop reading.
+
+	/// The body of the background thread.
+	void Run();
+
+	/**
+	 * Gets whether the buffer has reached the window or the end of file.
+	 * The caller must hold the lock.
+	 * @return Whether the background thread has nothing to do.
+	 */
+	bool IsFull() const;
+
+	/**
+	 * Drops chunks behind the position, and updates the fill metric.
+	 * The caller must hold the lock.
+	 */
+	void Trim();
+
+	/**
+	 * Discards all buffered data and restarts buffering at the position.
+	 * The caller must hold the lock.
+	 */
+	void Restart();
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_PREFETCH_H
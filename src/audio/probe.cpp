@@ -0,0 +1,108 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of audio format sniffing.
+ * @see audio/probe.h
+ */
+
+#include "probe.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif // _WIN32
+
+namespace Playd::Audio
+{
+/**
+ * Checks whether a span of bytes has the given ASCII text at an offset.
+ * @param head The span to check.
+ * @param offset The offset at which the text should appear.
+ * @param text The text.
+ * @return Whether the text appears at @a offset.
+ */
+static bool HasTextAt(gsl::span<const std::byte> head, std::size_t offset, std::string_view text)
+{
+	if (static_cast<std::size_t>(head.size()) < offset + text.size()) return false;
+	return std::equal(text.cbegin(), text.cend(), head.begin() + offset,
+	                  [](char c, std::byte b) { return static_cast<std::byte>(c) == b; });
+}
+
+/**
+ * Checks whether a span of bytes starts with a plausible MPEG audio frame
+ * header (layer I, II or III; not AAC, which shares the sync word).
+ * @param head The span to check.
+ * @return Whether the span starts with an MPEG audio frame header.
+ */
+static bool HasMpegSync(gsl::span<const std::byte> head)
+{
+	if (head.size() < 3) return false;
+	const auto b0 = std::to_integer<std::uint8_t>(head[0]);
+	const auto b1 = std::to_integer<std::uint8_t>(head[1]);
+	const auto b2 = std::to_integer<std::uint8_t>(head[2]);
+
+	if (b0 != 0xFF || (b1 & 0xE0) != 0xE0) return false; // sync word
+	if (((b1 >> 3) & 0x3) == 0x1) return false;           // reserved version
+	if (((b1 >> 1) & 0x3) == 0x0) return false;           // reserved layer (AAC)
+	if ((b2 >> 4) == 0xF) return false;                   // bad bitrate
+	if (((b2 >> 2) & 0x3) == 0x3) return false;           // reserved rate
+	return true;
+}
+
+/**
+ * Gets the total size of an ID3v2 tag at the start of a span.
+ * @param head The span to check.
+ * @return The size of the tag, including its header and any footer; or 0 if
+ *   there is no tag.
+ */
+static std::size_t Id3Size(gsl::span<const std::byte> head)
+{
+	if (!HasTextAt(head, 0, "ID3") || head.size() < 10) return 0;
+
+	// The size is 'synchsafe': four 7-bit bytes, most significant first.
+	std::size_t size = 0;
+	for (std::size_t i = 6; i < 10; i++) size = (size << 7) | (std::to_integer<std::size_t>(head[i]) & 0x7F);
+
+	const auto has_footer = (std::to_integer<std::uint8_t>(head[5]) & 0x10) != 0;
+	return 10 + size + (has_footer ? 10 : 0);
+}
+
+std::string_view SniffFormat(gsl::span<const std::byte> head)
+{
+	if (HasTextAt(head, 0, "fLaC")) return "flac";
+	if (HasTextAt(head, 0, "OggS")) return "ogg";
+	if ((HasTextAt(head, 0, "RIFF") || HasTextAt(head, 0, "RF64")) && HasTextAt(head, 8, "WAVE")) return "wav";
+	if (HasTextAt(head, 0, "FORM") && (HasTextAt(head, 8, "AIFF") || HasTextAt(head, 8, "AIFC"))) return "aiff";
+	if (HasMpegSync(head)) return "mp3";
+
+	// ID3v2 tags mostly front MP3s, but can front other formats too, so
+	// look at what comes after the tag if we can.  If the tag is too big
+	// for the head to reach past it, MP3 is by far the best guess.
+	if (const auto id3_size = Id3Size(head); 0 < id3_size) {
+		if (static_cast<std::size_t>(head.size()) <= id3_size) return "mp3";
+		const auto after = SniffFormat(head.last(head.size() - id3_size));
+		return after.empty() ? "mp3" : after;
+	}
+
+	return "";
+}
+
+bool IsStream(std::string_view path)
+{
+	if (path == "-") return true;
+
+#ifndef _WIN32
+	struct stat st {};
+	if (stat(std::string{path}.c_str(), &st) == 0) return S_ISFIFO(st.st_mode);
+#endif // _WIN32
+
+	return false;
+}
+
+} // namespace Playd::Audio
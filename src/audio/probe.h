@@ -0,0 +1,43 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of audio format sniffing.
+ * @see audio/probe.cpp
+ */
+
+#ifndef PLAYD_AUDIO_PROBE_H
+#define PLAYD_AUDIO_PROBE_H
+
+#include <string_view>
+
+#undef max
+#include <gsl/gsl>
+
+namespace Playd::Audio
+{
+/**
+ * Works out the format of an audio file from the bytes at its start.
+ *
+ * The format names returned are the same as the file extensions conventionally
+ * used for each format ("mp3", "wav", "flac", "ogg", "aiff"), so that callers
+ * can use one lookup table for both sniffed formats and extensions.
+ *
+ * @param head The first bytes of the file (see Input::Head).
+ * @return The name of the format, or an empty string if it is unrecognised.
+ */
+std::string_view SniffFormat(gsl::span<const std::byte> head);
+
+/**
+ * Works out whether a path names a stream, rather than a file.
+ * Streams are standard input (given as '-') and named pipes (FIFOs); they
+ * can only be read once, from start to end, so can't be sniffed.
+ * @param path The path to check.
+ * @return Whether @a path is a stream.
+ */
+bool IsStream(std::string_view path);
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_PROBE_H
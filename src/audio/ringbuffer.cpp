@@ -34,7 +34,7 @@ namespace Playd::Audio
                       write capacity may be lower than actual
       - always atomically read capacities */
 
-RingBuffer::RingBuffer(size_t capacity) : buffer(capacity), count{0}
+RingBuffer::RingBuffer(size_t capacity, Gauge *fill) : buffer(capacity), count{0}, fill{fill}
 {
 	this->r_it = this->buffer.cbegin();
 	this->w_it = this->buffer.begin();
@@ -47,6 +47,11 @@ RingBuffer::RingBuffer(size_t capacity) : buffer(capacity), count{0}
 	Ensures(WriteCapacity() == capacity);
 }
 
+RingBuffer::~RingBuffer()
+{
+	if (this->fill != nullptr) this->fill->Add(-static_cast<std::int64_t>(this->ReadCapacity()));
+}
+
 inline size_t RingBuffer::ReadCapacity() const
 {
 	/* Acquire order here means two things:
@@ -119,6 +124,7 @@ size_t RingBuffer::Write(const gsl::span<const std::byte> src)
 	 * it, this needs to be acquire-release.
 	 */
 	this->count.fetch_add(write_count, std::memory_order_acq_rel);
+	if (this->fill != nullptr) this->fill->Add(static_cast<std::int64_t>(write_count));
 
 	Ensures(write_start_count + write_end_count == write_count);
 	return write_count;
@@ -167,6 +173,7 @@ size_t RingBuffer::Read(gsl::span<std::byte> dest)
 
 	if (this->count.fetch_sub(read_count, std::memory_order_acq_rel) < read_count)
 		throw InternalError("capacity decreased unexpectedly");
+	if (this->fill != nullptr) this->fill->Add(-static_cast<std::int64_t>(read_count));
 
 	Ensures(read_start_count + read_end_count == read_count);
 	return read_count;
@@ -185,7 +192,8 @@ void RingBuffer::Flush()
 
 inline void RingBuffer::FlushInner()
 {
-	this->count.store(0, std::memory_order_release);
+	const auto flushed = this->count.exchange(0, std::memory_order_acq_rel);
+	if (this->fill != nullptr) this->fill->Add(-static_cast<std::int64_t>(flushed));
 }
 
 } // namespace Playd::Audio
@@ -16,6 +16,8 @@
 #undef max
 #include <gsl/gsl>
 
+#include "../metrics.h"
+
 namespace Playd::Audio
 {
 /**
@@ -30,11 +32,13 @@ public:
 	/**
 	 * Constructs a Ring_buffer.
 	 * @param capacity The capacity of the ring buffer, in bytes.
+	 * @param fill If given, a gauge to which the ring buffer adds the bytes
+	 *   it holds, as they come and go.
 	 */
-	explicit RingBuffer(size_t capacity);
+	explicit RingBuffer(size_t capacity, Gauge *fill = nullptr);
 
-	/// Destructs a Ring_buffer.
-	~RingBuffer() = default;
+	/// Destructs a Ring_buffer, taking what it holds back off its gauge.
+	~RingBuffer();
 
 	/// Deleted copy constructor.
 	RingBuffer(const RingBuffer &) = delete;
@@ -101,6 +105,8 @@ private:
 	std::atomic<size_t> count; ///< The current read capacity.
 	// Write capacity is the total buffer capacity minus count.
 
+	Gauge *fill; ///< The gauge of bytes held, if any.
+
 	std::mutex r_lock; ///< The read lock.
 	std::mutex w_lock; ///< The write lock.
 };
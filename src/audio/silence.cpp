@@ -0,0 +1,117 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the SilenceMeter class, and silence analysis.
+ * @see audio/silence.h
+ */
+
+#include "silence.h"
+
+#include <chrono>
+#include <cstdint>
+
+#include "dsp.h"
+
+namespace Playd::Audio
+{
+/// Version of the cache entry format.
+constexpr std::uint32_t silence_cache_version{1};
+
+/**
+ * Converts a count of frames into a position.
+ * @param frames The count of frames.
+ * @param rate The sample rate, in Hz.
+ * @return The position.
+ */
+static std::chrono::microseconds FramesToMicros(std::uint64_t frames, std::uint32_t rate)
+{
+	if (rate == 0) return std::chrono::microseconds{0};
+
+	// Split to avoid overflow on long files.
+	const auto seconds = frames / rate;
+	const auto rest = frames % rate;
+	return std::chrono::seconds{seconds} + std::chrono::microseconds{rest * 1000000 / rate};
+}
+
+//
+// Cues
+//
+
+std::chrono::microseconds Cues::In() const
+{
+	return FramesToMicros(this->in, this->rate);
+}
+
+std::chrono::microseconds Cues::Out() const
+{
+	return FramesToMicros(this->out, this->rate);
+}
+
+//
+// SilenceMeter
+//
+
+SilenceMeter::SilenceMeter(std::uint32_t rate, std::uint8_t channels)
+    : rate{rate}, channels{channels}, frames{0}, heard{false}, in{0}, out{0}
+{
+	Expects(0 < channels);
+}
+
+void SilenceMeter::Add(gsl::span<const float> samples)
+{
+	const auto frame_count = static_cast<std::size_t>(samples.size()) / this->channels;
+	samples = samples.first(frame_count * this->channels);
+
+	// Until we hear something, each block is searched forwards for the
+	// cue-in.  Whatever we find, the last loud sample in the block is the
+	// cue-out so far.
+	if (!this->heard) {
+		const auto first = FirstAbove(samples, SILENCE_THRESHOLD);
+		if (first < static_cast<std::size_t>(samples.size())) {
+			this->heard = true;
+			this->in = this->frames + first / this->channels;
+		}
+	}
+	if (this->heard) {
+		const auto last = LastAbove(samples, SILENCE_THRESHOLD);
+		if (0 < last) this->out = this->frames + (last - 1) / this->channels + 1;
+	}
+
+	this->frames += frame_count;
+}
+
+Cues SilenceMeter::Result() const
+{
+	return Cues{this->rate, this->in, this->out};
+}
+
+//
+// SilenceTraits
+//
+
+/* static */ std::vector<std::byte> SilenceTraits::Pack(const Cues &cues)
+{
+	std::vector<std::byte> data;
+	AppendPod(data, silence_cache_version);
+	AppendPod(data, SilenceMeter::SILENCE_THRESHOLD);
+	AppendPod(data, cues.rate);
+	AppendPod(data, cues.in);
+	AppendPod(data, cues.out);
+	return data;
+}
+
+/* static */ std::optional<Cues> SilenceTraits::Unpack(gsl::span<const std::byte> data)
+{
+	std::uint32_t version = 0;
+	float threshold = 0;
+	Cues cues{};
+	if (!ReadPod(data, version) || version != silence_cache_version) return std::nullopt;
+	// Cues found with a different idea of silence are out of date.
+	if (!ReadPod(data, threshold) || threshold != SilenceMeter::SILENCE_THRESHOLD) return std::nullopt;
+	if (!ReadPod(data, cues.rate) || !ReadPod(data, cues.in) || !ReadPod(data, cues.out)) return std::nullopt;
+	return cues;
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,131 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the SilenceMeter class, and silence analysis.
+ * @see audio/silence.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SILENCE_H
+#define PLAYD_AUDIO_SILENCE_H
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "analysis.h"
+
+namespace Playd::Audio
+{
+/**
+ * Where the sound in a file starts and stops, once any leading and trailing
+ * silence is cut off.
+ *
+ * A file that is silent throughout has its cue-in and cue-out both at 0.
+ */
+struct Cues {
+	std::uint32_t rate; ///< The file's sample rate, in Hz.
+	std::uint64_t in;   ///< The first frame louder than silence.
+	std::uint64_t out;  ///< The frame after the last frame louder than silence.
+
+	/// @return Whether the file is silent throughout.
+	bool Silent() const
+	{
+		return this->out <= this->in;
+	}
+
+	/// @return The cue-in, as a position in the file.
+	std::chrono::microseconds In() const;
+
+	/// @return The cue-out, as a position in the file.
+	std::chrono::microseconds Out() const;
+};
+
+/**
+ * Finds the cue points of audio fed to it.
+ *
+ * Anything with a sample over SILENCE_THRESHOLD (-60dBFS), in any channel,
+ * counts as sound.  The meter keeps nothing but the two cue points, and
+ * looks at most samples only once: after the cue-in, each block is only
+ * searched backwards from its end, which stops at the first loud sample.
+ */
+class SilenceMeter
+{
+public:
+	/// The level, as a fraction of full scale, above which samples count as sound.
+	static constexpr float SILENCE_THRESHOLD{0.001f};
+
+	/**
+	 * Constructs a SilenceMeter.
+	 * @param rate The sample rate of the audio, in Hz.
+	 * @param channels The number of interleaved channels in the audio.
+	 */
+	SilenceMeter(std::uint32_t rate, std::uint8_t channels);
+
+	/**
+	 * Feeds some audio to the meter.
+	 * @param samples Interleaved samples, in [-1, 1].  Any partial frame at
+	 *   the end is ignored.
+	 */
+	void Add(gsl::span<const float> samples);
+
+	/// @return The cue points of the audio fed so far.
+	Cues Result() const;
+
+private:
+	std::uint32_t rate;    ///< The sample rate.
+	std::uint8_t channels; ///< The number of channels.
+	std::uint64_t frames;  ///< Frames fed so far.
+	bool heard;            ///< Whether anything has been louder than silence.
+	std::uint64_t in;      ///< The cue-in, once heard.
+	std::uint64_t out;     ///< The cue-out so far, once heard.
+};
+
+/// Describes silence analysis to Analysis.
+struct SilenceTraits {
+	using Value = Cues;         ///< Results are cue points.
+	using Meter = SilenceMeter; ///< Cue points come from a SilenceMeter.
+
+	/// The kind of Cache in which results live.
+	static constexpr std::string_view KIND{"cues"};
+
+	/// The name of the counter of analyses run.
+	static constexpr std::string_view ANALYSES_METRIC{"playd_silence_analyses_total"};
+
+	/// The description of the counter of analyses run.
+	static constexpr std::string_view ANALYSES_HELP{"Leading and trailing silence analyses run to completion."};
+
+	/// The name of the counter of cache hits.
+	static constexpr std::string_view HITS_METRIC{"playd_silence_cache_hits_total"};
+
+	/// The description of the counter of cache hits.
+	static constexpr std::string_view HITS_HELP{"Cue points found in the cache."};
+
+	/**
+	 * Packs cue points into a cache entry.
+	 * @param cues The cue points.
+	 * @return The entry.
+	 */
+	static std::vector<std::byte> Pack(const Cues &cues);
+
+	/**
+	 * Unpacks cue points from a cache entry.
+	 * @param data The entry.
+	 * @return The cue points, or nothing if the entry is malformed or
+	 *   outdated.
+	 */
+	static std::optional<Cues> Unpack(gsl::span<const std::byte> data);
+};
+
+/// An analysis of a file's leading and trailing silence, run in the background.
+using SilenceAnalysis = Analysis<SilenceTraits>;
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_SILENCE_H
@@ -10,12 +10,13 @@
 #include "sink.h"
 
 #include <algorithm>
-#include <array>
 #include <cassert>
-#include <string>
+#include <optional>
 
 #include "../errors.h"
-#include "SDL.h"
+#include "../metrics.h"
+#include "../trace.h"
+#include "device.h"
 #include "ringbuffer.h"
 #include "sample_format.h"
 #include "source.h"
@@ -31,103 +32,90 @@ Sink::State Sink::CurrentState()
 	return Sink::State::NONE;
 }
 
-//
-// SDLSink
-//
-
-/* static */ const std::array<SDL_AudioFormat, SAMPLE_FORMAT_COUNT> SDLSink::formats{{
-        AUDIO_U8,  // UINT8
-        AUDIO_S8,  // SINT8
-        AUDIO_S16, // SINT16
-        AUDIO_S32, // SINT32
-        AUDIO_F32  // FLOAT32
-}};
-
-/**
- * The callback used by SDL_Audio.
- * Trampolines back into vsink, which must point to an Sdl_audio_sink.
- */
-static void SDLCallback(void *vsink, unsigned char *data, int len)
+bool Sink::CueCrossfade(Sink *, Samples, Samples, FadeCurve)
 {
-	Expects(vsink != nullptr);
-	Expects(data != nullptr);
-
-	auto sink = static_cast<SDLSink *>(vsink);
-	sink->Callback(gsl::span<std::byte>(reinterpret_cast<std::byte *>(data), len));
+	return false;
 }
 
-SDLSink::SDLSink(const Audio::Source &source, int device_id)
-    : bytes_per_sample{source.BytesPerSample()},
-      ring_buf{(1U << RINGBUF_POWER) * source.BytesPerSample()},
-      position_sample_count{0},
-      source_out{false},
-      state{Sink::State::STOPPED}
+std::optional<Levels> Sink::TakeLevels()
 {
-	auto name = SDL_GetAudioDeviceName(device_id, 0);
-	if (name == nullptr) {
-		throw ConfigError(std::string("invalid device id: ") + std::to_string(device_id));
-	}
-
-	SDL_AudioSpec want;
-	SDL_zero(want);
-	want.freq = source.SampleRate();
-	want.format = formats[static_cast<int>(source.OutputSampleFormat())];
-	want.channels = source.ChannelCount();
-	want.callback = &SDLCallback;
-	want.userdata = static_cast<void *>(this);
-
-	SDL_AudioSpec have;
-	SDL_zero(have);
+	return std::nullopt;
+}
 
-	this->device = SDL_OpenAudioDevice(name, 0, &want, &have, 0);
-	if (this->device == 0) {
-		throw ConfigError(std::string("couldn't open device: ") + SDL_GetError());
-	}
+std::optional<Underrun> Sink::TakeUnderrun()
+{
+	return std::nullopt;
 }
 
-SDLSink::~SDLSink()
+std::optional<Samples> Sink::Buffered()
 {
-	if (this->device == 0) return;
+	return std::nullopt;
+}
+
+//
+// DeviceSink
+//
 
-	// Silence any currently playing audio.
-	SDL_PauseAudioDevice(this->device, SDL_TRUE);
-	SDL_CloseAudioDevice(this->device);
+/// @return The gauge of bytes waiting in all DeviceSinks' ring buffers.
+static Gauge &BufferedGauge()
+{
+	static auto &gauge = Metrics::Global().GetGauge("playd_sink_buffered_bytes",
+	                                                "Bytes decoded and waiting in sinks for the audio device.");
+	return gauge;
 }
 
-/* static */ void SDLSink::InitLibrary()
+DeviceSink::DeviceSink(const Audio::Source &source, int device_id, const DeviceFn &open)
+    : bytes_per_sample{source.BytesPerSample()},
+      format{source.OutputSampleFormat()},
+      channels{source.ChannelCount()},
+      meter{source.SampleRate()},
+      underruns{},
+      ring_buf{(1U << (source.IsLive() ? LIVE_RINGBUF_POWER : RINGBUF_POWER)) * source.BytesPerSample(),
+               &BufferedGauge()},
+      position_sample_count{0},
+      seek{NO_SEEK},
+      clock{source.SampleRate()},
+      latency{0},
+      last_position{0},
+      source_out{false},
+      state{Sink::State::STOPPED}
 {
-	if (SDL_Init(SDL_INIT_AUDIO) != 0) {
-		throw ConfigError(std::string("could not initialise SDL: ") + SDL_GetError());
-	}
+	// Otherwise, let the device pick a buffer size that suits it.
+	const std::uint16_t block = source.IsLive() ? LIVE_DEVICE_SAMPLES : 0;
+	const DeviceSpec spec{source.SampleRate(), this->format, this->channels, block};
+
+	this->device = open(device_id, spec, [this](gsl::span<std::byte> dest) { this->Callback(dest); });
+	this->latency = this->device->Latency();
 }
 
-/* static */ void SDLSink::CleanupLibrary()
+DeviceSink::~DeviceSink()
 {
-	SDL_Quit();
+	// The device must go before anything its callback touches.
+	this->device.reset();
 }
 
-void SDLSink::Start()
+void DeviceSink::Start()
 {
 	if (this->state != Sink::State::STOPPED) return;
 
-	SDL_PauseAudioDevice(this->device, 0);
+	this->device->Pause(false);
 	this->state = Sink::State::PLAYING;
 }
 
-void SDLSink::Stop()
+void DeviceSink::Stop()
 {
 	if (this->state == Sink::State::STOPPED) return;
 
-	SDL_PauseAudioDevice(this->device, 1);
+	this->device->Pause(true);
 	this->state = Sink::State::STOPPED;
 }
 
-Sink::State SDLSink::CurrentState()
+Sink::State DeviceSink::CurrentState()
 {
 	return this->state;
 }
 
-void SDLSink::SourceOut()
+void DeviceSink::SourceOut()
 {
 	// The sink should only be out if the source is.
 	Expects(this->source_out || this->state != Sink::State::AT_END);
@@ -135,14 +123,33 @@ void SDLSink::SourceOut()
 	this->source_out = true;
 }
 
-uint64_t SDLSink::Position()
+uint64_t DeviceSink::Position()
 {
-	return this->position_sample_count;
+	// Until the callback picks up a new position, that's where we are.
+	const auto sought = this->seek.load(std::memory_order_acquire);
+	if (sought != NO_SEEK) return sought;
+
+	// When stopped, everything handed to the device counts as played, as
+	// it always does for devices that don't play in real time.
+	Samples position = 0;
+	if (this->state == Sink::State::PLAYING && this->device->IsRealTime()) {
+		position = this->clock.Estimate(SampleClock::Clock::now(), this->latency);
+	} else {
+		const auto reading = this->clock.Read();
+		position = reading.position + reading.frames;
+	}
+
+	// Callbacks come a little early or late, which would otherwise make
+	// the estimate wobble backwards across block boundaries.
+	this->last_position = std::max(this->last_position, position);
+	return this->last_position;
 }
 
-void SDLSink::SetPosition(uint64_t samples)
+void DeviceSink::SetPosition(uint64_t samples)
 {
-	this->position_sample_count = samples;
+	// The callback owns the position, so hand the new one over.
+	this->seek.store(samples, std::memory_order_release);
+	this->last_position = samples;
 
 	// We might have been at the end of the file previously.
 	// If so, we might not be now, so clear the out flags.
@@ -157,7 +164,7 @@ void SDLSink::SetPosition(uint64_t samples)
 	this->ring_buf.Flush();
 }
 
-size_t SDLSink::Transfer(const gsl::span<const std::byte> src)
+size_t DeviceSink::Transfer(const gsl::span<const std::byte> src)
 {
 	// No point transferring 0 bytes.
 	if (src.empty()) return 0;
@@ -183,12 +190,28 @@ size_t SDLSink::Transfer(const gsl::span<const std::byte> src)
 	return written_count;
 }
 
-void SDLSink::Callback(gsl::span<std::byte> dest)
+void DeviceSink::Callback(gsl::span<std::byte> dest)
 {
 	Expects(0 <= dest.size());
 
 	// How many bytes do we want to pull out of the ring buffer?
 	const auto req_bytes = static_cast<size_t>(dest.size());
+	TraceSpan span{TraceEvent::CALLBACK, req_bytes};
+
+	const auto now = SampleClock::Clock::now();
+	auto sought = this->seek.load(std::memory_order_acquire);
+	if (sought != NO_SEEK) {
+		// The ring was flushed, so give it a chance to refill.
+		this->position_sample_count = sought;
+		this->underruns.Disarm();
+
+		// Position reports the seek until it's cleared, and the clock
+		// after, so the clock must be at the new position first; else
+		// Position could catch the old one in between and latch it.
+		// If another seek came in meanwhile, leave it for next time.
+		this->clock.Publish(sought, 0, now);
+		this->seek.compare_exchange_strong(sought, NO_SEEK, std::memory_order_acq_rel);
+	}
 
 	// Make sure anything not filled up with sound later is set to silence.
 	// This is slightly inefficient (two writes to sound-filled regions
@@ -196,9 +219,12 @@ void SDLSink::Callback(gsl::span<std::byte> dest)
 	std::fill(dest.begin(), dest.end(), std::byte{0});
 
 	// If we're not supposed to be playing, don't play anything.
-	if (this->state != Sink::State::PLAYING) return;
+	if (this->state != Sink::State::PLAYING) {
+		this->clock.Publish(this->position_sample_count, 0, now);
+		return;
+	}
 
-	// Let's find out how many bytes are available in total to give SDL.
+	// Let's find out how many bytes are available in total to give the device.
 	//
 	// Note: Since we run concurrently with the decoder, which is also
 	// trying to modify the read capacity of the ringbuf (by adding
@@ -215,12 +241,17 @@ void SDLSink::Callback(gsl::span<std::byte> dest)
 		// out all we can?  If the latter, we're now out too.
 		if (this->source_out) this->state = Sink::State::AT_END;
 
+		// If it's temporary, the listener hears a dropout.
+		const auto wanted = this->source_out ? 0 : req_bytes / this->bytes_per_sample;
+		this->underruns.Played(this->position_sample_count, wanted, 0);
+
 		// Don't even bother reading from the ring buffer.
+		this->clock.Publish(this->position_sample_count, 0, now);
 		return;
 	}
 
 	// Of the bytes available, how many do we need?  Send this amount to
-	// SDL.
+	// the device.
 	auto bytes = std::min(req_bytes, avail_bytes);
 	// We should be asking for a whole number of samples.
 	assert(bytes % bytes_per_sample == 0);
@@ -231,29 +262,28 @@ void SDLSink::Callback(gsl::span<std::byte> dest)
 	assert(read_bytes % this->bytes_per_sample == 0);
 	auto read_samples = read_bytes / this->bytes_per_sample;
 
+	this->meter.Measure(dest.first(read_bytes), this->format, this->channels);
+
+	const auto wanted = this->source_out ? read_samples : req_bytes / this->bytes_per_sample;
+	this->underruns.Played(this->position_sample_count, wanted, read_samples);
+
+	this->clock.Publish(this->position_sample_count, read_samples, now);
 	this->position_sample_count += read_samples;
 }
 
-/* static */ std::vector<std::pair<int, std::string>> SDLSink::GetDevicesInfo()
+std::optional<Levels> DeviceSink::TakeLevels()
 {
-	std::vector<std::pair<int, std::string>> list;
-
-	// The 0 in SDL_GetNumAudioDevices tells SDL we want playback devices.
-	const auto is = SDL_GetNumAudioDevices(0);
-	for (auto i = 0; i < is; i++) {
-		auto n = SDL_GetAudioDeviceName(i, 0);
-		if (n != nullptr) list.emplace_back(i, std::string(n));
-	}
-
-	return list;
+	return this->meter.Take();
 }
 
-/* static */ bool SDLSink::IsOutputDevice(int id)
+std::optional<Underrun> DeviceSink::TakeUnderrun()
 {
-	const auto ids = SDL_GetNumAudioDevices(0);
+	return this->underruns.Take();
+}
 
-	// See comment in GetDevicesInfo for why this is sufficient.
-	return 0 <= id && id < ids;
+std::optional<Samples> DeviceSink::Buffered()
+{
+	return this->ring_buf.ReadCapacity() / this->bytes_per_sample;
 }
 
 } // namespace Playd::Audio
@@ -3,24 +3,27 @@
 
 /**
  * @file
- * Declaration of the Sink and Sdl_sink classes.
+ * Declaration of the Sink and DeviceSink classes.
  * @see audio/audio.cpp
  */
 
 #ifndef PLAYD_AUDIO_SINK_H
 #define PLAYD_AUDIO_SINK_H
 
-#include <array>
+#include <atomic>
 #include <cstdint>
+#include <limits>
 #include <memory>
-#include <string>
-#include <utility>
-#include <vector>
+#include <optional>
 
-#include "SDL.h"
+#include "clock.h"
+#include "device.h"
+#include "dsp.h"
+#include "levels.h"
 #include "ringbuffer.h"
 #include "sample_format.h"
 #include "source.h"
+#include "underrun.h"
 
 namespace Playd::Audio
 {
@@ -100,27 +103,79 @@ public:
 	 * @return The number of bytes transferred.
 	 */
 	virtual size_t Transfer(gsl::span<const std::byte> src) = 0;
+
+	/**
+	 * Cues another sink to start when this one reaches a given position,
+	 * and crossfades between the two.
+	 *
+	 * This sink fades out, and @a next fades in, over the @a length
+	 * samples from @a at.  Only sinks sharing an output can do this; the
+	 * default implementation can't, and does nothing.
+	 *
+	 * @param next The sink to start, or nullptr to cancel any cue not yet
+	 *   reached.
+	 * @param at The position, in samples, at which @a next starts.
+	 * @param length The length of the crossfade, in samples.
+	 * @param curve The shape of both fades.
+	 * @return Whether the crossfade was cued (or cancelled).
+	 */
+	virtual bool CueCrossfade(Sink *next, Samples at, Samples length, FadeCurve curve);
+
+	/**
+	 * Takes the levels of the audio played since the last call.
+	 * The default implementation doesn't meter, and returns nothing.
+	 * @return The levels, or nothing if none are ready.
+	 * @see LevelMeter
+	 */
+	virtual std::optional<Levels> TakeLevels();
+
+	/**
+	 * Takes the oldest underrun not yet taken.
+	 * The default implementation doesn't detect underruns, and returns
+	 * nothing.
+	 * @return The underrun, or nothing if there are none.
+	 * @see UnderrunDetector
+	 */
+	virtual std::optional<Underrun> TakeUnderrun();
+
+	/**
+	 * Gets how much audio the sink holds that the device hasn't yet had.
+	 * While playing, this is how long the sink could go without a Transfer.
+	 * The default implementation doesn't know, and returns nothing.
+	 * @return The number of frames buffered, or nothing if unknown.
+	 */
+	virtual std::optional<Samples> Buffered();
 };
 
 /**
- * An output stream for audio, using SDL.
+ * An output stream for audio, through a Device.
  *
- * An Sdl_audio_sink consists of an SDL output device and a buffer that stores
- * decoded samples from the Audio object.  While active, the Sdl_audio_sink
- * periodically transfers samples from its buffer to SDL2 in a separate thread.
+ * A DeviceSink consists of a Device and a ring buffer that stores decoded
+ * samples from the Source.  While playing, the device's callback takes
+ * samples from the ring in a separate thread, at the rate the device plays
+ * them; which device that is (SDL, or one paced by a clock) makes no
+ * difference to the sink.
  */
-class SDLSink : public Sink
+class DeviceSink : public Sink
 {
 public:
 	/**
-	 * Constructs an Sdl_audio_sink.
+	 * Constructs a DeviceSink.
 	 * @param source The source from which this sink will receive audio.
 	 * @param device_id The device ID to which this sink will output.
+	 * @param open The function that opens the device.
+	 * @exception ConfigError if the device can't be opened.
 	 */
-	SDLSink(const Source &source, int device_id);
+	DeviceSink(const Source &source, int device_id, const DeviceFn &open = SDLDevice::Open);
+
+	/// Destructs a DeviceSink, closing its device.
+	~DeviceSink() override;
+
+	/// Deleted copy constructor.
+	DeviceSink(const DeviceSink &) = delete;
 
-	/// Destructs an Sdl_audio_sink.
-	~SDLSink() override;
+	/// Deleted copy-assignment.
+	DeviceSink &operator=(const DeviceSink &) = delete;
 
 	void Start() override;
 
@@ -128,6 +183,12 @@ public:
 
 	Sink::State CurrentState() override;
 
+	/**
+	 * @copydoc Sink::Position
+	 * While playing, this interpolates between callbacks from the
+	 * SampleClock, and allows for the device's buffer, so it is accurate
+	 * to well under a millisecond and moves smoothly.
+	 */
 	Samples Position() override;
 
 	void SetPosition(Samples samples) override;
@@ -136,58 +197,75 @@ public:
 
 	size_t Transfer(gsl::span<const std::byte> src) override;
 
+	std::optional<Levels> TakeLevels() override;
+
+	std::optional<Underrun> TakeUnderrun() override;
+
+	std::optional<Samples> Buffered() override;
+
 	/**
 	 * The audio callback.
-	 * This is executed in a separate thread by SDL once a stream is
-	 * playing with the callback registered to it.
+	 * This is executed in a separate thread by the device once a stream is
+	 * playing.
 	 * @param dest The output span to which our samples should be written.
 	 */
 	void Callback(gsl::span<std::byte> dest);
 
-	/**
-	 * Gets the number and name of each output device entry in the
-	 * AudioSystem.
-	 * @return List of output devices, as strings.
-	 */
-	static std::vector<std::pair<int, std::string>> GetDevicesInfo();
-
-	/**
-	 * Can a sound device output sound?
-	 * @param id Device ID.
-	 * @return If the device can handle outputting sound.
-	 */
-	static bool IsOutputDevice(int id);
-
-	/// Initialises the AudioSink's libraries, if not initialised already.
-	static void InitLibrary();
-
-	/// Cleans up the AudioSink's libraries, if not cleaned up already.
-	static void CleanupLibrary();
-
 private:
-	/// The SDL device to which we are outputting sound.
-	SDL_AudioDeviceID device;
-
 	/// n, where 2^n is the capacity of the Audio ring buffer.
 	static constexpr size_t RINGBUF_POWER = 16;
 
-	/// Mapping from SampleFormats to their equivalent SDL_AudioFormats.
-	static const std::array<SDL_AudioFormat, SAMPLE_FORMAT_COUNT> formats;
+	/// n, where 2^n is the capacity of the ring buffer for live sources.
+	/// Everything in the ring is latency for a live source, so keep it small.
+	static constexpr size_t LIVE_RINGBUF_POWER = 12;
+
+	/// The device buffer size, in samples, for live sources.
+	static constexpr std::uint16_t LIVE_DEVICE_SAMPLES = 1024;
 
 	/// Number of bytes in one sample.
 	size_t bytes_per_sample;
 
+	/// The format of samples from the source.
+	SampleFormat format;
+
+	/// The number of channels the source has.
+	std::uint8_t channels;
+
+	/// Meters each block the callback plays.
+	LevelMeter meter;
+
+	/// Spots the callback running out of audio mid-file.
+	UnderrunDetector underruns;
+
 	/// The ring buffer used to transfer samples to the playing callback.
 	RingBuffer ring_buf;
 
-	/// The current position, in samples.
+	/// Marks there being no new position for the callback to pick up.
+	static constexpr Samples NO_SEEK = std::numeric_limits<Samples>::max();
+
+	/// The position of the next sample the callback plays; callback only.
 	Samples position_sample_count;
 
+	/// A new position for the callback to pick up, or NO_SEEK.
+	std::atomic<Samples> seek;
+
+	/// Where the callback has got to, for Position to interpolate from.
+	SampleClock clock;
+
+	/// Frames the device holds between the callback and the speaker.
+	Samples latency;
+
+	/// The last position reported, which never goes backwards unless set.
+	Samples last_position;
+
 	/// Whether the source has run out of things to feed the sink.
 	bool source_out;
 
 	/// The decoder's current state.
 	Sink::State state;
+
+	/// The device; opened last, as its callback uses everything above.
+	std::unique_ptr<Device> device;
 };
 
 } // namespace Playd::Audio
@@ -30,6 +30,16 @@ std::string_view Source::Path() const
 	return this->path;
 }
 
+bool Source::IsLive() const
+{
+	return false;
+}
+
+bool Source::IsReady() const
+{
+	return true;
+}
+
 Samples Source::SamplesFromMicros(std::chrono::microseconds micros) const
 {
 	// The sample rate is expressed in terms of samples per second, so we
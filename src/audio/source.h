@@ -20,6 +20,12 @@
 
 namespace Playd::Audio
 {
+/// What a Source is being opened for.
+enum class SourceUse : std::uint8_t {
+	PLAYBACK, ///< Playing, where seeks and lengths should be exact.
+	ANALYSIS  ///< Decoding from start to end, once, in the background.
+};
+
 /**
  * An object responsible for decoding an audio file.
  *
@@ -118,6 +124,24 @@ public:
 	 */
 	virtual std::string_view Path() const;
 
+	/**
+	 * Gets whether this source is decoding a live stream, rather than a
+	 * file.  Live sources have no known length (Length returns 0), can't
+	 * seek, and want sinks to buffer as little as possible.
+	 * @return Whether this source is live; by default, false.
+	 */
+	virtual bool IsLive() const;
+
+	/**
+	 * Gets whether this source is ready to play.  Most sources are ready
+	 * once built; a live stream only once it has started, and its format
+	 * is known.  Until then, only Path and Decode (which decodes nothing)
+	 * may be called.
+	 * @return Whether this source is ready; by default, true.
+	 * @exception FileError if the source won't ever be ready.
+	 */
+	virtual bool IsReady() const;
+
 	/**
 	 * Converts a position in microseconds to an elapsed sample count.
 	 * @param micros The song position, in microseconds.
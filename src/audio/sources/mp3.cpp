@@ -7,19 +7,26 @@
  * @see audio/sources/mp3.h
  */
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <cstdio>
+#include <functional>
 #include <gsl/gsl>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
+#include <thread>
 
 // We don't include mpg123.h directly here, because mp3.h does some polyfills
 // before including it.
 
+#include "../../cache.h"
 #include "../../errors.h"
+#include "../../log.h"
 #include "../../messages.h"
+#include "../input.h"
 #include "../sample_format.h"
 #include "../source.h"
 #include "mp3.h"
@@ -30,6 +37,13 @@ namespace Playd::Audio
 constexpr int mp3_requested_encodings{MPG123_ENC_UNSIGNED_8 | MPG123_ENC_SIGNED_8 | MPG123_ENC_SIGNED_16 |
                                       MPG123_ENC_SIGNED_32 | MPG123_ENC_FLOAT_32};
 
+/// The version of the frame index cache format; bump on changing it.
+constexpr std::uint32_t mp3_index_version{1};
+
+/// The amount by which the scanner's frame index grows when it fills up.
+/// mpg123 would otherwise thin the index out, making seeks less direct.
+constexpr long mp3_index_growth{4096};
+
 SampleFormat SampleFormatOfMpg123(int encoding)
 {
 	// This switch should range over the encodings listed above.
@@ -53,7 +67,65 @@ SampleFormat SampleFormatOfMpg123(int encoding)
 	}
 }
 
-MP3Source::MP3Source(std::string_view path) : Source{path}, buffer{}, context{nullptr}
+/// The reader state that MP3Source hands to mpg123.
+struct MP3Reader {
+	Input *input;                       ///< The input being read.
+	const std::atomic<bool> *cancelled; ///< If not null, whether to give up.
+};
+
+/// mpg123 read callback for MP3Readers.
+static ssize_t MP3Read(void *handle, void *buf, size_t count)
+{
+	auto reader = static_cast<MP3Reader *>(handle);
+	assert(reader != nullptr);
+
+	// Failing the read is the only way we have to stop mpg123_scan early.
+	if (reader->cancelled != nullptr && reader->cancelled->load(std::memory_order_relaxed)) return -1;
+
+	try {
+		const auto nread = reader->input->Read(gsl::make_span(static_cast<std::byte *>(buf), count));
+		return static_cast<ssize_t>(nread);
+	} catch (FileError &e) {
+		PLAYD_LOG(ERROR) << "mp3: read failed:" << e.Message();
+		return -1;
+	}
+}
+
+/// mpg123 seek callback for MP3Readers.
+static off_t MP3Seek(void *handle, off_t offset, int whence)
+{
+	auto reader = static_cast<MP3Reader *>(handle);
+	assert(reader != nullptr);
+
+	try {
+		return static_cast<off_t>(reader->input->Seek(offset, whence));
+	} catch (FileError &e) {
+		PLAYD_LOG(ERROR) << "mp3: seek failed:" << e.Message();
+		return -1;
+	}
+}
+
+/**
+ * Points an mpg123 context at an MP3Reader.
+ * @param context The mpg123 context.
+ * @param reader The reader, which must outlive the context's use of it.
+ * @return Whether mpg123 accepted the reader.
+ */
+static bool MP3OpenReader(mpg123_handle *context, MP3Reader &reader)
+{
+	return mpg123_replace_reader_handle(context, MP3Read, MP3Seek, nullptr) == MPG123_OK &&
+	       mpg123_open_handle(context, &reader) == MPG123_OK;
+}
+
+MP3Source::MP3Source(std::string_view path, std::unique_ptr<Input> input, SourceUse use)
+    : Source{path},
+      buffer{},
+      context{nullptr},
+      input{input == nullptr ? Input::Open(path) : std::move(input)},
+      reader{},
+      index_cache{Cache::Default("mp3idx")},
+      scan_cancelled{false},
+      scan_done{false}
 {
 	this->context = mpg123_new(nullptr, nullptr);
 	mpg123_format_none(this->context);
@@ -61,13 +133,21 @@ MP3Source::MP3Source(std::string_view path) : Source{path}, buffer{}, context{nu
 	auto rates = AvailableRates();
 	std::for_each(std::begin(rates), std::end(rates), std::bind(&MP3Source::AddFormat, this, std::placeholders::_1));
 
-	if (mpg123_open(this->context, this->path.c_str()) == MPG123_ERR) {
+	this->reader = std::make_unique<MP3Reader>(MP3Reader{this->input.get(), nullptr});
+	if (!MP3OpenReader(this->context, *this->reader)) {
 		throw FileError("mp3: can't open " + this->path + ": " + mpg123_strerror(this->context));
 	}
+
+	// Analyses only ever decode straight through, so an index (and a
+	// whole-file scan to build one) would be wasted on them.
+	if (use == SourceUse::PLAYBACK) this->StartIndexing();
 }
 
 MP3Source::~MP3Source()
 {
+	this->scan_cancelled.store(true, std::memory_order_relaxed);
+	if (this->scanner.joinable()) this->scanner.join();
+
 	mpg123_delete(this->context);
 	this->context = nullptr;
 }
@@ -76,9 +156,135 @@ std::uint64_t MP3Source::Length() const
 {
 	assert(this->context != nullptr);
 
+	if (this->exact_length) return *this->exact_length;
 	return mpg123_length(this->context);
 }
 
+void MP3Source::StartIndexing()
+{
+	try {
+		this->identity = FileIdentity::Of(this->path);
+	} catch (FileError &e) {
+		// We can still scan, but we can't cache the result.
+		PLAYD_LOG(WARNING) << "mp3: not caching index:" << e.Message();
+	}
+
+	if (this->identity) {
+		if (auto data = this->index_cache.Load(*this->identity); data) {
+			if (auto index = UnpackIndex(*data); index) {
+				this->ApplyIndex(*index);
+				return;
+			}
+		}
+	}
+
+	this->scanner = std::thread{&MP3Source::ScanIndex, this};
+}
+
+void MP3Source::ScanIndex()
+{
+	this->scanned = BuildIndex(this->path, this->scan_cancelled);
+	if (this->scanned && this->identity) {
+		this->index_cache.Store(*this->identity, PackIndex(*this->scanned));
+	}
+
+	this->scan_done.store(true, std::memory_order_release);
+}
+
+/* static */ std::optional<MP3Source::Index> MP3Source::BuildIndex(const std::string &path,
+                                                                  const std::atomic<bool> &cancelled)
+{
+	// The scanner needs its own position in the file, and so its own Input.
+	std::unique_ptr<Input> input;
+	try {
+		input = Input::Open(path);
+	} catch (FileError &e) {
+		PLAYD_LOG(WARNING) << "mp3: can't scan:" << e.Message();
+		return std::nullopt;
+	}
+	MP3Reader reader{input.get(), &cancelled};
+
+	std::optional<Index> index;
+
+	// mpg123 contexts aren't thread-safe, so we can't share the decoding
+	// one; this one only ever parses frames, and never decodes them.
+	auto scan = mpg123_new(nullptr, nullptr);
+	if (scan != nullptr) {
+		mpg123_param(scan, MPG123_INDEX_SIZE, -mp3_index_growth, 0.0);
+
+		if (MP3OpenReader(scan, reader) && mpg123_scan(scan) == MPG123_OK) {
+			off_t *offsets = nullptr;
+			off_t step = 0;
+			size_t fill = 0;
+			const auto length = mpg123_length(scan);
+			if (mpg123_index(scan, &offsets, &step, &fill) == MPG123_OK && 0 <= length) {
+				index = Index{step, {offsets, offsets + fill}, static_cast<std::uint64_t>(length)};
+			}
+		} else if (!cancelled.load(std::memory_order_relaxed)) {
+			PLAYD_LOG(WARNING) << "mp3: index scan failed:" << mpg123_strerror(scan);
+		}
+
+		mpg123_delete(scan);
+	}
+
+	return index;
+}
+
+void MP3Source::ApplyScannedIndex()
+{
+	if (!this->scanner.joinable()) return;
+	if (!this->scan_done.load(std::memory_order_acquire)) return;
+
+	// The scanner has already finished, so this won't block.
+	this->scanner.join();
+	if (this->scanned) this->ApplyIndex(*this->scanned);
+	this->scanned.reset();
+}
+
+void MP3Source::ApplyIndex(const Index &index)
+{
+	assert(this->context != nullptr);
+
+	std::vector<off_t> offsets{index.offsets.begin(), index.offsets.end()};
+	if (mpg123_set_index(this->context, offsets.data(), index.step, offsets.size()) != MPG123_OK) {
+		PLAYD_LOG(WARNING) << "mp3: can't set index:" << mpg123_strerror(this->context);
+		return;
+	}
+
+	this->exact_length = index.length;
+	PLAYD_LOG(DEBUG) << "mp3: indexed" << offsets.size() << "frames, length" << index.length;
+}
+
+/* static */ std::vector<std::byte> MP3Source::PackIndex(const Index &index)
+{
+	std::vector<std::byte> data;
+	AppendPod(data, mp3_index_version);
+	AppendPod(data, index.step);
+	AppendPod(data, index.length);
+	AppendPod(data, static_cast<std::uint64_t>(index.offsets.size()));
+	for (const auto offset : index.offsets) AppendPod(data, offset);
+	return data;
+}
+
+/* static */ std::optional<MP3Source::Index> MP3Source::UnpackIndex(gsl::span<const std::byte> data)
+{
+	std::uint32_t version = 0;
+	Index index{};
+	std::uint64_t count = 0;
+	if (!ReadPod(data, version) || version != mp3_index_version) return std::nullopt;
+	if (!ReadPod(data, index.step) || !ReadPod(data, index.length) || !ReadPod(data, count)) return std::nullopt;
+	if (index.step <= 0) return std::nullopt;
+
+	// Check the count against the bytes left, rather than the other way
+	// round, so that a corrupt count can't overflow into a match.
+	const auto size = static_cast<std::uint64_t>(data.size());
+	if (size % sizeof(std::int64_t) != 0 || count != size / sizeof(std::int64_t)) return std::nullopt;
+
+	index.offsets.resize(count);
+	for (auto &offset : index.offsets) ReadPod(data, offset);
+	return index;
+}
+
 /* static */ gsl::span<const long> MP3Source::AvailableRates()
 {
 	const long *rawrates = nullptr;
@@ -89,7 +295,7 @@ std::uint64_t MP3Source::Length() const
 
 void MP3Source::AddFormat(long rate)
 {
-	Debug() << "trying to enable formats at " << rate << std::endl;
+	PLAYD_LOG(DEBUG) << "mp3: trying to enable formats at" << rate;
 
 	// The requested encodings correspond to the sample formats available in
 	// the SampleFormat enum.
@@ -97,7 +303,7 @@ void MP3Source::AddFormat(long rate)
 		// Ignore the error for now -- another sample rate may be
 		// available.
 		// If no sample rates work, loading a file will fail anyway.
-		Debug() << "can't support" << rate << std::endl;
+		PLAYD_LOG(DEBUG) << "mp3: can't support" << rate;
 	};
 }
 
@@ -129,15 +335,16 @@ std::uint32_t MP3Source::SampleRate() const
 std::uint64_t MP3Source::Seek(std::uint64_t in_samples)
 {
 	assert(this->context != nullptr);
+	this->ApplyScannedIndex();
 
 	// Have we tried to seek past the end of the file?
-	if (auto clen = static_cast<unsigned long>(mpg123_length(this->context)); clen < in_samples) {
-		Debug() << "mp3: seek at" << in_samples << "past EOF at" << clen << std::endl;
+	if (auto clen = this->Length(); clen < in_samples) {
+		PLAYD_LOG(WARNING) << "mp3: seek at" << in_samples << "past EOF at" << clen;
 		throw SeekError{MSG_SEEK_FAIL};
 	}
 
 	if (mpg123_seek(this->context, in_samples, SEEK_SET) == MPG123_ERR) {
-		Debug() << "mp3: seek failed:" << mpg123_strerror(this->context) << std::endl;
+		PLAYD_LOG(ERROR) << "mp3: seek failed:" << mpg123_strerror(this->context);
 		throw SeekError{MSG_SEEK_FAIL};
 	}
 
@@ -150,6 +357,7 @@ std::uint64_t MP3Source::Seek(std::uint64_t in_samples)
 MP3Source::DecodeResult MP3Source::Decode()
 {
 	assert(this->context != nullptr);
+	this->ApplyScannedIndex();
 
 	auto buf = reinterpret_cast<unsigned char *>(&this->buffer.front());
 	size_t rbytes = 0;
@@ -161,7 +369,7 @@ MP3Source::DecodeResult MP3Source::Decode()
 	if (err == MPG123_DONE) {
 		decode_state = DecodeState::END_OF_FILE;
 	} else if (err != MPG123_OK && err != MPG123_NEW_FORMAT) {
-		Debug() << "mp3: decode error:" << mpg123_strerror(this->context) << std::endl;
+		PLAYD_LOG(ERROR) << "mp3: decode error:" << mpg123_strerror(this->context);
 		decode_state = DecodeState::END_OF_FILE;
 	} else {
 		// Copy only the bit of the buffer occupied by decoded data
@@ -182,10 +390,10 @@ SampleFormat MP3Source::OutputSampleFormat() const
 	return SampleFormatOfMpg123(encoding);
 }
 
-std::unique_ptr<MP3Source> MP3Source::MakeUnique(std::string_view path)
+std::unique_ptr<MP3Source> MP3Source::MakeUnique(std::string_view path, std::unique_ptr<Input> input, SourceUse use)
 {
 	// This is in a separate function to let it be put into a jump table.
-	return std::make_unique<MP3Source, std::string_view>(std::move(path));
+	return std::make_unique<MP3Source>(path, std::move(input), use);
 }
 
 } // namespace Playd::Audio
@@ -11,21 +11,36 @@
 #define PLAYD_AUDIO_SOURCES_MP3_H
 #ifdef WITH_MP3
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 extern "C" {
 #include <mpg123.h>
 }
 
+#include "../../cache.h"
+#include "../input.h"
 #include "../sample_format.h"
 #include "../source.h"
 
 namespace Playd::Audio
 {
-/// Audio source for use on MP3 files.
+struct MP3Reader;
+
+/**
+ * Audio source for use on MP3 files.
+ *
+ * mpg123 can only seek quickly and accurately, and report an exact length, once
+ * it knows where every frame in the file lies.  VBR files without a Xing/TOC
+ * header don't tell it this up front, so MP3Source builds a full frame index by
+ * scanning the file on a background thread after loading.  The index is cached
+ * on disk, so that subsequent loads of the same file have it immediately.
+ */
 class MP3Source : public Source
 {
 public:
@@ -33,17 +48,25 @@ public:
 	 * Constructs an Mp3_audio_source.
 	 * @param path The path to the file to load and decode using this
 	 *   decoder.
+	 * @param input An Input already open on @a path, or nullptr to open
+	 *   one here.
+	 * @param use What the source is for; only sources for playback build
+	 *   (or load) a frame index, as nothing else seeks.
 	 */
-	explicit MP3Source(std::string_view path);
+	MP3Source(std::string_view path, std::unique_ptr<Input> input, SourceUse use = SourceUse::PLAYBACK);
 
 	/// Destructs an Mp3AudioSource.
-	~MP3Source();
+	~MP3Source() override;
 
 	DecodeResult Decode() override;
 
 	std::uint64_t Seek(std::uint64_t position) override;
 
-	/// The length of the audio, in samples.
+	/**
+	 * The length of the audio, in samples.
+	 * This is exact once the frame index is available, and an estimate
+	 * before then.
+	 */
 	std::uint64_t Length() const override;
 
 	std::uint8_t ChannelCount() const override;
@@ -56,9 +79,13 @@ public:
 	 * Constructs an Mp3_audio_source and returns a unique pointer to it.
 	 * @param path The path to the file to load and decode using this
 	 *   decoder.
+	 * @param input An Input already open on @a path, or nullptr to open
+	 *   one here.
+	 * @param use What the source is for.
 	 * @returns A unique pointer to a Mp3_audio_source.
 	 */
-	static std::unique_ptr<MP3Source> MakeUnique(std::string_view path);
+	static std::unique_ptr<MP3Source> MakeUnique(std::string_view path, std::unique_ptr<Input> input,
+	                                             SourceUse use = SourceUse::PLAYBACK);
 
 private:
 	// This value is somewhat arbitrary, but corresponds to the minimum
@@ -70,6 +97,40 @@ private:
 	/// Pointer to the mpg123 context associated with this source.
 	mpg123_handle *context;
 
+	/// The input from which mpg123 reads the file.
+	std::unique_ptr<Input> input;
+
+	/// The reader state mpg123 holds on to; see mp3.cpp.
+	std::unique_ptr<MP3Reader> reader;
+
+	/// A frame index for an MP3 file, as built by mpg123_scan.
+	struct Index {
+		std::int64_t step;                 ///< Frames between offsets.
+		std::vector<std::int64_t> offsets; ///< Byte offsets of frames.
+		std::uint64_t length;              ///< Exact length, in samples.
+	};
+
+	/// The cache in which frame indices are persisted.
+	Cache index_cache;
+
+	/// The identity of the file, if it could be established.
+	std::optional<FileIdentity> identity;
+
+	/// The exact length of the file, in samples, once known.
+	std::optional<std::uint64_t> exact_length;
+
+	/// The background thread scanning for the frame index, if any.
+	std::thread scanner;
+
+	/// Set to ask the scanner to give up early.
+	std::atomic<bool> scan_cancelled;
+
+	/// Set by the scanner once it has finished, successfully or not.
+	std::atomic<bool> scan_done;
+
+	/// The index built by the scanner; only read after joining it.
+	std::optional<Index> scanned;
+
 	/**
 	 * @returns A span containing the available sample rates.
 	 */
@@ -80,6 +141,51 @@ private:
 	 * @param rate The sample rate to add.
 	 */
 	void AddFormat(long rate);
+
+	/**
+	 * Loads the frame index from the cache, or starts scanning for it.
+	 */
+	void StartIndexing();
+
+	/**
+	 * Scans the file for its frame index, and caches the result.
+	 * This is the body of the scanner thread.
+	 */
+	void ScanIndex();
+
+	/**
+	 * Builds a frame index by scanning a file with a fresh mpg123 context.
+	 * @param path The path to the file.
+	 * @param cancelled A flag which, when set, aborts the scan.
+	 * @return The index, if the scan succeeded.
+	 */
+	static std::optional<Index> BuildIndex(const std::string &path, const std::atomic<bool> &cancelled);
+
+	/**
+	 * Picks up the index built by the scanner, if it has finished.
+	 * This must be called from the thread that owns the context.
+	 */
+	void ApplyScannedIndex();
+
+	/**
+	 * Hands a frame index to mpg123, and adopts its exact length.
+	 * @param index The index to apply.
+	 */
+	void ApplyIndex(const Index &index);
+
+	/**
+	 * Serialises a frame index for the index cache.
+	 * @param index The index to serialise.
+	 * @return The serialised index.
+	 */
+	static std::vector<std::byte> PackIndex(const Index &index);
+
+	/**
+	 * Deserialises a frame index from the index cache.
+	 * @param data The serialised index.
+	 * @return The index, if @a data is well-formed.
+	 */
+	static std::optional<Index> UnpackIndex(gsl::span<const std::byte> data);
 };
 
 } // namespace Playd::Audio
@@ -18,17 +18,63 @@
 #include <string>
 
 #include "../../errors.h"
+#include "../../log.h"
 #include "../../messages.h"
+#include "../input.h"
 #include "../sample_format.h"
 #include "../source.h"
 
 namespace Playd::Audio
 {
-SndfileSource::SndfileSource(std::string_view path) : Source{path}, file{nullptr}, buffer{}
+//
+// libsndfile virtual I/O callbacks, reading from an Input
+//
+
+/// libsndfile callback for getting the length of an Input.
+static sf_count_t SndfileLength(void *handle)
+{
+	return static_cast<sf_count_t>(static_cast<Input *>(handle)->Length());
+}
+
+/// libsndfile callback for seeking in an Input.
+static sf_count_t SndfileSeek(sf_count_t offset, int whence, void *handle)
+{
+	try {
+		return static_cast<sf_count_t>(static_cast<Input *>(handle)->Seek(offset, whence));
+	} catch (FileError &e) {
+		PLAYD_LOG(ERROR) << "sndfile: seek failed:" << e.Message();
+		return -1;
+	}
+}
+
+/// libsndfile callback for reading from an Input.
+static sf_count_t SndfileRead(void *ptr, sf_count_t count, void *handle)
+{
+	try {
+		auto dest = gsl::make_span(static_cast<std::byte *>(ptr), static_cast<std::size_t>(count));
+		return static_cast<sf_count_t>(static_cast<Input *>(handle)->Read(dest));
+	} catch (FileError &e) {
+		PLAYD_LOG(ERROR) << "sndfile: read failed:" << e.Message();
+		return 0;
+	}
+}
+
+/// libsndfile callback for telling the position of an Input.
+static sf_count_t SndfileTell(void *handle)
+{
+	return static_cast<sf_count_t>(static_cast<Input *>(handle)->Tell());
+}
+
+/// The virtual I/O table through which libsndfile reads Inputs.
+/// We only ever read, so there is no write callback.
+static SF_VIRTUAL_IO sndfile_input_io{SndfileLength, SndfileSeek, SndfileRead, nullptr, SndfileTell};
+
+SndfileSource::SndfileSource(std::string_view path, std::unique_ptr<Input> input)
+    : Source{path}, input{input == nullptr ? Input::Open(path) : std::move(input)}, file{nullptr}, buffer{}
 {
 	this->info.format = 0;
 
-	this->file = sf_open(this->path.c_str(), SFM_READ, &this->info);
+	this->file = sf_open_virtual(&sndfile_input_io, SFM_READ, &this->info, this->input.get());
 	if (this->file == nullptr) {
 		throw FileError("sndfile: can't open " + this->path + ": " + sf_strerror(nullptr));
 	}
@@ -66,13 +112,13 @@ std::uint64_t SndfileSource::Seek(std::uint64_t in_samples)
 {
 	// Have we tried to seek past the end of the file?
 	if (auto clen = static_cast<unsigned long>(this->info.frames); clen < in_samples) {
-		Debug() << "sndfile: seek at" << in_samples << "past EOF at" << clen << std::endl;
+		PLAYD_LOG(WARNING) << "sndfile: seek at" << in_samples << "past EOF at" << clen;
 		throw SeekError(MSG_SEEK_FAIL);
 	}
 
 	auto out_samples = sf_seek(this->file, in_samples, SEEK_SET);
 	if (out_samples == -1) {
-		Debug() << "sndfile: seek failed" << std::endl;
+		PLAYD_LOG(ERROR) << "sndfile: seek failed";
 		throw SeekError(MSG_SEEK_FAIL);
 	}
 
@@ -120,9 +166,10 @@ SampleFormat SndfileSource::OutputSampleFormat() const
 	return SampleFormat::SINT32;
 }
 
-std::unique_ptr<SndfileSource> SndfileSource::MakeUnique(std::string_view path)
+std::unique_ptr<SndfileSource> SndfileSource::MakeUnique(std::string_view path, std::unique_ptr<Input> input,
+                                                         SourceUse)
 {
-	return std::make_unique<SndfileSource, std::string_view>(std::move(path));
+	return std::make_unique<SndfileSource>(path, std::move(input));
 }
 
 } // namespace Playd::Audio
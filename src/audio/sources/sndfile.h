@@ -18,6 +18,7 @@
 #include <string>
 #include <vector>
 
+#include "../input.h"
 #include "../sample_format.h"
 #include "../source.h"
 
@@ -31,9 +32,11 @@ public:
 	 * Constructs a Sndfile_audio_source.
 	 * @param path The path to the file to load and decode using this
 	 *   decoder.
-	 * @see http://www.mega-nerd.com/libsndfile/api.html#open
+	 * @param input An Input already open on @a path, or nullptr to open
+	 *   one here.
+	 * @see http://www.mega-nerd.com/libsndfile/api.html#open_virtual
 	 */
-	explicit SndfileSource(std::string_view path);
+	SndfileSource(std::string_view path, std::unique_ptr<Input> input);
 
 	/// Destructs a Sndfile_audio_source.
 	~SndfileSource();
@@ -54,13 +57,18 @@ public:
 	 * Constructs an Sndfile_audio_source and returns a unique pointer to it.
 	 * @param path The path to the file to load and decode using this
 	 *   decoder.
+	 * @param input An Input already open on @a path, or nullptr to open
+	 *   one here.
+	 * @param use Ignored: sndfile sources work the same for any use.
 	 * @returns A unique pointer to a Sndfile_audio_source.
 	 */
-	static std::unique_ptr<SndfileSource> MakeUnique(std::string_view path);
+	static std::unique_ptr<SndfileSource> MakeUnique(std::string_view path, std::unique_ptr<Input> input,
+	                                                 SourceUse use = SourceUse::PLAYBACK);
 
 private:
-	SF_INFO info;  ///< The libsndfile info structure.
-	SNDFILE *file; ///< The libsndfile file structure.
+	std::unique_ptr<Input> input; ///< The input libsndfile reads from.
+	SF_INFO info;                 ///< The libsndfile info structure.
+	SNDFILE *file;                ///< The libsndfile file structure.
 
 	std::vector<int32_t> buffer; ///< The decoding buffer.
 };
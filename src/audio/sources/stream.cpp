@@ -0,0 +1,399 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the StreamSource class.
+ * @see audio/sources/stream.h
+ */
+
+#ifndef _WIN32
+
+#include "stream.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include "../../errors.h"
+#include "../../log.h"
+#include "../../messages.h"
+#include "../../metrics.h"
+#include "../sample_format.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/// The longest WAV header we'll wait for before giving up on a stream.
+constexpr std::size_t stream_max_header{64 * 1024};
+
+/// @return The gauge of bytes buffered across all StreamSources.
+static Gauge &StreamBufferedGauge()
+{
+	static auto &gauge = Metrics::Global().GetGauge("playd_stream_buffered_bytes",
+	                                                "Bytes of live stream audio buffered for decoding.");
+	return gauge;
+}
+
+/// @return The counter of bytes of live stream audio dropped on overflow.
+static Counter &StreamDroppedCounter()
+{
+	static auto &counter = Metrics::Global().GetCounter("playd_stream_dropped_bytes_total",
+	                                                    "Bytes of live stream audio dropped as the buffer was full.");
+	return counter;
+}
+
+/// @return The counter of times a live stream ran dry and had to rebuffer.
+static Counter &StreamRebufferCounter()
+{
+	static auto &counter = Metrics::Global().GetCounter("playd_stream_rebuffers_total",
+	                                                    "Times a live stream's buffer ran dry during playback.");
+	return counter;
+}
+
+/// Reads a little-endian unsigned integer of N bytes from a span.
+template <std::size_t N>
+static std::uint32_t ReadLE(gsl::span<const std::byte> bytes, std::size_t offset)
+{
+	std::uint32_t value = 0;
+	for (std::size_t i = 0; i < N; i++) value |= std::to_integer<std::uint32_t>(bytes[offset + i]) << (8 * i);
+	return value;
+}
+
+/// Checks whether four bytes of a span spell out a RIFF chunk ID.
+static bool IsChunkId(gsl::span<const std::byte> bytes, std::size_t offset, const char (&id)[5])
+{
+	for (std::size_t i = 0; i < 4; i++) {
+		if (bytes[offset + i] != static_cast<std::byte>(id[i])) return false;
+	}
+	return true;
+}
+
+/**
+ * Maps a WAV format tag and bit depth onto a SampleFormat.
+ * @param tag The WAV format tag (1 for integer PCM, 3 for float).
+ * @param bits The number of bits per mono sample.
+ * @return The SampleFormat.
+ * @exception FileError if the format isn't one playd can play.
+ */
+static SampleFormat SampleFormatOfWav(std::uint32_t tag, std::uint32_t bits)
+{
+	if (tag == 1 && bits == 8) return SampleFormat::UINT8;
+	if (tag == 1 && bits == 16) return SampleFormat::SINT16;
+	if (tag == 1 && bits == 32) return SampleFormat::SINT32;
+	if (tag == 3 && bits == 32) return SampleFormat::FLOAT32;
+	throw FileError("stream: unsupported WAV sample format (tag " + std::to_string(tag) + ", " +
+	                std::to_string(bits) + " bits)");
+}
+
+/* static */ std::optional<StreamSource::Format> StreamSource::ParseHeader(gsl::span<const std::byte> head, bool eof,
+                                                                         std::size_t &header_size)
+{
+	const auto size = static_cast<std::size_t>(head.size());
+	if (size == 0 && eof) throw FileError("stream: ended before any audio");
+
+	// Anything that isn't a WAV file is raw audio, header and all.
+	if (size < 12) {
+		if (!eof) return std::nullopt;
+		header_size = 0;
+		return RAW_FORMAT;
+	}
+	if (!(IsChunkId(head, 0, "RIFF") || IsChunkId(head, 0, "RF64")) || !IsChunkId(head, 8, "WAVE")) {
+		header_size = 0;
+		return RAW_FORMAT;
+	}
+
+	std::optional<Format> format;
+	for (std::size_t offset = 12;;) {
+		if (stream_max_header < offset) throw FileError("stream: WAV header too long");
+		if (size < offset + 8) {
+			if (eof) throw FileError("stream: truncated WAV header");
+			return std::nullopt;
+		}
+
+		const auto chunk_size = ReadLE<4>(head, offset + 4);
+		const auto body = offset + 8;
+
+		// We ignore the size of the data chunk, as live encoders can't
+		// know it in advance; the stream ends when the writer closes it.
+		if (IsChunkId(head, offset, "data")) {
+			if (!format) throw FileError("stream: WAV data before format");
+			header_size = body;
+			return format;
+		}
+
+		if (IsChunkId(head, offset, "fmt ")) {
+			if (chunk_size < 16) throw FileError("stream: bad WAV format chunk");
+			if (size < body + chunk_size) {
+				if (eof) throw FileError("stream: truncated WAV header");
+				return std::nullopt;
+			}
+
+			auto tag = ReadLE<2>(head, body);
+			const auto channels = ReadLE<2>(head, body + 2);
+			const auto rate = ReadLE<4>(head, body + 4);
+			const auto bits = ReadLE<2>(head, body + 14);
+
+			// WAVE_FORMAT_EXTENSIBLE keeps the real tag in its sub-format.
+			if (tag == 0xFFFE && 26 <= chunk_size) tag = ReadLE<2>(head, body + 24);
+
+			if (channels == 0 || 255 < channels || rate == 0) throw FileError("stream: bad WAV format chunk");
+			format = Format{static_cast<std::uint8_t>(channels), rate, SampleFormatOfWav(tag, bits)};
+		}
+
+		// Chunks are padded to even sizes.
+		offset = body + chunk_size + (chunk_size & 1U);
+	}
+}
+
+StreamSource::StreamSource(std::string_view path, std::unique_ptr<Input>)
+    : Source{path},
+      fd{-1},
+      wake{-1, -1},
+      own_fd{false},
+      started{std::chrono::steady_clock::now()},
+      prebuffer_bytes{0},
+      capacity_bytes{0},
+      published{0},
+      buffering{true},
+      eof{false},
+      quit{false},
+      done{false}
+{
+	if (pipe(this->wake) != 0) throw FileError("stream: can't create pipe: " + std::string{std::strerror(errno)});
+
+	this->reader = std::thread{&StreamSource::Run, this};
+}
+
+StreamSource::~StreamSource()
+{
+	this->Stop();
+
+	std::lock_guard<std::mutex> guard{this->lock};
+	StreamBufferedGauge().Add(-this->published);
+}
+
+void StreamSource::Stop()
+{
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		if (this->quit) return;
+		this->quit = true;
+	}
+
+	// Wake the reader if it's waiting for data...
+	const char poke = 0;
+	[[maybe_unused]] auto written = write(this->wake[1], &poke, 1);
+
+	// ...or, if it is still waiting for a writer to open the pipe, become
+	// that writer for long enough to let it see that it should stop.
+	for (;;) {
+		{
+			std::lock_guard<std::mutex> guard{this->lock};
+			if (this->done) break;
+		}
+		if (this->path != "-") {
+			const auto writer = open(this->path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+			if (0 <= writer) close(writer);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds{1});
+	}
+	this->reader.join();
+
+	if (this->own_fd && 0 <= this->fd) close(this->fd);
+	close(this->wake[0]);
+	close(this->wake[1]);
+}
+
+void StreamSource::Run()
+{
+	try {
+		if (this->path == "-") {
+			this->fd = STDIN_FILENO;
+		} else {
+			// This blocks until something opens the pipe for writing.
+			this->fd = open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (this->fd < 0) throw FileError("stream: can't open " + this->path + ": " + std::strerror(errno));
+			this->own_fd = true;
+		}
+
+		std::vector<std::byte> head;
+		std::array<std::byte, READ_SIZE> buf{};
+		for (;;) {
+			const auto count = this->ReadSome(buf);
+			const auto bytes = gsl::make_span(buf.data(), count);
+
+			std::lock_guard<std::mutex> guard{this->lock};
+			if (this->quit) break;
+			if (count == 0) this->eof = true;
+
+			if (this->format) {
+				this->Push(bytes);
+			} else {
+				head.insert(head.end(), bytes.begin(), bytes.end());
+				std::size_t header_size = 0;
+				this->format = ParseHeader(head, this->eof, header_size);
+				if (this->format) {
+					const auto bps = sample_format_bps[static_cast<std::uint8_t>(this->format->format)] *
+					                 this->format->channels;
+					const auto bytes_per_ms = this->format->rate * bps / 1000.0;
+					this->prebuffer_bytes = static_cast<std::size_t>(bytes_per_ms * PREBUFFER.count());
+					this->capacity_bytes = static_cast<std::size_t>(bytes_per_ms * CAPACITY.count());
+
+					this->Push(gsl::make_span(head).last(head.size() - header_size));
+				}
+			}
+
+			if (this->eof) break;
+		}
+	} catch (FileError &e) {
+		PLAYD_LOG(ERROR) << e.Message();
+
+		std::lock_guard<std::mutex> guard{this->lock};
+		this->error = std::string{e.Message()};
+		this->eof = true;
+	}
+
+	std::lock_guard<std::mutex> guard{this->lock};
+	this->done = true;
+}
+
+std::size_t StreamSource::ReadSome(gsl::span<std::byte> dest)
+{
+	for (;;) {
+		std::array<pollfd, 2> fds{{{this->fd, POLLIN, 0}, {this->wake[0], POLLIN, 0}}};
+		if (poll(fds.data(), fds.size(), -1) < 0) {
+			if (errno == EINTR) continue;
+			throw FileError("stream: can't poll " + this->path + ": " + std::strerror(errno));
+		}
+		if (fds[1].revents != 0) return 0;
+		if (fds[0].revents == 0) continue;
+
+		const auto count = read(this->fd, dest.data(), dest.size());
+		if (0 <= count) return static_cast<std::size_t>(count);
+		if (errno == EINTR || errno == EAGAIN) continue;
+		throw FileError("stream: can't read " + this->path + ": " + std::strerror(errno));
+	}
+}
+
+void StreamSource::Push(gsl::span<const std::byte> bytes)
+{
+	this->buffer.insert(this->buffer.end(), bytes.begin(), bytes.end());
+
+	// If we're over capacity, drop whole samples from the front, so that
+	// the buffer keeps starting on a sample boundary.
+	if (this->capacity_bytes < this->buffer.size()) {
+		const auto bps = this->BytesPerSample();
+		auto drop = this->buffer.size() - this->capacity_bytes;
+		drop = std::min(drop + (bps - drop % bps) % bps, this->buffer.size());
+		this->buffer.erase(this->buffer.begin(), this->buffer.begin() + drop);
+		StreamDroppedCounter().Add(drop);
+	}
+
+	this->Publish();
+}
+
+void StreamSource::Publish()
+{
+	const auto buffered = static_cast<std::int64_t>(this->buffer.size());
+	StreamBufferedGauge().Add(buffered - this->published);
+	this->published = buffered;
+}
+
+bool StreamSource::IsReady() const
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	if (this->format) return true;
+	if (this->error) throw FileError(*this->error);
+
+	// We can't build a sink for the stream until we know its format, and
+	// we can't know that until the stream starts; but we can't wait for
+	// ever, either.
+	if (OPEN_TIMEOUT < std::chrono::steady_clock::now() - this->started) {
+		throw FileError("stream: nothing received from " + this->path);
+	}
+	return false;
+}
+
+StreamSource::DecodeResult StreamSource::Decode()
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+
+	// Until the stream starts, there's nothing to decode.
+	if (!this->format) return std::make_pair(DecodeState::DECODING, DecodeVector{});
+
+	// If we've run dry mid-stream, build the buffer back up before carrying
+	// on, so that we don't stutter through every small hiccup upstream.
+	if (this->buffer.empty() && !this->eof && !this->buffering) {
+		this->buffering = true;
+		StreamRebufferCounter().Add();
+	}
+	if (this->buffering) {
+		if (this->buffer.size() < this->prebuffer_bytes && !this->eof) {
+			return std::make_pair(DecodeState::DECODING, DecodeVector{});
+		}
+		this->buffering = false;
+	}
+
+	const auto bps = this->BytesPerSample();
+	auto count = std::min(this->buffer.size(), DECODE_SAMPLES * bps);
+	count -= count % bps;
+
+	// At the end of the stream, any partial sample left over is junk.
+	if (count == 0) {
+		if (!this->eof) return std::make_pair(DecodeState::DECODING, DecodeVector{});
+		return std::make_pair(DecodeState::END_OF_FILE, DecodeVector{});
+	}
+
+	DecodeVector decoded{this->buffer.begin(), this->buffer.begin() + count};
+	this->buffer.erase(this->buffer.begin(), this->buffer.begin() + count);
+	this->Publish();
+
+	return std::make_pair(DecodeState::DECODING, decoded);
+}
+
+std::uint64_t StreamSource::Seek(std::uint64_t)
+{
+	throw SeekError{MSG_SEEK_UNSUPPORTED};
+}
+
+std::uint64_t StreamSource::Length() const
+{
+	return 0;
+}
+
+std::uint8_t StreamSource::ChannelCount() const
+{
+	return this->format->channels;
+}
+
+std::uint32_t StreamSource::SampleRate() const
+{
+	return this->format->rate;
+}
+
+SampleFormat StreamSource::OutputSampleFormat() const
+{
+	return this->format->format;
+}
+
+bool StreamSource::IsLive() const
+{
+	return true;
+}
+
+std::unique_ptr<StreamSource> StreamSource::MakeUnique(std::string_view path, std::unique_ptr<Input> input,
+                                                       SourceUse)
+{
+	return std::make_unique<StreamSource>(path, std::move(input));
+}
+
+} // namespace Playd::Audio
+
+#endif // _WIN32
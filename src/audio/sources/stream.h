@@ -0,0 +1,187 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the StreamSource class.
+ * @see audio/sources/stream.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SOURCES_STREAM_H
+#define PLAYD_AUDIO_SOURCES_STREAM_H
+#ifndef _WIN32
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../input.h"
+#include "../sample_format.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/**
+ * Audio source for live PCM streams on standard input or a named pipe.
+ *
+ * The stream may start with a WAV header, which gives its format; otherwise,
+ * it is taken to be raw CD audio (44.1kHz, stereo, signed 16-bit
+ * little-endian).  WAV data sizes are ignored, as streaming encoders rarely
+ * know them up front.
+ *
+ * Building a StreamSource doesn't wait for the stream to start, as that
+ * can take as long as the writer likes; the source is ready (see IsReady)
+ * once the reader has worked out the format.
+ *
+ * A background thread reads the stream into a bounded buffer.  To absorb
+ * jitter, decoding waits until PREBUFFER of audio is buffered, both at the
+ * start and whenever the buffer runs dry.  If the buffer fills up (because
+ * the stream is arriving faster than it is played), the oldest audio is
+ * dropped, so latency stays bounded.
+ *
+ * Live streams have no length and can't be seeked.
+ */
+class StreamSource : public Source
+{
+public:
+	/// The format of a stream's samples.
+	struct Format {
+		std::uint8_t channels; ///< The number of channels.
+		std::uint32_t rate;    ///< The sample rate, in Hz.
+		SampleFormat format;   ///< The sample format.
+	};
+
+	/// The format assumed for streams without a WAV header.
+	static constexpr Format RAW_FORMAT{2, 44100, SampleFormat::SINT16};
+
+	/// The amount of audio to buffer before decoding starts or resumes.
+	static constexpr std::chrono::milliseconds PREBUFFER{200};
+
+	/// The most audio to buffer before dropping the oldest.
+	static constexpr std::chrono::milliseconds CAPACITY{1000};
+
+	/// How long the stream may take to start before IsReady gives up on it.
+	static constexpr std::chrono::seconds OPEN_TIMEOUT{5};
+
+	/**
+	 * Constructs a StreamSource, and starts reading the stream.
+	 * @param path The path to the stream: '-' for standard input, or the
+	 *   path to a named pipe.
+	 * @param input Ignored; streams can't be read through Inputs.
+	 * @exception FileError if the reader can't be set up.
+	 */
+	StreamSource(std::string_view path, std::unique_ptr<Input> input);
+
+	/// Destructs a StreamSource, stopping its reader thread.
+	~StreamSource() override;
+
+	DecodeResult Decode() override;
+
+	/// @exception SeekError always, as streams can't seek.
+	std::uint64_t Seek(std::uint64_t position) override;
+
+	/// @return 0, as streams have no known length.
+	std::uint64_t Length() const override;
+
+	std::uint8_t ChannelCount() const override;
+
+	std::uint32_t SampleRate() const override;
+
+	SampleFormat OutputSampleFormat() const override;
+
+	/// @return True.
+	bool IsLive() const override;
+
+	/**
+	 * @copydoc Source::IsReady
+	 * A stream is ready once it has started and its format is known.
+	 * @exception FileError if the stream can't be opened, has an invalid
+	 *   header, or hasn't started within OPEN_TIMEOUT of construction.
+	 */
+	bool IsReady() const override;
+
+	/**
+	 * Constructs a StreamSource and returns a unique pointer to it.
+	 * @param path The path to the stream.
+	 * @param input Ignored.
+	 * @param use Ignored: streams are only ever played.
+	 * @returns A unique pointer to a StreamSource.
+	 */
+	static std::unique_ptr<StreamSource> MakeUnique(std::string_view path, std::unique_ptr<Input> input,
+	                                                SourceUse use = SourceUse::PLAYBACK);
+
+	/**
+	 * Works out the format of a stream from the bytes at its start.
+	 * @param head The bytes read from the stream so far.
+	 * @param eof Whether the stream has ended after @a head.
+	 * @param header_size Set to the number of bytes of header before the
+	 *   first sample, when a format is returned.
+	 * @return The format, or std::nullopt if more bytes are needed.
+	 * @exception FileError if the stream has a bad or unsupported header.
+	 */
+	static std::optional<Format> ParseHeader(gsl::span<const std::byte> head, bool eof, std::size_t &header_size);
+
+private:
+	/// The most bytes the reader thread reads in one go.
+	static constexpr std::size_t READ_SIZE = 4096;
+
+	/// The most samples one Decode returns.
+	static constexpr std::size_t DECODE_SAMPLES = 4096;
+
+	int fd;      ///< The stream's file descriptor, or -1 if not open.
+	int wake[2]; ///< A pipe used to wake the reader thread to stop.
+	bool own_fd; ///< Whether we opened fd (and so must close it).
+
+	std::thread reader; ///< The background reading thread.
+
+	/// When the source was built, from which OPEN_TIMEOUT counts.
+	std::chrono::steady_clock::time_point started;
+
+	mutable std::mutex lock; ///< Guards everything below.
+
+	std::optional<Format> format;     ///< The format, once known.
+	std::optional<std::string> error; ///< Why the reader failed, if it did.
+	std::deque<std::byte> buffer;     ///< Samples read but not decoded.
+	std::size_t prebuffer_bytes;      ///< PREBUFFER, in bytes.
+	std::size_t capacity_bytes;       ///< CAPACITY, in bytes.
+	std::int64_t published;           ///< Our share of the buffer metric.
+	bool buffering;                   ///< Whether we're waiting to prebuffer.
+	bool eof;                         ///< Whether the stream has ended.
+	bool quit;                        ///< Whether the reader should stop.
+	bool done;                        ///< Whether the reader has stopped.
+
+	/// The body of the reader thread.
+	void Run();
+
+	/**
+	 * Reads from the stream, waiting until there's data or we're stopped.
+	 * @param dest The buffer to read into.
+	 * @return The number of bytes read; 0 at end of stream or on stopping.
+	 * @exception FileError if the read fails.
+	 */
+	std::size_t ReadSome(gsl::span<std::byte> dest);
+
+	/**
+	 * Adds samples to the buffer, dropping the oldest if it overflows.
+	 * The caller must hold the lock.
+	 * @param bytes The samples, as bytes.
+	 */
+	void Push(gsl::span<const std::byte> bytes);
+
+	/// Stops and joins the reader thread, and closes the stream.
+	void Stop();
+
+	/// Updates the buffer metric.  The caller must hold the lock.
+	void Publish();
+};
+
+} // namespace Playd::Audio
+
+#endif // _WIN32
+#endif // PLAYD_AUDIO_SOURCES_STREAM_H
@@ -0,0 +1,91 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the UnderrunDetector class.
+ * @see audio/underrun.h
+ */
+
+#include "underrun.h"
+
+#include <chrono>
+#include <optional>
+
+#include "../metrics.h"
+#include "../trace.h"
+
+namespace Playd::Audio
+{
+/// @return The counter of underruns in audio callbacks.
+static Counter &UnderrunsCounter()
+{
+	static auto &counter = Metrics::Global().GetCounter(
+	        "playd_underruns_total", "Times a sink ran out of audio to play before its source ended.");
+	return counter;
+}
+
+/// @return The counter of frames of silence played in underruns.
+static Counter &UnderrunFramesCounter()
+{
+	static auto &counter = Metrics::Global().GetCounter("playd_underrun_frames_total",
+	                                                    "Frames of silence played in place of audio in underruns.");
+	return counter;
+}
+
+UnderrunDetector::UnderrunDetector() : queue{}, queued{0}, taken{0}, armed{false}, current{}
+{
+	// Registering takes a lock, so get it out of the way of the audio thread.
+	UnderrunsCounter();
+	UnderrunFramesCounter();
+}
+
+void UnderrunDetector::Played(Samples position, Samples wanted, Samples got)
+{
+	// Any audio at all ends an underrun, and arms us for the next one.
+	if (got != 0) {
+		this->Finish();
+		this->armed = true;
+	}
+	if (!this->armed || got == wanted) return;
+
+	if (!this->current) {
+		this->current = Underrun{position + got, 0, std::chrono::steady_clock::now()};
+		UnderrunsCounter().Add();
+		Tracer::Global().Mark(TraceEvent::UNDERRUN, wanted - got);
+	}
+	this->current->frames += wanted - got;
+	UnderrunFramesCounter().Add(wanted - got);
+}
+
+void UnderrunDetector::Disarm()
+{
+	this->Finish();
+	this->armed = false;
+}
+
+void UnderrunDetector::Finish()
+{
+	if (!this->current) return;
+
+	// If the loop hasn't made room, it has fallen far enough behind that
+	// the metrics will have to do.
+	const auto queued_now = this->queued.load(std::memory_order_relaxed);
+	if (queued_now - this->taken.load(std::memory_order_acquire) < CAPACITY) {
+		this->queue[queued_now % CAPACITY] = *this->current;
+		this->queued.store(queued_now + 1, std::memory_order_release);
+	}
+	this->current.reset();
+}
+
+std::optional<Underrun> UnderrunDetector::Take()
+{
+	const auto taken_now = this->taken.load(std::memory_order_relaxed);
+	if (taken_now == this->queued.load(std::memory_order_acquire)) return std::nullopt;
+
+	const auto underrun = this->queue[taken_now % CAPACITY];
+	this->taken.store(taken_now + 1, std::memory_order_release);
+	return underrun;
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,107 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the UnderrunDetector class.
+ * @see audio/underrun.cpp
+ */
+
+#ifndef PLAYD_AUDIO_UNDERRUN_H
+#define PLAYD_AUDIO_UNDERRUN_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/// A stretch of time in which a sink had nothing to play, but should have.
+struct Underrun {
+	Samples position;                         ///< Where the sink ran dry.
+	Samples frames;                           ///< Frames of silence played.
+	std::chrono::steady_clock::time_point at; ///< When the sink ran dry.
+};
+
+/**
+ * Spots underruns in a sink's audio callback, and hands them to the loop.
+ *
+ * The callback tells the detector, for each block, how many frames it
+ * wanted and how many it got.  Consecutive short blocks make up one
+ * underrun, which is handed over once audio comes back.  Handing over goes
+ * through a small single-producer, single-consumer queue, so the callback
+ * never blocks or allocates; if the loop lets the queue fill, further
+ * underruns are still counted in the metrics, but not queued.
+ *
+ * The detector only arms once it has seen some audio, and Disarm puts it
+ * back to that state, so that the gaps while a sink first fills up (or
+ * refills after a seek) don't count.
+ */
+class UnderrunDetector
+{
+public:
+	/// Constructs an UnderrunDetector, disarmed.
+	UnderrunDetector();
+
+	/// Deleted copy constructor.
+	UnderrunDetector(const UnderrunDetector &) = delete;
+
+	/// Deleted copy-assignment.
+	UnderrunDetector &operator=(const UnderrunDetector &) = delete;
+
+	/**
+	 * Notes what the sink played for one block.  Call from the audio
+	 * callback only.
+	 * @param position The position of the block's first frame.
+	 * @param wanted The frames the device asked for; pass @a got if the
+	 *   source has run out, as a sink running dry then isn't an underrun.
+	 * @param got The frames the sink had to give it.
+	 */
+	void Played(Samples position, Samples wanted, Samples got);
+
+	/**
+	 * Stops counting underruns until the sink next has audio to play.
+	 * Call from the audio callback, or with it locked out.
+	 */
+	void Disarm();
+
+	/**
+	 * Takes the oldest underrun not yet taken.  Call from one thread only
+	 * (the main loop).
+	 * @return The underrun, or nothing if there are none (or the sink is
+	 *   still in the middle of its first one).
+	 */
+	std::optional<Underrun> Take();
+
+private:
+	/// The number of underruns that can wait to be taken.
+	static constexpr std::size_t CAPACITY = 16;
+
+	/// Underruns waiting to be taken.
+	std::array<Underrun, CAPACITY> queue;
+
+	/// The number of underruns ever queued; written by the callback.
+	std::atomic<std::uint64_t> queued;
+
+	/// The number of underruns ever taken; written by the loop.
+	std::atomic<std::uint64_t> taken;
+
+	// The following belong to the callback.
+
+	/// Whether the sink has played anything since it was disarmed.
+	bool armed;
+
+	/// The underrun in progress, if any.
+	std::optional<Underrun> current;
+
+	/// Queues the underrun in progress, if any, and ends it.
+	void Finish();
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_UNDERRUN_H
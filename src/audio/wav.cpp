@@ -0,0 +1,153 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the WavWriter class.
+ * @see audio/wav.h
+ */
+
+#include "wav.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "../errors.h"
+#include "../metrics.h"
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/// @return The counter of bytes of audio written to WAV files.
+static Counter &WrittenCounter()
+{
+	static auto &counter = Metrics::Global().GetCounter("playd_wav_written_bytes_total",
+	                                                    "Bytes of audio written to WAV files.");
+	return counter;
+}
+
+/// @return The counter of failed writes to WAV files.
+static Counter &ErrorCounter()
+{
+	static auto &counter = Metrics::Global().GetCounter("playd_wav_write_errors_total",
+	                                                    "Blocks of audio that couldn't be written to WAV files.");
+	return counter;
+}
+
+/// The size of the header WriteHeader writes, in bytes.
+static constexpr std::size_t HEADER_BYTES = 44;
+
+/**
+ * Puts a little-endian integer into a header.
+ * @tparam N The width of the integer, in bytes.
+ * @param at Where in the header to put the integer.
+ * @param value The integer.
+ */
+template <std::size_t N>
+static void PutLE(std::uint8_t *at, std::uint32_t value)
+{
+	for (std::size_t i = 0; i < N; i++) at[i] = static_cast<std::uint8_t>(value >> (8 * i));
+}
+
+WavWriter::WavWriter(std::string path, bool header)
+    : path{std::move(path)}, header{header}, file{nullptr}, shape{}, data_bytes{0}
+{
+}
+
+WavWriter::~WavWriter()
+{
+	if (this->file == nullptr) return;
+
+	// Now we know how long the file is, go back and say so.
+	this->WriteHeader();
+	std::fclose(this->file);
+}
+
+void WavWriter::Claim(std::uint32_t rate, SampleFormat format, std::uint8_t channels)
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+
+	if (this->shape) {
+		if (this->shape->rate == rate && this->shape->format == format && this->shape->channels == channels) return;
+		throw FileError("can't write audio of another format to " + this->path + " (try --mix)");
+	}
+
+	this->file = std::fopen(this->path.c_str(), "wb");
+	if (this->file == nullptr) throw FileError("couldn't create " + this->path);
+
+	this->shape = Shape{rate, format, channels};
+	// The lengths are filled in at the end; this keeps the place.
+	this->WriteHeader();
+}
+
+void WavWriter::Write(gsl::span<const std::byte> block)
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	Expects(this->file != nullptr);
+
+	auto *data = reinterpret_cast<const char *>(block.data());
+	if (this->header && this->shape->format == SampleFormat::SINT8) {
+		// WAV only has unsigned 8-bit samples.
+		this->scratch.assign(data, block.size());
+		for (auto &c : this->scratch) c = static_cast<char>(static_cast<std::uint8_t>(c) ^ 0x80U);
+		data = this->scratch.data();
+	}
+
+	if (std::fwrite(data, 1, block.size(), this->file) != static_cast<std::size_t>(block.size())) {
+		ErrorCounter().Add();
+		return;
+	}
+
+	this->data_bytes += block.size();
+	WrittenCounter().Add(block.size());
+}
+
+std::uint64_t WavWriter::DataBytes()
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	return this->data_bytes;
+}
+
+void WavWriter::WriteHeader()
+{
+	Expects(this->file != nullptr && this->shape);
+	if (!this->header) return;
+
+	const auto bps = static_cast<std::uint32_t>(sample_format_bps[static_cast<int>(this->shape->format)]);
+	const auto frame_bytes = bps * this->shape->channels;
+	const bool is_float = this->shape->format == SampleFormat::FLOAT32;
+
+	// WAV can't say how long anything past 4GiB is; players mostly cope
+	// with the lengths being stuck at the maximum.
+	constexpr std::uint64_t max_data = std::numeric_limits<std::uint32_t>::max() - (HEADER_BYTES - 8);
+	const auto data = static_cast<std::uint32_t>(std::min(this->data_bytes, max_data));
+
+	std::array<std::uint8_t, HEADER_BYTES> h{};
+	std::copy_n("RIFF", 4, h.begin());
+	PutLE<4>(&h[4], data + HEADER_BYTES - 8);
+	std::copy_n("WAVE", 4, h.begin() + 8);
+	std::copy_n("fmt ", 4, h.begin() + 12);
+	PutLE<4>(&h[16], 16);
+	PutLE<2>(&h[20], is_float ? 3 : 1); // IEEE float, or PCM
+	PutLE<2>(&h[22], this->shape->channels);
+	PutLE<4>(&h[24], this->shape->rate);
+	PutLE<4>(&h[28], this->shape->rate * frame_bytes);
+	PutLE<2>(&h[32], frame_bytes);
+	PutLE<2>(&h[34], bps * 8);
+	std::copy_n("data", 4, h.begin() + 36);
+	PutLE<4>(&h[40], data);
+
+	const auto at = std::ftell(this->file);
+	std::fseek(this->file, 0, SEEK_SET);
+	if (std::fwrite(h.data(), 1, h.size(), this->file) != h.size()) ErrorCounter().Add();
+	if (0 < at) std::fseek(this->file, at, SEEK_SET);
+	std::fflush(this->file);
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,119 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the WavWriter class.
+ * @see audio/wav.cpp
+ */
+
+#ifndef PLAYD_AUDIO_WAV_H
+#define PLAYD_AUDIO_WAV_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#undef max
+#include <gsl/gsl>
+
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/**
+ * Writes audio to a WAV file, block by block, as it's played.
+ *
+ * A writer can be shared by several devices in turn (one for each file
+ * played on a channel, say), as long as they all play the same shape of
+ * audio: the first to claim it fixes the shape.  The header's lengths are
+ * filled in when the writer is destroyed.
+ *
+ * A writer can also leave the header out, writing raw samples.
+ */
+class WavWriter
+{
+public:
+	/**
+	 * Constructs a WavWriter.  The file isn't created until first claimed.
+	 * @param path The path of the file to write.
+	 * @param header Whether to write a WAV header; if not, the file is
+	 *   raw samples.
+	 */
+	explicit WavWriter(std::string path, bool header = true);
+
+	/// Destructs a WavWriter, finishing and closing the file.
+	~WavWriter();
+
+	/// Deleted copy constructor.
+	WavWriter(const WavWriter &) = delete;
+
+	/// Deleted copy-assignment.
+	WavWriter &operator=(const WavWriter &) = delete;
+
+	/**
+	 * Claims the writer for audio of a given shape, creating the file if
+	 * this is the first claim.
+	 * @param rate The sample rate, in Hz.
+	 * @param format The format of each sample.
+	 * @param channels The number of channels.
+	 * @exception FileError if the file can't be created, or holds audio of
+	 *   another shape.
+	 */
+	void Claim(std::uint32_t rate, SampleFormat format, std::uint8_t channels);
+
+	/**
+	 * Appends a block of audio, in the claimed shape.
+	 * Write errors are counted in the metrics, but not thrown, as
+	 * this runs on a device's thread.
+	 * @param block The block.
+	 */
+	void Write(gsl::span<const std::byte> block);
+
+	/**
+	 * Gets the number of bytes of audio written so far.
+	 * @return The length of the file's data chunk.
+	 */
+	std::uint64_t DataBytes();
+
+private:
+	/// The shape of the audio in the file.
+	struct Shape {
+		std::uint32_t rate;    ///< The sample rate, in Hz.
+		SampleFormat format;   ///< The format of each sample.
+		std::uint8_t channels; ///< The number of channels.
+	};
+
+	/// The path of the file.
+	std::string path;
+
+	/// Whether the file has a WAV header.
+	bool header;
+
+	/// Lock over everything below.
+	std::mutex lock;
+
+	/// The file, or nullptr until first claimed.
+	std::FILE *file;
+
+	/// The shape of the audio, once claimed.
+	std::optional<Shape> shape;
+
+	/// The number of bytes of audio written.
+	std::uint64_t data_bytes;
+
+	/// Scratch space for converting blocks of signed 8-bit audio.
+	std::string scratch;
+
+	/**
+	 * Writes the header, with the lengths as they stand.
+	 * Call with the lock held.
+	 */
+	void WriteHeader();
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_WAV_H
@@ -0,0 +1,345 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the benchmark harness.
+ * @see bench/bench.h
+ */
+
+#include "bench.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../errors.h"
+
+namespace Playd::Bench
+{
+std::uint64_t IntOption(const Options &options, std::string_view name, std::uint64_t fallback)
+{
+	auto opt = options.find(name);
+	if (opt == options.end()) return fallback;
+
+	std::uint64_t value = 0;
+	const auto &str = opt->second;
+	auto [p, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+	if (ec != std::errc{} || p != str.data() + str.size()) {
+		throw ConfigError("--" + std::string{name} + " needs a non-negative integer, not '" + str + "'");
+	}
+	return value;
+}
+
+//
+// JsonObject
+//
+
+/**
+ * Quotes and escapes a string for JSON.
+ * @param str The string.
+ * @return The string, as a JSON string literal.
+ */
+static std::string JsonString(std::string_view str)
+{
+	std::string out{"\""};
+	for (const auto c : str) {
+		if (c == '"' || c == '\\') {
+			out.push_back('\\');
+			out.push_back(c);
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			char escape[7];
+			std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+			out += escape;
+		} else {
+			out.push_back(c);
+		}
+	}
+	out.push_back('"');
+	return out;
+}
+
+JsonObject &JsonObject::AddJson(std::string_view key, std::string_view json)
+{
+	this->members.push_back(JsonString(key) + ":" + std::string{json});
+	return *this;
+}
+
+JsonObject &JsonObject::Add(std::string_view key, std::string_view value)
+{
+	return this->AddJson(key, JsonString(value));
+}
+
+JsonObject &JsonObject::Add(std::string_view key, double value)
+{
+	// JSON has no infinities or NaNs.
+	if (!std::isfinite(value)) return this->AddJson(key, "null");
+
+	std::ostringstream os;
+	os << value;
+	return this->AddJson(key, os.str());
+}
+
+JsonObject &JsonObject::Add(std::string_view key, std::uint64_t value)
+{
+	return this->AddJson(key, std::to_string(value));
+}
+
+JsonObject &JsonObject::Add(std::string_view key, const std::vector<JsonObject> &values)
+{
+	std::string json{"["};
+	for (const auto &value : values) {
+		if (json.size() > 1) json.push_back(',');
+		json += value.Str();
+	}
+	json.push_back(']');
+	return this->AddJson(key, json);
+}
+
+JsonObject &JsonObject::Add(std::string_view key, const JsonObject &value)
+{
+	return this->AddJson(key, value.Str());
+}
+
+std::string JsonObject::Str() const
+{
+	std::string json{"{"};
+	for (const auto &member : this->members) {
+		if (json.size() > 1) json.push_back(',');
+		json += member;
+	}
+	json.push_back('}');
+	return json;
+}
+
+//
+// BenchSource
+//
+
+BenchSource::BenchSource(std::string_view path) : Audio::Source{path}, position{0}
+{
+}
+
+/* static */ std::unique_ptr<Audio::Source> BenchSource::MakeUnique(std::string_view path,
+                                                                    std::unique_ptr<Audio::Input>, Audio::SourceUse)
+{
+	return std::make_unique<BenchSource>(path);
+}
+
+Audio::Source::DecodeResult BenchSource::Decode()
+{
+	if (LENGTH <= this->position) return std::make_pair(DecodeState::END_OF_FILE, DecodeVector{});
+
+	DecodeVector frame(FRAME_SAMPLES * this->BytesPerSample());
+	auto *out = reinterpret_cast<std::int16_t *>(frame.data());
+	for (std::size_t i = 0; i < FRAME_SAMPLES; i++, this->position++) {
+		const auto phase = static_cast<std::int16_t>(this->position % 256);
+		out[2 * i] = out[2 * i + 1] = static_cast<std::int16_t>((phase < 128 ? phase : 256 - phase) * 8);
+	}
+	return std::make_pair(DecodeState::DECODING, std::move(frame));
+}
+
+std::uint8_t BenchSource::ChannelCount() const
+{
+	return 2;
+}
+
+std::uint32_t BenchSource::SampleRate() const
+{
+	return 44100;
+}
+
+Audio::SampleFormat BenchSource::OutputSampleFormat() const
+{
+	return Audio::SampleFormat::SINT16;
+}
+
+std::uint64_t BenchSource::Seek(std::uint64_t new_position)
+{
+	this->position = new_position;
+	return this->position;
+}
+
+std::uint64_t BenchSource::Length() const
+{
+	return LENGTH;
+}
+
+//
+// BenchSink
+//
+
+BenchSink::BenchSink(const Audio::Source &source, int)
+    : bytes_per_sample{source.BytesPerSample()},
+      sample_rate{source.SampleRate()},
+      ring_buf{(1U << RINGBUF_POWER) * source.BytesPerSample()},
+      scratch((1U << RINGBUF_POWER) * source.BytesPerSample()),
+      position{0},
+      source_out{false},
+      state{State::STOPPED}
+{
+}
+
+void BenchSink::Start()
+{
+	this->last_drain = std::chrono::steady_clock::now();
+	this->state = State::PLAYING;
+}
+
+void BenchSink::Stop()
+{
+	this->state = State::STOPPED;
+}
+
+Audio::Sink::State BenchSink::CurrentState()
+{
+	this->Drain();
+	return this->state;
+}
+
+Audio::Samples BenchSink::Position()
+{
+	return this->position;
+}
+
+void BenchSink::SetPosition(Audio::Samples samples)
+{
+	this->position = samples;
+	this->ring_buf.Flush();
+	this->source_out = false;
+}
+
+void BenchSink::SourceOut()
+{
+	this->source_out = true;
+}
+
+std::size_t BenchSink::Transfer(gsl::span<const std::byte> src)
+{
+	auto count = std::min(static_cast<std::size_t>(src.size()), this->ring_buf.WriteCapacity());
+	count -= count % this->bytes_per_sample;
+	if (count == 0) return 0;
+	return this->ring_buf.Write(src.first(count));
+}
+
+void BenchSink::Drain()
+{
+	if (this->state != State::PLAYING) return;
+
+	const auto now = std::chrono::steady_clock::now();
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - this->last_drain);
+	const auto due = static_cast<std::size_t>(elapsed.count() * this->sample_rate / 1000000);
+	if (due == 0) return;
+	this->last_drain = now;
+
+	// Like a real device, we play silence if the ring runs dry.
+	const auto want = std::min({due * this->bytes_per_sample, this->scratch.size(), this->ring_buf.ReadCapacity()});
+	if (0 < want) {
+		const auto got = this->ring_buf.Read(gsl::make_span(this->scratch).first(want));
+		this->position += got / this->bytes_per_sample;
+	}
+
+	if (this->source_out && this->ring_buf.ReadCapacity() == 0) this->state = State::AT_END;
+}
+
+//
+// Usage
+//
+
+Usage &Usage::operator+=(const Usage &other)
+{
+	this->cpu += other.cpu;
+	this->max_rss_kib += other.max_rss_kib;
+	return *this;
+}
+
+/**
+ * Converts a timeval from getrusage and friends into microseconds.
+ * @param tv The timeval.
+ * @return The same time, in microseconds.
+ */
+static std::chrono::microseconds Micros(const timeval &tv)
+{
+	return std::chrono::seconds{tv.tv_sec} + std::chrono::microseconds{tv.tv_usec};
+}
+
+pid_t StartChild(const std::function<void()> &job)
+{
+	// Anything buffered now would otherwise be written once per child.
+	std::cout.flush();
+	std::cerr.flush();
+
+	const auto pid = fork();
+	if (pid < 0) throw InternalError("couldn't fork benchmark child");
+	if (pid == 0) {
+		auto status = EXIT_SUCCESS;
+		try {
+			job();
+		} catch (Error &e) {
+			std::cerr << "benchmark child failed: " << e.Message() << std::endl;
+			status = EXIT_FAILURE;
+		}
+		// Skip the parent's atexit handlers: they aren't ours to run.
+		_exit(status);
+	}
+	return pid;
+}
+
+/**
+ * Waits for a benchmark child to finish, and measures it.
+ * @param pid The child's process ID.
+ * @param usage Set to the resources the child used.
+ * @return Whether the child succeeded.
+ * @exception InternalError if the child can't be waited for.
+ */
+static bool ReapChild(pid_t pid, Usage &usage)
+{
+	int status = 0;
+	struct rusage ru {};
+	if (wait4(pid, &status, 0, &ru) < 0) throw InternalError("couldn't wait for benchmark child");
+
+	// Linux reports ru_maxrss in KiB; macOS reports it in bytes.
+#ifdef __APPLE__
+	const auto rss_kib = static_cast<std::uint64_t>(ru.ru_maxrss) / 1024;
+#else
+	const auto rss_kib = static_cast<std::uint64_t>(ru.ru_maxrss);
+#endif // __APPLE__
+	usage = Usage{Micros(ru.ru_utime) + Micros(ru.ru_stime), rss_kib};
+	return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+Usage WaitForChild(pid_t pid)
+{
+	Usage usage;
+	if (!ReapChild(pid, usage)) throw InternalError("a benchmark child failed");
+	return usage;
+}
+
+Usage RunInChildren(const std::vector<std::function<void()>> &jobs)
+{
+	std::vector<pid_t> children;
+	for (const auto &job : jobs) children.push_back(StartChild(job));
+
+	Usage total;
+	auto failed = false;
+	for (const auto pid : children) {
+		Usage usage;
+		failed = !ReapChild(pid, usage) || failed;
+		total += usage;
+	}
+	if (failed) throw InternalError("a benchmark child failed");
+
+	return total;
+}
+
+} // namespace Playd::Bench
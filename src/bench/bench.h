@@ -0,0 +1,457 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the benchmark harness, and of the benchmarks themselves.
+ * @see bench/bench.cpp
+ */
+
+#ifndef PLAYD_BENCH_H
+#define PLAYD_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "../audio/input.h"
+#include "../audio/ringbuffer.h"
+#include "../audio/sample_format.h"
+#include "../audio/sink.h"
+#include "../audio/source.h"
+
+namespace Playd::Bench
+{
+/// The host on which benchmark channels listen.
+constexpr std::string_view BENCH_HOST{"127.0.0.1"};
+
+/// Options given to a benchmark, as a map from NAME to VALUE in --NAME=VALUE.
+using Options = std::map<std::string, std::string, std::less<>>;
+
+/**
+ * Gets a non-negative integer option.
+ * @param options The options given to the benchmark.
+ * @param name The name of the option.
+ * @param fallback The value to use if the option wasn't given.
+ * @return The option's value.
+ * @exception ConfigError if the option's value isn't a non-negative integer.
+ */
+std::uint64_t IntOption(const Options &options, std::string_view name, std::uint64_t fallback);
+
+/**
+ * A JSON object, built up one member at a time.
+ *
+ * Benchmarks report their results as one of these, so that scripts can
+ * compare runs without scraping text.
+ */
+class JsonObject
+{
+public:
+	/**
+	 * Adds a string member.
+	 * @param key The member's key.
+	 * @param value The member's value, which is escaped as needed.
+	 * @return This object, for chaining.
+	 */
+	JsonObject &Add(std::string_view key, std::string_view value);
+
+	/**
+	 * Adds a numeric member.
+	 * @param key The member's key.
+	 * @param value The member's value.
+	 * @return This object, for chaining.
+	 */
+	JsonObject &Add(std::string_view key, double value);
+
+	/**
+	 * Adds an integer member.
+	 * @param key The member's key.
+	 * @param value The member's value.
+	 * @return This object, for chaining.
+	 */
+	JsonObject &Add(std::string_view key, std::uint64_t value);
+
+	/**
+	 * Adds a member holding an array of objects.
+	 * @param key The member's key.
+	 * @param values The objects in the array.
+	 * @return This object, for chaining.
+	 */
+	JsonObject &Add(std::string_view key, const std::vector<JsonObject> &values);
+
+	/**
+	 * Adds a member holding another object.
+	 * @param key The member's key.
+	 * @param value The member's value.
+	 * @return This object, for chaining.
+	 */
+	JsonObject &Add(std::string_view key, const JsonObject &value);
+
+	/**
+	 * Gets the JSON form of this object.
+	 * @return The object, as JSON text.
+	 */
+	std::string Str() const;
+
+private:
+	/// The JSON forms of each member, sans separating commas.
+	std::vector<std::string> members;
+
+	/**
+	 * Adds a member whose value is already in JSON form.
+	 * @param key The member's key.
+	 * @param json The member's value, as JSON text.
+	 * @return This object, for chaining.
+	 */
+	JsonObject &AddJson(std::string_view key, std::string_view json);
+};
+
+/// The resources a benchmark used.
+struct Usage {
+	std::chrono::microseconds cpu{0}; ///< User plus system CPU time.
+	std::uint64_t max_rss_kib{0};     ///< Peak resident set size, in KiB.
+
+	/**
+	 * Adds another Usage to this one.
+	 * CPU time adds up, as does peak RSS (which gives the peak memory
+	 * of processes that ran side by side).
+	 * @param other The other Usage.
+	 * @return This Usage.
+	 */
+	Usage &operator+=(const Usage &other);
+};
+
+/**
+ * Runs jobs side by side, each in its own child process, and measures
+ * them.  Running jobs in children keeps their memory and CPU use apart
+ * from the harness, and from each other.
+ * @param jobs The jobs to run.
+ * @return The total resources the children used.
+ * @exception InternalError if a child can't be started or fails.
+ */
+Usage RunInChildren(const std::vector<std::function<void()>> &jobs);
+
+/**
+ * Starts a job in its own child process, and leaves it running; for jobs,
+ * such as servers, that run until told to stop.
+ * @param job The job to run.
+ * @return The child's process ID.
+ * @exception InternalError if the child can't be started.
+ * @see WaitForChild
+ */
+pid_t StartChild(const std::function<void()> &job);
+
+/**
+ * Waits for a child started by StartChild to finish, and measures it.
+ * @param pid The child's process ID.
+ * @return The resources the child used.
+ * @exception InternalError if the child can't be waited for, or fails.
+ */
+Usage WaitForChild(pid_t pid);
+
+/**
+ * A Source that synthesises a quiet triangle wave, so that benchmarks
+ * don't measure a real decoder (or the disk).
+ */
+class BenchSource : public Audio::Source
+{
+public:
+	/// The number of samples in each decoded frame (the same as MP3).
+	static constexpr std::size_t FRAME_SAMPLES = 1152;
+
+	/// The length of the audio: long enough not to end mid-benchmark.
+	static constexpr std::uint64_t LENGTH = 44100ULL * 60 * 60;
+
+	/**
+	 * Constructs a BenchSource.
+	 * @param path The (unused) path to the file.
+	 */
+	explicit BenchSource(std::string_view path);
+
+	/**
+	 * Makes a BenchSource, ignoring any Input and use.
+	 * @param path The (unused) path to the file.
+	 * @return The BenchSource.
+	 */
+	static std::unique_ptr<Audio::Source> MakeUnique(std::string_view path, std::unique_ptr<Audio::Input>,
+	                                                 Audio::SourceUse);
+
+	DecodeResult Decode() override;
+
+	std::uint8_t ChannelCount() const override;
+
+	std::uint32_t SampleRate() const override;
+
+	Audio::SampleFormat OutputSampleFormat() const override;
+
+	std::uint64_t Seek(std::uint64_t new_position) override;
+
+	std::uint64_t Length() const override;
+
+private:
+	std::uint64_t position; ///< The next sample to synthesise.
+};
+
+/**
+ * A Sink that drains its ring buffer at the source's sample rate, as an
+ * audio device would, but without a device.
+ */
+class BenchSink : public Audio::Sink
+{
+public:
+	/// n, where 2^n is the capacity of the ring buffer (as in DeviceSink).
+	static constexpr std::size_t RINGBUF_POWER = 16;
+
+	/**
+	 * Constructs a BenchSink.
+	 * @param source The source from which this sink will receive audio.
+	 */
+	BenchSink(const Audio::Source &source, int);
+
+	void Start() override;
+
+	void Stop() override;
+
+	State CurrentState() override;
+
+	Audio::Samples Position() override;
+
+	void SetPosition(Audio::Samples samples) override;
+
+	void SourceOut() override;
+
+	std::size_t Transfer(gsl::span<const std::byte> src) override;
+
+private:
+	std::size_t bytes_per_sample;   ///< Number of bytes in one sample.
+	std::uint32_t sample_rate;      ///< Samples per second to drain.
+	Audio::RingBuffer ring_buf;     ///< The buffer the 'device' drains.
+	std::vector<std::byte> scratch; ///< Where drained samples go.
+	Audio::Samples position;        ///< The current position, in samples.
+	bool source_out;                ///< Whether the source has run out.
+	State state;                    ///< The sink's current state.
+
+	/// When the ring buffer was last drained.
+	std::chrono::steady_clock::time_point last_drain;
+
+	/// Drains as many samples as would have played since the last drain.
+	void Drain();
+};
+
+/// Type of benchmark functions.
+using BenchmarkFn = std::function<JsonObject(const Options &)>;
+
+//
+// Benchmarks
+//
+
+/**
+ * Compares N channels in one playd process with N single-channel processes.
+ *
+ * Each channel plays synthetic audio into a sink that drains at real-time
+ * rate, so the cost measured is that of playd itself: its loop, timer,
+ * decode/transfer cycle, and per-process overhead.
+ *
+ * Options: --decks=N (default 8), --seconds=S (default 10), and --port=P
+ * (default 13500), the first of the N ports used.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject MultiDeck(const Options &options);
+
+/**
+ * Measures the cost of mixing 2, 8 and 32 strips in the software mixer.
+ *
+ * Only the mixing itself is timed: feeding the strips isn't, as that
+ * happens on the decoder's side in playd.
+ *
+ * Options: --seconds=S (default 60), the amount of audio to mix for each
+ * number of strips.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject Mixing(const Options &options);
+
+/**
+ * Measures the gain kernel in each sample format, both holding a gain and
+ * ramping between gains, in samples per nanosecond.
+ *
+ * Options: --megasamples=M (default 256), the number of samples to scale
+ * for each format and mode.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject Gain(const Options &options);
+
+/**
+ * Measures loudness analysis, as run on the background worker, against
+ * real time.  The source is the synthetic BenchSource, so this times the
+ * meter rather than any decoder.
+ *
+ * Options: --seconds=S (default 600), the amount of audio to analyse.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject Loudness(const Options &options);
+
+/**
+ * Measures live level metering as the audio callback does it, per block of
+ * 1024 stereo frames, in each sample format; callback_percent is the share
+ * of each block's playing time spent metering it.
+ *
+ * Options: --blocks=N (default 100000), the number of blocks to meter for
+ * each format.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject Meter(const Options &options);
+
+/**
+ * Measures waveform peak generation, in hours of audio per second.  As with
+ * the loudness benchmark, the source is the synthetic BenchSource.
+ *
+ * Options: --seconds=S (default 3600), the amount of audio to summarise.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject Peaks(const Options &options);
+
+/**
+ * Measures leading and trailing silence detection, in hours of audio per
+ * second, both over the synthetic BenchSource (where the scan stops early)
+ * and over silence (where every sample is looked at).
+ *
+ * Options: --seconds=S (default 3600), the amount of audio to scan in each
+ * run.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject Silence(const Options &options);
+
+/**
+ * Measures the output limiter with 1, 2 and 6 channels, per block of 1024
+ * frames of audio hot enough to keep it limiting, in nanoseconds per
+ * channel-frame and as a share of real time.
+ *
+ * Options: --seconds=S (default 600), the amount of audio to limit for
+ * each number of channels.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject Limiter(const Options &options);
+
+/**
+ * Measures moving audio through a RingBuffer, as sinks do, in chunks of 64,
+ * 1024, 4096 and 16384 bytes: each chunk is written and then read back,
+ * with the ring kept half full so that chunks wrap around its end.
+ *
+ * Options: --megabytes=M (default 1024), the amount of audio to move in
+ * each chunk size.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject RingTransfer(const Options &options);
+
+/**
+ * Measures the Tokeniser on typical client commands, both fed one line at
+ * a time and in batches of 64 lines, in nanoseconds per line.
+ *
+ * Options: --lines=N (default 4000000), the number of lines to tokenise
+ * in each run.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject Tokenising(const Options &options);
+
+/**
+ * Measures building and packing responses, with arguments that need no
+ * escaping and arguments that do, in nanoseconds per response.
+ *
+ * Options: --responses=N (default 2000000), the number of responses to
+ * build in each run.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject ResponsePacking(const Options &options);
+
+/**
+ * Measures BasicAudio::Update on a playing deck whose sink takes all it is
+ * given, with a source that decodes nothing and with the synthetic
+ * BenchSource; also measures Source::SamplesFromMicros.
+ *
+ * Options: --updates=N (default 1000000), the number of updates in each
+ * run; ten times as many conversions are made.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject AudioUpdate(const Options &options);
+
+/**
+ * Drives one playd channel over TCP from many connections at once, and
+ * measures how it copes.
+ *
+ * First, each connection sends commands drawn from a weighted mix, waiting
+ * for each command's ACK before sending the next; the time from sending to
+ * ACK is reported as percentiles, overall and per command.  Then one
+ * connection toggles playback over and over, and the time until each
+ * connection (and the last of them) hears the PLAY or STOP broadcast is
+ * reported the same way.
+ *
+ * Unless --host is given, the benchmark runs its own playd in a child
+ * process, on a sink that plays in real time without an audio device, and
+ * reports the CPU time it used.
+ *
+ * Options: --connections=N (default 16); --seconds=S (default 10), how long
+ * to send commands for; --broadcasts=N (default 200), the number of
+ * broadcasts to time; --mix=COMMAND:WEIGHT,... (default
+ * fload:1,play:4,stop:4,pos:8,dump:2), from fload, play, stop, pos and dump;
+ * --file=PATH (default /loadgen.bench), the file for fload; --host=ADDRESS,
+ * the IPv4 address of a playd to drive instead; and --port=P (default
+ * 13600), the port of the channel.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject LoadGen(const Options &options);
+
+#ifdef WITH_SNDFILE
+/**
+ * Measures the real decoders over a corpus of WAV and FLAC files, written
+ * with libsndfile at several sample rates, channel counts and bit depths:
+ * the time to open each file, how far ahead of real time it decodes, the
+ * bytes each second of its audio comes to, and the time to seek to a random
+ * position and decode from there.  The corpus lives in a temporary
+ * directory, and is removed afterwards.
+ *
+ * Options: --length=S (default 60), the length of each file; --seconds=S
+ * (default 600), the amount of audio to decode from each file; --seeks=N
+ * (default 1000), the number of seeks in each file; and --mp3=PATH, an MP3
+ * file to measure too, as libsndfile can't write one.
+ *
+ * @param options The options given to the benchmark.
+ * @return The results.
+ */
+JsonObject Decode(const Options &options);
+#endif // WITH_SNDFILE
+
+} // namespace Playd::Bench
+
+#endif // PLAYD_BENCH_H
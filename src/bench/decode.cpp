@@ -0,0 +1,205 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The decode benchmark: how fast the real decoders open, decode and seek
+ * files, over a corpus generated on the spot.
+ * @see bench/bench.h
+ */
+
+#ifdef WITH_SNDFILE
+
+#include <sndfile.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../audio/source.h"
+#include "../audio/sources/mp3.h"
+#include "../audio/sources/sndfile.h"
+#include "../errors.h"
+#include "../player.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/// A file in the generated corpus.
+struct CorpusFile {
+	std::string_view name; ///< The file's name, which also names its run.
+	int format;            ///< The libsndfile format to write it in.
+	std::uint32_t rate;    ///< The sample rate, in Hz.
+	std::uint8_t channels; ///< The number of channels.
+};
+
+/// The corpus: the formats and shapes of file that playd is usually given.
+constexpr std::array<CorpusFile, 6> CORPUS{{
+        {"pcm16_44100_2.wav", SF_FORMAT_WAV | SF_FORMAT_PCM_16, 44100, 2},
+        {"pcm24_48000_2.wav", SF_FORMAT_WAV | SF_FORMAT_PCM_24, 48000, 2},
+        {"float_96000_2.wav", SF_FORMAT_WAV | SF_FORMAT_FLOAT, 96000, 2},
+        {"pcm16_22050_1.wav", SF_FORMAT_WAV | SF_FORMAT_PCM_16, 22050, 1},
+        {"pcm16_44100_2.flac", SF_FORMAT_FLAC | SF_FORMAT_PCM_16, 44100, 2},
+        {"pcm24_48000_6.flac", SF_FORMAT_FLAC | SF_FORMAT_PCM_24, 48000, 6},
+}};
+
+/// Pi, which M_PI would give us if it were standard.
+constexpr double PI = 3.14159265358979323846;
+
+/// The number of times each file is opened to time opening it.
+constexpr int DECODE_OPENS = 20;
+
+/**
+ * Writes a file of the corpus: a few tones per channel, with a little
+ * noise so that FLAC can't squash it to nothing.
+ * @param path The path to write to.
+ * @param file The file's format and shape.
+ * @param seconds The length of the file.
+ * @exception FileError if the file can't be written.
+ */
+static void WriteCorpusFile(const std::string &path, const CorpusFile &file, std::uint64_t seconds)
+{
+	SF_INFO info{};
+	info.samplerate = static_cast<int>(file.rate);
+	info.channels = file.channels;
+	info.format = file.format;
+
+	auto *out = sf_open(path.c_str(), SFM_WRITE, &info);
+	if (out == nullptr) throw FileError("can't write " + path + ": " + sf_strerror(nullptr));
+
+	constexpr sf_count_t BLOCK_FRAMES = 4096;
+	std::vector<int> block(BLOCK_FRAMES * file.channels);
+	std::uint32_t noise = 1;
+	const auto frames = seconds * file.rate;
+	for (std::uint64_t done = 0; done < frames; done += BLOCK_FRAMES) {
+		for (sf_count_t i = 0; i < BLOCK_FRAMES; i++) {
+			const auto t = static_cast<double>(done + i) / file.rate;
+			for (std::uint8_t c = 0; c < file.channels; c++) {
+				noise = noise * 1664525U + 1013904223U;
+				const auto tone = 0.3 * std::sin(2 * PI * (220.0 + 110.0 * c) * t) +
+				                  0.2 * std::sin(2 * PI * 1234.5 * t) +
+				                  0.01 * (static_cast<double>(noise >> 8U) / (1U << 24U) - 0.5);
+				block[i * file.channels + c] = static_cast<int>(tone * INT32_MAX);
+			}
+		}
+		sf_writef_int(out, block.data(), BLOCK_FRAMES);
+	}
+	sf_close(out);
+}
+
+/**
+ * Times opening, decoding and seeking in one file.
+ * @param name The name of the run.
+ * @param path The path to the file.
+ * @param make The function that opens the file as a Source.
+ * @param seconds The amount of audio to decode; the file is decoded over
+ *   and over to make this up.
+ * @param seeks The number of random seeks to make.
+ * @return The report.
+ */
+static JsonObject DecodeFile(std::string_view name, const std::string &path,
+                             const Player::SourceFn &make, std::uint64_t seconds, std::uint64_t seeks)
+{
+	// Opening: the first open warms the page cache, so isn't counted.
+	auto src = make(path, nullptr, Audio::SourceUse::PLAYBACK);
+	const auto open_start = std::chrono::steady_clock::now();
+	for (int i = 0; i < DECODE_OPENS; i++) src = make(path, nullptr, Audio::SourceUse::PLAYBACK);
+	const std::chrono::nanoseconds opening = std::chrono::steady_clock::now() - open_start;
+
+	// Sequential decoding.
+	const auto frames = seconds * src->SampleRate();
+	std::uint64_t done = 0;
+	std::uint64_t bytes = 0;
+	std::uint64_t decodes = 0;
+	const auto decode_start = std::chrono::steady_clock::now();
+	while (done < frames) {
+		auto [state, frame] = src->Decode();
+		if (state == Audio::Source::DecodeState::END_OF_FILE) {
+			src->Seek(0);
+			continue;
+		}
+		bytes += frame.size();
+		done += frame.size() / src->BytesPerSample();
+		decodes++;
+	}
+	const std::chrono::nanoseconds decoding = std::chrono::steady_clock::now() - decode_start;
+
+	// Random seeks, each followed by the decode that playing would need.
+	std::uint64_t seed = 1;
+	const auto length = src->Length();
+	const auto seek_start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < seeks && 0 < length; i++) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		src->Seek((seed >> 16U) % length);
+		src->Decode();
+	}
+	const std::chrono::nanoseconds seeking = std::chrono::steady_clock::now() - seek_start;
+
+	const auto audio_seconds = static_cast<double>(done) / src->SampleRate();
+	return JsonObject{}
+	        .Add("file", name)
+	        .Add("rate", static_cast<std::uint64_t>(src->SampleRate()))
+	        .Add("channels", static_cast<std::uint64_t>(src->ChannelCount()))
+	        .Add("open_us", static_cast<double>(opening.count()) / 1e3 / DECODE_OPENS)
+	        .Add("realtime_factor", audio_seconds * 1e9 / static_cast<double>(decoding.count()))
+	        .Add("bytes_per_audio_second", static_cast<double>(bytes) / audio_seconds)
+	        .Add("bytes_per_decode", static_cast<double>(bytes) / static_cast<double>(decodes))
+	        .Add("seek_us", seeks == 0 ? 0.0 : static_cast<double>(seeking.count()) / 1e3 / seeks);
+}
+
+JsonObject Decode(const Options &options)
+{
+	const auto length = IntOption(options, "length", 60);
+	const auto seconds = IntOption(options, "seconds", 600);
+	const auto seeks = IntOption(options, "seeks", 1000);
+	if (length == 0) throw ConfigError("--length must be at least 1");
+
+	std::string dir{"/tmp/playd_bench.XXXXXX"};
+	if (mkdtemp(dir.data()) == nullptr) throw FileError("can't make a directory for the corpus");
+
+	std::vector<JsonObject> runs;
+	std::vector<std::string> written;
+	const auto remove_corpus = [&dir, &written] {
+		for (const auto &path : written) std::remove(path.c_str());
+		rmdir(dir.c_str());
+	};
+	try {
+		for (const auto &file : CORPUS) {
+			auto &path = written.emplace_back(dir + "/" + std::string{file.name});
+			WriteCorpusFile(path, file, length);
+			runs.push_back(DecodeFile(file.name, path, Audio::SndfileSource::MakeUnique, seconds, seeks));
+		}
+
+		// libsndfile can't write MP3, so MP3s come from the caller.
+		if (auto mp3 = options.find("mp3"); mp3 != options.end()) {
+#ifdef WITH_MP3
+			runs.push_back(DecodeFile(mp3->second, mp3->second, Audio::MP3Source::MakeUnique, seconds, seeks));
+#else
+			throw ConfigError("--mp3 given, but playd was built without MP3 support");
+#endif // WITH_MP3
+		}
+	} catch (...) {
+		remove_corpus();
+		throw;
+	}
+	remove_corpus();
+
+	return JsonObject{}
+	        .Add("benchmark", "decode")
+	        .Add("length", length)
+	        .Add("seconds", seconds)
+	        .Add("seeks", seeks)
+	        .Add("runs", runs);
+}
+
+} // namespace Playd::Bench
+
+#endif // WITH_SNDFILE
@@ -0,0 +1,82 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The gain benchmark: the throughput of the gain kernel.
+ * @see bench/bench.h
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "../audio/dsp.h"
+#include "../audio/sample_format.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/// The sample formats to benchmark, with their names.
+constexpr std::array<std::pair<Audio::SampleFormat, std::string_view>, Audio::SAMPLE_FORMAT_COUNT> GAIN_FORMATS{{
+        {Audio::SampleFormat::UINT8, "uint8"},
+        {Audio::SampleFormat::SINT8, "sint8"},
+        {Audio::SampleFormat::SINT16, "sint16"},
+        {Audio::SampleFormat::SINT32, "sint32"},
+        {Audio::SampleFormat::FLOAT32, "float32"},
+}};
+
+/// The number of stereo samples scaled per call, about one decoded frame's worth.
+constexpr std::size_t GAIN_SAMPLES = 4608;
+
+/**
+ * Scales samples over and over, and reports how fast it went.
+ * @param fmt The sample format.
+ * @param samples The total number of samples to scale.
+ * @param step The per-frame gain step; non-zero to ramp.
+ * @return The throughput, in samples per nanosecond.
+ */
+static double SamplesPerNs(Audio::SampleFormat fmt, std::uint64_t samples, float step)
+{
+	// A quiet buffer doesn't saturate, so every sample takes the usual path.
+	std::vector<std::byte> buf(GAIN_SAMPLES * Audio::sample_format_bps[static_cast<std::size_t>(fmt)],
+	                           std::byte{0x10});
+
+	const auto calls = samples / GAIN_SAMPLES;
+	const auto start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < calls; i++) {
+		// Alternating just above and below unity keeps the data steady.
+		const auto gain = i % 2 == 0 ? 1.01f : 0.99f;
+		Audio::ScaleSamples(buf, fmt, 2, gain, i % 2 == 0 ? -step : step);
+	}
+	const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+	return static_cast<double>(calls * GAIN_SAMPLES) / static_cast<double>(elapsed.count());
+}
+
+JsonObject Gain(const Options &options)
+{
+	const auto samples = IntOption(options, "megasamples", 256) * 1000000;
+
+	std::vector<JsonObject> runs;
+	for (const auto &[fmt, name] : GAIN_FORMATS) {
+		runs.push_back(JsonObject{}
+		                       .Add("format", name)
+		                       .Add("hold_samples_per_ns", SamplesPerNs(fmt, samples, 0.0f))
+		                       .Add("ramp_samples_per_ns", SamplesPerNs(fmt, samples, 1e-6f)));
+	}
+
+	return JsonObject{}
+	        .Add("benchmark", "gain")
+	        .Add("samples", samples)
+#ifdef PLAYD_DSP_SSE2
+	        .Add("kernels", "sse2")
+#else
+	        .Add("kernels", "scalar")
+#endif // PLAYD_DSP_SSE2
+	        .Add("runs", runs);
+}
+
+} // namespace Playd::Bench
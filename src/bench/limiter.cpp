@@ -0,0 +1,88 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The limiter benchmark: the cost of the look-ahead output limiter.
+ * @see bench/bench.h
+ */
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "../audio/dsp.h"
+#include "../audio/limiter.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/// The numbers of channels to limit: mono, stereo and 5.1.
+constexpr std::array<std::uint8_t, 3> LIMIT_CHANNELS{{1, 2, 6}};
+
+/// The number of frames limited per call, about what SDL asks for at a time.
+constexpr std::size_t LIMIT_FRAMES = 1024;
+
+/// The sample rate of the audio limited.
+constexpr std::uint32_t LIMIT_RATE = 44100;
+
+/**
+ * Limits audio with some number of channels, and reports how long it took.
+ * @param channels The number of channels.
+ * @param seconds The amount of audio to limit.
+ * @return The report.
+ */
+static JsonObject LimitChannels(std::uint8_t channels, std::chrono::seconds seconds)
+{
+	// A 441Hz sine at twice full scale, against a -1dBTP ceiling, keeps
+	// the gain moving all the time.
+	std::vector<float> feed(LIMIT_FRAMES * channels);
+	for (std::size_t i = 0; i < LIMIT_FRAMES; i++) {
+		const auto x = static_cast<float>(2.0 * std::sin(6.28318530717958647692 * static_cast<double>(i) / 100.0));
+		for (std::uint8_t c = 0; c < channels; c++) feed[i * channels + c] = x;
+	}
+
+	Audio::Limiter limiter{LIMIT_RATE, channels, 0.891f};
+	std::vector<float> block(feed.size());
+	const auto calls = static_cast<std::uint64_t>(seconds.count()) * LIMIT_RATE / LIMIT_FRAMES;
+	std::chrono::nanoseconds limiting{0};
+	for (std::uint64_t i = 0; i < calls; i++) {
+		block = feed;
+
+		const auto start = std::chrono::steady_clock::now();
+		limiter.Process(block);
+		limiting += std::chrono::steady_clock::now() - start;
+	}
+
+	const auto frames = static_cast<double>(calls * LIMIT_FRAMES);
+	const auto audio_ns = frames * 1e9 / LIMIT_RATE;
+	return JsonObject{}
+	        .Add("channels", static_cast<std::uint64_t>(channels))
+	        .Add("frames", static_cast<std::uint64_t>(frames))
+	        .Add("latency_frames", static_cast<std::uint64_t>(limiter.Latency()))
+	        .Add("ns_per_frame", static_cast<double>(limiting.count()) / frames)
+	        .Add("ns_per_channel_frame", static_cast<double>(limiting.count()) / frames / channels)
+	        .Add("realtime_percent", 100.0 * static_cast<double>(limiting.count()) / audio_ns);
+}
+
+JsonObject Limiter(const Options &options)
+{
+	const std::chrono::seconds seconds(IntOption(options, "seconds", 600));
+
+	std::vector<JsonObject> runs;
+	for (const auto channels : LIMIT_CHANNELS) runs.push_back(LimitChannels(channels, seconds));
+
+	return JsonObject{}
+	        .Add("benchmark", "limiter")
+	        .Add("seconds", static_cast<std::uint64_t>(seconds.count()))
+#ifdef PLAYD_DSP_SSE2
+	        .Add("kernels", "sse2")
+#else
+	        .Add("kernels", "scalar")
+#endif // PLAYD_DSP_SSE2
+	        .Add("runs", runs);
+}
+
+} // namespace Playd::Bench
@@ -0,0 +1,614 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The loadgen benchmark: many clients driving one playd over its protocol.
+ * @see bench/bench.h
+ */
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <uv.h>
+
+#include "../errors.h"
+#include "../io.h"
+#include "../player.h"
+#include "../tokeniser.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/// The commands sent by default, each with its share of the load.
+constexpr std::string_view LOADGEN_MIX{"fload:1,play:4,stop:4,pos:8,dump:2"};
+
+/// The commands the load generator knows how to send.
+constexpr std::array<std::string_view, 5> LOADGEN_COMMANDS{{"fload", "play", "stop", "pos", "dump"}};
+
+/// How long to wait for playd to start listening.
+constexpr std::chrono::seconds LOADGEN_CONNECT_TIMEOUT{5};
+
+/// The furthest into the file that pos commands seek, in microseconds.
+constexpr std::uint64_t LOADGEN_MAX_POS = 60'000'000;
+
+/// A command in the mix.
+struct MixEntry {
+	std::string_view command; ///< The command's name.
+	std::uint64_t weight;     ///< Its share of the commands sent.
+};
+
+/**
+ * Parses a command mix.
+ * @param mix The mix, as COMMAND:WEIGHT pairs separated by commas; a
+ *   missing weight counts as 1.
+ * @return The mix.
+ * @exception ConfigError if the mix is malformed, or sends nothing.
+ */
+static std::vector<MixEntry> ParseMix(std::string_view mix)
+{
+	std::vector<MixEntry> entries;
+	while (!mix.empty()) {
+		const auto comma = mix.find(',');
+		const auto item = mix.substr(0, comma);
+		mix = comma == std::string_view::npos ? std::string_view{} : mix.substr(comma + 1);
+
+		const auto colon = item.find(':');
+		const auto name = item.substr(0, colon);
+		const auto command = std::find(LOADGEN_COMMANDS.begin(), LOADGEN_COMMANDS.end(), name);
+		if (command == LOADGEN_COMMANDS.end()) {
+			throw ConfigError("--mix: unknown command '" + std::string{name} + "'");
+		}
+
+		std::uint64_t weight = 1;
+		if (colon != std::string_view::npos) {
+			const auto digits = item.substr(colon + 1);
+			auto [p, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), weight);
+			if (ec != std::errc{} || p != digits.data() + digits.size()) {
+				throw ConfigError("--mix: bad weight for '" + std::string{name} + "'");
+			}
+		}
+		if (0 < weight) entries.push_back(MixEntry{*command, weight});
+	}
+	if (entries.empty()) throw ConfigError("--mix needs at least one command with a weight");
+	return entries;
+}
+
+/**
+ * Adds latency percentiles to a report.
+ * @param report The report.
+ * @param ns The latencies, in nanoseconds, in any order.
+ * @return The report.
+ */
+static JsonObject &AddPercentiles(JsonObject &report, std::vector<std::uint64_t> ns)
+{
+	std::sort(ns.begin(), ns.end());
+	const auto at = [&ns](double p) {
+		if (ns.empty()) return 0.0;
+		const auto rank = static_cast<std::size_t>(std::ceil(p * static_cast<double>(ns.size())));
+		return static_cast<double>(ns[std::max<std::size_t>(rank, 1) - 1]) / 1e3;
+	};
+	return report.Add("count", static_cast<std::uint64_t>(ns.size()))
+	        .Add("p50_us", at(0.5))
+	        .Add("p90_us", at(0.9))
+	        .Add("p99_us", at(0.99))
+	        .Add("p999_us", at(0.999))
+	        .Add("max_us", at(1.0));
+}
+
+/**
+ * Waits for something to be listening on a port, as a freshly started
+ * playd may not be yet.
+ * @param addr The address to try.
+ * @exception NetError if nothing listens within LOADGEN_CONNECT_TIMEOUT.
+ */
+static void WaitForListener(const sockaddr_in &addr)
+{
+	const auto deadline = std::chrono::steady_clock::now() + LOADGEN_CONNECT_TIMEOUT;
+	while (true) {
+		const auto fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0) throw NetError("loadgen: can't make a socket");
+		const auto ok = connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0;
+		close(fd);
+		if (ok) return;
+
+		if (deadline < std::chrono::steady_clock::now()) throw NetError("loadgen: nothing is listening");
+		std::this_thread::sleep_for(std::chrono::milliseconds{20});
+	}
+}
+
+class LoadGenerator;
+
+/// One of the load generator's connections to playd.
+struct LoadConnection {
+	uv_tcp_t tcp;             ///< The connection.
+	uv_connect_t connect;     ///< The connection request.
+	LoadGenerator *generator; ///< The generator driving this connection.
+	std::size_t index;        ///< This connection's place in the generator.
+	Tokeniser tokeniser;      ///< Splits what playd sends into lines.
+	std::string tag;          ///< The tag of the command awaiting an ACK, if any.
+	std::string_view command; ///< The command awaiting an ACK.
+	std::uint64_t sent;       ///< When that command was sent, from uv_hrtime.
+	std::uint64_t sequence;   ///< The number of commands sent so far.
+	std::uint64_t heard;      ///< The last broadcast event this connection heard.
+};
+
+/// A command line on its way to playd.
+struct LoadWrite {
+	uv_write_t req;   ///< The write request.
+	std::string data; ///< The line, which must live until it's written.
+};
+
+/**
+ * Drives a number of connections to one playd channel.
+ *
+ * Each run has two phases.  First, every connection sends commands drawn
+ * from the mix, each waiting for the ACK to its last command before it
+ * sends the next, and the time from sending to ACK is recorded.  Then one
+ * connection toggles playback, and the time until every connection hears
+ * the resulting broadcast is recorded.
+ *
+ * Everything runs on a private libuv loop on the calling thread.
+ */
+class LoadGenerator
+{
+public:
+	/**
+	 * Constructs a LoadGenerator.
+	 * @param addr The address of the playd channel.
+	 * @param connections The number of connections to open.
+	 * @param mix The commands to send.
+	 * @param file The file for fload commands.
+	 */
+	LoadGenerator(const sockaddr_in &addr, std::uint64_t connections, std::vector<MixEntry> mix, std::string file)
+	    : addr{addr}, mix{std::move(mix)}, file{std::move(file)}
+	{
+		uv_loop_init(&this->loop);
+		uv_timer_init(&this->loop, &this->timer);
+		this->timer.data = this;
+		for (std::uint64_t i = 0; i < connections; i++) {
+			auto &conn = *this->connections.emplace_back(std::make_unique<LoadConnection>());
+			conn.generator = this;
+			conn.index = i;
+			uv_tcp_init(&this->loop, &conn.tcp);
+			conn.tcp.data = &conn;
+		}
+		for (const auto &entry : this->mix) this->total_weight += entry.weight;
+	}
+
+	/// Deleted copy constructor.
+	LoadGenerator(const LoadGenerator &) = delete;
+
+	/// Deleted copy-assignment.
+	LoadGenerator &operator=(const LoadGenerator &) = delete;
+
+	/// Destructs a LoadGenerator, closing its connections.
+	~LoadGenerator()
+	{
+		for (auto &conn : this->connections) uv_close(reinterpret_cast<uv_handle_t *>(&conn->tcp), nullptr);
+		uv_close(reinterpret_cast<uv_handle_t *>(&this->timer), nullptr);
+		uv_run(&this->loop, UV_RUN_DEFAULT);
+		uv_loop_close(&this->loop);
+	}
+
+	/**
+	 * Opens every connection.
+	 * @exception NetError if a connection fails.
+	 */
+	void Connect()
+	{
+		WaitForListener(this->addr);
+
+		this->phase = Phase::CONNECTING;
+		for (auto &conn : this->connections) {
+			uv_tcp_connect(&conn->connect, &conn->tcp, reinterpret_cast<const sockaddr *>(&this->addr),
+			               &LoadGenerator::UvConnectCallback);
+		}
+		this->Run();
+	}
+
+	/**
+	 * Sends commands on every connection for a while, then waits for the
+	 * outstanding ACKs.
+	 * @param seconds How long to send commands for.
+	 * @exception NetError if a connection fails.
+	 */
+	void Drive(std::chrono::seconds seconds)
+	{
+		this->phase = Phase::DRIVING;
+		const auto start = uv_hrtime();
+		for (auto &conn : this->connections) this->SendNext(*conn);
+
+		uv_timer_start(
+		        &this->timer,
+		        [](uv_timer_t *handle) {
+			        auto *self = static_cast<LoadGenerator *>(handle->data);
+			        self->phase = Phase::DRAINING;
+			        if (self->outstanding == 0) uv_stop(&self->loop);
+		        },
+		        std::chrono::milliseconds{seconds}.count(), 0);
+		this->Run();
+		this->driven = uv_hrtime() - start;
+	}
+
+	/**
+	 * Toggles playback from the first connection, over and over, timing
+	 * how long each broadcast takes to reach every connection.
+	 * @param broadcasts The number of broadcasts to time.
+	 * @exception NetError if a connection fails.
+	 */
+	void FanOut(std::uint64_t broadcasts)
+	{
+		if (broadcasts == 0) return;
+		this->broadcasts_left = broadcasts;
+
+		// Broadcasts from the first phase may still be on their way.  A
+		// connection has heard all of them once it has the ACK to a command
+		// sent after them, as playd answers each client in order.
+		this->phase = Phase::SETTLING;
+		for (auto &conn : this->connections) this->Send(*conn, "dump");
+		this->Run();
+	}
+
+	/**
+	 * Reports the results of the run.
+	 * @return The report.
+	 */
+	JsonObject Report() const
+	{
+		std::vector<std::uint64_t> all;
+		std::vector<JsonObject> by_command;
+		for (const auto &[command, ns] : this->latencies) {
+			all.insert(all.end(), ns.begin(), ns.end());
+			JsonObject report;
+			report.Add("command", command);
+			by_command.push_back(AddPercentiles(report, ns));
+		}
+
+		const auto status = [this](const std::string &name) {
+			const auto count = this->statuses.find(name);
+			return count == this->statuses.end() ? 0 : count->second;
+		};
+
+		JsonObject ack;
+		AddPercentiles(ack, all);
+		JsonObject each;
+		AddPercentiles(each, this->heard_each);
+		JsonObject last;
+		AddPercentiles(last, this->heard_last);
+		return JsonObject{}
+		        .Add("commands", static_cast<std::uint64_t>(all.size()))
+		        .Add("commands_per_second", static_cast<double>(all.size()) * 1e9 / static_cast<double>(this->driven))
+		        .Add("ok", status("OK"))
+		        .Add("fail", status("FAIL"))
+		        .Add("what", status("WHAT"))
+		        .Add("ack", ack)
+		        .Add("ack_by_command", by_command)
+		        .Add("fanout_each", each)
+		        .Add("fanout_last", last);
+	}
+
+private:
+	/// What the generator is doing.
+	enum class Phase : std::uint8_t {
+		CONNECTING,  ///< Opening connections.
+		DRIVING,     ///< Sending commands and timing their ACKs.
+		DRAINING,    ///< Waiting for the last ACKs of DRIVING.
+		SETTLING,    ///< Waiting for stray broadcasts before FANNING_OUT.
+		FANNING_OUT, ///< Timing broadcasts.
+	};
+
+	sockaddr_in addr;                            ///< The address of playd.
+	uv_loop_t loop;                              ///< The generator's loop.
+	uv_timer_t timer;                            ///< Ends DRIVING.
+	std::vector<std::unique_ptr<LoadConnection>> connections; ///< The connections.
+	std::vector<MixEntry> mix;                   ///< The commands to send.
+	std::uint64_t total_weight = 0;              ///< The sum of the mix's weights.
+	std::string file;                            ///< The file for fload commands.
+	std::mt19937_64 random{1350};                ///< Picks commands and positions.
+	Phase phase = Phase::CONNECTING;             ///< What the generator is doing.
+	std::uint64_t opened = 0;                    ///< Connections open so far.
+	std::uint64_t outstanding = 0;               ///< Commands awaiting an ACK.
+	std::optional<std::string> failure;          ///< Why the loop was stopped early, if it was.
+	std::uint64_t driven = 0;                    ///< The length of DRIVING and DRAINING, in ns.
+
+	/// ACK latencies in DRIVING and DRAINING, by command, in ns.
+	std::map<std::string_view, std::vector<std::uint64_t>> latencies;
+
+	/// ACK statuses in DRIVING and DRAINING.
+	std::map<std::string, std::uint64_t> statuses;
+
+	std::uint64_t broadcasts_left = 0; ///< Broadcasts still to time.
+	std::uint64_t event = 0;           ///< The broadcast being timed.
+	std::string_view awaited;          ///< The response code of that broadcast.
+	std::uint64_t event_sent = 0;      ///< When it was asked for, from uv_hrtime.
+	std::uint64_t event_heard = 0;     ///< Connections that have heard it.
+	bool event_acked = false;          ///< Whether its command has been ACKed.
+	int refusals = 0;                  ///< Toggles refused in a row.
+
+	/// Times from asking for each broadcast to each connection hearing it, in ns.
+	std::vector<std::uint64_t> heard_each;
+
+	/// Times from asking for each broadcast to the last connection hearing it, in ns.
+	std::vector<std::uint64_t> heard_last;
+
+	/**
+	 * Runs the loop until the current phase stops it.
+	 * @exception NetError if a connection failed.
+	 */
+	void Run()
+	{
+		uv_run(&this->loop, UV_RUN_DEFAULT);
+		if (this->failure) throw NetError("loadgen: " + *this->failure);
+	}
+
+	/**
+	 * Stops the loop because something went wrong.
+	 * @param why What went wrong.
+	 */
+	void Fail(std::string why)
+	{
+		if (!this->failure) this->failure = std::move(why);
+		uv_stop(&this->loop);
+	}
+
+	/**
+	 * Sends a command.
+	 * @param conn The connection to send it on.
+	 * @param command The command, which must outlive its ACK.
+	 */
+	void Send(LoadConnection &conn, std::string_view command)
+	{
+		conn.tag = std::to_string(conn.index) + ":" + std::to_string(conn.sequence++);
+		conn.command = command;
+
+		auto *write = new LoadWrite;
+		write->data = conn.tag + " " + std::string{command};
+		if (command == "fload") {
+			write->data += " \"";
+			for (const auto c : this->file) {
+				if (c == '"' || c == '\\') write->data.push_back('\\');
+				write->data.push_back(c);
+			}
+			write->data += "\"";
+		} else if (command == "pos") {
+			write->data += " " + std::to_string(this->random() % LOADGEN_MAX_POS);
+		}
+		write->data += "\n";
+
+		this->outstanding++;
+		conn.sent = uv_hrtime();
+		auto buf = uv_buf_init(write->data.data(), write->data.size());
+		uv_write(&write->req, reinterpret_cast<uv_stream_t *>(&conn.tcp), &buf, 1, [](uv_write_t *req, int status) {
+			auto *write = reinterpret_cast<LoadWrite *>(req);
+			if (status < 0) {
+				auto *conn = static_cast<LoadConnection *>(req->handle->data);
+				conn->generator->Fail(std::string{"write failed: "} + uv_strerror(status));
+			}
+			delete write;
+		});
+	}
+
+	/**
+	 * Sends a command drawn from the mix.
+	 * @param conn The connection to send it on.
+	 */
+	void SendNext(LoadConnection &conn)
+	{
+		auto pick = this->random() % this->total_weight;
+		for (const auto &entry : this->mix) {
+			if (pick < entry.weight) return this->Send(conn, entry.command);
+			pick -= entry.weight;
+		}
+	}
+
+	/**
+	 * Asks for the next broadcast to be timed.
+	 * @param command play or stop.
+	 */
+	void StartEvent(std::string_view command)
+	{
+		this->event++;
+		this->awaited = command == "play" ? "PLAY" : "STOP";
+		this->event_heard = 0;
+		this->event_acked = false;
+		this->event_sent = uv_hrtime();
+		this->Send(*this->connections.front(), command);
+	}
+
+	/// Moves on from a broadcast once it has been heard everywhere and ACKed.
+	void FinishEvent()
+	{
+		if (!this->event_acked || this->event_heard < this->connections.size()) return;
+		if (--this->broadcasts_left == 0) return uv_stop(&this->loop);
+		this->StartEvent(this->awaited == "PLAY" ? "stop" : "play");
+	}
+
+	/**
+	 * Handles a line from playd.
+	 * @param conn The connection that received it.
+	 * @param words The line's words.
+	 */
+	void Heard(LoadConnection &conn, const std::vector<std::string> &words)
+	{
+		if (words.size() < 2) return;
+		if (words[0] == conn.tag && words[1] == "ACK") return this->Acked(conn, words.size() < 3 ? "" : words[2]);
+
+		if (this->phase != Phase::FANNING_OUT || words[0] != Response::NOREQUEST) return;
+		if (words[1] != this->awaited || conn.heard == this->event) return;
+		conn.heard = this->event;
+
+		const auto delay = uv_hrtime() - this->event_sent;
+		this->heard_each.push_back(delay);
+		if (++this->event_heard == this->connections.size()) this->heard_last.push_back(delay);
+		this->FinishEvent();
+	}
+
+	/**
+	 * Handles the ACK to a connection's command.
+	 * @param conn The connection.
+	 * @param status The ACK's status.
+	 */
+	void Acked(LoadConnection &conn, const std::string &status)
+	{
+		const auto latency = uv_hrtime() - conn.sent;
+		const auto command = conn.command;
+		conn.tag.clear();
+		this->outstanding--;
+
+		switch (this->phase) {
+			case Phase::DRIVING:
+			case Phase::DRAINING:
+				this->latencies[command].push_back(latency);
+				this->statuses[status]++;
+				if (this->phase == Phase::DRIVING) {
+					this->SendNext(conn);
+				} else if (this->outstanding == 0) {
+					uv_stop(&this->loop);
+				}
+				break;
+			case Phase::SETTLING:
+				if (this->outstanding != 0) break;
+				this->phase = Phase::FANNING_OUT;
+				this->StartEvent("play");
+				break;
+			case Phase::FANNING_OUT:
+				// Playing when already playing (or stopping when stopped)
+				// fails without a broadcast, so try the other way.
+				if (status != "OK" && this->event_heard == 0) {
+					if (++this->refusals == 2) return this->Fail("can't play or stop; is a file loaded?");
+					this->StartEvent(command == "play" ? "stop" : "play");
+					break;
+				}
+				this->refusals = 0;
+				this->event_acked = true;
+				this->FinishEvent();
+				break;
+			case Phase::CONNECTING:
+				break;
+		}
+	}
+
+	/// libuv callback for a connection being opened.
+	static void UvConnectCallback(uv_connect_t *req, int status)
+	{
+		auto *conn = static_cast<LoadConnection *>(req->handle->data);
+		auto *self = conn->generator;
+		if (status < 0) return self->Fail(std::string{"connect failed: "} + uv_strerror(status));
+
+		uv_tcp_nodelay(&conn->tcp, 1);
+		uv_read_start(
+		        req->handle,
+		        [](uv_handle_t *, size_t size, uv_buf_t *buf) { *buf = uv_buf_init(new char[size], size); },
+		        &LoadGenerator::UvReadCallback);
+		if (++self->opened == self->connections.size()) uv_stop(&self->loop);
+	}
+
+	/// libuv callback for data arriving on a connection.
+	static void UvReadCallback(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
+	{
+		auto *conn = static_cast<LoadConnection *>(stream->data);
+		if (0 < nread) {
+			for (const auto &line : conn->tokeniser.Feed(std::string{buf->base, static_cast<std::size_t>(nread)})) {
+				conn->generator->Heard(*conn, line);
+			}
+		}
+		delete[] buf->base;
+		if (nread < 0) conn->generator->Fail(std::string{"playd hung up: "} + uv_strerror(nread));
+	}
+};
+
+/**
+ * Runs a playd channel for the load generator, until sent SIGINT.
+ * @param port The port to listen on.
+ * @param file The file to load at the start.
+ */
+static void ServeLoad(std::uint64_t port, const std::string &file)
+{
+	// As in playd proper: clients hanging up mid-write mustn't kill us.
+	signal(SIGPIPE, SIG_IGN);
+
+	const std::map<std::string, Player::SourceFn> sources{{"bench", BenchSource::MakeUnique}};
+	Player player{0, &std::make_unique<BenchSink, const Audio::Source &, int>, sources};
+
+	std::vector<Player *> players{&player};
+	IO::Core io{players};
+	player.Load(Response::NOREQUEST, file);
+	io.Run(BENCH_HOST, std::to_string(port));
+}
+
+JsonObject LoadGen(const Options &options)
+{
+	const auto connections = IntOption(options, "connections", 16);
+	const std::chrono::seconds seconds(IntOption(options, "seconds", 10));
+	const auto broadcasts = IntOption(options, "broadcasts", 200);
+	const auto port = IntOption(options, "port", 13600);
+	if (connections == 0) throw ConfigError("--connections must be at least 1");
+	if (port == 0 || UINT16_MAX < port) throw ConfigError("--port must be a TCP port");
+
+	const auto mix_option = options.find("mix");
+	const auto mix = ParseMix(mix_option == options.end() ? LOADGEN_MIX : std::string_view{mix_option->second});
+	const auto file_option = options.find("file");
+	const auto file = file_option == options.end() ? std::string{"/loadgen.bench"} : file_option->second;
+
+	// Unless pointed at a playd, run our own, with a sink that plays in real
+	// time but needs no audio device.
+	const auto host_option = options.find("host");
+	const auto host = host_option == options.end() ? std::string{BENCH_HOST} : host_option->second;
+	std::optional<pid_t> server;
+	if (host_option == options.end()) server = StartChild([port, file] { ServeLoad(port, file); });
+
+	sockaddr_in addr{};
+	JsonObject results;
+	try {
+		if (uv_ip4_addr(host.c_str(), static_cast<int>(port), &addr) != 0) {
+			throw ConfigError("--host needs an IPv4 address, not '" + host + "'");
+		}
+
+		LoadGenerator generator{addr, connections, mix, file};
+		generator.Connect();
+		generator.Drive(seconds);
+		generator.FanOut(broadcasts);
+		results = generator.Report();
+	} catch (...) {
+		if (server) {
+			kill(*server, SIGINT);
+			waitpid(*server, nullptr, 0);
+		}
+		throw;
+	}
+
+	auto report = JsonObject{}
+	                      .Add("benchmark", "loadgen")
+	                      .Add("connections", connections)
+	                      .Add("seconds", static_cast<std::uint64_t>(seconds.count()))
+	                      .Add("results", results);
+
+	// The IO core quits on SIGINT, so that's how we stop it.
+	if (server) {
+		kill(*server, SIGINT);
+		const auto usage = WaitForChild(*server);
+		report.Add("server_cpu_ms", static_cast<double>(usage.cpu.count()) / 1000.0)
+		        .Add("server_rss_kib", usage.max_rss_kib);
+	}
+	return report;
+}
+
+} // namespace Playd::Bench
@@ -0,0 +1,57 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The loudness benchmark: how far ahead of real time analysis runs.
+ * @see bench/bench.h
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "../audio/dsp.h"
+#include "../audio/loudness.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+JsonObject Loudness(const Options &options)
+{
+	const std::chrono::seconds seconds(IntOption(options, "seconds", 600));
+
+	BenchSource source{"loudness.bench"};
+	Audio::LoudnessMeter meter{source.SampleRate(), source.ChannelCount()};
+	const auto frames = static_cast<std::uint64_t>(seconds.count()) * source.SampleRate();
+
+	// As in the analysis itself, each decoded frame is converted and metered;
+	// only that is timed, as the real decoder is the file's business.
+	std::vector<float> samples;
+	std::uint64_t done = 0;
+	std::chrono::nanoseconds metering{0};
+	while (done < frames) {
+		auto [state, bytes] = source.Decode();
+		if (state == Audio::Source::DecodeState::END_OF_FILE) source.Seek(0);
+
+		const auto start = std::chrono::steady_clock::now();
+		samples.resize(bytes.size() / sizeof(std::int16_t));
+		Audio::ToFloat(bytes, source.OutputSampleFormat(), samples);
+		meter.Add(samples);
+		metering += std::chrono::steady_clock::now() - start;
+
+		done += bytes.size() / source.BytesPerSample();
+	}
+	const auto result = meter.Result();
+
+	const auto audio_ns = static_cast<double>(done) * 1e9 / source.SampleRate();
+	return JsonObject{}
+	        .Add("benchmark", "loudness")
+	        .Add("seconds", static_cast<std::uint64_t>(seconds.count()))
+	        .Add("ns_per_frame", static_cast<double>(metering.count()) / done)
+	        .Add("realtime_factor", audio_ns / static_cast<double>(metering.count()))
+	        .Add("integrated_lufs", result.integrated)
+	        .Add("true_peak_dbtp", result.true_peak);
+}
+
+} // namespace Playd::Bench
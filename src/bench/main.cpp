@@ -0,0 +1,102 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Main entry point for playd_bench, which runs one benchmark and prints its
+ * results as JSON.
+ * @see bench/bench.h
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+
+#ifdef WITH_MP3
+#include <mpg123.h>
+#endif // WITH_MP3
+
+#include "../audio/device.h"
+#include "../errors.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/// Map from benchmark names to their descriptions and functions.
+static const std::map<std::string, std::pair<std::string_view, BenchmarkFn>, std::less<>> BENCHMARKS{
+#ifdef WITH_SNDFILE
+        {"decode", {"speed of opening, decoding and seeking files of each format", Decode}},
+#endif // WITH_SNDFILE
+        {"gain", {"throughput of the gain kernel in each sample format", Gain}},
+        {"limiter", {"cost of the output limiter per channel", Limiter}},
+        {"loadgen", {"command-to-ACK latency and broadcast fan-out under many clients", LoadGen}},
+        {"loudness", {"speed of loudness analysis against real time", Loudness}},
+        {"meter", {"cost of live level metering per audio callback", Meter}},
+        {"mixer", {"cost of mixing 2, 8 and 32 strips", Mixing}},
+        {"multideck", {"N channels in one process versus N processes", MultiDeck}},
+        {"pack", {"cost of building and packing a response", ResponsePacking}},
+        {"peaks", {"hours of audio summarised into waveform peaks per second", Peaks}},
+        {"ringbuffer", {"cost of moving audio through a ring buffer in chunks of each size", RingTransfer}},
+        {"silence", {"hours of audio scanned for leading and trailing silence per second", Silence}},
+        {"tokeniser", {"cost of tokenising a client command line", Tokenising}},
+        {"update", {"cost of one audio update on the main loop", AudioUpdate}},
+};
+
+/**
+ * Reports usage information and exits.
+ * @param progname The name of the program as executed.
+ */
+[[noreturn]] static void ExitWithUsage(std::string_view progname)
+{
+	std::cerr << "usage: " << progname << " BENCHMARK [--OPTION=VALUE...]\n";
+	std::cerr << "where BENCHMARK is one of:\n";
+	for (const auto &[name, benchmark] : BENCHMARKS) {
+		std::cerr << "\t" << name << ": " << benchmark.first << "\n";
+	}
+	std::exit(EXIT_FAILURE);
+}
+} // namespace Playd::Bench
+
+/**
+ * The main entry point.
+ * @param argc Program argument count.
+ * @param argv Program argument vector.
+ * @return The exit code (zero for success; non-zero otherwise).
+ */
+int main(int argc, char *argv[])
+{
+	if (argc < 2) Playd::Bench::ExitWithUsage(argv[0]);
+
+	auto benchmark = Playd::Bench::BENCHMARKS.find(std::string_view{argv[1]});
+	if (benchmark == Playd::Bench::BENCHMARKS.end()) Playd::Bench::ExitWithUsage(argv[0]);
+
+	Playd::Bench::Options options;
+	for (int i = 2; i < argc; i++) {
+		std::string_view arg{argv[i]};
+		if (arg.substr(0, 2) != "--") Playd::Bench::ExitWithUsage(argv[0]);
+
+		auto option = arg.substr(2);
+		auto eq = option.find('=');
+		options[std::string{option.substr(0, eq)}] =
+		        eq == std::string_view::npos ? "" : std::string{option.substr(eq + 1)};
+	}
+
+	// Benchmarks use the same libraries as playd, so need the same setup.
+	Playd::Audio::SDLDevice::InitLibrary();
+	atexit(Playd::Audio::SDLDevice::CleanupLibrary);
+#ifdef WITH_MP3
+	mpg123_init();
+	atexit(mpg123_exit);
+#endif // WITH_MP3
+
+	try {
+		std::cout << benchmark->second.second(options).Str() << std::endl;
+	} catch (Error &e) {
+		std::cerr << "benchmark failed: " << e.Message() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
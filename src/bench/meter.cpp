@@ -0,0 +1,82 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The meter benchmark: the cost live level metering adds to audio callbacks.
+ * @see bench/bench.h
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "../audio/levels.h"
+#include "../audio/sample_format.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/// The sample formats to benchmark, with their names.
+constexpr std::array<std::pair<Audio::SampleFormat, std::string_view>, Audio::SAMPLE_FORMAT_COUNT> METER_FORMATS{{
+        {Audio::SampleFormat::UINT8, "uint8"},
+        {Audio::SampleFormat::SINT8, "sint8"},
+        {Audio::SampleFormat::SINT16, "sint16"},
+        {Audio::SampleFormat::SINT32, "sint32"},
+        {Audio::SampleFormat::FLOAT32, "float32"},
+}};
+
+/// The number of stereo frames metered per call, about what SDL asks for at a time.
+constexpr std::size_t METER_FRAMES = 1024;
+
+/// The sample rate the blocks are taken to play at.
+constexpr std::uint32_t METER_RATE = 44100;
+
+/**
+ * Meters blocks over and over, as an audio callback would, and reports how
+ * long each took.
+ * @param fmt The sample format.
+ * @param blocks The number of blocks to meter.
+ * @return The report.
+ */
+static JsonObject MeterBlocks(Audio::SampleFormat fmt, std::uint64_t blocks)
+{
+	std::vector<std::byte> buf(METER_FRAMES * 2 * Audio::sample_format_bps[static_cast<std::size_t>(fmt)],
+	                           std::byte{0x10});
+	Audio::LevelMeter meter{METER_RATE};
+
+	const auto start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < blocks; i++) {
+		meter.Measure(buf, fmt, 2);
+		// Taking now and then, as the loop would, exercises the hand-over.
+		if (i % 8 == 0) meter.Take();
+	}
+	const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+	const auto ns_per_block = static_cast<double>(elapsed.count()) / static_cast<double>(blocks);
+	const auto block_ns = 1e9 * METER_FRAMES / METER_RATE;
+	return JsonObject{}.Add("ns_per_block", ns_per_block).Add("callback_percent", 100.0 * ns_per_block / block_ns);
+}
+
+JsonObject Meter(const Options &options)
+{
+	const auto blocks = IntOption(options, "blocks", 100000);
+
+	std::vector<JsonObject> runs;
+	for (const auto &[fmt, name] : METER_FORMATS) runs.push_back(MeterBlocks(fmt, blocks).Add("format", name));
+
+	return JsonObject{}
+	        .Add("benchmark", "meter")
+	        .Add("blocks", blocks)
+	        .Add("frames_per_block", static_cast<std::uint64_t>(METER_FRAMES))
+#ifdef PLAYD_DSP_SSE2
+	        .Add("kernels", "sse2")
+#else
+	        .Add("kernels", "scalar")
+#endif // PLAYD_DSP_SSE2
+	        .Add("runs", runs);
+}
+
+} // namespace Playd::Bench
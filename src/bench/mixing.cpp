@@ -0,0 +1,93 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The mixer benchmark: the cost of summing strips in the software mixer.
+ * @see bench/bench.h
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../audio/dsp.h"
+#include "../audio/mixer.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/// The numbers of strips to mix.
+constexpr std::array<std::uint64_t, 3> MIX_STRIPS{{2, 8, 32}};
+
+/// The number of frames mixed per call, about what SDL asks for at a time.
+constexpr std::size_t MIX_FRAMES = 1024;
+
+/**
+ * Mixes audio from some number of strips, and reports how long it took.
+ * @param strips The number of strips.
+ * @param seconds The amount of audio to mix.
+ * @return The report.
+ */
+static JsonObject MixStrips(std::uint64_t strips, std::chrono::seconds seconds)
+{
+	BenchSource source{"mix.bench"};
+	auto mixer = std::make_shared<Audio::Mixer>(source.SampleRate());
+
+	// Every strip gets the same audio; the mixer can't tell.
+	std::vector<std::byte> feed;
+	while (feed.size() < MIX_FRAMES * source.BytesPerSample()) {
+		auto [state, frame] = source.Decode();
+		feed.insert(feed.end(), frame.begin(), frame.end());
+	}
+	feed.resize(MIX_FRAMES * source.BytesPerSample());
+
+	std::vector<std::unique_ptr<Audio::Mixer::Strip>> inputs;
+	for (std::uint64_t i = 0; i < strips; i++) {
+		auto &strip = inputs.emplace_back(mixer->MakeStrip(source));
+		strip->SetGain(1.0f / strips);
+		strip->Start();
+	}
+
+	std::vector<float> out(MIX_FRAMES * Audio::Mixer::CHANNELS);
+	const auto calls = seconds.count() * source.SampleRate() / MIX_FRAMES;
+	std::chrono::nanoseconds mixing{0};
+	for (std::uint64_t i = 0; i < static_cast<std::uint64_t>(calls); i++) {
+		for (auto &strip : inputs) strip->Transfer(feed);
+
+		const auto start = std::chrono::steady_clock::now();
+		mixer->Mix(out);
+		mixing += std::chrono::steady_clock::now() - start;
+	}
+
+	const auto frames = static_cast<double>(calls * MIX_FRAMES);
+	const auto audio_ns = frames * 1e9 / source.SampleRate();
+	return JsonObject{}
+	        .Add("strips", strips)
+	        .Add("frames", static_cast<std::uint64_t>(frames))
+	        .Add("ns_per_frame", static_cast<double>(mixing.count()) / frames)
+	        .Add("ns_per_strip_frame", static_cast<double>(mixing.count()) / frames / strips)
+	        .Add("realtime_percent", 100.0 * static_cast<double>(mixing.count()) / audio_ns);
+}
+
+JsonObject Mixing(const Options &options)
+{
+	const std::chrono::seconds seconds(IntOption(options, "seconds", 60));
+
+	std::vector<JsonObject> runs;
+	for (const auto strips : MIX_STRIPS) runs.push_back(MixStrips(strips, seconds));
+
+	return JsonObject{}
+	        .Add("benchmark", "mixer")
+	        .Add("seconds", static_cast<std::uint64_t>(seconds.count()))
+#ifdef PLAYD_DSP_SSE2
+	        .Add("kernels", "sse2")
+#else
+	        .Add("kernels", "scalar")
+#endif // PLAYD_DSP_SSE2
+	        .Add("runs", runs);
+}
+
+} // namespace Playd::Bench
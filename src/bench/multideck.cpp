@@ -0,0 +1,108 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The multideck benchmark: many channels in one process versus many processes.
+ * @see bench/bench.h
+ */
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../audio/source.h"
+#include "../errors.h"
+#include "../io.h"
+#include "../player.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/**
+ * Runs playd with one channel per deck for a while, playing synthetic
+ * audio, then quits as if sent Ctrl-C.
+ * @param decks The number of decks.
+ * @param port The first port to use.
+ * @param seconds How long to play for.
+ */
+static void RunDecks(std::uint64_t decks, std::uint64_t port, std::chrono::seconds seconds)
+{
+	const std::map<std::string, Player::SourceFn> sources{{"bench", BenchSource::MakeUnique}};
+
+	std::vector<std::unique_ptr<Player>> players;
+	std::vector<Player *> player_ptrs;
+	for (std::uint64_t i = 0; i < decks; i++) {
+		auto &player = players.emplace_back(std::make_unique<Player>(
+		        0, &std::make_unique<BenchSink, const Audio::Source &, int>, sources));
+		player_ptrs.push_back(player.get());
+	}
+
+	IO::Core io{player_ptrs};
+	for (std::uint64_t i = 0; i < decks; i++) {
+		players[i]->Load(Response::NOREQUEST, "deck" + std::to_string(i) + ".bench");
+		players[i]->SetPlaying(Response::NOREQUEST, true);
+	}
+
+	// The IO core quits on SIGINT, so that's how we stop it.
+	std::thread stopper{[seconds] {
+		std::this_thread::sleep_for(seconds);
+		kill(getpid(), SIGINT);
+	}};
+	io.Run(BENCH_HOST, std::to_string(port));
+	stopper.join();
+}
+
+/**
+ * Reports the resources used by one way of running the decks.
+ * @param mode The name of the way.
+ * @param processes The number of processes used.
+ * @param decks The number of decks.
+ * @param usage The resources used.
+ * @return The report.
+ */
+static JsonObject Report(std::string_view mode, std::uint64_t processes, std::uint64_t decks, const Usage &usage)
+{
+	const auto cpu_ms = static_cast<double>(usage.cpu.count()) / 1000.0;
+	return JsonObject{}
+	        .Add("mode", mode)
+	        .Add("processes", processes)
+	        .Add("cpu_ms", cpu_ms)
+	        .Add("cpu_ms_per_deck", cpu_ms / decks)
+	        .Add("rss_kib", usage.max_rss_kib)
+	        .Add("rss_kib_per_deck", static_cast<double>(usage.max_rss_kib) / decks);
+}
+
+JsonObject MultiDeck(const Options &options)
+{
+	const auto decks = IntOption(options, "decks", 8);
+	const std::chrono::seconds seconds(IntOption(options, "seconds", 10));
+	const auto port = IntOption(options, "port", 13500);
+	if (decks == 0) throw ConfigError("--decks must be at least 1");
+
+	// First, every deck in one process...
+	const auto shared = RunInChildren({[=] { RunDecks(decks, port, seconds); }});
+
+	// ...then each deck in its own process, as playd used to be run.
+	std::vector<std::function<void()>> jobs;
+	for (std::uint64_t i = 0; i < decks; i++) {
+		jobs.emplace_back([=] { RunDecks(1, port + i, seconds); });
+	}
+	const auto separate = RunInChildren(jobs);
+
+	return JsonObject{}
+	        .Add("benchmark", "multideck")
+	        .Add("decks", decks)
+	        .Add("seconds", static_cast<std::uint64_t>(seconds.count()))
+	        .Add("runs", {Report("shared", 1, decks, shared), Report("separate", decks, decks, separate)});
+}
+
+} // namespace Playd::Bench
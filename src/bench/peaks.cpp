@@ -0,0 +1,64 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The peaks benchmark: how quickly waveform peaks are generated.
+ * @see bench/bench.h
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "../audio/dsp.h"
+#include "../audio/peaks.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+JsonObject Peaks(const Options &options)
+{
+	const std::chrono::seconds seconds(IntOption(options, "seconds", 3600));
+
+	BenchSource source{"peaks.bench"};
+	Audio::PeakMeter meter{source.SampleRate(), source.ChannelCount()};
+	const auto frames = static_cast<std::uint64_t>(seconds.count()) * source.SampleRate();
+
+	// As in the loudness benchmark, only conversion and metering are timed.
+	std::vector<float> samples;
+	std::uint64_t done = 0;
+	std::chrono::nanoseconds metering{0};
+	while (done < frames) {
+		auto [state, bytes] = source.Decode();
+		if (state == Audio::Source::DecodeState::END_OF_FILE) source.Seek(0);
+
+		const auto start = std::chrono::steady_clock::now();
+		samples.resize(bytes.size() / sizeof(std::int16_t));
+		Audio::ToFloat(bytes, source.OutputSampleFormat(), samples);
+		meter.Add(samples);
+		metering += std::chrono::steady_clock::now() - start;
+
+		done += bytes.size() / source.BytesPerSample();
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto peaks = meter.Result();
+	const auto building = std::chrono::steady_clock::now() - start;
+
+	const auto hours = static_cast<double>(done) / source.SampleRate() / 3600;
+	const auto total = std::chrono::duration<double>(metering + building).count();
+	return JsonObject{}
+	        .Add("benchmark", "peaks")
+	        .Add("seconds", static_cast<std::uint64_t>(seconds.count()))
+#ifdef PLAYD_DSP_SSE2
+	        .Add("kernels", "sse2")
+#else
+	        .Add("kernels", "scalar")
+#endif // PLAYD_DSP_SSE2
+	        .Add("base_pairs", static_cast<std::uint64_t>(peaks.Base().size()))
+	        .Add("pyramid_ms", std::chrono::duration<double, std::milli>(building).count())
+	        .Add("hours_per_second", hours / total);
+}
+
+} // namespace Playd::Bench
@@ -0,0 +1,63 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The response benchmark: the cost of building and packing responses.
+ * @see bench/bench.h
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../response.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/**
+ * Builds and packs responses, and reports how long it took.
+ * @param name The name of the run.
+ * @param code The code of each response.
+ * @param args The arguments of each response.
+ * @param count The number of responses to build.
+ * @return The report.
+ */
+static JsonObject PackResponses(std::string_view name, Response::Code code, const std::vector<std::string> &args,
+                                std::uint64_t count)
+{
+	std::uint64_t bytes = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < count; i++) {
+		Response response{Response::NOREQUEST, code};
+		for (const auto &arg : args) response.AddArg(arg);
+		bytes += response.Pack().size();
+	}
+	const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+	return JsonObject{}
+	        .Add("response", name)
+	        .Add("responses", count)
+	        .Add("bytes_per_response", static_cast<double>(bytes) / static_cast<double>(count))
+	        .Add("ns_per_response", static_cast<double>(elapsed.count()) / static_cast<double>(count));
+}
+
+JsonObject ResponsePacking(const Options &options)
+{
+	const auto responses = IntOption(options, "responses", 2000000);
+
+	// POS is what every client gets several times a second, so its
+	// arguments need no escaping; paths in FLOAD often do.
+	std::vector<JsonObject> runs;
+	runs.push_back(PackResponses("pos", Response::Code::POS, {"123456789"}, responses));
+	runs.push_back(PackResponses("fload_plain", Response::Code::FLOAD, {"/srv/music/track01.mp3"}, responses));
+	runs.push_back(PackResponses("fload_escaped", Response::Code::FLOAD,
+	                             {"/srv/music/Artist Name/It's \"Quoted\" (Live).flac"}, responses));
+
+	return JsonObject{}.Add("benchmark", "pack").Add("responses", responses).Add("runs", runs);
+}
+
+} // namespace Playd::Bench
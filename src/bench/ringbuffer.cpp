@@ -0,0 +1,77 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The ringbuffer benchmark: the cost of moving audio through a RingBuffer.
+ * @see bench/bench.h
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "../audio/ringbuffer.h"
+#include "../metrics.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/// The chunk sizes to move, in bytes: from a few frames up to a whole MP3 frame's worth and more.
+constexpr std::array<std::size_t, 4> RING_CHUNKS{{64, 1024, 4096, 16384}};
+
+/// The capacity of the ring, in bytes: that of an DeviceSink's ring for 16-bit stereo.
+constexpr std::size_t RING_CAPACITY = (1U << 16U) * 4;
+
+/**
+ * Writes and reads chunks through a ring buffer, as the loop and audio
+ * callback would (if they took turns), and reports how long each took.
+ * @param chunk The size of each chunk, in bytes.
+ * @param bytes The number of bytes to move.
+ * @return The report.
+ */
+static JsonObject MoveChunks(std::size_t chunk, std::uint64_t bytes)
+{
+	// Sinks' rings keep a gauge, so this one does too.
+	Gauge fill;
+	Audio::RingBuffer ring{RING_CAPACITY, &fill};
+	std::vector<std::byte> in(chunk, std::byte{0x5a});
+	std::vector<std::byte> out(chunk);
+
+	// Keep the ring half full, so that chunks wrap around its end as they
+	// do in a sink.
+	while (ring.ReadCapacity() < RING_CAPACITY / 2) ring.Write(in);
+
+	const auto chunks = bytes / chunk;
+	std::uint64_t moved = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < chunks; i++) {
+		moved += ring.Write(in);
+		moved += ring.Read(out);
+	}
+	const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+	const auto ns = static_cast<double>(elapsed.count());
+	return JsonObject{}
+	        .Add("chunk_bytes", static_cast<std::uint64_t>(chunk))
+	        .Add("chunks", chunks)
+	        .Add("ns_per_write_and_read", ns / static_cast<double>(chunks))
+	        .Add("gib_per_second", static_cast<double>(moved / 2) / ns * 1e9 / (1U << 30U));
+}
+
+JsonObject RingTransfer(const Options &options)
+{
+	const auto megabytes = IntOption(options, "megabytes", 1024);
+
+	std::vector<JsonObject> runs;
+	for (const auto chunk : RING_CHUNKS) runs.push_back(MoveChunks(chunk, megabytes << 20U));
+
+	return JsonObject{}
+	        .Add("benchmark", "ringbuffer")
+	        .Add("megabytes", megabytes)
+	        .Add("capacity_bytes", static_cast<std::uint64_t>(RING_CAPACITY))
+	        .Add("runs", runs);
+}
+
+} // namespace Playd::Bench
@@ -0,0 +1,81 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The silence benchmark: how quickly leading and trailing silence is found.
+ * @see bench/bench.h
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "../audio/dsp.h"
+#include "../audio/silence.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/**
+ * Finds the cue points of some audio, and reports how fast it went.
+ * @param source The source of the audio; if it runs out, it starts again.
+ * @param silent Whether to replace the audio with silence, so that every
+ *   sample has to be looked at.
+ * @param seconds The amount of audio to scan.
+ * @return The report.
+ */
+static JsonObject ScanRun(BenchSource &source, bool silent, std::chrono::seconds seconds)
+{
+	Audio::SilenceMeter meter{source.SampleRate(), source.ChannelCount()};
+	const auto frames = static_cast<std::uint64_t>(seconds.count()) * source.SampleRate();
+
+	// As in the loudness benchmark, only conversion and metering are timed.
+	std::vector<float> samples;
+	std::uint64_t done = 0;
+	std::chrono::nanoseconds scanning{0};
+	while (done < frames) {
+		auto [state, bytes] = source.Decode();
+		if (state == Audio::Source::DecodeState::END_OF_FILE) source.Seek(0);
+		if (silent) std::fill(bytes.begin(), bytes.end(), std::byte{0});
+
+		const auto start = std::chrono::steady_clock::now();
+		samples.resize(bytes.size() / sizeof(std::int16_t));
+		Audio::ToFloat(bytes, source.OutputSampleFormat(), samples);
+		meter.Add(samples);
+		scanning += std::chrono::steady_clock::now() - start;
+
+		done += bytes.size() / source.BytesPerSample();
+	}
+
+	const auto hours = static_cast<double>(done) / source.SampleRate() / 3600;
+	const auto cues = meter.Result();
+	return JsonObject{}
+	        .Add("audio", silent ? "silence" : "sound")
+	        .Add("cue_in_frames", cues.in)
+	        .Add("cue_out_frames", cues.out)
+	        .Add("hours_per_second", hours / std::chrono::duration<double>(scanning).count());
+}
+
+JsonObject Silence(const Options &options)
+{
+	const std::chrono::seconds seconds(IntOption(options, "seconds", 3600));
+
+	BenchSource source{"silence.bench"};
+	std::vector<JsonObject> runs;
+	runs.push_back(ScanRun(source, false, seconds));
+	runs.push_back(ScanRun(source, true, seconds));
+
+	return JsonObject{}
+	        .Add("benchmark", "silence")
+	        .Add("seconds", static_cast<std::uint64_t>(seconds.count()))
+#ifdef PLAYD_DSP_SSE2
+	        .Add("kernels", "sse2")
+#else
+	        .Add("kernels", "scalar")
+#endif // PLAYD_DSP_SSE2
+	        .Add("runs", runs);
+}
+
+} // namespace Playd::Bench
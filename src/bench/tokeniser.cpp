@@ -0,0 +1,81 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The tokeniser benchmark: the cost of splitting client commands into words.
+ * @see bench/bench.h
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../tokeniser.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/// Commands much like those a playout system sends, with and without quoting.
+constexpr std::array<std::string_view, 6> TOKENISER_LINES{{
+        "1 play\n",
+        "2 pos 1234567\n",
+        "3 fload '/srv/music/Artist Name/Album (Deluxe)/01 Track.mp3'\n",
+        "4 fload \"/srv/music/It's \\\"Quoted\\\".flac\"\n",
+        "5 gain -3.5\n",
+        "6 stat\n",
+}};
+
+/**
+ * Feeds lines to a Tokeniser in batches, and reports how long it took.
+ * @param batch The number of lines in each call to Feed.
+ * @param lines The number of lines to feed.
+ * @return The report.
+ */
+static JsonObject FeedLines(std::uint64_t batch, std::uint64_t lines)
+{
+	// Each feed starts at a different line, so that every batch size
+	// tokenises the same mix of lines.
+	std::vector<std::string> feeds(TOKENISER_LINES.size());
+	for (std::size_t f = 0; f < feeds.size(); f++) {
+		for (std::uint64_t i = 0; i < batch; i++) feeds[f] += TOKENISER_LINES[(f + i) % TOKENISER_LINES.size()];
+	}
+
+	Tokeniser tokeniser;
+	const auto calls = lines / batch;
+	std::uint64_t words = 0;
+	std::uint64_t bytes = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < calls; i++) {
+		const auto &feed = feeds[i % feeds.size()];
+		for (const auto &line : tokeniser.Feed(feed)) words += line.size();
+		bytes += feed.size();
+	}
+	const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+	const auto ns = static_cast<double>(elapsed.count());
+	const auto fed = static_cast<double>(bytes);
+	return JsonObject{}
+	        .Add("lines_per_feed", batch)
+	        .Add("lines", calls * batch)
+	        .Add("words", words)
+	        .Add("ns_per_line", ns / static_cast<double>(calls * batch))
+	        .Add("mib_per_second", fed / ns * 1e9 / (1U << 20U));
+}
+
+JsonObject Tokenising(const Options &options)
+{
+	const auto lines = IntOption(options, "lines", 4000000);
+
+	// One line per read is the usual case for an interactive client; a
+	// batch is what a client that pipelines its commands sends.
+	std::vector<JsonObject> runs;
+	for (const auto batch : {1, 64}) runs.push_back(FeedLines(batch, lines));
+
+	return JsonObject{}.Add("benchmark", "tokeniser").Add("lines", lines).Add("runs", runs);
+}
+
+} // namespace Playd::Bench
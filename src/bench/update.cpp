@@ -0,0 +1,96 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The update benchmark: the cost of one BasicAudio::Update, as run on every
+ * tick of the main loop, and of the sample conversions around it.
+ * @see bench/bench.h
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "../audio/audio.h"
+#include "../audio/sink.h"
+#include "../audio/source.h"
+#include "../tests/dummy_audio_sink.h"
+#include "../tests/dummy_audio_source.h"
+#include "bench.h"
+
+namespace Playd::Bench
+{
+/**
+ * Updates a playing BasicAudio over and over, and reports how long it took.
+ * The sink takes everything it's given, so each update decodes a frame and
+ * transfers all of it.
+ * @param name The name of the run.
+ * @param src The source to play.
+ * @param updates The number of updates to make.
+ * @return The report.
+ */
+static JsonObject UpdateAudio(std::string_view name, std::unique_ptr<Audio::Source> src, std::uint64_t updates)
+{
+	auto sink = std::make_unique<Tests::DummyAudioSink>(*src, 0);
+	sink->state = Audio::Sink::State::PLAYING;
+	Audio::BasicAudio audio{std::move(src), std::move(sink)};
+
+	std::uint64_t playing = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < updates; i++) {
+		if (audio.Update() == Audio::Audio::State::PLAYING) playing++;
+	}
+	const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+	return JsonObject{}
+	        .Add("source", name)
+	        .Add("updates", updates)
+	        .Add("playing", playing)
+	        .Add("ns_per_update", static_cast<double>(elapsed.count()) / static_cast<double>(updates));
+}
+
+/**
+ * Converts microseconds to samples over and over, as position handling
+ * does, and reports how long it took.
+ * @param conversions The number of conversions to make.
+ * @return The report.
+ */
+static JsonObject ConvertMicros(std::uint64_t conversions)
+{
+	BenchSource source{"convert.bench"};
+
+	// Summing the results keeps the compiler from dropping the calls.
+	Audio::Samples total = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < conversions; i++) {
+		total += source.SamplesFromMicros(std::chrono::microseconds{i * 7919});
+	}
+	const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+	return JsonObject{}
+	        .Add("conversions", conversions)
+	        .Add("checksum", static_cast<std::uint64_t>(total))
+	        .Add("ns_per_conversion", static_cast<double>(elapsed.count()) / static_cast<double>(conversions));
+}
+
+JsonObject AudioUpdate(const Options &options)
+{
+	const auto updates = IntOption(options, "updates", 1000000);
+
+	// The dummy source decodes nothing, so its run is the fixed cost of an
+	// update; BenchSource adds that of handing over a real frame.
+	std::vector<JsonObject> runs;
+	runs.push_back(UpdateAudio("dummy", std::make_unique<Tests::DummyAudioSource>("update.dummy"), updates));
+	runs.push_back(UpdateAudio("synthetic", std::make_unique<BenchSource>("update.bench"), updates));
+
+	return JsonObject{}
+	        .Add("benchmark", "update")
+	        .Add("updates", updates)
+	        .Add("runs", runs)
+	        .Add("samples_from_micros", ConvertMicros(updates * 10));
+}
+
+} // namespace Playd::Bench
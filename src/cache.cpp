@@ -0,0 +1,207 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the FileIdentity and Cache classes.
+ * @see cache.h
+ */
+
+#include "cache.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif // _WIN32
+
+#include "errors.h"
+#include "log.h"
+
+namespace Playd
+{
+/// Magic number at the start of every cache entry.
+constexpr std::array<char, 4> CACHE_MAGIC{{'P', 'D', 'C', '1'}};
+
+/**
+ * Makes a temporary path, next to a cache entry, that no other writer of
+ * the entry (in this process or any other) will also pick.
+ * @param path The path to the entry.
+ * @return The temporary path.
+ */
+static std::filesystem::path TempPathFor(const std::filesystem::path &path)
+{
+	static std::atomic<std::uint64_t> next_temp{0};
+
+#ifdef _WIN32
+	const auto pid = _getpid();
+#else
+	const auto pid = getpid();
+#endif // _WIN32
+
+	std::ostringstream os;
+	os << "." << pid << "-" << std::hex << std::hash<std::thread::id>{}(std::this_thread::get_id()) << "-"
+	   << next_temp.fetch_add(1, std::memory_order_relaxed) << ".tmp";
+
+	auto tmp_path = path;
+	tmp_path += os.str();
+	return tmp_path;
+}
+
+//
+// FileIdentity
+//
+
+/* static */ FileIdentity FileIdentity::Of(std::string_view path)
+{
+	const std::filesystem::path fspath{path};
+
+	std::error_code ec;
+	const auto size = std::filesystem::file_size(fspath, ec);
+	if (ec) throw FileError("can't query " + std::string{path} + ": " + ec.message());
+	const auto mtime = std::filesystem::last_write_time(fspath, ec);
+	if (ec) throw FileError("can't query " + std::string{path} + ": " + ec.message());
+
+	return FileIdentity{std::string{path}, size, mtime.time_since_epoch().count()};
+}
+
+std::string FileIdentity::Key() const
+{
+	// 64-bit FNV-1a.  We can't use std::hash, as it needn't be stable
+	// between runs, and the whole point here is that it is.
+	std::uint64_t hash = 14695981039346656037ULL;
+	for (const auto c : this->path) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 1099511628211ULL;
+	}
+
+	std::ostringstream os;
+	os << std::hex << std::setw(16) << std::setfill('0') << hash;
+	return os.str();
+}
+
+bool FileIdentity::operator==(const FileIdentity &other) const
+{
+	return this->path == other.path && this->size == other.size && this->mtime == other.mtime;
+}
+
+//
+// Cache
+//
+
+Cache::Cache(std::filesystem::path dir, std::string_view kind) : dir{std::move(dir)}, kind{kind}
+{
+}
+
+/* static */ Cache Cache::Default(std::string_view kind)
+{
+	return Cache{DefaultDir(), kind};
+}
+
+/* static */ std::filesystem::path Cache::DefaultDir()
+{
+	if (const auto *env = std::getenv("PLAYD_CACHE_DIR"); env != nullptr) return env;
+
+#ifdef _WIN32
+	if (const auto *env = std::getenv("LOCALAPPDATA"); env != nullptr) {
+		return std::filesystem::path{env} / "playd";
+	}
+#else
+	if (const auto *env = std::getenv("XDG_CACHE_HOME"); env != nullptr && *env != '\0') {
+		return std::filesystem::path{env} / "playd";
+	}
+	if (const auto *env = std::getenv("HOME"); env != nullptr) {
+		return std::filesystem::path{env} / ".cache" / "playd";
+	}
+#endif // _WIN32
+
+	return {};
+}
+
+std::filesystem::path Cache::EntryPath(const FileIdentity &id) const
+{
+	return this->dir / (id.Key() + "." + this->kind);
+}
+
+std::optional<std::vector<std::byte>> Cache::Load(const FileIdentity &id) const
+{
+	if (this->dir.empty()) return std::nullopt;
+
+	std::ifstream in{this->EntryPath(id), std::ios::binary};
+	if (!in) return std::nullopt;
+
+	const std::string raw{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+	gsl::span<const std::byte> rest(reinterpret_cast<const std::byte *>(raw.data()), raw.size());
+
+	// The entry must be for exactly this file, as it is now.
+	std::array<char, 4> magic{};
+	FileIdentity stored{};
+	std::uint32_t path_len = 0;
+	if (!ReadPod(rest, magic) || magic != CACHE_MAGIC) return std::nullopt;
+	if (!ReadPod(rest, stored.size) || !ReadPod(rest, stored.mtime)) return std::nullopt;
+	if (!ReadPod(rest, path_len) || static_cast<std::size_t>(rest.size()) < path_len) return std::nullopt;
+	stored.path.assign(reinterpret_cast<const char *>(rest.data()), path_len);
+	rest = rest.last(rest.size() - path_len);
+	if (!(stored == id)) return std::nullopt;
+
+	return std::vector<std::byte>{rest.begin(), rest.end()};
+}
+
+bool Cache::Store(const FileIdentity &id, gsl::span<const std::byte> data) const
+{
+	if (this->dir.empty()) return false;
+
+	std::error_code ec;
+	std::filesystem::create_directories(this->dir, ec);
+	if (ec) {
+		PLAYD_LOG(WARNING) << "cache: can't create" << this->dir.string() << ":" << ec.message();
+		return false;
+	}
+
+	std::vector<std::byte> header;
+	AppendPod(header, CACHE_MAGIC);
+	AppendPod(header, id.size);
+	AppendPod(header, id.mtime);
+	AppendPod(header, static_cast<std::uint32_t>(id.path.size()));
+
+	// Write to a temporary file of our own and rename it over the entry,
+	// so that nobody (including other playd instances, and other threads
+	// storing the same entry) sees a half-written or mixed entry.
+	const auto path = this->EntryPath(id);
+	const auto tmp_path = TempPathFor(path);
+	{
+		std::ofstream out{tmp_path, std::ios::binary | std::ios::trunc};
+		out.write(reinterpret_cast<const char *>(header.data()), header.size());
+		out.write(id.path.data(), id.path.size());
+		out.write(reinterpret_cast<const char *>(data.data()), data.size());
+		if (!out) {
+			PLAYD_LOG(WARNING) << "cache: can't write" << tmp_path.string();
+			out.close();
+			std::filesystem::remove(tmp_path, ec);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tmp_path, path, ec);
+	if (ec) {
+		PLAYD_LOG(WARNING) << "cache: can't replace" << path.string() << ":" << ec.message();
+		std::filesystem::remove(tmp_path, ec);
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace Playd
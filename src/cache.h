@@ -0,0 +1,168 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the FileIdentity and Cache classes.
+ * @see cache.cpp
+ */
+
+#ifndef PLAYD_CACHE_H
+#define PLAYD_CACHE_H
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+namespace Playd
+{
+/**
+ * The identity of a file on disk.
+ *
+ * Two FileIdentities are equal if they refer to the same path and that path
+ * has not been changed (as far as size and modification time can tell) in
+ * between.  This is what we key cached analyses of audio files on.
+ */
+struct FileIdentity {
+	std::string path;    ///< The path to the file, as given to playd.
+	std::uintmax_t size; ///< The size of the file, in bytes.
+	std::int64_t mtime;  ///< The file's modification time, in clock ticks.
+
+	/**
+	 * Finds the identity of the file at the given path.
+	 * @param path The path to the file.
+	 * @return The file's identity.
+	 * @exception FileError if the file cannot be queried.
+	 */
+	static FileIdentity Of(std::string_view path);
+
+	/**
+	 * Hashes this identity's path into a string suitable for a file name.
+	 * The size and modification time don't contribute, so that a changed
+	 * file's cache entries are overwritten rather than left to pile up.
+	 * @return A string of hexadecimal digits.
+	 */
+	std::string Key() const;
+
+	/**
+	 * Compares two FileIdentities for equality.
+	 * @param other The other FileIdentity.
+	 * @return Whether the identities match.
+	 */
+	bool operator==(const FileIdentity &other) const;
+};
+
+/**
+ * A directory of binary blobs keyed on FileIdentity.
+ *
+ * Each Cache has a 'kind', which separates different types of cached data
+ * for the same file.  Entries record the identity they were made for, so a
+ * file that has changed since its entry was stored reads as a cache miss.
+ *
+ * A Cache with an empty directory is disabled: every load misses, and every
+ * store is silently dropped.
+ */
+class Cache
+{
+public:
+	/**
+	 * Constructs a Cache.
+	 * @param dir The directory in which cache entries live.  This is
+	 *   created on the first store, if it does not already exist.
+	 * @param kind The kind of data this Cache stores.
+	 */
+	Cache(std::filesystem::path dir, std::string_view kind);
+
+	/**
+	 * Constructs a Cache in the default cache directory.
+	 * @param kind The kind of data this Cache stores.
+	 * @return The Cache.
+	 * @see DefaultDir
+	 */
+	static Cache Default(std::string_view kind);
+
+	/**
+	 * Gets the default cache directory.
+	 *
+	 * This is $PLAYD_CACHE_DIR if set; otherwise, the platform's per-user
+	 * cache directory with 'playd' appended.  If none of these can be
+	 * found, the result is empty (and caching is disabled).
+	 *
+	 * @return The default cache directory.
+	 */
+	static std::filesystem::path DefaultDir();
+
+	/**
+	 * Tries to load the entry for a file.
+	 * @param id The identity of the file.
+	 * @return The entry's data, if it exists and matches @a id.
+	 */
+	std::optional<std::vector<std::byte>> Load(const FileIdentity &id) const;
+
+	/**
+	 * Stores the entry for a file, replacing any existing entry.
+	 * Failures are not fatal: caching is only ever an optimisation.
+	 * @param id The identity of the file.
+	 * @param data The data to store.
+	 * @return Whether the entry was stored.
+	 */
+	bool Store(const FileIdentity &id, gsl::span<const std::byte> data) const;
+
+private:
+	std::filesystem::path dir; ///< The directory holding the entries.
+	std::string kind;          ///< The kind of data in this Cache.
+
+	/**
+	 * Gets the path to the entry for a file.
+	 * @param id The identity of the file.
+	 * @return The path to the entry.
+	 */
+	std::filesystem::path EntryPath(const FileIdentity &id) const;
+};
+
+//
+// Serialisation helpers for cache entries
+//
+
+/**
+ * Appends the bytes of a plain-old-data value to a byte vector.
+ * @tparam T The type of value; must be trivially copyable.
+ * @param out The vector to which the value's bytes are appended.
+ * @param x The value to append.
+ */
+template <typename T>
+void AppendPod(std::vector<std::byte> &out, const T &x)
+{
+	static_assert(std::is_trivially_copyable_v<T>, "can only append trivially copyable types");
+	const auto *begin = reinterpret_cast<const std::byte *>(&x);
+	out.insert(out.end(), begin, begin + sizeof(T));
+}
+
+/**
+ * Reads a plain-old-data value from the front of a byte span.
+ * On success, the span is advanced past the value.
+ * @tparam T The type of value; must be trivially copyable.
+ * @param in The span from which to read.
+ * @param x The value into which the bytes are read.
+ * @return Whether there were enough bytes to read the value.
+ */
+template <typename T>
+bool ReadPod(gsl::span<const std::byte> &in, T &x)
+{
+	static_assert(std::is_trivially_copyable_v<T>, "can only read trivially copyable types");
+	if (static_cast<std::size_t>(in.size()) < sizeof(T)) return false;
+	std::memcpy(&x, in.data(), sizeof(T));
+	in = in.last(in.size() - sizeof(T));
+	return true;
+}
+
+} // namespace Playd
+
+#endif // PLAYD_CACHE_H
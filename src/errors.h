@@ -10,8 +10,9 @@
 #ifndef PLAYD_ERRORS_H
 #define PLAYD_ERRORS_H
 
-#include <iostream>
-#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 
 /**
  * A playd exception.
@@ -129,50 +130,4 @@ public:
 	}
 };
 
-/** Class for telling the human what playd is doing. */
-class Debug
-{
-public:
-	/** Constructor. */
-	inline Debug()
-	{
-		oss << "DEBUG:";
-	}
-
-	/** Destructor. Actually shoves things to the screen. */
-	inline ~Debug()
-	{
-		std::cerr << oss.str();
-	}
-
-	/**
-	 * Stream operator for shoving objects onto a screen somewhere.
-	 * @tparam T Type of parameter.
-	 * @param x Object to write to the stream.
-	 * @return Chainable reference.
-	 */
-	template <typename T>
-	inline Debug &operator<<(const T &x)
-	{
-		oss << " ";
-		oss << x;
-		return *this;
-	}
-
-	/**
-	 * Specialisation for std::endl, which is actually a function pointer.
-	 * @param pf Function pointer.
-	 * @return Chainable reference.
-	 */
-	inline Debug &operator<<(std::ostream &(*pf)(std::ostream &))
-	{
-		oss << pf;
-		return *this;
-	}
-
-private:
-	std::ostringstream oss; ///< Stream buffer (avoids theoretical threading
-	                        /// issues).
-};
-
 #endif // PLAYD_ERRORS_HPP
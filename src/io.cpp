@@ -16,8 +16,12 @@
 
 #include <algorithm>
 #include <cassert>
+#include <charconv>
 #include <csignal>
+#include <functional>
 #include <string>
+#include <utility>
+#include <vector>
 
 // If UNICODE is defined on Windows, it'll select the wide-char gai_strerror.
 // We don't want this.
@@ -31,9 +35,12 @@ typedef ptrdiff_t ssize_t;
 #include <uv.h>
 
 #include "errors.h"
+#include "log.h"
 #include "messages.h"
+#include "metrics.h"
 #include "player.h"
 #include "response.h"
+#include "trace.h"
 
 #include "io.h"
 
@@ -41,6 +48,72 @@ namespace Playd::IO {
 
     const std::uint16_t Core::PLAYER_UPDATE_PERIOD = 5; // ms
 
+/// The share of the players' headroom for which the loop may stall unwarned.
+    constexpr double HEADROOM_WARNING{0.5};
+
+/// The most a scrape may send before its request is refused as too large.
+    constexpr std::size_t MAX_SCRAPE_REQUEST{8192};
+
+/// A response on its way to a client: the libuv request, and its bytes.
+    struct WriteRequest {
+        uv_write_t req;   ///< The libuv write request; its data points here.
+        std::string data; ///< The bytes being written.
+    };
+
+//
+// Metrics
+//
+
+/// @return The gauge of open client connections.
+    static Gauge &ConnectionsGauge() {
+        static auto &gauge = Metrics::Global().GetGauge("playd_connections", "Clients connected to all channels.");
+        return gauge;
+    }
+
+/// @return The counter of bytes written to clients.
+    static Counter &WrittenCounter() {
+        static auto &counter = Metrics::Global().GetCounter("playd_written_bytes_total",
+                                                            "Bytes of responses written to clients.");
+        return counter;
+    }
+
+/// @return The gauge of bytes queued for writing to clients.
+    static Gauge &QueuedGauge() {
+        static auto &gauge = Metrics::Global().GetGauge("playd_write_queued_bytes",
+                                                        "Bytes of responses waiting to be written to clients.");
+        return gauge;
+    }
+
+/// @return The histogram of how late the update timer fired.
+    static Histogram &LagHistogram() {
+        static auto &histogram = Metrics::Global().GetHistogram(
+                "playd_loop_lag_us", "Microseconds after it was scheduled that each player update began.",
+                Histogram::LogLinear(8, 16, 8));
+        return histogram;
+    }
+
+/// @return The histogram of how long updating all players took.
+    static Histogram &UpdateHistogram() {
+        static auto &histogram = Metrics::Global().GetHistogram(
+                "playd_update_us", "Microseconds taken by each update of all players.", Histogram::LogLinear(8, 16, 8));
+        return histogram;
+    }
+
+/// @return The counter of stalls long enough to risk a dropout.
+    static Counter &HeadroomCounter() {
+        static auto &counter = Metrics::Global().GetCounter(
+                "playd_loop_headroom_warnings_total",
+                "Times the loop stalled for over half of the audio the players had buffered.");
+        return counter;
+    }
+
+/// @return The counter of player updates skipped because the loop was busy.
+    static Counter &OverrunCounter() {
+        static auto &counter = Metrics::Global().GetCounter(
+                "playd_timer_overruns_total", "Player updates missed because the loop was busy for a whole period.");
+        return counter;
+    }
+
 //
 // libuv callbacks
 //
@@ -73,15 +146,51 @@ namespace Playd::IO {
         // It will be used for future reads on this client!
     }
 
+    /// The callback fired when some bytes are read from a metrics scrape.
+    void UvMetricsReadCallback(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
+        assert(stream != nullptr);
+
+        auto *server = static_cast<MetricsServer *>(stream->data);
+        assert(server != nullptr);
+
+        // NB: Read delete[]s buf->base, so we don't.
+        server->Read(reinterpret_cast<uv_tcp_t *>(stream), nread, buf);
+    }
+
+    /// The callback fired when a new scrape is acquired by the metrics listener.
+    void UvMetricsListenCallback(uv_stream_t *server, int status) {
+        assert(server != nullptr);
+        if (status < 0) return;
+
+        auto *metrics = static_cast<MetricsServer *>(server->data);
+        assert(metrics != nullptr);
+
+        metrics->Accept(server);
+    }
+
+    /// The callback fired when a scrape has been answered.
+    void UvMetricsWriteCallback(uv_write_t *req, int) {
+        assert(req != nullptr);
+
+        auto *write = static_cast<WriteRequest *>(req->data);
+        assert(write != nullptr);
+
+        // One request per connection, so we're done with it.
+        auto *client = reinterpret_cast<uv_tcp_t *>(req->handle);
+        static_cast<MetricsServer *>(client->data)->Close(client);
+
+        delete write;
+    }
+
     /// The callback fired when a new client connection is acquired by the listener.
     void UvListenCallback(uv_stream_t *server, int status) {
         assert(server != nullptr);
         if (status < 0) return;
 
-        auto *io = static_cast<Core *>(server->data);
-        assert(io != nullptr);
+        auto *channel = static_cast<Channel *>(server->data);
+        assert(channel != nullptr);
 
-        io->Accept(server);
+        channel->Accept(server);
     }
 
 /// The callback fired when a response has been sent to a client.
@@ -89,21 +198,20 @@ namespace Playd::IO {
         assert(req != nullptr);
 
         if (status) {
-            Debug() << "UvRespondCallback: got status:" << status
-                    << std::endl;
+            PLAYD_LOG(WARNING) << "UvRespondCallback: got status:" << status;
         }
 
-        // We receive the write buffer as the write_t's data pointer.
-        // This is because something has to delete[] it,
+        // We receive the write request, and its buffer, as the write_t's
+        // data pointer.  This is because something has to delete it,
         // and we drew the short straw.
-        auto *buf = static_cast<char *>(req->data);
-        assert(buf != nullptr);
+        auto *write = static_cast<WriteRequest *>(req->data);
+        assert(write != nullptr);
 
-        delete[] buf;
+        const auto length = static_cast<std::int64_t>(write->data.size());
+        QueuedGauge().Add(-length);
+        if (status == 0) WrittenCounter().Add(length);
 
-        // This handle was created specifically for this shutdown.
-        // We thus have to delete it.
-        delete req;
+        delete write;
     }
 
 /// The callback fired when the update timer fires.
@@ -113,35 +221,54 @@ namespace Playd::IO {
         auto *io = static_cast<Core *>(handle->data);
         assert(io != nullptr);
 
-        io->UpdatePlayer();
+        io->MeasureLag(uv_hrtime());
+        io->UpdatePlayers();
 
         // We don't delete the handle.
         // It is being used for other timer fires.
     }
 
+/// The callback fired on each loop iteration while freewheeling.
+    void UvSpinnerCallback(uv_idle_t *handle) {
+        assert(handle != nullptr);
+
+        auto *io = static_cast<Core *>(handle->data);
+        assert(io != nullptr);
+
+        io->UpdatePlayers();
+    }
+
 /// The callback fired when SIGINT occurs.
     void UvSigintCallback(uv_signal_t *handle, int signum) {
         assert(handle != nullptr);
 
-        auto *player = static_cast<Player *>(handle->data);
-        assert(player != nullptr);
+        auto *io = static_cast<Core *>(handle->data);
+        assert(io != nullptr);
 
         if (signum != SIGINT) return;
 
-        Debug() << "Caught SIGINT, closing..." << std::endl;
-        player->Quit(Response::NOREQUEST);
+        PLAYD_LOG(INFO) << "Caught SIGINT, closing...";
+        io->Quit();
 
         // We don't delete the handle.
         // It is being used for other signals.
     }
 
+/// The callback fired when SIGUSR1 occurs, while tracing.
+    void UvSigdumpCallback(uv_signal_t *handle, int) {
+        assert(handle != nullptr);
+
+        if (!Tracer::Global().Dump()) {
+            PLAYD_LOG(INFO) << "Trace has nowhere to dump to";
+        }
+    }
+
 /// The callback fired when a client is shut down.
     void UvShutdownCallback(uv_shutdown_t *handle, int status) {
         assert(handle != nullptr);
 
         if (status) {
-            Debug() << "UvShutdownCallback: got status:" << status
-                    << std::endl;
+            PLAYD_LOG(WARNING) << "UvShutdownCallback: got status:" << status;
         }
 
         auto *conn = static_cast<Connection *>(handle->data);
@@ -159,17 +286,59 @@ namespace Playd::IO {
 // Core
 //
 
-    Core::Core(Player &player) : loop{nullptr}, player{player} {
+    std::vector<int> ParseChannelList(std::string_view list, const std::function<int(std::string_view)> &parse) {
+        std::vector<int> ids;
+        while (true) {
+            const auto comma = list.find(',');
+            const auto id = parse(list.substr(0, comma));
+            if (id < 0) return {};
+            ids.push_back(id);
+
+            if (comma == std::string_view::npos) return ids;
+            list.remove_prefix(comma + 1);
+        }
+    }
+
+    Core::Core(const std::vector<Player *> &players) : loop{nullptr}, due{0}, last_update{0}, headroom{} {
+        // Register these up front, so that scrapes see them at zero
+        // before anyone connects.
+        ConnectionsGauge();
+        WrittenCounter();
+        QueuedGauge();
+        OverrunCounter();
+        HeadroomCounter();
+
+        for (auto *player : players) {
+            assert(player != nullptr);
+            auto channel = std::make_unique<Channel>(*player, this->channels.size());
+            player->SetIo(*channel);
+            this->channels.push_back(std::move(channel));
+        }
     }
 
     void Core::Run(std::string_view host, std::string_view port) {
+        // Work out the port range before touching the loop, so a bad port
+        // doesn't leave half the channels listening.
+        std::uint32_t first_port = 0;
+        const auto port_end = port.data() + port.size();
+        auto [p, ec] = std::from_chars(port.data(), port_end, first_port);
+        if (ec != std::errc{} || p != port_end || first_port == 0 ||
+            UINT16_MAX + 1u < first_port + this->channels.size()) {
+            throw NetError("Invalid port for " + std::to_string(this->channels.size()) +
+                           " channel(s): " + std::string{port});
+        }
+
         this->loop = uv_default_loop();
         if (this->loop == nullptr) throw InternalError(MSG_IO_CANNOT_ALLOC);
 
-        this->InitAcceptor(host, port);
+        for (size_t i = 0; i < this->channels.size(); i++) {
+            this->channels[i]->Listen(this->loop, host, static_cast<std::uint16_t>(first_port + i));
+        }
+        if (this->metrics_port) this->metrics.Listen(this->loop, host, *this->metrics_port);
         this->InitSignals();
         this->InitUpdateTimer();
 
+        Tracer::Global().NameThread("loop");
         uv_run(this->loop, UV_RUN_DEFAULT);
 
         // We presume all of the open handles have been closed in Shutdown().
@@ -177,7 +346,161 @@ namespace Playd::IO {
         uv_loop_close(this->loop);
     }
 
-    void Core::Accept(uv_stream_t *server) {
+    void Core::ServeMetrics(std::uint16_t port) {
+        this->metrics_port = port;
+    }
+
+    void Core::Freewheel(std::function<void(std::chrono::milliseconds)> advance) {
+        this->advance = std::move(advance);
+    }
+
+    void Core::MeasureLag(std::uint64_t now) {
+        // uv_hrtime is in nanoseconds, and uv_now in milliseconds.
+        if (this->due != 0) {
+            const auto lag = now < this->due ? 0 : (now - this->due) / 1000;
+            LagHistogram().Observe(lag);
+
+            // libuv doesn't catch up on missed ticks; it just fires late.
+            const auto period = std::uint64_t{PLAYER_UPDATE_PERIOD} * 1000;
+            if (period <= lag) OverrunCounter().Add(lag / period);
+        }
+
+        // libuv schedules the next tick a period after the loop time at
+        // which this one ran.  That time is only to the millisecond, so
+        // lags under a millisecond are partly rounding.
+        this->due = (uv_now(this->loop) + PLAYER_UPDATE_PERIOD) * 1000000;
+
+        // The players topped up their buffers at the end of the last
+        // update, and have been playing out of them since.
+        if (!this->headroom || this->last_update == 0) return;
+        const auto stalled = std::chrono::microseconds{(now - this->last_update) / 1000};
+        if (stalled < *this->headroom * HEADROOM_WARNING) return;
+
+        HeadroomCounter().Add();
+        PLAYD_LOG(WARNING) << "Loop stalled for" << std::to_string(stalled.count()) << "us, with only"
+                           << std::to_string(this->headroom->count()) << "us of audio buffered";
+    }
+
+    void Core::UpdatePlayers() {
+        const auto start = uv_hrtime();
+        TraceSpan span{TraceEvent::UPDATE};
+
+        // Every channel gets its update, even if an earlier one is closing,
+        // so that audio keeps flowing on the others.
+        auto running = false;
+        auto playing = false;
+        std::optional<std::chrono::microseconds> least;
+        for (const auto &channel : this->channels) {
+            auto &player = channel->GetPlayer();
+            if (player.Update()) running = true;
+            if (player.IsPlaying()) playing = true;
+
+            const auto player_headroom = player.Headroom();
+            if (player_headroom && (!least || *player_headroom < *least)) least = player_headroom;
+        }
+        this->headroom = least;
+
+        // When freewheeling, time only passes while something plays, and
+        // then as fast as we can go round the loop, but never faster than
+        // the sources can keep up (a live stream, say, might be waiting
+        // for more audio).
+        if (this->advance) {
+            const auto period = std::chrono::milliseconds{PLAYER_UPDATE_PERIOD};
+            if (playing && (!this->headroom || period <= *this->headroom)) {
+                this->advance(period);
+                uv_idle_start(&this->spinner, UvSpinnerCallback);
+            } else {
+                uv_idle_stop(&this->spinner);
+            }
+        }
+
+        this->last_update = uv_hrtime();
+        UpdateHistogram().Observe((this->last_update - start) / 1000);
+
+        if (!running) this->Shutdown();
+    }
+
+    void Core::Quit() {
+        for (const auto &channel : this->channels) {
+            channel->GetPlayer().Quit(Response::NOREQUEST);
+        }
+    }
+
+    void Core::Shutdown() {
+        PLAYD_LOG(INFO) << "Shutting down...";
+
+        // If the players are ready to terminate, we need to kill the event
+        // loop in order to disconnect clients and stop the updating.
+        // We do this by stopping everything using the loop.
+
+        // First, the update timer (and spinner, if freewheeling):
+        uv_timer_stop(&this->updater);
+        if (this->advance) uv_idle_stop(&this->spinner);
+
+        // Then, each channel's TCP server and connections:
+        for (const auto &channel : this->channels) channel->Shutdown();
+        this->metrics.Shutdown();
+
+        // Finally, unregister signal processing.
+        uv_signal_stop(&this->sigint);
+        uv_close(reinterpret_cast<uv_handle_t *>(&this->sigint), nullptr);
+#ifdef SIGUSR1
+        if (Tracer::Global().IsEnabled()) {
+            uv_signal_stop(&this->sigdump);
+            uv_close(reinterpret_cast<uv_handle_t *>(&this->sigdump), nullptr);
+        }
+#endif // SIGUSR1
+    }
+
+    void Core::InitUpdateTimer() {
+        assert(this->loop != nullptr);
+
+        uv_timer_init(this->loop, &this->updater);
+        this->updater.data = static_cast<void *>(this);
+
+        uv_timer_start(&this->updater, UvUpdateTimerCallback, 0,
+                       PLAYER_UPDATE_PERIOD);
+
+        // The spinner only starts once something plays.
+        if (!this->advance) return;
+        uv_idle_init(this->loop, &this->spinner);
+        this->spinner.data = static_cast<void *>(this);
+    }
+
+    void Core::InitSignals() {
+        const auto r = uv_signal_init(this->loop, &this->sigint);
+        if (r) {
+            auto error = std::string{MSG_IO_CANNOT_ALLOC} + ": " + uv_err_name(r);
+            throw InternalError{error};
+        }
+
+        // The SIGINT handler tells the players to quit, which then tells us
+        // to shutdown once they've all finished.
+        this->sigint.data = static_cast<void *>(this);
+        assert(this->sigint.data != nullptr);
+        uv_signal_start(&this->sigint, UvSigintCallback, SIGINT);
+
+#ifdef SIGUSR1
+        // SIGUSR1 asks for whatever led up to now, say after hearing a
+        // glitch that playd didn't notice.
+        if (!Tracer::Global().IsEnabled()) return;
+        uv_signal_init(this->loop, &this->sigdump);
+        uv_signal_start(&this->sigdump, UvSigdumpCallback, SIGUSR1);
+#endif // SIGUSR1
+    }
+
+//
+// Channel
+//
+
+    Channel::Channel(Player &player, size_t index) : loop{nullptr}, player{player}, index{index} {
+    }
+
+    Player &Channel::GetPlayer() const {
+        return this->player;
+    }
+
+    void Channel::Accept(uv_stream_t *server) {
         assert(server != nullptr);
         assert(this->loop != nullptr);
 
@@ -191,6 +514,11 @@ namespace Playd::IO {
             return;
         }
 
+        // Responses are small and often come in twos (a broadcast, then an
+        // ACK); Nagle's algorithm would hold the second back until the
+        // client's delayed ACK, adding tens of milliseconds to each command.
+        uv_tcp_nodelay(client, 1);
+
         auto id = this->NextConnectionID();
         auto conn = std::make_shared<Connection>(*this, client, this->player, id);
         client->data = static_cast<void *>(conn.get());
@@ -211,7 +539,7 @@ namespace Playd::IO {
                       UvReadCallback);
     }
 
-    size_t Core::NextConnectionID() {
+    size_t Channel::NextConnectionID() {
         // We'll want to try and use an existing, empty ID in the connection
         // pool.  If there aren't any (we've exceeded the maximum-so-far number
         // of simultaneous connections), we expand the pool.
@@ -230,7 +558,7 @@ namespace Playd::IO {
         return id;
     }
 
-    void Core::ExpandPool() {
+    void Channel::ExpandPool() {
         // If we already have SIZE_MAX-1 simultaneous connections, we bail out.
         // Since this is at least 65,534, and likely to be 2^32-2 or 2^64-2,
         // this is incredibly unlikely to happen and probably means someone's
@@ -246,7 +574,7 @@ namespace Playd::IO {
         this->free_list.push_back(this->pool.size());
     }
 
-    void Core::Remove(size_t slot) {
+    void Channel::Remove(size_t slot) {
         assert(0 < slot && slot <= this->pool.size());
 
         // Don't remove if it's already a nullptr, because we'd end up with the
@@ -259,36 +587,17 @@ namespace Playd::IO {
         assert(!this->pool.at(slot - 1));
     }
 
-    void Core::UpdatePlayer() {
-        const auto running = this->player.Update();
-        if (!running) this->Shutdown();
-    }
-
-    void Core::Shutdown() {
-        Debug() << "Shutting down..." << std::endl;
-
-        // If the player is ready to terminate, we need to kill the event loop
-        // in order to disconnect clients and stop the updating.
-        // We do this by stopping everything using the loop.
-
-        // First, the update timer:
-        uv_timer_stop(&this->updater);
-
-        // Then, the TCP server (as far as we can tell, this does *not* close
-        // down the connections):
+    void Channel::Shutdown() {
+        // As far as we can tell, closing the TCP server does *not* close
+        // down the connections, so we ask each one to stop.
         uv_close(reinterpret_cast<uv_handle_t *>(&this->server), nullptr);
 
-        // Next, ask each connection to stop.
         for (const auto &conn : this->pool) {
             if (conn) conn->Shutdown();
         }
-
-        // Finally, unregister signal processing.
-        uv_signal_stop(&this->sigint);
-        uv_close(reinterpret_cast<uv_handle_t *>(&this->sigint), nullptr);
     }
 
-    void Core::Respond(size_t id, const Response &response) const {
+    void Channel::Respond(size_t id, const Response &response) const {
         if (this->pool.empty()) return;
 
         if (id == 0) {
@@ -298,8 +607,9 @@ namespace Playd::IO {
         }
     }
 
-    void Core::Broadcast(const Response &response) const {
-        Debug() << "broadcast:" << response.Pack() << std::endl;
+    void Channel::Broadcast(const Response &response) const {
+        PLAYD_LOG(DEBUG) << "broadcast #" << std::to_string(this->index) << ":"
+                         << response.Pack();
 
         // Copy the connection by value, so that there's at least one
         // active reference to it throughout.
@@ -308,28 +618,19 @@ namespace Playd::IO {
         }
     }
 
-    void Core::Unicast(size_t id, const Response &response) const {
+    void Channel::Unicast(size_t id, const Response &response) const {
         assert(0 < id && id <= this->pool.size());
 
-        Debug() << "unicast @" << std::to_string(id) << ":" << response.Pack()
-                << std::endl;
+        PLAYD_LOG(DEBUG) << "unicast #" << std::to_string(this->index) << " @"
+                         << std::to_string(id) << ":" << response.Pack();
 
         auto c = this->pool.at(id - 1);
         if (c) c->Respond(response);
     }
 
-    void Core::InitUpdateTimer() {
-        assert(this->loop != nullptr);
-
-        uv_timer_init(this->loop, &this->updater);
-        this->updater.data = static_cast<void *>(this);
-
-        uv_timer_start(&this->updater, UvUpdateTimerCallback, 0,
-                       PLAYER_UPDATE_PERIOD);
-    }
-
-    void Core::InitAcceptor(std::string_view address, std::string_view port) {
-        assert(this->loop != nullptr);
+    void Channel::Listen(uv_loop_t *loop, std::string_view address, std::uint16_t port) {
+        assert(loop != nullptr);
+        this->loop = loop;
 
         if (uv_tcp_init(this->loop, &this->server)) {
             throw InternalError(MSG_IO_CANNOT_ALLOC);
@@ -338,10 +639,9 @@ namespace Playd::IO {
         assert(this->server.data != nullptr);
 
         std::string address_str{address};
-        std::string port_str{port};
 
         struct sockaddr_in bind_addr;
-        uv_ip4_addr(address_str.c_str(), stoi(port_str), &bind_addr);
+        uv_ip4_addr(address_str.c_str(), port, &bind_addr);
         uv_tcp_bind(&this->server,
                     reinterpret_cast<const sockaddr *>(&bind_addr), 0);
 
@@ -353,59 +653,43 @@ namespace Playd::IO {
             throw NetError(error.str());
         }
 
-        Debug() << "Listening at" << address << "on" << port << std::endl;
-    }
-
-    void Core::InitSignals() {
-        const auto r = uv_signal_init(this->loop, &this->sigint);
-        if (r) {
-            auto error = std::string{MSG_IO_CANNOT_ALLOC} + ": " + uv_err_name(r);
-            throw InternalError{error};
-        }
-
-        // We pass the player, not the IoCore.
-        // This is so the SIGINT handler can tell the player to quit,
-        // which then tells us to shutdown
-        this->sigint.data = static_cast<void *>(&this->player);
-        assert(this->sigint.data != nullptr);
-        uv_signal_start(&this->sigint, UvSigintCallback, SIGINT);
+        PLAYD_LOG(INFO) << "Channel" << std::to_string(this->index) << "listening at"
+                        << address << "on" << std::to_string(port);
     }
 
 //
 // Connection
 //
 
-    Connection::Connection(Core &parent, uv_tcp_t *tcp, Player &player, size_t id)
+    Connection::Connection(Channel &parent, uv_tcp_t *tcp, Player &player, size_t id)
             : parent(parent), tcp(tcp), tokeniser(), player(player), id(id) {
-        Debug() << "Opening connection from" << Name() << std::endl;
+        PLAYD_LOG(INFO) << "Opening connection from" << Name();
+        ConnectionsGauge().Add(1);
     }
 
     Connection::~Connection() {
-        Debug() << "Closing connection from" << Name() << std::endl;
+        PLAYD_LOG(INFO) << "Closing connection from" << Name();
+        ConnectionsGauge().Add(-1);
         uv_close(reinterpret_cast<uv_handle_t *>(this->tcp), UvCloseCallback);
     }
 
     void Connection::Respond(const Response &response) {
         // Pack provides us the response's wire format, except the newline.
         // We can provide that here.
+        TraceSpan span{TraceEvent::WRITE};
         auto string = response.Pack();
         string.push_back('\n');
+        span.SetArg(string.size());
 
-        const auto l = string.length();
-
-        // Make a libuv buffer and pour the request into it.
-        // The onus is on UvRespondCallback to free buf.base.
-        auto buf = uv_buf_init(new char[l], l);
-        assert(buf.base != nullptr);
-        string.copy(buf.base, l);
-
-        // Make a write request.
-        // Since the callback must free the buffer, pass it through as data.
-        // The callback will also free req.
-        auto req = new uv_write_t;
-        req->data = static_cast<void *>(buf.base);
+        // Make a write request holding the response, and a libuv buffer
+        // over it.  The onus is on UvWriteCallback to free the request,
+        // so pass it through as data.
+        auto write = new WriteRequest{{}, std::move(string)};
+        write->req.data = static_cast<void *>(write);
+        auto buf = uv_buf_init(write->data.data(), write->data.size());
+        QueuedGauge().Add(static_cast<std::int64_t>(write->data.size()));
 
-        uv_write((uv_write_t *) req, (uv_stream_t *) this->tcp, &buf, 1,
+        uv_write(&write->req, (uv_stream_t *) this->tcp, &buf, 1,
                  UvWriteCallback);
     }
 
@@ -456,8 +740,7 @@ namespace Playd::IO {
 
         // Did we hit any other read errors?  Also de-pool, but log the error.
         if (nread < 0) {
-            Debug() << "Error on" << Name() << "-" << uv_err_name(nread)
-                    << std::endl;
+            PLAYD_LOG(INFO) << "Error on" << Name() << "-" << uv_err_name(nread);
             this->Depool();
             return;
         }
@@ -481,6 +764,7 @@ namespace Playd::IO {
         // First of all, figure out what the tag of this command is.
         // The first word is always the tag.
         auto tag = cmd[0];
+        TraceSpan span{TraceEvent::COMMAND, this->id};
         if (cmd.size() <= 1) return Response::Invalid(tag, MSG_CMD_SHORT);
 
         // The next words are the actual command, and any other arguments.
@@ -493,9 +777,19 @@ namespace Playd::IO {
             if ("end" == word) return this->player.End(tag);
             if ("eject" == word) return this->player.Eject(tag);
             if ("dump" == word) return this->player.Dump(id, tag);
+            if ("stats" == word) return this->player.Stats(id, tag);
         } else if (nargs == 1) {
             if ("fload" == word) return this->player.Load(tag, cmd[2]);
             if ("pos" == word) return this->player.Pos(tag, cmd[2]);
+            if ("nload" == word) return this->player.NLoad(tag, cmd[2]);
+            if ("gain" == word) return this->player.Gain(tag, cmd[2]);
+            if ("meter" == word) return this->player.Meter(tag, cmd[2]);
+            if ("xfade" == word) return this->player.Crossfade(tag, cmd[2], "linear");
+        } else if (nargs == 2) {
+            if ("xfade" == word) return this->player.Crossfade(tag, cmd[2], cmd[3]);
+        } else if (nargs == 3) {
+            if ("peaks" == word) return this->player.Peaks(id, tag, false, cmd[2], cmd[3], cmd[4]);
+            if ("npeaks" == word) return this->player.Peaks(id, tag, true, cmd[2], cmd[3], cmd[4]);
         }
 
         return Response::Invalid(tag, MSG_CMD_INVALID);
@@ -515,4 +809,140 @@ namespace Playd::IO {
         this->parent.Remove(this->id);
     }
 
+//
+// MetricsServer
+//
+
+    MetricsServer::MetricsServer() : loop{nullptr} {
+    }
+
+    void MetricsServer::Listen(uv_loop_t *loop, std::string_view address, std::uint16_t port) {
+        assert(loop != nullptr);
+
+        if (uv_tcp_init(loop, &this->server)) {
+            throw InternalError(MSG_IO_CANNOT_ALLOC);
+        }
+        this->loop = loop;
+        this->server.data = static_cast<void *>(this);
+
+        std::string address_str{address};
+
+        struct sockaddr_in bind_addr;
+        uv_ip4_addr(address_str.c_str(), port, &bind_addr);
+        auto r = uv_tcp_bind(&this->server,
+                             reinterpret_cast<const sockaddr *>(&bind_addr), 0);
+        if (!r) {
+            r = uv_listen(reinterpret_cast<uv_stream_t *>(&this->server), 16,
+                          UvMetricsListenCallback);
+        }
+        if (r) {
+            throw NetError("Could not serve metrics on " + address_str + ":" +
+                           std::to_string(port) + " (" + uv_err_name(r) + ")");
+        }
+
+        PLAYD_LOG(INFO) << "Metrics listening at" << address << "on"
+                        << std::to_string(this->Port());
+    }
+
+    std::uint16_t MetricsServer::Port() const {
+        if (this->loop == nullptr) return 0;
+
+        struct sockaddr_storage s;
+        int namelen = sizeof(s);
+        if (uv_tcp_getsockname(&this->server, reinterpret_cast<sockaddr *>(&s), &namelen)) return 0;
+        if (s.ss_family != AF_INET) return 0;
+        return ntohs(reinterpret_cast<const sockaddr_in *>(&s)->sin_port);
+    }
+
+    void MetricsServer::Accept(uv_stream_t *server) {
+        assert(server != nullptr);
+        assert(this->loop != nullptr);
+
+        auto client = new uv_tcp_t();
+        uv_tcp_init(this->loop, client);
+
+        if (uv_accept(server, reinterpret_cast<uv_stream_t *>(client))) {
+            uv_close(reinterpret_cast<uv_handle_t *>(client),
+                     UvCloseCallback);
+            return;
+        }
+
+        client->data = static_cast<void *>(this);
+        this->clients.emplace(client, std::string{});
+        uv_read_start(reinterpret_cast<uv_stream_t *>(client), UvAlloc,
+                      UvMetricsReadCallback);
+    }
+
+    void MetricsServer::Read(uv_tcp_t *client, ssize_t nread, const uv_buf_t *buf) {
+        assert(buf != nullptr);
+        auto base = std::unique_ptr<char[]>(buf->base);
+
+        auto it = this->clients.find(client);
+        if (it == this->clients.end()) return;
+
+        // A scraper hanging up before asking for anything isn't an error
+        // worth telling anyone about.
+        if (nread < 0) {
+            this->Close(client);
+            return;
+        }
+
+        // Wait until the headers are in; we don't care about any body.
+        auto &request = it->second;
+        request.append(base.get(), nread);
+        const auto complete = request.find("\r\n\r\n") != std::string::npos ||
+                              request.find("\n\n") != std::string::npos;
+        if (!complete && request.size() < MAX_SCRAPE_REQUEST) return;
+
+        uv_read_stop(reinterpret_cast<uv_stream_t *>(client));
+        auto write = new WriteRequest{{}, complete ? Answer(request) : Answer("")};
+        write->req.data = static_cast<void *>(write);
+        auto out = uv_buf_init(write->data.data(), write->data.size());
+        uv_write(&write->req, reinterpret_cast<uv_stream_t *>(client), &out, 1,
+                 UvMetricsWriteCallback);
+    }
+
+    void MetricsServer::Close(uv_tcp_t *client) {
+        // The write callback may come after Shutdown closed everything.
+        if (this->clients.erase(client) == 0) return;
+
+        uv_close(reinterpret_cast<uv_handle_t *>(client), UvCloseCallback);
+    }
+
+    void MetricsServer::Shutdown() {
+        if (this->loop == nullptr) return;
+
+        uv_close(reinterpret_cast<uv_handle_t *>(&this->server), nullptr);
+        while (!this->clients.empty()) this->Close(this->clients.begin()->first);
+        this->loop = nullptr;
+    }
+
+    /* static */ std::string MetricsServer::Answer(std::string_view request) {
+        // The request line is METHOD TARGET VERSION; we ignore the version,
+        // and always close the connection after answering.
+        request = request.substr(0, request.find_first_of("\r\n"));
+        const auto method = request.substr(0, request.find(' '));
+        auto target = request.substr(std::min(request.size(), method.size() + 1));
+        target = target.substr(0, target.find_first_of(" ?"));
+
+        std::string status{"200 OK"};
+        std::string headers{"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"};
+        std::string body;
+        if (method != "GET" && method != "HEAD") {
+            status = request.empty() ? "400 Bad Request" : "405 Method Not Allowed";
+            headers = "Allow: GET, HEAD\r\n";
+        } else if (target != "/metrics") {
+            status = "404 Not Found";
+            headers.clear();
+        } else {
+            body = Metrics::Global().Prometheus();
+        }
+
+        auto response = "HTTP/1.1 " + status + "\r\n" + headers +
+                        "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+                        "Connection: close\r\n\r\n";
+        if (method != "HEAD") response += body;
+        return response;
+    }
+
 } // namespace Playd::IO
@@ -10,8 +10,17 @@
 #ifndef PLAYD_IO_CORE_H
 #define PLAYD_IO_CORE_H
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
 #include <ostream>
 #include <set>
+#include <string>
+#include <string_view>
+#include <vector>
 
 // Use the same ssize_t as libmpg123 on Windows.
 #ifdef _MSC_VER
@@ -35,22 +44,116 @@ namespace Playd::IO {
 
     class Connection;
 
+    class Channel;
+
+    /**
+     * A plain HTTP server that answers scrapes of playd's metrics.
+     *
+     * It serves `GET /metrics` (and `HEAD`) with Metrics::Global() in the
+     * Prometheus text format, one request per connection, and nothing else.
+     * It shares the IO core's loop, so a scrape costs the players no more
+     * than one update's worth of time.
+     */
+    class MetricsServer {
+    public:
+        /// Constructs a MetricsServer, not yet listening.
+        MetricsServer();
+
+        /// Deleted copy constructor.
+        MetricsServer(const MetricsServer &) = delete;
+
+        /// Deleted copy-assignment.
+        MetricsServer &operator=(const MetricsServer &) = delete;
+
+        /**
+         * Initialises a TCP acceptor on the given address and port.
+         *
+         * @param loop The loop on which the server should run.
+         * @param address The IPv4 address on which the server should listen.
+         * @param port The TCP port on which the server should listen; 0
+         *   picks any free port.
+         * @exception NetError Thrown if the server can't listen.
+         */
+        void Listen(uv_loop_t *loop, std::string_view address, std::uint16_t port);
+
+        /**
+         * Gets the port on which the server is listening.
+         * @return The port, or 0 if it isn't listening.
+         */
+        std::uint16_t Port() const;
+
+        /**
+         * Accepts a new scrape.
+         * @param server Pointer to the libuv server accepting connections.
+         */
+        void Accept(uv_stream_t *server);
+
+        /**
+         * Processes a data read on a scrape, answering once the request
+         * is complete.
+         * @param client The scrape's connection.
+         * @param nread The number of bytes read.
+         * @param buf The buffer containing the read data.
+         */
+        void Read(uv_tcp_t *client, ssize_t nread, const uv_buf_t *buf);
+
+        /**
+         * Closes a scrape's connection, if it isn't already closed.
+         * @param client The scrape's connection.
+         */
+        void Close(uv_tcp_t *client);
+
+        /// Closes the server, and any scrapes in progress.
+        void Shutdown();
+
+        /**
+         * Works out the reply to an HTTP request.
+         * @param request The request, up to the end of its headers.
+         * @return The entire HTTP response.
+         */
+        static std::string Answer(std::string_view request);
+
+    private:
+        uv_loop_t *loop; ///< The loop this server is using, if listening.
+        uv_tcp_t server; ///< The libuv handle for the TCP server.
+
+        /// The scrapes in progress, and what they've sent so far.
+        std::map<uv_tcp_t *, std::string> clients;
+    };
+
+    /**
+     * Parses the comma-separated list of device IDs, one per channel, that
+     * playd takes on the command line.
+     * @param list The list.
+     * @param parse Parses one ID, returning it, or a negative number if it
+     *   is invalid.
+     * @return The IDs, in channel order, or an empty vector if any is
+     *   invalid (an empty one, say, from a stray comma).
+     */
+    std::vector<int> ParseChannelList(std::string_view list, const std::function<int(std::string_view)> &parse);
+
     /**
      * The IO core, which services input, routes responses, and executes the
      * Player update routine periodically.
      *
-     * The IO core also maintains a pool of connections which can be sent responses
-     * via their IDs inside the pool.  It ensures that each connection is given an
-     * ID that is unique up until the removal of said connection.
+     * One IO core can host several Players (one per output device), each on
+     * its own Channel.  The Players share the core's loop, update timer and
+     * signal handling, so running N channels in one process costs far less
+     * than running N playd processes.
      */
-    class Core : public ResponseSink {
+    class Core {
     public:
         /**
          * Constructs an IO core.
-         * @param player The player to which update requests, commands, and new
-         *   connection state dump requests shall be sent.
+         *
+         * This creates one Channel per player, and makes each player send
+         * its responses to its Channel.  The players must outlive the core.
+         *
+         * @param players The players to which update requests, commands, and
+         *   new connection state dump requests shall be sent, in channel
+         *   order.
          */
-        explicit Core(Player &player);
+        explicit Core(const std::vector<Player *> &players);
 
         /// Deleted copy constructor.
         Core(const Core &) = delete;
@@ -62,12 +165,132 @@ namespace Playd::IO {
          * Runs the reactor.
          * It will block until it terminates.
          * @param host The IP host to which the IO core will bind.
-         * @param port The TCP port to which the IO core will bind.
+         * @param port The TCP port to which the IO core will bind the first
+         *   channel.  Channel N binds to @a port + N.
          * @exception Net_error Thrown if the IO core cannot bind to @a host or @a
          *   port.
          */
         void Run(std::string_view host, std::string_view port);
 
+        /**
+         * Makes Run also serve metrics over HTTP.
+         * @param port The TCP port on which to serve them, on Run's host.
+         */
+        void ServeMetrics(std::uint16_t port);
+
+        /**
+         * Makes Run render offline: while any player is playing, it updates
+         * them as fast as it can, rather than every PLAYER_UPDATE_PERIOD,
+         * and has one period pass after each update.
+         * While nothing plays, or any player has less than a period of
+         * audio ready, no time passes, and the players update as usual; so
+         * clients can take their time to send commands, and nothing runs
+         * dry.
+         * @param advance Called after each update in which anything is
+         *   playing, to make one period pass.
+         */
+        void Freewheel(std::function<void(std::chrono::milliseconds)> advance);
+
+        /**
+         * Performs a player update cycle on every channel.
+         * Once every player is closing, IoCore will announce this fact to
+         * all current connections, close them, and end the I/O loop.
+         */
+        void UpdatePlayers();
+
+        /**
+         * Measures how late the update timer fired, for the metrics, and
+         * warns if the loop stalled for long enough to risk a dropout.
+         * @param now The time it fired, from uv_hrtime.
+         */
+        void MeasureLag(std::uint64_t now);
+
+        /// Tells every player to quit, which eventually shuts down the IoCore.
+        void Quit();
+
+        /// Shuts down the IoCore by terminating all IO loop tasks.
+        void Shutdown();
+
+    private:
+        /// The period between player updates.
+        static const uint16_t PLAYER_UPDATE_PERIOD;
+
+        uv_loop_t *loop;     ///< The loop this IoCore is using.
+        uv_signal_t sigint;  ///< The libuv handle for the Ctrl-C signal.
+        uv_signal_t sigdump; ///< The libuv handle for the trace dump signal.
+        uv_timer_t updater;  ///< The libuv handle for the update timer.
+        uv_idle_t spinner;   ///< The libuv handle for freewheeling updates.
+
+        /// Makes time pass when freewheeling; empty if not.
+        std::function<void(std::chrono::milliseconds)> advance;
+
+        /// When the next update is due, from uv_hrtime; 0 if none is yet.
+        std::uint64_t due;
+
+        /// When the players last finished updating, from uv_hrtime; 0 if never.
+        std::uint64_t last_update;
+
+        /// The least audio any player had buffered after the last update.
+        std::optional<std::chrono::microseconds> headroom;
+
+        /// The channels, one per player.
+        std::vector<std::unique_ptr<Channel>> channels;
+
+        /// The port on which to serve metrics, if any.
+        std::optional<std::uint16_t> metrics_port;
+
+        /// The server for metrics, if metrics_port is set.
+        MetricsServer metrics;
+
+        /// Sets up a periodic timer to run the playd update loop.
+        void InitUpdateTimer();
+
+        /**
+         * Initialises playd's signal handling.
+         *
+         * We trap SIGINT, and the equivalent emulated signal on Windows, to
+         * make playd close gracefully when Ctrl-C is sent.  When tracing,
+         * we also trap SIGUSR1 (where there is one) to dump the trace.
+         */
+        void InitSignals();
+    };
+
+    /**
+     * One Player, the TCP server through which clients control it, and the
+     * pool of connections to that server.
+     *
+     * The channel maintains a pool of connections which can be sent responses
+     * via their IDs inside the pool.  It ensures that each connection is given an
+     * ID that is unique up until the removal of said connection.  IDs are
+     * only unique within a channel, which is fine, as a Player only ever
+     * responds to its own channel.
+     */
+    class Channel : public ResponseSink {
+    public:
+        /**
+         * Constructs a Channel.
+         * @param player The player this channel controls.
+         * @param index The index of this channel in its IoCore.
+         */
+        Channel(Player &player, size_t index);
+
+        /// Deleted copy constructor.
+        Channel(const Channel &) = delete;
+
+        /// Deleted copy-assignment.
+        Channel &operator=(const Channel &) = delete;
+
+        /**
+         * Initialises a TCP acceptor on the given address and port.
+         *
+         * @param loop The loop on which the TCP server should run.
+         * @param address The IPv4 address on which the TCP server should
+         *   listen.
+         * @param port The TCP port on which the TCP server should listen.
+         * @exception NetError Thrown if the server can't listen.
+         */
+        void Listen(uv_loop_t *loop, std::string_view address, std::uint16_t port);
+
         //
         // Connection API
         //
@@ -75,7 +298,7 @@ namespace Playd::IO {
         /**
          * Accepts a new connection.
          *
-         * This accepts the connection, and adds it to this IoCore's
+         * This accepts the connection, and adds it to this Channel's
          * connection pool.
          *
          * This should be called with a server that has just received a new
@@ -87,62 +310,37 @@ namespace Playd::IO {
 
         /**
          * Removes a connection.
-         * As the IoCore owns the Connection, it will be destroyed by this
+         * As the Channel owns the Connection, it will be destroyed by this
          * operation.
          * @param id The ID of the connection to remove.
          */
         void Remove(size_t id);
 
         /**
-         * Performs a player update cycle.
-         * If the player is closing, IoCore will announce this fact to
-         * all current connections, close them, and end the I/O loop.
+         * Gets the player this channel controls.
+         * @return The player.
          */
-        void UpdatePlayer();
+        Player &GetPlayer() const;
 
         void Respond(size_t id, const Response &response) const override;
 
-        /// Shuts down the IoCore by terminating all IO loop tasks.
+        /// Closes the TCP server, and asks each connection to stop.
         void Shutdown();
 
     private:
-        /// The period between player updates.
-        static const uint16_t PLAYER_UPDATE_PERIOD;
-
-        uv_loop_t *loop;    ///< The loop this IoCore is using.
-        uv_signal_t sigint; ///< The libuv handle for the Ctrl-C signal.
-        uv_tcp_t server;    ///< The libuv handle for the TCP server.
-        uv_timer_t updater; ///< The libuv handle for the update timer.
+        uv_loop_t *loop; ///< The loop this Channel is using.
+        uv_tcp_t server; ///< The libuv handle for the TCP server.
 
         Player &player; ///< The player.
+        size_t index;   ///< The index of this channel in its IoCore.
 
-        /// The set of connections inside this IoCore.
+        /// The set of connections inside this Channel.
         std::vector<std::shared_ptr<Connection>> pool;
 
         /// A list of free 1-indexed slots inside pool.
         /// These slots may be re-used instead of creating a new slot.
         std::vector<size_t> free_list;
 
-        /**
-         * Initialises a TCP acceptor on the given address and port.
-         *
-         * @param address The IPv4 address on which the TCP server should
-         *   listen.
-         * @param port The TCP port on which the TCP server should listen.
-         */
-        void InitAcceptor(std::string_view address, std::string_view port);
-
-        /// Sets up a periodic timer to run the playd update loop.
-        void InitUpdateTimer();
-
-        /**
-         * Initialises playd's signal handling.
-         *
-         * We trap SIGINT, and the equivalent emulated signal on Windows, to
-         * make playd close gracefully when Ctrl-C is sent.
-         */
-        void InitSignals();
-
         //
         // Connection pool handling
         //
@@ -187,18 +385,18 @@ namespace Playd::IO {
      *
      * This class wraps a libuv TCP stream representing a client connection,
      * allowing it to be sent responses (directly, or via a broadcast), removed
-     * from its IoCore, and queried for its name.
+     * from its Channel, and queried for its name.
      */
     class Connection {
     public:
         /**
          * Constructs a Connection.
-         * @param parent The connection pool to which this Connection belongs.
+         * @param parent The channel to which this Connection belongs.
          * @param tcp The underlying libuv TCP stream.
          * @param player The player to which read commands should be sent.
-         * @param id The ID of this Connection in the IoCore.
+         * @param id The ID of this Connection in its Channel.
          */
-        Connection(Core &parent, uv_tcp_t *tcp, Player &player, size_t id);
+        Connection(Channel &parent, uv_tcp_t *tcp, Player &player, size_t id);
 
         /**
          * Destructs a Connection.
@@ -248,8 +446,8 @@ namespace Playd::IO {
         std::string Name();
 
     private:
-        /// The pool on which this connection is running.
-        Core &parent;
+        /// The channel on which this connection is running.
+        Channel &parent;
 
         /// The libuv handle for the TCP connection.
         uv_tcp_t *tcp;
@@ -0,0 +1,146 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Logger and LogLine classes.
+ * @see log.h
+ */
+
+#include "log.h"
+
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+
+#include "metrics.h"
+
+namespace Playd
+{
+/// @return The counter of log messages dropped as the writer fell behind.
+static Counter &DroppedCounter()
+{
+	static auto &counter = Metrics::Global().GetCounter("playd_log_dropped_total",
+	                                                    "Log messages dropped as too many were waiting to be written.");
+	return counter;
+}
+
+/// The names of the log levels, as ParseLevel takes them.
+static constexpr std::array<std::string_view, 4> LEVEL_NAMES{{"debug", "info", "warning", "error"}};
+
+/// The prefixes of messages at each log level.
+static constexpr std::array<std::string_view, 4> LEVEL_PREFIXES{{"DEBUG:", "INFO:", "WARNING:", "ERROR:"}};
+
+//
+// Logger
+//
+
+Logger::Logger(std::ostream &out) : out{out}, level{LogLevel::INFO}, dropped{0}, writing{false}, quit{false}
+{
+	this->writer = std::thread{&Logger::Run, this};
+}
+
+Logger::~Logger()
+{
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		this->quit = true;
+	}
+	this->wake.notify_all();
+	this->writer.join();
+}
+
+/* static */ Logger &Logger::Global()
+{
+	// Never destroyed, as anything (including other statics' destructors)
+	// might log; instead, we make sure the queue is written on the way out.
+	static Logger *logger = [] {
+		auto *l = new Logger{std::cerr};
+		std::atexit([] { Global().Flush(); });
+		return l;
+	}();
+	return *logger;
+}
+
+void Logger::SetLevel(LogLevel new_level)
+{
+	this->level.store(new_level, std::memory_order_relaxed);
+}
+
+/* static */ std::optional<LogLevel> Logger::ParseLevel(std::string_view name)
+{
+	for (std::size_t i = 0; i < LEVEL_NAMES.size(); i++) {
+		if (LEVEL_NAMES[i] == name) return static_cast<LogLevel>(i);
+	}
+	return std::nullopt;
+}
+
+void Logger::Submit(std::string message)
+{
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		if (CAPACITY <= this->messages.size()) {
+			this->dropped++;
+			DroppedCounter().Add();
+			return;
+		}
+		this->messages.push_back(std::move(message));
+	}
+	this->wake.notify_one();
+}
+
+void Logger::Flush()
+{
+	std::unique_lock<std::mutex> guard{this->lock};
+	this->idle.wait(guard, [this] { return this->messages.empty() && this->dropped == 0 && !this->writing; });
+}
+
+void Logger::Run()
+{
+	std::string batch;
+
+	std::unique_lock<std::mutex> guard{this->lock};
+	while (true) {
+		this->wake.wait(guard, [this] { return !this->messages.empty() || this->dropped != 0 || this->quit; });
+		if (this->messages.empty() && this->dropped == 0) break;
+
+		// Write everything waiting in one go, so that a burst of messages
+		// costs one write, and nobody waits on the stream.
+		batch.clear();
+		for (const auto &message : this->messages) batch += message;
+		this->messages.clear();
+		if (this->dropped != 0) {
+			batch += std::string{LEVEL_PREFIXES[static_cast<int>(LogLevel::WARNING)]} + " dropped " +
+			         std::to_string(this->dropped) + " log messages\n";
+			this->dropped = 0;
+		}
+
+		this->writing = true;
+		guard.unlock();
+		this->out.write(batch.data(), batch.size());
+		this->out.flush();
+		guard.lock();
+		this->writing = false;
+
+		this->idle.notify_all();
+	}
+	this->idle.notify_all();
+}
+
+//
+// LogLine
+//
+
+LogLine::LogLine(Logger &logger, LogLevel level) : logger{logger}
+{
+	this->oss << LEVEL_PREFIXES[static_cast<int>(level)];
+}
+
+LogLine::~LogLine()
+{
+	this->oss << '\n';
+	this->logger.Submit(this->oss.str());
+}
+
+} // namespace Playd
@@ -0,0 +1,202 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Logger and LogLine classes, and the PLAYD_LOG macro.
+ * @see log.cpp
+ */
+
+#ifndef PLAYD_LOG_H
+#define PLAYD_LOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// windows.h defines ERROR, which would clash with LogLevel::ERROR.
+#undef ERROR
+
+/**
+ * The lowest level of log message compiled in, from 0 (debug) to 3 (error).
+ * Messages below it cost nothing at all, whatever the level set at runtime.
+ */
+#ifndef PLAYD_LOG_FLOOR
+#define PLAYD_LOG_FLOOR 0
+#endif
+
+/**
+ * Starts a log message at a given level, to be streamed into, as in
+ * PLAYD_LOG(INFO) << "listening on" << port;
+ * Each item streamed in is separated from the last by a space, and the
+ * message ends with a newline.  If the level is off, nothing streamed in is
+ * evaluated.
+ * @param level The level: DEBUG, INFO, WARNING or ERROR.
+ */
+#define PLAYD_LOG(level)                                                                                         \
+	if (!(::Playd::Logger::IsCompiledIn(::Playd::LogLevel::level) &&                                             \
+	      ::Playd::Logger::Global().IsEnabled(::Playd::LogLevel::level))) {                                      \
+	} else                                                                                                       \
+		::Playd::LogLine(::Playd::Logger::Global(), ::Playd::LogLevel::level)
+
+namespace Playd
+{
+/// The levels of log message, from least to most important.
+enum class LogLevel : std::uint8_t {
+	DEBUG,   ///< What playd is doing, in detail (every response, say).
+	INFO,    ///< What playd is doing, in outline (clients coming and going).
+	WARNING, ///< Something went wrong, but playd could carry on as normal.
+	ERROR    ///< Something went wrong, and something failed because of it.
+};
+
+/**
+ * Writes log messages to a stream, from a thread of its own.
+ *
+ * Finished messages are queued, and the writer thread writes whatever has
+ * queued up in one go, so that logging never waits on the stream.  If the
+ * writer falls CAPACITY messages behind, further messages are dropped (and
+ * counted in the metrics) until it catches up, and it then says how many it
+ * dropped.
+ */
+class Logger
+{
+public:
+	/// The number of messages that can wait to be written.
+	static constexpr std::size_t CAPACITY = 1024;
+
+	/**
+	 * Constructs a Logger, and starts its writer.
+	 * Messages at INFO and above are written, until SetLevel says otherwise.
+	 * @param out The stream to which to write; it must outlive the logger.
+	 */
+	explicit Logger(std::ostream &out);
+
+	/// Destructs a Logger, writing what is still queued first.
+	~Logger();
+
+	/// Deleted copy constructor.
+	Logger(const Logger &) = delete;
+
+	/// Deleted copy-assignment.
+	Logger &operator=(const Logger &) = delete;
+
+	/**
+	 * Gets the process-wide logger, which writes to standard error.
+	 * It is never destroyed, so can be logged to from anywhere; anything
+	 * queued is written when the program exits.
+	 * @return The logger.
+	 */
+	static Logger &Global();
+
+	/**
+	 * Gets whether messages at a level are compiled in at all.
+	 * @param level The level.
+	 * @return Whether @a level is at or above PLAYD_LOG_FLOOR.
+	 */
+	static constexpr bool IsCompiledIn(LogLevel level)
+	{
+		return static_cast<LogLevel>(PLAYD_LOG_FLOOR) <= level;
+	}
+
+	/**
+	 * Gets whether messages at a level are written.
+	 * @param level The level.
+	 * @return Whether @a level is compiled in and at or above the set level.
+	 */
+	bool IsEnabled(LogLevel level) const
+	{
+		return IsCompiledIn(level) && this->level.load(std::memory_order_relaxed) <= level;
+	}
+
+	/**
+	 * Sets the least important level of message to write.
+	 * @param new_level The level.
+	 */
+	void SetLevel(LogLevel new_level);
+
+	/**
+	 * Parses the name of a level.
+	 * @param name The name: debug, info, warning or error.
+	 * @return The level, or nothing if @a name isn't one.
+	 */
+	static std::optional<LogLevel> ParseLevel(std::string_view name);
+
+	/**
+	 * Queues a finished message for writing.
+	 * @param message The message, including its newline.
+	 */
+	void Submit(std::string message);
+
+	/// Waits until everything queued so far has been written.
+	void Flush();
+
+private:
+	std::ostream &out;           ///< The stream to which to write.
+	std::atomic<LogLevel> level; ///< The least important level written.
+
+	std::mutex lock;                  ///< Lock over the below.
+	std::condition_variable wake;     ///< Signalled on new messages or quitting.
+	std::condition_variable idle;     ///< Signalled when the writer catches up.
+	std::deque<std::string> messages; ///< Messages waiting to be written.
+	std::uint64_t dropped;            ///< Messages dropped since the last write.
+	bool writing;                     ///< Whether the writer is mid-write.
+	bool quit;                        ///< Whether the writer should stop.
+	std::thread writer;               ///< The writer thread.
+
+	/// The body of the writer thread.
+	void Run();
+};
+
+/**
+ * A log message under construction; it is queued when destroyed.
+ * Use PLAYD_LOG rather than making these directly, so that messages at
+ * levels that are off cost nothing.
+ */
+class LogLine
+{
+public:
+	/**
+	 * Constructs a LogLine.
+	 * @param logger The logger to which the message goes.
+	 * @param level The message's level.
+	 */
+	LogLine(Logger &logger, LogLevel level);
+
+	/// Destructs a LogLine, queueing its message.
+	~LogLine();
+
+	/// Deleted copy constructor.
+	LogLine(const LogLine &) = delete;
+
+	/// Deleted copy-assignment.
+	LogLine &operator=(const LogLine &) = delete;
+
+	/**
+	 * Adds an item to the message, after a space.
+	 * @tparam T Type of the item.
+	 * @param x The item.
+	 * @return Chainable reference.
+	 */
+	template <typename T>
+	LogLine &operator<<(const T &x)
+	{
+		this->oss << ' ' << x;
+		return *this;
+	}
+
+private:
+	Logger &logger;         ///< The logger to which the message goes.
+	std::ostringstream oss; ///< The message so far.
+};
+
+} // namespace Playd
+
+#endif // PLAYD_LOG_H
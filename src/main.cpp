@@ -9,12 +9,27 @@
 
 #include <algorithm>
 #include <charconv>
+#include <chrono>
+#include <cmath>
 #include <iostream>
-
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "audio/device.h"
+#include "audio/mixer.h"
+#include "audio/wav.h"
 #include "io.h"
+#include "log.h"
 #include "messages.h"
 #include "player.h"
 #include "response.h"
+#include "trace.h"
 
 #ifdef WITH_MP3
 #include "audio/sources/mp3.h"
@@ -22,6 +37,7 @@
 #ifdef WITH_SNDFILE
 #include "audio/sources/sndfile.h"
 #endif // WITH_SNDFILE
+#include "audio/sources/stream.h"
 
 namespace Playd {
 
@@ -31,17 +47,30 @@ namespace Playd {
 /// The default TCP port on which playd will bind.
     constexpr std::string_view DEFAULT_PORT{"1350"};
 
-/// Map from file extensions to Audio_source builder functions.
+/// The kinds of output playd can play into; see ParseSink.
+    enum class SinkKind {
+        SDL,    ///< Real audio devices, through SDL.
+        NONE,   ///< Nothing, but at the pace of a real device.
+        WAV,    ///< WAV files, at the pace of a real device.
+        RENDER, ///< Nothing, or WAV files, as fast as playd can go.
+    };
+
+/// Map from format names (see Audio::SniffFormat) to Audio_source builder functions.
     static const std::map<std::string, Player::SourceFn> SOURCES{
 #ifdef WITH_MP3
             {"mp3", Audio::MP3Source::MakeUnique},
 #endif // WITH_MP3
 
 #ifdef WITH_SNDFILE
+            {"aiff", Audio::SndfileSource::MakeUnique},
             {"flac", Audio::SndfileSource::MakeUnique},
             {"ogg", Audio::SndfileSource::MakeUnique},
             {"wav", Audio::SndfileSource::MakeUnique},
 #endif // WITH_SNDFILE
+
+#ifndef _WIN32
+            {"stream", Audio::StreamSource::MakeUnique},
+#endif // _WIN32
     };
 
 /**
@@ -56,15 +85,14 @@ namespace Playd {
         return args;
     }
 
-    int GetDeviceIDFromArg(const std::string_view arg) {
+    int GetDeviceIDFromArg(const std::string_view arg, SinkKind kind) {
 	    auto id = -1;
 
-    	// MSVC doesn't support casting of string_view_iterator to const char*,
-    	// so we have to do some strange pointer fun.
-		const auto begin_ptr = &*arg.cbegin();
-		// Parse, but only accept valid numbers (for which ec is empty).
+		const auto begin_ptr = arg.data();
+		// Parse, but only accept valid numbers (for which ec is empty) with
+		// nothing after them.  The ID may be empty, from a stray comma.
     	auto[p, ec] = std::from_chars(begin_ptr, begin_ptr + arg.size(), id);
-        if (ec == std::errc::invalid_argument) {
+        if (ec == std::errc::invalid_argument || (ec == std::errc{} && p != begin_ptr + arg.size())) {
             std::cerr << "not a valid device ID: " << arg << std::endl;
             return -1;
         }
@@ -73,22 +101,200 @@ namespace Playd {
             return -1;
         }
 
+        // Without SDL, IDs just name channels, but negatives mean nothing.
+        if (kind != SinkKind::SDL) return id < 0 ? -1 : id;
+
         // Only allow valid, outputtable devices; reject input-only devices.
-        if (!Audio::SDLSink::IsOutputDevice(id)) return -1;
+        if (!Audio::SDLDevice::IsOutputDevice(id)) return -1;
 
         return id;
     }
 
 /**
- * Tries to get the output device ID from program arguments.
+ * Removes options, which take the form --NAME=VALUE, from program arguments.
+ * Options may appear anywhere after the program name.
+ * @param args The program argument vector, which loses its options.
+ * @return A map from option names (sans dashes) to their values.
+ */
+    std::map<std::string_view, std::string_view> TakeOptions(std::vector<std::string_view> &args) {
+        std::map<std::string_view, std::string_view> options;
+
+        auto is_option = [](std::string_view arg) { return arg.substr(0, 2) == "--"; };
+        for (auto it = std::next(args.begin()); it != args.end(); it++) {
+            if (!is_option(*it)) continue;
+
+            auto option = it->substr(2);
+            auto eq = option.find('=');
+            options[option.substr(0, eq)] = eq == std::string_view::npos ? "" : option.substr(eq + 1);
+        }
+        args.erase(std::remove_if(std::next(args.begin()), args.end(), is_option), args.end());
+
+        return options;
+    }
+
+/**
+ * Parses a non-negative number of seconds from an option value.
+ * @param value The option value.
+ * @return The number of seconds, or std::nullopt if the value is invalid.
+ */
+    std::optional<std::chrono::seconds> ParseSeconds(std::string_view value) {
+        std::chrono::seconds::rep secs = 0;
+        const auto begin_ptr = value.data();
+        auto [p, ec] = std::from_chars(begin_ptr, begin_ptr + value.size(), secs);
+        if (ec != std::errc{} || p != begin_ptr + value.size() || secs < 0) return std::nullopt;
+        return std::chrono::seconds{secs};
+    }
+
+/**
+ * Parses a sample rate from an option value.
+ * @param value The option value.
+ * @return The sample rate in Hz, or std::nullopt if the value is invalid.
+ */
+    std::optional<std::uint32_t> ParseRate(std::string_view value) {
+        std::uint32_t rate = 0;
+        const auto begin_ptr = value.data();
+        auto [p, ec] = std::from_chars(begin_ptr, begin_ptr + value.size(), rate);
+        if (ec != std::errc{} || p != begin_ptr + value.size() || rate < 8000 || 384000 < rate) return std::nullopt;
+        return rate;
+    }
+
+/**
+ * Parses a target loudness from an option value.
+ * @param value The option value.
+ * @return The loudness in LUFS, or std::nullopt if the value is invalid.
+ */
+    std::optional<double> ParseLoudness(std::string_view value) {
+        std::string str{value};
+        size_t cpos = 0;
+        double lufs = 0;
+        try {
+            lufs = std::stod(str, &cpos);
+        } catch (std::logic_error &) {
+            return std::nullopt;
+        }
+        if (cpos != str.size() || !(-70 <= lufs && lufs <= 0)) return std::nullopt;
+        return lufs;
+    }
+
+/**
+ * Parses a limiter ceiling from an option value.
+ * @param value The option value.
+ * @return The ceiling in dBTP, or std::nullopt if the value is invalid.
+ */
+    std::optional<double> ParseCeiling(std::string_view value) {
+        std::string str{value};
+        size_t cpos = 0;
+        double dbtp = 0;
+        try {
+            dbtp = std::stod(str, &cpos);
+        } catch (std::logic_error &) {
+            return std::nullopt;
+        }
+        if (cpos != str.size() || !(-20 <= dbtp && dbtp <= 0)) return std::nullopt;
+        return dbtp;
+    }
+
+/**
+ * Parses a TCP port from an option value.
+ * @param value The option value.
+ * @return The port, or std::nullopt if the value is invalid.
+ */
+    std::optional<std::uint16_t> ParsePort(std::string_view value) {
+        std::uint16_t port = 0;
+        const auto begin_ptr = value.data();
+        auto [p, ec] = std::from_chars(begin_ptr, begin_ptr + value.size(), port);
+        if (ec != std::errc{} || p != begin_ptr + value.size() || port == 0) return std::nullopt;
+        return port;
+    }
+
+/**
+ * Parses the choice of output from an option value.
+ * This is one of 'sdl', 'null', 'wav:PATH', 'render' or 'render:PATH'.
+ * @param value The option value.
+ * @return The kind of output, and the path for WAV output (or empty), or
+ *   std::nullopt if the value is invalid.
+ */
+    std::optional<std::pair<SinkKind, std::string>> ParseSink(std::string_view value) {
+        if (value == "sdl") return std::make_pair(SinkKind::SDL, std::string{});
+        if (value == "null") return std::make_pair(SinkKind::NONE, std::string{});
+        if (value == "render") return std::make_pair(SinkKind::RENDER, std::string{});
+
+        for (auto [prefix, kind] : {std::make_pair(std::string_view{"wav:"}, SinkKind::WAV),
+                                    std::make_pair(std::string_view{"render:"}, SinkKind::RENDER)}) {
+            if (value.substr(0, prefix.size()) != prefix || value.size() == prefix.size()) continue;
+            return std::make_pair(kind, std::string{value.substr(prefix.size())});
+        }
+        return std::nullopt;
+    }
+
+/**
+ * Works out the WAV file to which a channel (or mixer) writes.
+ * When there are several, each gets its own file, with its number before
+ * the extension (so out.wav becomes out-0.wav, out-1.wav, ...).
+ * @param path The path given in the --sink option.
+ * @param number The number of the channel, or the device ID of the mixer.
+ * @param only Whether this is the only one.
+ * @return The path of the WAV file.
+ */
+    std::string WavPathFor(const std::string &path, std::size_t number, bool only) {
+        if (only) return path;
+
+        const auto slash = path.find_last_of("/\\");
+        auto dot = path.rfind('.');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = path.size();
+        return path.substr(0, dot) + "-" + std::to_string(number) + path.substr(dot);
+    }
+
+/**
+ * Makes the function that opens devices of a given kind.
+ * Without SDL, a clock stands in for each device, so that playd plays (and
+ * times) everything just as it would on real hardware; or, when rendering,
+ * the renderer does, so that it can play everything as fast as it can.
+ * @param kind The kind of output.
+ * @param wav_path For WAV output, the file the devices write, in turn;
+ *   if it ends in .raw, the file is raw samples.  Empty for no file.
+ * @param renderer When rendering, the renderer.
+ * @return The function.
+ */
+    Audio::DeviceFn MakeDeviceFn(SinkKind kind, const std::string &wav_path,
+                                 const std::shared_ptr<Audio::Renderer> &renderer) {
+        std::shared_ptr<Audio::WavWriter> writer;
+        if (!wav_path.empty()) {
+            constexpr std::string_view raw{".raw"};
+            const auto is_raw = raw.size() <= wav_path.size() && wav_path.substr(wav_path.size() - raw.size()) == raw;
+            writer = std::make_shared<Audio::WavWriter>(wav_path, !is_raw);
+        }
+
+        switch (kind) {
+            case SinkKind::NONE:
+            case SinkKind::WAV:
+                return [writer](int, const Audio::DeviceSpec &spec, Audio::Device::Callback callback) {
+                    if (writer) writer->Claim(spec.rate, spec.format, spec.channels);
+                    return std::make_unique<Audio::ClockDevice>(spec, std::move(callback), writer);
+                };
+            case SinkKind::RENDER:
+                return [writer, renderer](int, const Audio::DeviceSpec &spec, Audio::Device::Callback callback) {
+                    if (writer) writer->Claim(spec.rate, spec.format, spec.channels);
+                    return std::make_unique<Audio::RenderDevice>(spec, std::move(callback), renderer, writer);
+                };
+            default:
+                return Audio::SDLDevice::Open;
+        }
+    }
+
+/**
+ * Tries to get the output device IDs from program arguments.
+ * These are given as one comma-separated argument; each runs its own channel.
  * @param args The program argument vector.
- * @return The device ID, -1 if invalid selection (or none).
+ * @param kind The kind of output, which decides what IDs are valid.
+ * @return The device IDs, or an empty vector if any selection is invalid
+ *   (or there are none).
  */
-    int GetDeviceID(const std::vector<std::string_view> &args) {
+    std::vector<int> GetDeviceIDs(const std::vector<std::string_view> &args, SinkKind kind) {
         // Did the user provide an ID at all?
-        if (args.size() < 2) return -1;
+        if (args.size() < 2) return {};
 
-        return GetDeviceIDFromArg(args.at(1));
+        return IO::ParseChannelList(args.at(1), [kind](std::string_view arg) { return GetDeviceIDFromArg(arg, kind); });
     }
 
 /**
@@ -96,18 +302,34 @@ namespace Playd {
  * @param progname The name of the program as executed.
  */
     void ExitWithUsage(std::string_view progname) {
-        std::cerr << "usage: " << progname << " ID [HOST] [PORT]\n";
-        std::cerr << "where ID is one of the following numbers:\n";
-
-        // Show the user the valid device IDs they can use.
-        auto device_list = Audio::SDLSink::GetDevicesInfo();
-        for (const auto &device : device_list) {
-            std::cerr << "\t" << device.first << ": " << device.second
-                      << "\n";
+        std::cerr << "usage: " << progname << " [--log=LEVEL] [--prefetch=SECONDS] [--mix=RATE] [--auto-gain=LUFS] [--trim] [--limit=DBTP] [--metrics=PORT] [--trace=PATH] [--sink=sdl|null|wav:PATH|render[:PATH]] ID[,ID...] [HOST] [PORT]\n";
+        std::cerr << "where each ID is one of the following numbers (or, with --sink other than sdl, any number):\n";
+
+        // Show the user the valid device IDs they can use, if SDL can say.
+        try {
+            Audio::SDLDevice::InitLibrary();
+            auto device_list = Audio::SDLDevice::GetDevicesInfo();
+            for (const auto &device : device_list) {
+                std::cerr << "\t" << device.first << ": " << device.second
+                          << "\n";
+            }
+        } catch (ConfigError &e) {
+            std::cerr << "\t(none: " << e.Message() << ")\n";
         }
 
         std::cerr << "default HOST: " << DEFAULT_HOST << "\n";
         std::cerr << "default PORT: " << DEFAULT_PORT << "\n";
+        std::cerr << "the Nth ID (from 0) gets its own player on PORT+N\n";
+        std::cerr << "--log: write log messages at LEVEL (debug, info, warning or error) and above (default info)\n";
+        std::cerr << "--prefetch: seconds of audio to read ahead of the decoder (default 0, off)\n";
+        std::cerr << "--mix: mix channels on the same device, at RATE Hz, into one open device\n";
+        std::cerr << "--auto-gain: play each file at LUFS loudness, once analysed (default off)\n";
+        std::cerr << "--trim: skip each file's leading and trailing silence, once analysed (default off)\n";
+        std::cerr << "--limit: hold output at or below DBTP true peak, from -20 to 0 (default off)\n";
+        std::cerr << "--metrics: serve Prometheus metrics over HTTP at HOST:PORT/metrics (default off)\n";
+        std::cerr << "--trace: record timed events, dumping them to PATH on SIGUSR1 and after underruns (default off)\n";
+        std::cerr << "--sink: play through SDL (default), into nothing, or into WAV files at PATH (one per channel, or mixer)\n";
+        std::cerr << "\tin real time; or, with render, into nothing or PATH as fast as possible (.raw PATHs have no header)\n";
 
         exit(EXIT_FAILURE);
     }
@@ -128,13 +350,13 @@ namespace Playd {
 /**
  * Exits with an error message for a network error.
  * @param host The IP host to which playd tried to bind.
- * @param port The TCP port to which playd tried to bind.
+ * @param port The first TCP port to which playd tried to bind.
  * @param msg The exception's error message.
  */
     void ExitWithNetError(std::string_view host, std::string_view port,
                           std::string_view msg) {
         std::cerr << "Network error: " << msg << "\n";
-        std::cerr << "Is " << host << ":" << port << " available?\n";
+        std::cerr << "Are " << host << ":" << port << " (and the ports after it, one per channel) available?\n";
         exit(EXIT_FAILURE);
     }
 
@@ -163,13 +385,6 @@ int main(int argc, char *argv[])
 	signal(SIGPIPE, SIG_IGN);
 #endif
 
-	// SDL requires some cleanup and teardown.
-	// This call needs to happen before GetDeviceID, otherwise no device
-	// IDs will be recognised.  (This is why it's here, and not in
-	// SetupAudioSystem.)
-	Playd::Audio::SDLSink::InitLibrary();
-	atexit(Playd::Audio::SDLSink::CleanupLibrary);
-
 #ifdef WITH_MP3
 	// mpg123 insists on us running its init and exit functions, too.
 	mpg123_init();
@@ -177,19 +392,137 @@ int main(int argc, char *argv[])
 #endif // WITH_MP3
 
 	auto args = Playd::MakeArgVector(argc, argv);
+	auto options = Playd::TakeOptions(args);
+
+	// Each option we understand is removed once parsed; any left over are
+	// unknown, and so errors.
+	if (auto opt = options.find("log"); opt != options.end()) {
+		auto level = Playd::Logger::ParseLevel(opt->second);
+		if (!level) Playd::ExitWithUsage(args.at(0));
+		Playd::Logger::Global().SetLevel(*level);
+		options.erase(opt);
+	}
+	std::chrono::seconds prefetch{0};
+	if (auto opt = options.find("prefetch"); opt != options.end()) {
+		auto secs = Playd::ParseSeconds(opt->second);
+		if (!secs) Playd::ExitWithUsage(args.at(0));
+		prefetch = *secs;
+		options.erase(opt);
+	}
+	std::uint32_t mix_rate = 0;
+	if (auto opt = options.find("mix"); opt != options.end()) {
+		auto rate = Playd::ParseRate(opt->second);
+		if (!rate) Playd::ExitWithUsage(args.at(0));
+		mix_rate = *rate;
+		options.erase(opt);
+	}
+	std::optional<double> auto_gain;
+	if (auto opt = options.find("auto-gain"); opt != options.end()) {
+		auto_gain = Playd::ParseLoudness(opt->second);
+		if (!auto_gain) Playd::ExitWithUsage(args.at(0));
+		options.erase(opt);
+	}
+	auto trim = false;
+	if (auto opt = options.find("trim"); opt != options.end()) {
+		if (!opt->second.empty()) Playd::ExitWithUsage(args.at(0));
+		trim = true;
+		options.erase(opt);
+	}
+	std::optional<double> limit;
+	if (auto opt = options.find("limit"); opt != options.end()) {
+		limit = Playd::ParseCeiling(opt->second);
+		if (!limit) Playd::ExitWithUsage(args.at(0));
+		options.erase(opt);
+	}
+	std::optional<std::uint16_t> metrics_port;
+	if (auto opt = options.find("metrics"); opt != options.end()) {
+		metrics_port = Playd::ParsePort(opt->second);
+		if (!metrics_port) Playd::ExitWithUsage(args.at(0));
+		options.erase(opt);
+	}
+	if (auto opt = options.find("trace"); opt != options.end()) {
+		if (opt->second.empty()) Playd::ExitWithUsage(args.at(0));
+		Playd::Tracer::Global().Enable(std::string{opt->second});
+		options.erase(opt);
+	}
+	std::pair<Playd::SinkKind, std::string> sink_choice{Playd::SinkKind::SDL, ""};
+	if (auto opt = options.find("sink"); opt != options.end()) {
+		auto choice = Playd::ParseSink(opt->second);
+		if (!choice) Playd::ExitWithUsage(args.at(0));
+		sink_choice = *choice;
+		options.erase(opt);
+	}
+	if (!options.empty()) Playd::ExitWithUsage(args.at(0));
+	const auto &[sink_kind, wav_path] = sink_choice;
+
+	if (sink_kind == Playd::SinkKind::SDL) {
+		// SDL requires some cleanup and teardown.
+		// This call needs to happen before GetDeviceIDs, otherwise no
+		// device IDs will be recognised.
+		Playd::Audio::SDLDevice::InitLibrary();
+		atexit(Playd::Audio::SDLDevice::CleanupLibrary);
+	}
 
-	auto device_id = Playd::GetDeviceID(args);
-	if (device_id < 0) Playd::ExitWithUsage(args.at(0));
-
-	Playd::Player player{
-            device_id,
-            &std::make_unique<Playd::Audio::SDLSink, const Playd::Audio::Source &, int>,
-            Playd::SOURCES};
+	auto device_ids = Playd::GetDeviceIDs(args, sink_kind);
+	if (device_ids.empty()) Playd::ExitWithUsage(args.at(0));
+
+	// When rendering, this is the clock everything plays by.
+	std::shared_ptr<Playd::Audio::Renderer> renderer;
+	if (sink_kind == Playd::SinkKind::RENDER) renderer = std::make_shared<Playd::Audio::Renderer>();
+
+	// Each device gets its own player, but they all share one IO core
+	// (and so one loop and update timer).  When mixing, players on the same
+	// device also share a mixer, which keeps the device open throughout.
+	std::map<int, std::shared_ptr<Playd::Audio::Mixer>> mixers;
+	std::vector<std::unique_ptr<Playd::Player>> players;
+	std::vector<Playd::Player *> player_ptrs;
+	const auto device_count = std::set<int>(device_ids.begin(), device_ids.end()).size();
+	for (const auto device_id : device_ids) {
+		// Each channel writes its own WAV file, numbered by channel; when
+		// mixing, each device's mixer writes one, numbered by device.
+		const auto channel = players.size();
+		std::string channel_wav_path;
+		if (!wav_path.empty() && mix_rate == 0) {
+			channel_wav_path = Playd::WavPathFor(wav_path, channel, device_ids.size() == 1);
+		} else if (!wav_path.empty()) {
+			channel_wav_path = Playd::WavPathFor(wav_path, static_cast<std::size_t>(device_id), device_count == 1);
+		}
+		auto open = Playd::MakeDeviceFn(sink_kind, channel_wav_path, renderer);
+		Playd::Player::SinkFn sink = [open](const Playd::Audio::Source &source, int id) -> std::unique_ptr<Playd::Audio::Sink> {
+			return std::make_unique<Playd::Audio::DeviceSink>(source, id, open);
+		};
+		if (mix_rate != 0) {
+			auto &mixer = mixers[device_id];
+			if (!mixer) {
+				// When mixing, the limiter goes on the mix, not each file.
+				std::optional<float> ceiling;
+				if (limit) ceiling = static_cast<float>(std::pow(10.0, *limit / 20.0));
+				mixer = std::make_shared<Playd::Audio::Mixer>(mix_rate, ceiling);
+				try {
+					mixer->Open(open, device_id);
+				} catch (Error &e) {
+					Playd::ExitWithError(e.Message());
+				}
+			}
+			sink = [mixer](const Playd::Audio::Source &source, int) -> std::unique_ptr<Playd::Audio::Sink> {
+				return mixer->MakeStrip(source);
+			};
+		}
+
+		auto &player = players.emplace_back(std::make_unique<Playd::Player>(device_id, sink, Playd::SOURCES));
+		player->SetPrefetchWindow(prefetch);
+		player->SetAutoGain(auto_gain);
+		player->SetAutoTrim(trim);
+		if (mix_rate == 0) player->SetLimit(limit);
+		player_ptrs.push_back(player.get());
+	}
 
 	// Set up the IO now (to avoid a circular dependency).
-	// Make sure the player broadcasts its responses back to the IoCore.
-	Playd::IO::Core io{player};
-	player.SetIo(io);
+	// The IO core makes sure each player sends its responses back to the
+	// right channel.
+	Playd::IO::Core io{player_ptrs};
+	if (metrics_port) io.ServeMetrics(*metrics_port);
+	if (renderer) io.Freewheel([renderer](std::chrono::milliseconds time) { renderer->Advance(time); });
 
 	// Now, actually run the IO loop.
 	auto [host, port] = Playd::GetHostAndPort(args);
@@ -56,6 +56,15 @@ constexpr std::string_view MSG_CMD_NEEDS_STOPPED { "Command requires a stopped f
 /// Message shown when a command is sent to a closing Player.
 constexpr std::string_view MSG_CMD_PLAYER_CLOSING { "Server is closing" };
 
+/// Message shown when a gain command has an invalid gain.
+constexpr std::string_view MSG_GAIN_INVALID_VALUE { "Invalid gain: try decibels from -96 to 24" };
+
+/// Message shown when a meter command has an invalid interval.
+constexpr std::string_view MSG_METER_INVALID_INTERVAL { "Invalid interval: try 0, or at least 10000 microseconds" };
+
+/// Message shown when a crossfade command names an unknown curve.
+constexpr std::string_view MSG_XFADE_BAD_CURVE { "Unknown curve: try linear or power" };
+
 //
 // Decoder failures
 //
@@ -74,9 +83,24 @@ constexpr std::string_view MSG_DEV_BADID { "Incorrect device ID" };
 // Load failures
 //
 
+/// Message shown when a peaks command asks about a next file that isn't there.
+constexpr std::string_view MSG_PEAKS_NO_NEXT { "No file is loaded to play next" };
+
+/// Message shown when a peaks command comes before the peaks are ready.
+constexpr std::string_view MSG_PEAKS_NOT_READY { "Peaks are still being generated: try again later" };
+
+/// Message shown when a peaks command has an invalid range.
+constexpr std::string_view MSG_PEAKS_INVALID_RANGE { "Invalid range: try start and end microseconds, start first" };
+
+/// Message shown when a peaks command has an invalid count.
+constexpr std::string_view MSG_PEAKS_INVALID_COUNT { "Invalid count: try 1 to 16384" };
+
 /// Message shown when one tries to Load an empty path.
 constexpr std::string_view MSG_LOAD_EMPTY_PATH { "Empty file path given" };
 
+/// Message shown when a stream is loaded to play next before it has started.
+constexpr std::string_view MSG_LOAD_NOT_STARTED { "Stream has not started: try again once it has" };
+
 //
 // Audio output failures
 //
@@ -94,6 +118,9 @@ constexpr std::string_view MSG_OUTPUT_RINGINIT { "Ring buffer init error" };
 /// Message shown when an attempt to seek fails.
 constexpr std::string_view MSG_SEEK_FAIL { "Seek failed" };
 
+/// Message shown when an attempt is made to seek a live stream.
+constexpr std::string_view MSG_SEEK_UNSUPPORTED { "Can't seek in a live stream" };
+
 /// Message shown when a seek command has an invalid time value.
 constexpr std::string_view MSG_SEEK_INVALID_VALUE { "Invalid time: try integer" };
 
@@ -0,0 +1,221 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Metrics registry and its metric types.
+ * @see metrics.h
+ */
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <string_view>
+#include <utility>
+
+#include "errors.h"
+
+namespace Playd
+{
+//
+// Counter
+//
+
+void Counter::Add(std::uint64_t n)
+{
+	this->value.fetch_add(n, std::memory_order_relaxed);
+}
+
+std::uint64_t Counter::Value() const
+{
+	return this->value.load(std::memory_order_relaxed);
+}
+
+//
+// Gauge
+//
+
+void Gauge::Set(std::int64_t v)
+{
+	this->value.store(v, std::memory_order_relaxed);
+}
+
+void Gauge::Add(std::int64_t delta)
+{
+	this->value.fetch_add(delta, std::memory_order_relaxed);
+}
+
+std::int64_t Gauge::Value() const
+{
+	return this->value.load(std::memory_order_relaxed);
+}
+
+//
+// Histogram
+//
+
+Histogram::Histogram(std::vector<std::uint64_t> bounds)
+    : bounds{std::move(bounds)}, counts{std::make_unique<std::atomic<std::uint64_t>[]>(this->bounds.size() + 1)}
+{
+	for (std::size_t i = 0; i <= this->bounds.size(); i++) this->counts[i] = 0;
+}
+
+/* static */ std::vector<std::uint64_t> Histogram::Doubling(std::uint64_t first, std::size_t count)
+{
+	std::vector<std::uint64_t> bounds(count);
+	for (std::size_t i = 0; i < count; i++) bounds[i] = first << i;
+	return bounds;
+}
+
+/* static */ std::vector<std::uint64_t> Histogram::LogLinear(std::uint64_t first, std::size_t doublings,
+                                                            std::size_t steps)
+{
+	std::vector<std::uint64_t> bounds{first};
+	bounds.reserve(1 + doublings * steps);
+	for (std::size_t i = 0; i < doublings; i++) {
+		const auto base = first << i;
+		for (std::size_t j = 1; j <= steps; j++) bounds.push_back(base + base * j / steps);
+	}
+	return bounds;
+}
+
+void Histogram::Observe(std::uint64_t v)
+{
+	// Even HDR-style histograms only have a hundred or so buckets, so a
+	// binary search is cheap.
+	const auto bucket = std::lower_bound(this->bounds.cbegin(), this->bounds.cend(), v) - this->bounds.cbegin();
+	this->counts[bucket].fetch_add(1, std::memory_order_relaxed);
+	this->sum.fetch_add(v, std::memory_order_relaxed);
+}
+
+const std::vector<std::uint64_t> &Histogram::Bounds() const
+{
+	return this->bounds;
+}
+
+std::vector<std::uint64_t> Histogram::Counts() const
+{
+	std::vector<std::uint64_t> out(this->bounds.size() + 1);
+	for (std::size_t i = 0; i < out.size(); i++) out[i] = this->counts[i].load(std::memory_order_relaxed);
+	return out;
+}
+
+std::uint64_t Histogram::Sum() const
+{
+	return this->sum.load(std::memory_order_relaxed);
+}
+
+//
+// Metrics
+//
+
+/// The Prometheus names of each Metrics::Type, in order.
+static constexpr std::array<std::string_view, 3> TYPE_NAMES{{"counter", "gauge", "histogram"}};
+
+/* static */ Metrics &Metrics::Global()
+{
+	static Metrics global;
+	return global;
+}
+
+Counter &Metrics::GetCounter(std::string_view name, std::string_view help)
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	auto &entry = this->Find(name, help, Type::COUNTER);
+	if (entry.counter == nullptr) entry.counter = std::make_unique<Counter>();
+	return *entry.counter;
+}
+
+Gauge &Metrics::GetGauge(std::string_view name, std::string_view help)
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	auto &entry = this->Find(name, help, Type::GAUGE);
+	if (entry.gauge == nullptr) entry.gauge = std::make_unique<Gauge>();
+	return *entry.gauge;
+}
+
+Histogram &Metrics::GetHistogram(std::string_view name, std::string_view help, std::vector<std::uint64_t> bounds)
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	auto &entry = this->Find(name, help, Type::HISTOGRAM);
+	if (entry.histogram == nullptr) entry.histogram = std::make_unique<Histogram>(std::move(bounds));
+	return *entry.histogram;
+}
+
+Metrics::Entry &Metrics::Find(std::string_view name, std::string_view help, Type type)
+{
+	auto [it, inserted] =
+	        this->entries.try_emplace(std::string{name}, Entry{type, std::string{help}, nullptr, nullptr, nullptr});
+	if (!inserted && it->second.type != type) {
+		throw InternalError("metric registered twice with different types: " + std::string{name});
+	}
+	return it->second;
+}
+
+std::vector<Metrics::Sample> Metrics::Snapshot() const
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+
+	std::vector<Sample> samples;
+	samples.reserve(this->entries.size());
+	for (const auto &[name, entry] : this->entries) {
+		Sample sample{name, entry.help, entry.type, 0, {}, 0};
+		switch (entry.type) {
+		case Type::COUNTER:
+			sample.value = static_cast<std::int64_t>(entry.counter->Value());
+			break;
+		case Type::GAUGE:
+			sample.value = entry.gauge->Value();
+			break;
+		case Type::HISTOGRAM: {
+			const auto &bounds = entry.histogram->Bounds();
+			const auto counts = entry.histogram->Counts();
+			std::uint64_t total = 0;
+			for (std::size_t i = 0; i < bounds.size(); i++) {
+				total += counts[i];
+				sample.buckets.push_back(Bucket{bounds[i], total});
+			}
+			sample.value = static_cast<std::int64_t>(total + counts.back());
+			sample.sum = entry.histogram->Sum();
+			break;
+		}
+		}
+		samples.push_back(std::move(sample));
+	}
+	return samples;
+}
+
+std::string Metrics::Prometheus() const
+{
+	std::ostringstream out;
+	for (const auto &sample : this->Snapshot()) {
+		// Help text may not contain raw backslashes or newlines.
+		out << "# HELP " << sample.name << " ";
+		for (const auto c : sample.help) {
+			if (c == '\\') {
+				out << "\\\\";
+			} else if (c == '\n') {
+				out << "\\n";
+			} else {
+				out << c;
+			}
+		}
+		out << "\n# TYPE " << sample.name << " " << TYPE_NAMES[static_cast<std::size_t>(sample.type)] << "\n";
+
+		if (sample.type != Type::HISTOGRAM) {
+			out << sample.name << " " << sample.value << "\n";
+			continue;
+		}
+		for (const auto &bucket : sample.buckets) {
+			out << sample.name << "_bucket{le=\"" << bucket.bound << "\"} " << bucket.count << "\n";
+		}
+		out << sample.name << "_bucket{le=\"+Inf\"} " << sample.value << "\n";
+		out << sample.name << "_sum " << sample.sum << "\n";
+		out << sample.name << "_count " << sample.value << "\n";
+	}
+	return out.str();
+}
+
+} // namespace Playd
@@ -0,0 +1,259 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Metrics registry and its metric types.
+ * @see metrics.cpp
+ */
+
+#ifndef PLAYD_METRICS_H
+#define PLAYD_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Playd
+{
+/**
+ * A metric that only ever goes up, such as a count of events.
+ *
+ * Counters are lock-free, so they can be updated from audio callbacks and
+ * worker threads as well as the main loop.
+ */
+class Counter
+{
+public:
+	/**
+	 * Increases the counter.
+	 * @param n The amount by which to increase it.
+	 */
+	void Add(std::uint64_t n = 1);
+
+	/**
+	 * Gets the counter's current value.
+	 * @return The value.
+	 */
+	std::uint64_t Value() const;
+
+private:
+	std::atomic<std::uint64_t> value{0}; ///< The current value.
+};
+
+/**
+ * A metric that can go up and down, such as the fill level of a buffer.
+ *
+ * Gauges are lock-free, like Counters.  Where several objects contribute to
+ * one gauge (for example, several buffers of the same type), each should Add
+ * and subtract its own contribution rather than Set the total.
+ */
+class Gauge
+{
+public:
+	/**
+	 * Sets the gauge.
+	 * @param v The new value.
+	 */
+	void Set(std::int64_t v);
+
+	/**
+	 * Adjusts the gauge.
+	 * @param delta The amount to add (which may be negative).
+	 */
+	void Add(std::int64_t delta);
+
+	/**
+	 * Gets the gauge's current value.
+	 * @return The value.
+	 */
+	std::int64_t Value() const;
+
+private:
+	std::atomic<std::int64_t> value{0}; ///< The current value.
+};
+
+/**
+ * A metric that counts observations, such as durations, into buckets.
+ *
+ * Each bucket counts the observations no greater than its upper bound, and
+ * a final bucket catches everything above the last bound.  Histograms are
+ * lock-free, like Counters; a reader may catch an observation half-made,
+ * with its bucket bumped but not yet its sum, which is fine for metrics.
+ */
+class Histogram
+{
+public:
+	/**
+	 * Constructs a Histogram.
+	 * @param bounds The upper bounds of the buckets, in increasing order.
+	 */
+	explicit Histogram(std::vector<std::uint64_t> bounds);
+
+	/**
+	 * Makes bounds that double from one bucket to the next.
+	 * @param first The upper bound of the first bucket.
+	 * @param count The number of bounds.
+	 * @return The bounds: @a first, 2 @a first, 4 @a first, and so on.
+	 */
+	static std::vector<std::uint64_t> Doubling(std::uint64_t first, std::size_t count);
+
+	/**
+	 * Makes bounds in the style of an HDR histogram: each doubling is split
+	 * into equal steps, so that every bucket is as precise, relative to its
+	 * values, as every other.
+	 * @param first The upper bound of the first bucket; at least @a steps.
+	 * @param doublings The number of doublings past @a first to cover.
+	 * @param steps The number of buckets into which to split each doubling.
+	 * @return The bounds, from @a first to @a first * 2^@a doublings.
+	 */
+	static std::vector<std::uint64_t> LogLinear(std::uint64_t first, std::size_t doublings, std::size_t steps);
+
+	/**
+	 * Counts an observation.
+	 * @param v The observed value.
+	 */
+	void Observe(std::uint64_t v);
+
+	/**
+	 * Gets the upper bounds of the buckets.
+	 * @return The bounds, not including the catch-all bucket.
+	 */
+	const std::vector<std::uint64_t> &Bounds() const;
+
+	/**
+	 * Gets the number of observations in each bucket.
+	 * @return The counts, one per bound and then one for the catch-all.
+	 */
+	std::vector<std::uint64_t> Counts() const;
+
+	/**
+	 * Gets the sum of all observations.
+	 * @return The sum.
+	 */
+	std::uint64_t Sum() const;
+
+private:
+	std::vector<std::uint64_t> bounds; ///< The upper bounds of the buckets.
+
+	/// The count in each bucket, including the catch-all.
+	std::unique_ptr<std::atomic<std::uint64_t>[]> counts;
+
+	std::atomic<std::uint64_t> sum{0}; ///< The sum of all observations.
+};
+
+/**
+ * A registry of named metrics.
+ *
+ * Metrics are registered on first use, and live as long as the registry, so
+ * call sites can look them up once and keep the reference.  Looking up an
+ * existing name returns the same metric.
+ */
+class Metrics
+{
+public:
+	/// The types of metric in a registry.
+	enum class Type : std::uint8_t {
+		COUNTER,  ///< A Counter.
+		GAUGE,    ///< A Gauge.
+		HISTOGRAM ///< A Histogram.
+	};
+
+	/// A histogram bucket in a Sample.
+	struct Bucket {
+		std::uint64_t bound; ///< The upper bound of the bucket.
+		std::uint64_t count; ///< Observations no greater than the bound.
+	};
+
+	/// A reading of one metric at a point in time.
+	struct Sample {
+		std::string name;   ///< The name of the metric.
+		std::string help;   ///< A description of the metric.
+		Type type;          ///< The type of the metric.
+		std::int64_t value; ///< The value of the metric; for a histogram, its count.
+
+		/// For a histogram, its buckets, cumulative and without the catch-all.
+		std::vector<Bucket> buckets;
+
+		/// For a histogram, the sum of its observations.
+		std::uint64_t sum;
+	};
+
+	/**
+	 * Gets the process-wide registry.
+	 * @return The registry.
+	 */
+	static Metrics &Global();
+
+	/**
+	 * Gets, registering if needed, a Counter.
+	 * @param name The name of the counter.
+	 * @param help A description of the counter, used when registering it.
+	 * @return A reference to the counter.
+	 * @exception InternalError if @a name is registered as another type.
+	 */
+	Counter &GetCounter(std::string_view name, std::string_view help);
+
+	/**
+	 * Gets, registering if needed, a Gauge.
+	 * @param name The name of the gauge.
+	 * @param help A description of the gauge, used when registering it.
+	 * @return A reference to the gauge.
+	 * @exception InternalError if @a name is registered as another type.
+	 */
+	Gauge &GetGauge(std::string_view name, std::string_view help);
+
+	/**
+	 * Gets, registering if needed, a Histogram.
+	 * @param name The name of the histogram.
+	 * @param help A description of the histogram, used when registering it.
+	 * @param bounds The bucket bounds, used when registering it.
+	 * @return A reference to the histogram.
+	 * @exception InternalError if @a name is registered as another type.
+	 */
+	Histogram &GetHistogram(std::string_view name, std::string_view help, std::vector<std::uint64_t> bounds);
+
+	/**
+	 * Reads every metric in the registry.
+	 * @return A sample of each metric, in name order.
+	 */
+	std::vector<Sample> Snapshot() const;
+
+	/**
+	 * Reads every metric in the registry, in the Prometheus text format.
+	 * @return The metrics, with help and type lines, in name order.
+	 */
+	std::string Prometheus() const;
+
+private:
+	/// A registered metric; exactly one of the pointers is set.
+	struct Entry {
+		Type type;                            ///< The type of the metric.
+		std::string help;                     ///< A description of the metric.
+		std::unique_ptr<Counter> counter;     ///< The metric, if a Counter.
+		std::unique_ptr<Gauge> gauge;         ///< The metric, if a Gauge.
+		std::unique_ptr<Histogram> histogram; ///< The metric, if a Histogram.
+	};
+
+	mutable std::mutex lock;              ///< Guards registration.
+	std::map<std::string, Entry> entries; ///< The metrics, by name.
+
+	/**
+	 * Finds or creates the entry for a metric.
+	 * @param name The name of the metric.
+	 * @param help A description of the metric.
+	 * @param type The expected type of the metric.
+	 * @return The entry; the caller must hold the lock.
+	 * @exception InternalError if @a name is registered as another type.
+	 */
+	Entry &Find(std::string_view name, std::string_view help, Type type);
+};
+
+} // namespace Playd
+
+#endif // PLAYD_METRICS_H
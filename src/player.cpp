@@ -7,21 +7,137 @@
  * @see player.h
  */
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <charconv>
 #include <cstdint>
+#include <initializer_list>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 
 #include "audio/audio.h"
+#include "audio/input.h"
+#include "audio/loudness.h"
+#include "audio/peaks.h"
+#include "audio/prefetch.h"
+#include "audio/probe.h"
+#include "audio/silence.h"
 #include "audio/sink.h"
 #include "audio/source.h"
 #include "errors.h"
+#include "log.h"
 #include "messages.h"
+#include "metrics.h"
 #include "player.h"
 #include "response.h"
+#include "trace.h"
 
 namespace Playd {
 
+/// The number of bytes at the start of a newly loaded file to prefetch.
+    constexpr std::uint64_t LOAD_PREFETCH_BYTES{1u << 20u};
+
+/// The lowest gain, in decibels, that the gain command accepts.
+    constexpr double MIN_GAIN_DB{-96};
+
+/// The highest gain, in decibels, that the gain command accepts.
+    constexpr double MAX_GAIN_DB{24};
+
+/// The highest true peak, in dBTP, that automatic gain may push a file to.
+    constexpr double AUTO_GAIN_PEAK_DB{-1};
+
+/// The shortest interval, other than 0 (off), that the meter command accepts.
+    constexpr std::chrono::microseconds MIN_METER_INTERVAL{10000};
+
+/// The most peaks one peaks command can ask for.
+    constexpr std::size_t MAX_PEAKS{16384};
+
+/// The names of the crossfade curves, as used by the xfade command.
+    constexpr std::array<std::string_view, 2> CURVE_NAMES{{
+                                                                  "linear", // FadeCurve::LINEAR
+                                                                  "power"   // FadeCurve::EQUAL_POWER
+                                                          }};
+
+    /// @return The histogram of how long loading each file took.
+    static Histogram &LoadHistogram() {
+        static auto &histogram = Metrics::Global().GetHistogram(
+                "playd_load_us", "Microseconds taken to open each file loaded.", Histogram::Doubling(256, 16));
+        return histogram;
+    }
+
+    /// @return The histogram of how long each seek took.
+    static Histogram &SeekHistogram() {
+        static auto &histogram = Metrics::Global().GetHistogram(
+                "playd_seek_us", "Microseconds taken to seek each file.", Histogram::Doubling(64, 16));
+        return histogram;
+    }
+
+    /**
+     * Measures how long something took, in microseconds.
+     * @param start When it started.
+     * @return The microseconds since @a start.
+     */
+    static std::uint64_t MicrosecondsSince(std::chrono::steady_clock::time_point start) {
+        const auto took = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration_cast<std::chrono::microseconds>(took).count();
+    }
+
+    /**
+     * Formats a gain in decibels for a response.
+     * @param db The gain.
+     * @return The gain as a string, with no more precision than it needs.
+     */
+    static std::string DbString(double db) {
+        std::ostringstream os;
+        os << db;
+        return os.str();
+    }
+
+    /**
+     * Makes a LOUD response.
+     * @param tag The tag of the response.
+     * @param loudness The loudness to report.
+     * @return The response.
+     */
+    static Response LoudResponse(Response::Tag tag, const Audio::Loudness &loudness) {
+        Response rs{tag, Response::Code::LOUD};
+        for (const auto value : {loudness.integrated, loudness.range, loudness.true_peak}) {
+            std::ostringstream os;
+            os << std::fixed << std::setprecision(1) << value;
+            rs.AddArg(os.str());
+        }
+        return rs;
+    }
+
+    /**
+     * Formats a level for a LEVEL response.
+     * @param linear The level, with full scale at 1.
+     * @return The level in dBFS, to one decimal place; silence is -inf.
+     */
+    static std::string LevelString(double linear) {
+        std::ostringstream os;
+        os << std::fixed << std::setprecision(1) << 20.0 * std::log10(linear);
+        return os.str();
+    }
+
+    /**
+     * Makes a CUES response.
+     * @param tag The tag of the response.
+     * @param cues The cue points to report.
+     * @return The response.
+     */
+    static Response CuesResponse(Response::Tag tag, const Audio::Cues &cues) {
+        return Response(tag, Response::Code::CUES)
+                .AddArg(std::to_string(cues.In().count()))
+                .AddArg(std::to_string(cues.Out().count()));
+    }
+
     Response PlayerDead(std::string_view tag) {
         return Response::Failure(tag, MSG_CMD_PLAYER_CLOSING);
     }
@@ -35,26 +151,117 @@ namespace Playd {
               sink{std::move(sink)},
               sources{std::move(sources)},
               file{std::make_unique<Audio::NullAudio>()},
+              next{nullptr},
+              opening{nullptr},
               dead{false},
               io{nullptr},
-              last_pos{0} {
+              last_pos{0},
+              last_len{0},
+              prefetch_window{0},
+              xfade_length{0},
+              xfade_curve{Audio::FadeCurve::LINEAR},
+              gain_db{0},
+              auto_gain{},
+              auto_trim{false},
+              limit{},
+              meter_interval{0},
+              last_meter{},
+              updates{},
+              update_count{0},
+              file_loudness{nullptr},
+              next_loudness{nullptr},
+              file_peaks{nullptr},
+              next_peaks{nullptr},
+              file_cues{nullptr},
+              next_cues{nullptr} {
     }
 
     void Player::SetIo(const ResponseSink &new_io) {
         this->io = &new_io;
     }
 
+    void Player::SetPrefetchWindow(std::chrono::seconds window) {
+        this->prefetch_window = window;
+    }
+
+    void Player::SetAutoGain(std::optional<double> target) {
+        this->auto_gain = target;
+    }
+
+    void Player::SetAutoTrim(bool trim) {
+        this->auto_trim = trim;
+    }
+
+    void Player::SetLimit(std::optional<double> ceiling) {
+        this->limit = ceiling;
+    }
+
     bool Player::Update() {
         assert(this->file != nullptr);
+
+        this->updates[this->update_count++ % UPDATE_HISTORY] = std::chrono::steady_clock::now();
+
+        // A stream loaded before it started gets loaded properly once it has.
+        if (this->opening != nullptr) this->FinishOpening();
+
+        // Loudness analyses finish in the background; once they do, any
+        // automatic gain can take effect.
+        if (this->file_loudness != nullptr) {
+            if (auto loudness = this->file_loudness->Take(); loudness) {
+                this->Respond(0, LoudResponse(Response::NOREQUEST, *loudness));
+                if (this->auto_gain) this->file->SetGain(this->LinearGain(this->file_loudness.get()), true);
+            }
+        }
+        if (this->next_loudness != nullptr && this->next_loudness->Take() && this->auto_gain) {
+            this->next->SetGain(this->LinearGain(this->next_loudness.get()), true);
+        }
+
+        // Likewise, silence analyses move where files start and end.
+        if (this->file_cues != nullptr) {
+            if (auto cues = this->file_cues->Take(); cues) {
+                this->Respond(0, CuesResponse(Response::NOREQUEST, *cues));
+                if (this->SkipLeadingSilence(*this->file, this->file_cues.get())) {
+                    this->BroadcastPos(Response::NOREQUEST, this->file->Position());
+                }
+                this->CueNext();
+            }
+        }
+        if (this->next_cues != nullptr && this->next_cues->Take() && !this->NextStarted()) {
+            this->SkipLeadingSilence(*this->next, this->next_cues.get());
+        }
+
+        // Keep the next file's buffers full, so that it can start the moment
+        // it's cued.
+        if (this->next != nullptr) this->next->Update();
+
         const auto as = this->file->Update();
 
+        this->BroadcastLevels();
+        this->BroadcastUnderruns();
+
         if (as == Audio::Audio::State::AT_END) this->End(Response::NOREQUEST);
         if (as == Audio::Audio::State::PLAYING) {
             // Since the audio is currently playing, the position may have
             // advanced since last update.  So we need to update it.
             auto pos = this->file->Position();
-            if (this->CanBroadcastPos(pos))
+            if (auto out = this->TrimOut(); out && *out <= pos) {
+                // Trailing silence counts as past the end.
+                this->End(Response::NOREQUEST);
+            } else if (this->CanBroadcastPos(pos)) {
                 this->BroadcastPos(Response::NOREQUEST, pos);
+            }
+        }
+        if (as != Audio::Audio::State::NONE) {
+            // Some sources only learn their exact length after loading
+            // (eg, once an MP3 has been indexed), so keep clients updated.
+            auto len = this->file->Length();
+            if (len != this->last_len) {
+                this->last_len = len;
+                this->AnnounceTimestamp(Response::Code::LEN, 0, Response::NOREQUEST, len);
+
+                // The crossfade hangs off the end, so it moves too.
+                this->CueNext();
+            }
         }
 
         return !this->dead;
@@ -70,6 +277,44 @@ namespace Playd {
         this->DumpState(id, tag);
         this->DumpFileInfo(id, tag);
 
+        if (this->next != nullptr) {
+            this->Respond(id, Response(tag, Response::Code::NLOAD).AddArg(this->next->File()));
+        }
+        if (this->gain_db != 0) {
+            this->Respond(id, Response(tag, Response::Code::GAIN).AddArg(DbString(this->gain_db)));
+        }
+        if (0 < this->meter_interval.count()) {
+            this->Respond(id, Response(tag, Response::Code::METER).AddArg(std::to_string(this->meter_interval.count())));
+        }
+        if (0 < this->xfade_length.count()) {
+            this->Respond(id, Response(tag, Response::Code::XFADE)
+                    .AddArg(std::to_string(this->xfade_length.count()))
+                    .AddArg(CURVE_NAMES[static_cast<std::uint8_t>(this->xfade_curve)]));
+        }
+
+        return Response::Success(tag);
+    }
+
+    Response Player::Stats(size_t id, Response::Tag tag) const {
+        if (this->dead) return PlayerDead(tag);
+
+        for (const auto &sample : Metrics::Global().Snapshot()) {
+            // Histograms have too many buckets to list here, but their
+            // count and sum give the mean.
+            if (sample.type == Metrics::Type::HISTOGRAM) {
+                this->Respond(id, Response(tag, Response::Code::STAT)
+                        .AddArg(sample.name + "_count")
+                        .AddArg(std::to_string(sample.value)));
+                this->Respond(id, Response(tag, Response::Code::STAT)
+                        .AddArg(sample.name + "_sum")
+                        .AddArg(std::to_string(sample.sum)));
+                continue;
+            }
+            this->Respond(id, Response(tag, Response::Code::STAT)
+                    .AddArg(sample.name)
+                    .AddArg(std::to_string(sample.value)));
+        }
+
         return Response::Success(tag);
     }
 
@@ -83,13 +328,68 @@ namespace Playd {
         auto pos = this->file->Position();
         AnnounceTimestamp(Response::Code::POS, id, tag, pos);
 
+        // Live streams have no length to announce.
+        if (this->file->IsLive()) return;
         auto len = this->file->Length();
         AnnounceTimestamp(Response::Code::LEN, id, tag, len);
+
+        if (this->file_loudness != nullptr) {
+            if (auto loudness = this->file_loudness->Result(); loudness) this->Respond(id, LoudResponse(tag, *loudness));
+        }
+        if (this->file_cues != nullptr) {
+            if (auto cues = this->file_cues->Result(); cues) this->Respond(id, CuesResponse(tag, *cues));
+        }
+    }
+
+    Response Player::Peaks(size_t id, Response::Tag tag, bool next, std::string_view start_str,
+                           std::string_view end_str, std::string_view count_str) const {
+        if (this->dead) return PlayerDead(tag);
+        if (this->file->CurrentState() == Audio::Audio::State::NONE) return Response::Invalid(tag, MSG_CMD_NEEDS_LOADED);
+        if (next && this->next == nullptr) return Response::Invalid(tag, MSG_PEAKS_NO_NEXT);
+
+        std::chrono::microseconds start{0};
+        std::chrono::microseconds end{0};
+        try {
+            start = PosParse(start_str);
+            end = PosParse(end_str);
+        } catch (SeekError &) {
+            return Response::Invalid(tag, MSG_PEAKS_INVALID_RANGE);
+        }
+        if (end <= start) return Response::Invalid(tag, MSG_PEAKS_INVALID_RANGE);
+
+        std::size_t count = 0;
+        auto [p, ec] = std::from_chars(count_str.data(), count_str.data() + count_str.size(), count);
+        if (ec != std::errc{} || p != count_str.data() + count_str.size() || count == 0 || MAX_PEAKS < count) {
+            return Response::Invalid(tag, MSG_PEAKS_INVALID_COUNT);
+        }
+
+        const auto &analysis = next ? this->next_peaks : this->file_peaks;
+        const auto *peaks = analysis == nullptr ? nullptr : analysis->Result();
+        if (peaks == nullptr) return Response::Failure(tag, MSG_PEAKS_NOT_READY);
+
+        // Round outwards, so that the peaks cover at least what was asked.
+        const auto rate = peaks->SampleRate();
+        const auto first = static_cast<std::uint64_t>(start.count()) * rate / 1000000;
+        const auto last = (static_cast<std::uint64_t>(end.count()) * rate + 999999) / 1000000;
+
+        Response rs{tag, Response::Code::PEAKS};
+        rs.AddArg((next ? this->next : this->file)->File())
+                .AddArg(std::to_string(start.count()))
+                .AddArg(std::to_string(end.count()));
+        for (const auto peak : peaks->Range(first, std::max(last, first + 1), count)) {
+            rs.AddArg(std::to_string(peak.low) + "," + std::to_string(peak.high));
+        }
+        this->Respond(id, rs);
+
+        return Response::Success(tag);
     }
 
     Response Player::Eject(Response::Tag tag) {
         if (this->dead) return PlayerDead(tag);
 
+        // A stream yet to start has nothing to announce, so just goes.
+        this->opening = nullptr;
+
         // Silently ignore ejects on ejected files.
         // Concurrently speaking, this should be fine, as we are the only
         // thread that can eject or un-eject files.
@@ -98,7 +398,14 @@ namespace Playd {
         }
 
         assert(this->file != nullptr);
+        this->next = nullptr;
+        this->next_loudness = nullptr;
+        this->next_peaks = nullptr;
+        this->next_cues = nullptr;
         this->file = std::make_unique<Audio::NullAudio>();
+        this->file_loudness = nullptr;
+        this->file_peaks = nullptr;
+        this->file_cues = nullptr;
 
         this->DumpState(0, tag);
 
@@ -114,13 +421,40 @@ namespace Playd {
         // This is needed for auto-advancing playlists, etc.
         this->Respond(0, Response(Response::NOREQUEST, Response::Code::END));
 
+        // If there's a next file, it takes over from here, playing if this
+        // one was.  If we crossfaded into it, it's already playing, and some
+        // way in.
+        if (this->next != nullptr) {
+            const auto playing = this->file->CurrentState() != Audio::Audio::State::STOPPED;
+
+            this->file = std::move(this->next);
+            this->file_loudness = std::move(this->next_loudness);
+            this->file_peaks = std::move(this->next_peaks);
+            this->file_cues = std::move(this->next_cues);
+            if (playing) this->file->SetPlaying(true);
+
+            // The dump announces any loudness and cues we already have.
+            if (this->file_loudness != nullptr) this->file_loudness->Take();
+            if (this->file_cues != nullptr) this->file_cues->Take();
+
+            const auto pos = this->file->Position();
+            this->last_pos = std::chrono::duration_cast<std::chrono::seconds>(pos);
+            this->last_len = this->file->Length();
+            this->Dump(0, Response::NOREQUEST);
+
+            return Response::Success(tag);
+        }
+
         this->SetPlaying(tag, false);
 
-        // Rewind the file back to the start.  We can't use Player::Pos() here
-        // in case End() is called from Pos(); a seek failure could start an
-        // infinite loop.
+        // A live stream that ran out has nowhere to rewind to.
+        if (this->file->IsLive()) return Response::Success(tag);
+
+        // Rewind the file back to the start (or its cue-in).  We can't use
+        // Player::Pos() here in case End() is called from Pos(); a seek
+        // failure could start an infinite loop.
         try {
-            this->PosRaw(Response::NOREQUEST, std::chrono::microseconds{0});
+            this->PosRaw(Response::NOREQUEST, this->TrimIn(this->file_cues.get()));
         } catch (NullAudioError &) {
             return Response::Invalid(tag, MSG_CMD_NEEDS_LOADED);
         }
@@ -142,14 +476,44 @@ namespace Playd {
         this->Eject(Response::NOREQUEST);
 
         try {
-            this->file = this->LoadRaw(path);
+            const auto start = std::chrono::steady_clock::now();
+            auto source = LoadSource(this->sources, path, this->prefetch_window);
+            assert(source != nullptr);
+
+            // A live stream only knows its format once it starts, which is
+            // up to its writer; rather than hold up every channel on the
+            // loop until then, Update finishes the load once it has.
+            if (!source->IsReady()) {
+                this->opening = std::move(source);
+                return Response::Success(tag);
+            }
+            this->FinishLoad(std::move(source), start);
         } catch (FileError &e) {
             // File errors aren't fatal, so catch them here.
             return Response::Failure(tag, e.Message());
         }
 
+        return Response::Success(tag);
+    }
+
+    void Player::FinishLoad(std::unique_ptr<Audio::Source> source, std::chrono::steady_clock::time_point start) {
+        const auto path = std::string{source->Path()};
+        this->file = this->MakeAudio(std::move(source), start);
+
         assert(this->file != nullptr);
         this->last_pos = std::chrono::seconds{0};
+        this->last_len = this->file->Length();
+
+        // If the loudness is cached, it's known now, and the dump announces it.
+        this->Analyse(path, this->file_peaks, this->file_loudness, this->file_cues);
+        if (this->file_loudness != nullptr) {
+            this->file_loudness->Take();
+            this->file->SetGain(this->LinearGain(this->file_loudness.get()), false);
+        }
+        if (this->file_cues != nullptr) {
+            this->file_cues->Take();
+            this->SkipLeadingSilence(*this->file, this->file_cues.get());
+        }
 
         // A load will change all of the player's state in one go,
         // so just send a Dump() instead of writing out all of the responses
@@ -157,6 +521,119 @@ namespace Playd {
         // Don't take the response from here, though, because it has the wrong
         // tag.
         this->Dump(0, Response::NOREQUEST);
+    }
+
+    void Player::FinishOpening() {
+        try {
+            if (!this->opening->IsReady()) return;
+            this->FinishLoad(std::move(this->opening), std::chrono::steady_clock::now());
+        } catch (FileError &e) {
+            // Whoever asked for the load has long since had its ACK, so
+            // everyone hears of the failure instead.
+            this->opening = nullptr;
+            this->Respond(0, Response::Failure(Response::NOREQUEST, e.Message()));
+        }
+    }
+
+    Response Player::NLoad(Response::Tag tag, std::string_view path) {
+        if (this->dead) return PlayerDead(tag);
+
+        if (path.empty()) return Response::Invalid(tag, MSG_LOAD_EMPTY_PATH);
+
+        // With nothing loaded, there's nothing for the file to follow.
+        if (this->file->CurrentState() == Audio::Audio::State::NONE) return this->Load(tag, path);
+
+        // As in Load, bin the old next file before loading the new one.
+        this->next = nullptr;
+        this->next_loudness = nullptr;
+        this->next_peaks = nullptr;
+        this->next_cues = nullptr;
+
+        try {
+            this->next = this->LoadRaw(path);
+        } catch (FileError &e) {
+            return Response::Failure(tag, e.Message());
+        }
+
+        assert(this->next != nullptr);
+        this->Analyse(path, this->next_peaks, this->next_loudness, this->next_cues);
+        if (this->next_loudness != nullptr) {
+            this->next->SetGain(this->LinearGain(this->next_loudness.get()), false);
+        }
+        if (this->next_cues != nullptr) {
+            this->next_cues->Take();
+            this->SkipLeadingSilence(*this->next, this->next_cues.get());
+        }
+        this->Respond(0, Response(Response::NOREQUEST, Response::Code::NLOAD).AddArg(this->next->File()));
+        this->CueNext();
+
+        return Response::Success(tag);
+    }
+
+    Response Player::Crossfade(Response::Tag tag, std::string_view length_str, std::string_view curve_str) {
+        if (this->dead) return PlayerDead(tag);
+
+        std::chrono::microseconds length{0};
+        try {
+            length = PosParse(length_str);
+        } catch (SeekError &e) {
+            return Response::Invalid(tag, e.Message());
+        }
+
+        auto curve = std::find(CURVE_NAMES.begin(), CURVE_NAMES.end(), curve_str);
+        if (curve == CURVE_NAMES.end()) return Response::Invalid(tag, MSG_XFADE_BAD_CURVE);
+
+        this->xfade_length = length;
+        this->xfade_curve = static_cast<Audio::FadeCurve>(curve - CURVE_NAMES.begin());
+        this->Respond(0, Response(Response::NOREQUEST, Response::Code::XFADE)
+                .AddArg(std::to_string(length.count()))
+                .AddArg(*curve));
+        this->CueNext();
+
+        return Response::Success(tag);
+    }
+
+    Response Player::Gain(Response::Tag tag, std::string_view db_str) {
+        if (this->dead) return PlayerDead(tag);
+
+        try {
+            this->gain_db = GainParse(db_str);
+        } catch (std::invalid_argument &) {
+            return Response::Invalid(tag, MSG_GAIN_INVALID_VALUE);
+        }
+
+        if (this->file->CurrentState() != Audio::Audio::State::NONE) {
+            this->file->SetGain(this->LinearGain(this->file_loudness.get()), true);
+        }
+        if (this->next != nullptr) this->next->SetGain(this->LinearGain(this->next_loudness.get()), true);
+
+        this->Respond(0, Response(Response::NOREQUEST, Response::Code::GAIN).AddArg(DbString(this->gain_db)));
+
+        return Response::Success(tag);
+    }
+
+    Response Player::Meter(Response::Tag tag, std::string_view interval_str) {
+        if (this->dead) return PlayerDead(tag);
+
+        std::chrono::microseconds interval{0};
+        try {
+            interval = PosParse(interval_str);
+        } catch (SeekError &) {
+            return Response::Invalid(tag, MSG_METER_INVALID_INTERVAL);
+        }
+        // Any shorter, and the levels would cover too little audio to mean
+        // much (and the update timer couldn't keep up anyway).
+        if (0 < interval.count() && interval < MIN_METER_INTERVAL) {
+            return Response::Invalid(tag, MSG_METER_INVALID_INTERVAL);
+        }
+
+        // Throw away anything measured while nobody was looking, so the
+        // first broadcast covers only the first interval.
+        if (this->meter_interval.count() == 0) this->file->TakeLevels();
+
+        this->meter_interval = interval;
+        this->last_meter = std::chrono::steady_clock::now();
+        this->Respond(0, Response(Response::NOREQUEST, Response::Code::METER).AddArg(std::to_string(interval.count())));
 
         return Response::Success(tag);
     }
@@ -173,6 +650,12 @@ namespace Playd {
             return Response::Invalid(tag, e.Message());
         }
 
+        // Seeks in live streams aren't the client running off the end of
+        // something, so they shouldn't end it as failed seeks do below.
+        if (this->file->CurrentState() != Audio::Audio::State::NONE && this->file->IsLive()) {
+            return Response::Failure(tag, MSG_SEEK_UNSUPPORTED);
+        }
+
         try {
             this->PosRaw(tag, pos);
         } catch (NullAudioError &) {
@@ -182,7 +665,7 @@ namespace Playd {
             // seek position (usually because it's outside the audio file!).
             // Thus, unlike above, we try to recover.
 
-            Debug() << "Seek failure" << std::endl;
+            PLAYD_LOG(WARNING) << "Seek failure";
 
             // Make it look to the client as if the seek ran off the end of
             // the file.
@@ -209,6 +692,9 @@ namespace Playd {
             return Response::Invalid(tag, e.Message());
         }
 
+        // Mid-crossfade, both files start and stop together.
+        if (this->NextStarted()) this->next->SetPlaying(playing);
+
         this->DumpState(0, Response::NOREQUEST);
 
         // It can be helpful to know precisely where the player changed its
@@ -258,11 +744,104 @@ namespace Playd {
         return std::chrono::microseconds{pos};
     }
 
+    /* static */ double Player::GainParse(std::string_view db_str) {
+        size_t cpos = 0;
+
+        double db;
+        try {
+            db = std::stod(std::string{db_str}, &cpos);
+        } catch (std::out_of_range &) {
+            throw std::invalid_argument("gain out of range");
+        }
+
+        // As in PosParse, trailing junk makes the whole thing invalid.
+        // This also rules out NaNs, which fail every comparison.
+        if (cpos != db_str.length() || !(MIN_GAIN_DB <= db && db <= MAX_GAIN_DB)) {
+            throw std::invalid_argument("gain out of range");
+        }
+
+        return db;
+    }
+
+    float Player::LinearGain(const Audio::LoudnessAnalysis *loudness) const {
+        auto db = this->gain_db;
+
+        // Files we haven't measured yet, or that are silent, play as they are.
+        if (this->auto_gain && loudness != nullptr) {
+            if (auto result = loudness->Result(); result && std::isfinite(result->integrated)) {
+                db += std::min(*this->auto_gain - result->integrated, AUTO_GAIN_PEAK_DB - result->true_peak);
+            }
+        }
+
+        return static_cast<float>(std::pow(10.0, std::min(db, MAX_GAIN_DB) / 20.0));
+    }
+
+    std::chrono::microseconds Player::TrimIn(const Audio::SilenceAnalysis *cues) const {
+        if (!this->auto_trim || cues == nullptr) return std::chrono::microseconds{0};
+
+        // Silent files have nothing to trim down to, so play as they are.
+        auto result = cues->Result();
+        if (result == nullptr || result->Silent()) return std::chrono::microseconds{0};
+        return result->In();
+    }
+
+    std::optional<std::chrono::microseconds> Player::TrimOut() const {
+        if (!this->auto_trim || this->file_cues == nullptr) return std::nullopt;
+
+        auto result = this->file_cues->Result();
+        if (result == nullptr || result->Silent()) return std::nullopt;
+        return result->Out();
+    }
+
+    bool Player::SkipLeadingSilence(Audio::Audio &audio, const Audio::SilenceAnalysis *cues) const {
+        // Once a file has played, or been moved, it's too late to skip.
+        if (audio.CurrentState() != Audio::Audio::State::STOPPED || 0 < audio.Position().count()) return false;
+
+        const auto in = this->TrimIn(cues);
+        if (in.count() == 0) return false;
+
+        audio.SetPosition(in);
+        return true;
+    }
+
     void Player::PosRaw(Response::Tag tag, std::chrono::microseconds pos) {
         Expects(this->file != nullptr);
 
+        const auto start = std::chrono::steady_clock::now();
         this->file->SetPosition(pos);
+        SeekHistogram().Observe(MicrosecondsSince(start));
         this->BroadcastPos(tag, pos);
+
+        // Seeking mid-crossfade takes us away from the point at which the
+        // next file started, so start it again from the top when we next
+        // reach it.
+        if (this->NextStarted()) {
+            this->next->SetPlaying(false);
+            this->next->SetPosition(this->TrimIn(this->next_cues.get()));
+        }
+        this->CueNext();
+    }
+
+    void Player::CueNext() {
+        if (this->next == nullptr || this->NextStarted()) return;
+
+        // Live streams have no end to fade from.  If the output can't
+        // crossfade, this does nothing, and End starts the next file
+        // instead.
+        if (this->xfade_length.count() == 0 || this->file->IsLive()) {
+            this->file->CueCrossfade(nullptr, {}, {}, this->xfade_curve);
+            return;
+        }
+
+        const auto len = this->TrimOut().value_or(this->file->Length());
+        const auto length = std::min(this->xfade_length, len);
+        this->file->CueCrossfade(this->next.get(), len - length, length, this->xfade_curve);
+    }
+
+    bool Player::NextStarted() const {
+        if (this->next == nullptr) return false;
+        return this->next->CurrentState() == Audio::Audio::State::PLAYING ||
+               this->TrimIn(this->next_cues.get()) < this->next->Position();
     }
 
     void Player::DumpState(size_t id, Response::Tag tag) const {
@@ -309,24 +888,181 @@ namespace Playd {
         this->AnnounceTimestamp(Response::Code::POS, 0, tag, pos);
     }
 
+    void Player::BroadcastLevels() {
+        if (this->meter_interval.count() == 0) return;
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - this->last_meter < this->meter_interval) return;
+
+        // If the callback hasn't handed anything over yet, try again on the
+        // next update rather than waiting a whole interval.
+        const auto levels = this->file->TakeLevels();
+        if (!levels || levels->frames == 0) return;
+        this->last_meter = now;
+
+        Response rs{Response::NOREQUEST, Response::Code::LEVEL};
+        for (std::size_t c = 0; c < levels->channels; c++) {
+            rs.AddArg(LevelString(levels->peak[c]));
+            rs.AddArg(LevelString(std::sqrt(levels->energy[c] / static_cast<double>(levels->frames))));
+        }
+        this->Respond(0, rs);
+    }
+
+    void Player::BroadcastUnderruns() {
+        auto any = false;
+        for (auto *audio : {this->file.get(), this->next.get()}) {
+            if (audio == nullptr) continue;
+
+            while (auto dropout = audio->TakeUnderrun()) {
+                this->Respond(0, Response(Response::NOREQUEST, Response::Code::XRUN)
+                        .AddArg(std::to_string(dropout->position.count()))
+                        .AddArg(std::to_string(dropout->length.count()))
+                        .AddArg(std::to_string(this->LoopGap(dropout->at).count())));
+                any = true;
+            }
+        }
+
+        // Underruns come out once the audio comes back, so a trace dumped
+        // now shows what led up to each one, and what ended it.
+        if (any) Tracer::Global().Dump();
+    }
+
+    std::optional<std::chrono::microseconds> Player::Headroom() const {
+        assert(this->file != nullptr);
+
+        auto headroom = this->file->Headroom();
+        if (this->NextStarted()) {
+            const auto next_headroom = this->next->Headroom();
+            if (!headroom || (next_headroom && *next_headroom < *headroom)) headroom = next_headroom;
+        }
+        return headroom;
+    }
+
+    bool Player::IsPlaying() const {
+        assert(this->file != nullptr);
+        return this->file->CurrentState() == Audio::Audio::State::PLAYING || this->NextStarted();
+    }
+
+    std::chrono::microseconds Player::LoopGap(std::chrono::steady_clock::time_point at) const {
+        // Walk back from the newest update to the last one before the
+        // moment; the one after it (or now) closes the gap.
+        const auto known = std::min<std::uint64_t>(this->update_count, UPDATE_HISTORY);
+        auto after = std::chrono::steady_clock::now();
+        for (std::uint64_t i = 1; i <= known; i++) {
+            const auto start = this->updates[(this->update_count - i) % UPDATE_HISTORY];
+            if (start <= at) return std::chrono::duration_cast<std::chrono::microseconds>(after - start);
+            after = start;
+        }
+        return std::chrono::microseconds{0};
+    }
+
     std::unique_ptr<Audio::Audio> Player::LoadRaw(std::string_view path) const {
-        auto source = this->LoadSource(path);
+        const auto start = std::chrono::steady_clock::now();
+        auto source = LoadSource(this->sources, path, this->prefetch_window);
         assert(source != nullptr);
 
+        // Only Load can wait for a stream to start.
+        if (!source->IsReady()) throw FileError(MSG_LOAD_NOT_STARTED);
+        return this->MakeAudio(std::move(source), start);
+    }
+
+    std::unique_ptr<Audio::Audio> Player::MakeAudio(std::unique_ptr<Audio::Source> source,
+                                                    std::chrono::steady_clock::time_point start) const {
         auto sink = this->sink(*source, this->device_id);
-        return std::make_unique<Audio::BasicAudio>(std::move(source), std::move(sink));
+        std::optional<float> ceiling;
+        if (this->limit) ceiling = static_cast<float>(std::pow(10.0, *this->limit / 20.0));
+        auto audio = std::make_unique<Audio::BasicAudio>(std::move(source), std::move(sink), ceiling);
+
+        // Nothing has played yet, so there's nothing to ramp from.
+        audio->SetGain(this->LinearGain(nullptr), false);
+
+        LoadHistogram().Observe(MicrosecondsSince(start));
+        return audio;
     }
 
-    std::unique_ptr<Audio::Source> Player::LoadSource(std::string_view path) const {
-        size_t extpoint = path.find_last_of('.');
-        auto ext = std::string{path.substr(extpoint + 1)};
+    void Player::Analyse(std::string_view path, std::unique_ptr<Audio::PeakAnalysis> &peaks,
+                         std::unique_ptr<Audio::LoudnessAnalysis> &loudness,
+                         std::unique_ptr<Audio::SilenceAnalysis> &cues) const {
+        // Streams can't be read twice, so there's nothing to analyse.
+        if (Audio::IsStream(path)) {
+            peaks = nullptr;
+            loudness = nullptr;
+            cues = nullptr;
+            return;
+        }
+
+        // The pass reads the file for itself, on another thread, so it
+        // gets its own copy of everything it needs to open it.
+        Audio::AnalysisPass pass{path, [sources = this->sources, path = std::string{path}] {
+                                     return LoadSource(sources, path, std::chrono::seconds{0},
+                                                       Audio::SourceUse::ANALYSIS);
+                                 }};
+        peaks = pass.Add<Audio::PeakTraits>();
+        loudness = pass.Add<Audio::LoudnessTraits>();
+        cues = pass.Add<Audio::SilenceTraits>();
+        pass.Start();
+    }
+
+    /* static */ std::unique_ptr<Audio::Source> Player::LoadSource(const std::map<std::string, SourceFn> &sources,
+                                                                  std::string_view path,
+                                                                  std::chrono::seconds prefetch_window,
+                                                                  Audio::SourceUse use) {
+        // Streams can only be read once, so we can't sniff them or hand
+        // them to anything that might want to look at them first.
+        if (Audio::IsStream(path)) {
+            auto ibuilder = sources.find("stream");
+            if (ibuilder == sources.end()) throw FileError("Streams are not supported");
+            return (ibuilder->second)(path, nullptr, use);
+        }
+
+        // If we can't open the file, carry on with the extension alone: it
+        // might still be something a source can open by other means.  We
+        // only report the open failure if nothing else works.
+        std::unique_ptr<Audio::Input> input;
+        std::string open_error;
+        try {
+            input = Audio::Input::Open(path);
+        } catch (FileError &e) {
+            open_error = e.Message();
+        }
+
+        // Start bringing the start of the file into memory now, so that
+        // the first decodes after a play don't have to wait for the disk.
+        if (input != nullptr) input->Prefetch(0, LOAD_PREFETCH_BYTES);
+
+        auto format = std::string{input == nullptr ? "" : Audio::SniffFormat(input->Head())};
+        auto ibuilder = sources.find(format);
+        if (ibuilder == sources.end()) {
+            size_t extpoint = path.find_last_of('.');
+            format = std::string{path.substr(extpoint + 1)};
+            ibuilder = sources.find(format);
+        }
+        if (ibuilder == sources.end()) {
+            if (!open_error.empty()) throw FileError(open_error);
+            throw FileError("Unknown file format: " + format);
+        }
+
+        // Only now that we know the file is playable is it worth starting a
+        // reader thread for it.  Until the source is built we don't know how
+        // many bytes a second of audio is, so start with a modest window.
+        Audio::PrefetchInput::WindowSize window;
+        if (input != nullptr && 0 < prefetch_window.count()) {
+            window = std::make_shared<std::atomic<std::uint64_t>>(LOAD_PREFETCH_BYTES);
+            input = std::make_unique<Audio::PrefetchInput>(std::move(input), window);
+        }
+        const auto file_bytes = input == nullptr ? 0 : input->Length();
+
+        auto source = (ibuilder->second)(path, std::move(input), use);
 
-        auto ibuilder = this->sources.find(ext);
-        if (ibuilder == this->sources.end()) {
-            throw FileError("Unknown file format: " + ext);
+        if (window != nullptr && source != nullptr) {
+            const auto seconds = static_cast<double>(source->Length()) / source->SampleRate();
+            if (0 < seconds) {
+                const auto bytes_per_second = file_bytes / seconds;
+                window->store(static_cast<std::uint64_t>(bytes_per_second * prefetch_window.count()));
+            }
         }
 
-        return (ibuilder->second)(path);
+        return source;
     }
 
 } // namespace Playd
@@ -10,16 +10,22 @@
 #ifndef PLAYD_PLAYER_H
 #define PLAYD_PLAYER_H
 
+#include <array>
 #include <chrono>
 #include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "audio/audio.h"
+#include "audio/input.h"
+#include "audio/loudness.h"
+#include "audio/peaks.h"
+#include "audio/silence.h"
 #include "audio/sink.h"
 #include "audio/source.h"
 #include "response.h"
@@ -37,16 +43,22 @@ namespace Playd {
         using SinkFn =
         std::function<std::unique_ptr<Audio::Sink>(const Audio::Source &, int)>;
 
-        /// Type for functions that construct sources.
-        using SourceFn =
-        std::function<std::unique_ptr<Audio::Source>(std::string_view)>;
+        /**
+         * Type for functions that construct sources.
+         * These take the path to the file, an Input already open on it
+         * (or nullptr, if playd couldn't open one itself), and what the
+         * source is for.
+         */
+        using SourceFn = std::function<std::unique_ptr<Audio::Source>(std::string_view, std::unique_ptr<Audio::Input>,
+                                                                      Audio::SourceUse)>;
 
         /**
          * Constructs a Player.
          * @param device_id The device ID to which sinks shall output.
          * @param sink The function to be used for building sinks.
-         * @param sources The map of file extensions to functions used for
-         * building sources.
+         * @param sources The map of format names to functions used for
+         * building sources.  Format names are those given by
+         * Audio::SniffFormat, which double as file extensions.
          */
         Player(int device_id, SinkFn sink,
                std::map<std::string, SourceFn> sources);
@@ -65,6 +77,52 @@ namespace Playd {
          */
         void SetIo(const ResponseSink &io);
 
+        /**
+         * Sets how much audio the Player reads ahead of the decoder.
+         * The read-ahead happens on a background thread, so the decoder
+         * rides out filesystem stalls shorter than the window.  This only
+         * affects files loaded after the call.
+         * @param window The amount of audio to read ahead; zero (the
+         *   default) disables read-ahead.
+         * @see Audio::PrefetchInput
+         */
+        void SetPrefetchWindow(std::chrono::seconds window);
+
+        /**
+         * Sets whether, and to what loudness, the Player normalises files.
+         * Each file's loudness is analysed in the background; once known,
+         * the file's gain moves so that it plays at the target loudness,
+         * but never so loud that its true peak goes over -1dBTP.  This
+         * only affects files loaded after the call.
+         * @param target The target loudness, in LUFS; nothing (the
+         *   default) leaves files at their own loudness.
+         * @see Audio::LoudnessAnalysis
+         */
+        void SetAutoGain(std::optional<double> target);
+
+        /**
+         * Sets whether the Player skips files' leading and trailing silence.
+         * Each file's silence is analysed in the background; once known,
+         * a file that hasn't yet played starts at its cue-in, and every
+         * file ends (and crossfades) at its cue-out.  Cue points are
+         * announced as CUES either way.
+         * @param trim Whether to skip silence; false (the default) plays
+         *   files whole.
+         * @see Audio::SilenceAnalysis
+         */
+        void SetAutoTrim(bool trim);
+
+        /**
+         * Sets whether, and at what true peak, the Player limits files.
+         * A look-ahead limiter after the gain holds each file's output at
+         * or below the ceiling, delaying it by Audio::Limiter's latency.
+         * This only affects files loaded after the call.
+         * @param ceiling The ceiling, in dBTP; nothing (the default) lets
+         *   files through unlimited.
+         * @see Audio::Limiter
+         */
+        void SetLimit(std::optional<double> ceiling);
+
         /**
          * Instructs the Player to perform a cycle of work.
          * This includes decoding the next frame and responding to commands.
@@ -72,6 +130,22 @@ namespace Playd {
          */
         bool Update();
 
+        /**
+         * Works out how long the player could go without an Update before
+         * its audio runs dry.
+         * @return The least audio buffered by whatever is playing, or nothing
+         *   if nothing is.
+         * @see Audio::Audio::Headroom
+         */
+        std::optional<std::chrono::microseconds> Headroom() const;
+
+        /**
+         * Is anything playing?
+         * @return Whether the loaded file, or a next file already started,
+         *   is playing.
+         */
+        bool IsPlaying() const;
+
         //
         // Commands
         //
@@ -97,6 +171,40 @@ namespace Playd {
          */
         Response Dump(size_t id, Response::Tag tag) const;
 
+        /**
+         * Sends the value of every metric playd keeps to the given ID,
+         * as one STAT response per metric.
+         *
+         * @param id The ID of the connection to which the Player should
+         *   route any responses.  For broadcasts, use 0.
+         * @param tag The tag of the request calling this command.
+         * @return The result of sending the metrics, which is always success.
+         * @see Metrics
+         */
+        Response Stats(size_t id, Response::Tag tag) const;
+
+        /**
+         * Sends the waveform peaks of part of the loaded or next file to the
+         * given ID, as one PEAKS response.
+         *
+         * Peaks are generated in the background after each load, so there
+         * may be none to send yet.
+         *
+         * @param id The ID of the connection to which the Player should
+         *   route the response.
+         * @param tag The tag of the request calling this command.
+         * @param next Whether to look at the next file, not the loaded one.
+         * @param start_str A string containing the start of the part of the
+         *   file, in microseconds.
+         * @param end_str A string containing the end of the part of the
+         *   file, in microseconds.
+         * @param count_str A string containing the number of peaks into
+         *   which to divide the part.
+         * @return Whether the peaks were sent.
+         */
+        Response Peaks(size_t id, Response::Tag tag, bool next, std::string_view start_str, std::string_view end_str,
+                       std::string_view count_str) const;
+
         /**
          * Ejects the current loaded song, if any.
          * @param tag The tag of the request calling this command.
@@ -115,13 +223,66 @@ namespace Playd {
 
         /**
          * Loads a file.
+         * A live stream that hasn't started yet is only loaded (and its
+         * FLOAD sent) once it has, on a later Update; if it never does,
+         * that Update broadcasts the failure instead.
          * @param tag The tag of the request calling this command.
          *   For unsolicited loads, use Response::NOREQUEST.
          * @param path The absolute path to a track to load.
-         * @return Whether the load succeeded.
+         * @return Whether the load succeeded (or, for a stream yet to
+         *   start, began).
          */
         Response Load(Response::Tag tag, std::string_view path);
 
+        /**
+         * Loads a file to play once the current one ends.
+         * If a crossfade is set, and the output can crossfade, the next file
+         * starts that long before the current one ends.  Otherwise, it
+         * starts as soon as the current one ends.  Either way, the current
+         * file stays current (for positions, seeks and so on) until its END,
+         * whereupon the next file takes over.  Loading or ejecting the
+         * current file discards the next one.
+         * @param tag The tag of the request calling this command.
+         * @param path The absolute path to a track to load.
+         * @return Whether the load succeeded.
+         * @see Crossfade
+         */
+        Response NLoad(Response::Tag tag, std::string_view path);
+
+        /**
+         * Sets the crossfade between the current file and the next one.
+         * @param tag The tag of the request calling this command.
+         * @param length_str A string containing the length of the crossfade,
+         *   in microseconds; 0 turns crossfading off.
+         * @param curve_str The shape of the fades: 'linear' or 'power'
+         *   (for equal-power).
+         * @return Whether the change succeeded.
+         * @see NLoad
+         */
+        Response Crossfade(Response::Tag tag, std::string_view length_str, std::string_view curve_str);
+
+        /**
+         * Sets the gain applied to every file the Player plays.
+         * Changes to the gain ramp in quickly, rather than jumping, so that
+         * they don't click.
+         * @param tag The tag of the request calling this command.
+         * @param db_str A string containing the gain, in decibels.
+         * @return Whether the change succeeded.
+         */
+        Response Gain(Response::Tag tag, std::string_view db_str);
+
+        /**
+         * Sets how often the Player broadcasts the levels of its output.
+         * Each LEVEL broadcast gives the peak and RMS level of every
+         * channel of the loaded file, over the audio played since the last.
+         * @param tag The tag of the request calling this command.
+         * @param interval_str A string containing the interval between
+         *   broadcasts, in microseconds; 0 turns metering off.
+         * @return Whether the change succeeded.
+         * @see Audio::LevelMeter
+         */
+        Response Meter(Response::Tag tag, std::string_view interval_str);
+
         /**
          * Seeks to a given position in the current file.
          * @param tag The tag of the request calling this command.
@@ -144,9 +305,52 @@ namespace Playd {
         SinkFn sink;                             ///< The sink create function.
         std::map<std::string, SourceFn> sources; ///< The file formats map.
         std::unique_ptr<Audio::Audio> file;      ///< The loaded audio file.
+        std::unique_ptr<Audio::Audio> next;      ///< The file to play next.
+        std::unique_ptr<Audio::Source> opening;  ///< A stream loaded, but yet to start.
         bool dead;                               ///< Whether the Player is closing.
         const ResponseSink *io;                  ///< The sink for responses.
         std::chrono::seconds last_pos;           ///< The last-sent position.
+        std::chrono::microseconds last_len;      ///< The last-sent length.
+        std::chrono::seconds prefetch_window;    ///< The read-ahead window.
+        std::chrono::microseconds xfade_length;  ///< The crossfade length.
+        Audio::FadeCurve xfade_curve;            ///< The crossfade's shape.
+        double gain_db;                          ///< The gain, in decibels.
+        std::optional<double> auto_gain;         ///< The target loudness, if any.
+        bool auto_trim;                          ///< Whether to skip silence.
+        std::optional<double> limit;             ///< The limiter ceiling, if any.
+
+        /// The interval between LEVEL broadcasts; zero if metering is off.
+        std::chrono::microseconds meter_interval;
+
+        /// When levels were last broadcast.
+        std::chrono::steady_clock::time_point last_meter;
+
+        /// The number of recent updates remembered, to line underruns up with.
+        static constexpr std::size_t UPDATE_HISTORY = 64;
+
+        /// When recent updates started; update_count says which is newest.
+        std::array<std::chrono::steady_clock::time_point, UPDATE_HISTORY> updates;
+
+        /// The number of updates ever started.
+        std::uint64_t update_count;
+
+        /// The loudness analysis of the loaded file, if any.
+        std::unique_ptr<Audio::LoudnessAnalysis> file_loudness;
+
+        /// The loudness analysis of the next file, if any.
+        std::unique_ptr<Audio::LoudnessAnalysis> next_loudness;
+
+        /// The waveform peak analysis of the loaded file, if any.
+        std::unique_ptr<Audio::PeakAnalysis> file_peaks;
+
+        /// The waveform peak analysis of the next file, if any.
+        std::unique_ptr<Audio::PeakAnalysis> next_peaks;
+
+        /// The silence analysis of the loaded file, if any.
+        std::unique_ptr<Audio::SilenceAnalysis> file_cues;
+
+        /// The silence analysis of the next file, if any.
+        std::unique_ptr<Audio::SilenceAnalysis> next_cues;
 
         /**
          * Parses pos_str as a seek timestamp.
@@ -161,6 +365,44 @@ namespace Playd {
          */
         static std::chrono::microseconds PosParse(std::string_view pos_str);
 
+        /**
+         * Parses db_str as a gain in decibels.
+         * @param db_str The gain string to be parsed.
+         * @return The parsed gain.
+         * @exception std::invalid_argument
+         *   Raised if the gain isn't a number, or is out of range.
+         */
+        static double GainParse(std::string_view db_str);
+
+        /**
+         * Works out the gain for a file.
+         * @param loudness The analysis of the file's loudness, if any.
+         * @return The gain, including any automatic gain, as a linear factor.
+         */
+        float LinearGain(const Audio::LoudnessAnalysis *loudness) const;
+
+        /**
+         * Works out where a file starts.
+         * @param cues The analysis of the file's silence, if any.
+         * @return The file's cue-in, if trimming and known; otherwise, 0.
+         */
+        std::chrono::microseconds TrimIn(const Audio::SilenceAnalysis *cues) const;
+
+        /**
+         * Works out where the loaded file ends, if not at its length.
+         * @return The file's cue-out, if trimming and known; otherwise,
+         *   nothing.
+         */
+        std::optional<std::chrono::microseconds> TrimOut() const;
+
+        /**
+         * Moves a file that hasn't played yet to its cue-in, if trimming.
+         * @param audio The file.
+         * @param cues The analysis of the file's silence, if any.
+         * @return Whether the file moved.
+         */
+        bool SkipLeadingSilence(Audio::Audio &audio, const Audio::SilenceAnalysis *cues) const;
+
         /**
          * Performs an actual seek.
          * This does not do any EOF handling.
@@ -173,6 +415,19 @@ namespace Playd {
          */
         void PosRaw(Response::Tag tag, std::chrono::microseconds pos);
 
+        /**
+         * Cues the next file to crossfade in at the end of the current one,
+         * or cancels the cue if there's no crossfade.
+         * This does nothing once the next file has started.
+         */
+        void CueNext();
+
+        /**
+         * @return Whether the next file has started, because the current
+         *   one has reached its crossfade.
+         */
+        bool NextStarted() const;
+
         /**
          * Emits a response for the current audio state to the sink.
          *
@@ -247,6 +502,29 @@ namespace Playd {
          */
         void BroadcastPos(Response::Tag tag, std::chrono::microseconds pos);
 
+        /**
+         * Broadcasts a LEVEL response, if metering is on and an interval
+         * has passed since the last one.
+         */
+        void BroadcastLevels();
+
+        /**
+         * Broadcasts an XRUN response for each underrun the loaded and
+         * next files' sinks have had since the last update, then dumps the
+         * trace if there were any.
+         */
+        void BroadcastUnderruns();
+
+        /**
+         * Works out how long the loop went without updating the player
+         * around a given moment.
+         * @param at The moment, which should be recent.
+         * @return The gap between the updates either side of @a at (or
+         *   between the last update and now), or zero if @a at is older
+         *   than any update remembered.
+         */
+        std::chrono::microseconds LoopGap(std::chrono::steady_clock::time_point at) const;
+
         //
         // Audio subsystem
         //
@@ -255,17 +533,65 @@ namespace Playd {
          * Loads a file, creating an Audio for it.
          * @param path The path to a file.
          * @return A unique pointer to the Audio for that file.
+         * @exception FileError if the file can't be loaded, or is a stream
+         *   that hasn't started yet.
          */
         std::unique_ptr<Audio::Audio> LoadRaw(std::string_view path) const;
 
+        /**
+         * Creates an Audio for a source that is ready to play.
+         * @param source The source.
+         * @param start When loading the source started, for the metrics.
+         * @return A unique pointer to the Audio for that source.
+         */
+        std::unique_ptr<Audio::Audio> MakeAudio(std::unique_ptr<Audio::Source> source,
+                                                std::chrono::steady_clock::time_point start) const;
+
+        /**
+         * Makes a source that is ready to play into the loaded file, and
+         * announces it.
+         * @param source The source.
+         * @param start When loading the source started, for the metrics.
+         */
+        void FinishLoad(std::unique_ptr<Audio::Source> source, std::chrono::steady_clock::time_point start);
+
+        /**
+         * Finishes loading the stream that Load left opening, once it has
+         * started; or, if it never will, drops it and announces why.
+         */
+        void FinishOpening();
+
+        /**
+         * Starts analysing a file's peaks, loudness and silence in the
+         * background, in one pass over the file.
+         * Each analysis is set to nullptr if the file is a stream.
+         * @param path The path to the file.
+         * @param peaks Set to the waveform peak analysis.
+         * @param loudness Set to the loudness analysis.
+         * @param cues Set to the silence analysis.
+         */
+        void Analyse(std::string_view path, std::unique_ptr<Audio::PeakAnalysis> &peaks,
+                     std::unique_ptr<Audio::LoudnessAnalysis> &loudness,
+                     std::unique_ptr<Audio::SilenceAnalysis> &cues) const;
+
         /**
          * Loads a file, creating an AudioSource.
+         *
+         * The file's format is worked out from its first few bytes, falling
+         * back to its extension if these aren't recognised.
+         *
+         * @param sources The map of format names to source builders.
          * @param path The path to the file to load.
+         * @param prefetch_window The read-ahead window; zero disables it.
+         * @param use What the source is for.
          * @return An Audio_source pointer (may be nullptr, if no available
          *   and suitable Audio_source was found).
          * @see Load
          */
-        std::unique_ptr<Audio::Source> LoadSource(std::string_view path) const;
+        static std::unique_ptr<Audio::Source> LoadSource(const std::map<std::string, SourceFn> &sources,
+                                                         std::string_view path,
+                                                         std::chrono::seconds prefetch_window,
+                                                         Audio::SourceUse use = Audio::SourceUse::PLAYBACK);
     };
 
 } // namespace Playd
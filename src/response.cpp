@@ -25,7 +25,17 @@ namespace Playd {
                                                                                                "PLAY",  // Code::PLAY
                                                                                                "STOP",  // Code::STOP
                                                                                                "ACK",   // Code::ACK
-                                                                                               "LEN"    // Code::LEN
+                                                                                               "LEN",   // Code::LEN
+                                                                                               "STAT",  // Code::STAT
+                                                                                               "NLOAD", // Code::NLOAD
+                                                                                               "XFADE", // Code::XFADE
+                                                                                               "GAIN",  // Code::GAIN
+                                                                                               "LOUD",  // Code::LOUD
+                                                                                               "PEAKS", // Code::PEAKS
+                                                                                               "METER", // Code::METER
+                                                                                               "LEVEL", // Code::LEVEL
+                                                                                               "CUES",  // Code::CUES
+                                                                                               "XRUN"   // Code::XRUN
                                                                                        }};
 
     Response::Response(std::string_view tag, Response::Code code) {
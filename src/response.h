@@ -46,11 +46,21 @@ namespace Playd {
             PLAY,  ///< The loaded file is playing.
             STOP,  ///< The loaded file has stopped.
             ACK,   ///< Command result.
-            LEN    ///< Server sending song length.
+            LEN,   ///< Server sending song length.
+            STAT,  ///< Server sending the value of a metric.
+            NLOAD, ///< The file to play next just changed.
+            XFADE, ///< Server sending its crossfade settings.
+            GAIN,  ///< Server sending its gain.
+            LOUD,  ///< Server sending the loaded file's loudness.
+            PEAKS, ///< Server sending waveform peaks.
+            METER, ///< Server sending its level metering interval.
+            LEVEL, ///< Server sending live output levels.
+            CUES,  ///< Server sending the loaded file's cue points.
+            XRUN   ///< Server reporting an underrun in its output.
         };
 
         /// The number of codes, which should agree with Response::Code.
-        static constexpr std::uint8_t CODE_COUNT = 10;
+        static constexpr std::uint8_t CODE_COUNT = 20;
 
         /**
          * Constructs a Response with no arguments.
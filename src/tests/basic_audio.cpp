@@ -107,6 +107,56 @@ SCENARIO ("BasicAudio propagates source emptiness correctly", "[basic-audio]") {
 	}
 }
 
+SCENARIO ("BasicAudio reports the sink's buffered audio as headroom", "[basic-audio]") {
+	GIVEN ("a valid set of dummy components, with a second of audio buffered") {
+		auto src = std::make_unique<DummyAudioSource>("test");
+		auto snk = std::make_unique<DummyAudioSink>(*src, 0);
+		snk->buffered = 44100;
+
+		WHEN ("the sink is playing") {
+			snk->state = Audio::Audio::State::PLAYING;
+			Audio::BasicAudio pa(std::move(src), std::move(snk));
+
+			THEN ("the headroom is the buffered audio, in microseconds") {
+				REQUIRE(pa.Headroom() == std::chrono::microseconds{1000000});
+			}
+		}
+
+		WHEN ("the sink is stopped") {
+			snk->state = Audio::Audio::State::STOPPED;
+			Audio::BasicAudio pa(std::move(src), std::move(snk));
+
+			THEN ("there is no headroom, as nothing is being used up") {
+				REQUIRE(!pa.Headroom());
+			}
+		}
+
+		WHEN ("the sink is playing, but the source has run out") {
+			src->run_out = true;
+			auto *sink = snk.get();
+			Audio::BasicAudio pa(std::move(src), std::move(snk));
+			pa.Update();
+			// The dummy sink stops as soon as it hears the source is out;
+			// a real one plays out what it has first.
+			sink->state = Audio::Audio::State::PLAYING;
+
+			THEN ("there is no headroom, as no more updates are needed") {
+				REQUIRE(!pa.Headroom());
+			}
+		}
+
+		WHEN ("the sink doesn't know what it has buffered") {
+			snk->state = Audio::Audio::State::PLAYING;
+			snk->buffered = std::nullopt;
+			Audio::BasicAudio pa(std::move(src), std::move(snk));
+
+			THEN ("there is no headroom") {
+				REQUIRE(!pa.Headroom());
+			}
+		}
+	}
+}
+
 SCENARIO ("BasicAudio acquires state from the sink correctly", "[basic-audio]") {
 	GIVEN ("a valid set of dummy components") {
 		auto src = std::make_unique<DummyAudioSource>("test");
@@ -0,0 +1,160 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Cache class.
+ */
+
+#include "../cache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <thread>
+
+#include "../errors.h"
+#include "catch.hpp"
+#include "scratch.h"
+
+namespace Playd::Tests
+{
+SCENARIO ("Cache entries round-trip", "[cache]") {
+	GIVEN ("a cache in an empty directory, and an identity") {
+		auto dir = ScratchDir("cache-roundtrip");
+		Cache cache{dir / "cache", "test"};
+		FileIdentity id{"/music/foo.mp3", 1234, 5678};
+
+		WHEN ("nothing has been stored") {
+			THEN ("loading misses") {
+				REQUIRE_FALSE(cache.Load(id).has_value());
+			}
+		}
+
+		WHEN ("an entry is stored") {
+			std::vector<std::byte> data{std::byte{1}, std::byte{2}, std::byte{3}};
+			REQUIRE(cache.Store(id, data));
+
+			THEN ("loading the same identity returns the entry") {
+				auto loaded = cache.Load(id);
+				REQUIRE(loaded.has_value());
+				REQUIRE(*loaded == data);
+			}
+
+			THEN ("loading a changed file misses") {
+				FileIdentity changed{id.path, id.size, id.mtime + 1};
+				REQUIRE_FALSE(cache.Load(changed).has_value());
+			}
+
+			THEN ("a cache of a different kind misses") {
+				Cache other{dir / "cache", "other"};
+				REQUIRE_FALSE(other.Load(id).has_value());
+			}
+		}
+	}
+}
+
+SCENARIO ("Caches survive two threads storing the same entry", "[cache]") {
+	GIVEN ("a cache in an empty directory, and two different entries for one identity") {
+		auto dir = ScratchDir("cache-race");
+		Cache cache{dir, "test"};
+		FileIdentity id{"/music/foo.mp3", 1234, 5678};
+		const std::vector<std::byte> a(64 * 1024, std::byte{'a'});
+		const std::vector<std::byte> b(48 * 1024, std::byte{'b'});
+
+		WHEN ("two threads store them over and over at once") {
+			constexpr int STORES = 50;
+			auto store = [&](const std::vector<std::byte> &data) {
+				for (int i = 0; i < STORES; i++) cache.Store(id, data);
+			};
+			std::thread ta{store, std::cref(a)};
+			std::thread tb{store, std::cref(b)};
+			ta.join();
+			tb.join();
+
+			THEN ("the entry is one of them, whole") {
+				auto loaded = cache.Load(id);
+				REQUIRE(loaded.has_value());
+				REQUIRE((*loaded == a || *loaded == b));
+			}
+
+			THEN ("no temporary files are left behind") {
+				REQUIRE(std::distance(std::filesystem::directory_iterator{dir},
+				                      std::filesystem::directory_iterator{}) == 1);
+			}
+		}
+	}
+}
+
+SCENARIO ("Caches without a directory are disabled", "[cache]") {
+	GIVEN ("a cache with an empty directory") {
+		Cache cache{{}, "test"};
+		FileIdentity id{"foo", 1, 1};
+
+		WHEN ("an entry is stored") {
+			THEN ("the store is refused, and loading misses") {
+				REQUIRE_FALSE(cache.Store(id, std::vector<std::byte>{std::byte{1}}));
+				REQUIRE_FALSE(cache.Load(id).has_value());
+			}
+		}
+	}
+}
+
+SCENARIO ("FileIdentity tracks files on disk", "[cache]") {
+	GIVEN ("a file on disk") {
+		auto path = (ScratchDir("cache-identity") / "file.bin").string();
+		{
+			std::ofstream out{path, std::ios::binary};
+			out << "hello";
+		}
+
+		WHEN ("its identity is taken") {
+			auto id = FileIdentity::Of(path);
+
+			THEN ("the identity has the file's path and size") {
+				REQUIRE(id.path == path);
+				REQUIRE(id.size == 5);
+			}
+
+			THEN ("the key is stable and depends only on the path") {
+				FileIdentity other{path, 0, 0};
+				REQUIRE(id.Key() == other.Key());
+				REQUIRE(id.Key().size() == 16);
+			}
+		}
+	}
+
+	GIVEN ("a path to a nonexistent file") {
+		WHEN ("its identity is taken") {
+			THEN ("a FileError is thrown") {
+				REQUIRE_THROWS_AS(FileIdentity::Of("/nonexistent/playd/file.mp3"), FileError);
+			}
+		}
+	}
+}
+
+SCENARIO ("Plain-old-data values round-trip through byte vectors", "[cache]") {
+	GIVEN ("a byte vector with some values appended") {
+		std::vector<std::byte> data;
+		AppendPod(data, std::uint32_t{42});
+		AppendPod(data, std::int64_t{-7});
+
+		WHEN ("the values are read back") {
+			gsl::span<const std::byte> in{data};
+			std::uint32_t a = 0;
+			std::int64_t b = 0;
+			std::int64_t c = 0;
+
+			THEN ("they match, and reading past the end fails") {
+				REQUIRE(ReadPod(in, a));
+				REQUIRE(ReadPod(in, b));
+				REQUIRE(a == 42);
+				REQUIRE(b == -7);
+				REQUIRE_FALSE(ReadPod(in, c));
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,89 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the SampleClock class.
+ */
+
+#include "../audio/clock.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("SampleClock interpolates from the last block published", "[clock]") {
+	GIVEN ("a SampleClock at 44.1kHz") {
+		Audio::SampleClock clock{44100};
+		const auto t0 = Audio::SampleClock::Clock::now();
+
+		WHEN ("nothing has been published") {
+			THEN ("the clock is at 0") {
+				REQUIRE(clock.Estimate(t0, 0) == 0);
+			}
+		}
+
+		WHEN ("a block of 441 frames at position 1000 is published") {
+			clock.Publish(1000, 441, t0);
+
+			THEN ("reading gives back the block") {
+				const auto reading = clock.Read();
+				REQUIRE(reading.position == 1000);
+				REQUIRE(reading.frames == 441);
+				REQUIRE(reading.at == t0);
+			}
+
+			THEN ("the estimate moves at the sample rate through the block") {
+				REQUIRE(clock.Estimate(t0, 0) == 1000);
+				REQUIRE(clock.Estimate(t0 + std::chrono::milliseconds{5}, 0) == 1220);
+			}
+
+			THEN ("the estimate stops at the end of the block") {
+				REQUIRE(clock.Estimate(t0 + std::chrono::seconds{1}, 0) == 1441);
+			}
+
+			THEN ("the estimate never goes back before the block") {
+				REQUIRE(clock.Estimate(t0 - std::chrono::seconds{1}, 0) == 1000);
+			}
+
+			THEN ("the device's latency is taken off") {
+				REQUIRE(clock.Estimate(t0 + std::chrono::milliseconds{5}, 100) == 1120);
+				REQUIRE(clock.Estimate(t0, 2000) == 0);
+			}
+		}
+	}
+}
+
+SCENARIO ("SampleClock readers never see half a publication", "[clock]") {
+	GIVEN ("a SampleClock being published to from another thread") {
+		Audio::SampleClock clock{44100};
+		std::atomic<bool> done{false};
+		std::thread writer{[&clock, &done] {
+			for (Audio::Samples i = 1; i <= 200000; i++) {
+				clock.Publish(i, 2 * i, Audio::SampleClock::Clock::time_point{std::chrono::nanoseconds{3 * i}});
+			}
+			done = true;
+		}};
+
+		WHEN ("the clock is read while the writer runs") {
+			auto torn = 0;
+			while (!done) {
+				const auto reading = clock.Read();
+				const auto ticks = std::chrono::nanoseconds{3 * reading.position};
+				if (reading.frames != 2 * reading.position || reading.at.time_since_epoch() != ticks) torn++;
+			}
+			writer.join();
+
+			THEN ("every reading is of one whole publication") {
+				REQUIRE(torn == 0);
+				REQUIRE(clock.Read().position == 200000);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,383 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the ClockDevice, RenderDevice, WavWriter and DeviceSink classes.
+ */
+
+#include "../audio/device.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../audio/sink.h"
+#include "../audio/wav.h"
+#include "../errors.h"
+#include "catch.hpp"
+#include "dummy_audio_source.h"
+#include "scratch.h"
+
+namespace Playd::Tests
+{
+/**
+ * Reads a whole file.
+ * @param path The path of the file.
+ * @return The file's bytes.
+ */
+static std::vector<std::uint8_t> ReadAll(const std::string &path)
+{
+	std::ifstream in{path, std::ios::binary};
+	return {std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+}
+
+/**
+ * Reads a little-endian integer from a header.
+ * @param bytes The header.
+ * @param at The offset of the integer.
+ * @param n The width of the integer, in bytes.
+ * @return The integer.
+ */
+static std::uint32_t GetLE(const std::vector<std::uint8_t> &bytes, std::size_t at, std::size_t n)
+{
+	std::uint32_t value = 0;
+	for (std::size_t i = 0; i < n; i++) value |= static_cast<std::uint32_t>(bytes.at(at + i)) << (8 * i);
+	return value;
+}
+
+/**
+ * A real-time Device that calls back in small blocks as fast as it can, so
+ * that tests can hammer the callback against the main thread.
+ */
+class BusyDevice : public Audio::Device
+{
+public:
+	/**
+	 * Constructs a BusyDevice, and starts its thread.
+	 * @param spec The shape of the audio.
+	 * @param callback The callback.
+	 */
+	BusyDevice(const Audio::DeviceSpec &spec, Callback callback)
+	    : callback{std::move(callback)}, paused{true}, quit{false}
+	{
+		this->thread = std::thread{[this, bytes = 4096 * spec.BytesPerFrame()] {
+			std::vector<std::byte> block(bytes);
+			while (!this->quit.load()) {
+				std::lock_guard<std::mutex> guard{this->lock};
+				if (!this->paused) this->callback(block);
+			}
+		}};
+	}
+
+	/// Destructs a BusyDevice, stopping its thread.
+	~BusyDevice() override
+	{
+		this->quit = true;
+		this->thread.join();
+	}
+
+	/// Deleted copy constructor.
+	BusyDevice(const BusyDevice &) = delete;
+
+	/// Deleted copy-assignment.
+	BusyDevice &operator=(const BusyDevice &) = delete;
+
+	void Pause(bool new_paused) override
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		this->paused = new_paused;
+	}
+
+	Audio::Samples Latency() const override
+	{
+		return 0;
+	}
+
+private:
+	Callback callback;      ///< The callback.
+	std::mutex lock;        ///< Held while calling back, or pausing.
+	bool paused;            ///< Whether the device is paused.
+	std::atomic<bool> quit; ///< Whether the thread should stop.
+	std::thread thread;     ///< The thread calling back.
+};
+
+SCENARIO ("ClockDevice calls back at the sample rate while unpaused", "[device]") {
+	GIVEN ("a ClockDevice with 100-frame blocks at 8kHz") {
+		std::atomic<int> blocks{0};
+		std::atomic<std::size_t> block_size{0};
+		Audio::ClockDevice device{{8000, Audio::SampleFormat::SINT16, 2, 100},
+		                          [&](gsl::span<std::byte> dest) {
+			                          block_size = dest.size();
+			                          blocks++;
+		                          }};
+
+		THEN ("its latency is one block") {
+			REQUIRE(device.Latency() == 100);
+		}
+
+		WHEN ("it is left paused") {
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+			THEN ("it never calls back") {
+				REQUIRE(blocks.load() == 0);
+			}
+		}
+
+		WHEN ("it is unpaused for a while, then paused") {
+			device.Pause(false);
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			device.Pause(true);
+			const int played = blocks;
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+			THEN ("it calls back once per 12.5ms block, with whole blocks") {
+				// 16 blocks are due; allow for a slow, busy test machine.
+				REQUIRE(8 <= played);
+				REQUIRE(played <= 18);
+				REQUIRE(block_size.load() == 100 * 4);
+			}
+
+			THEN ("it stops calling back once paused") {
+				REQUIRE(blocks.load() == played);
+			}
+		}
+	}
+}
+
+SCENARIO ("WavWriter writes a WAV file of what it is given", "[device]") {
+	GIVEN ("a WavWriter claimed for 16-bit stereo at 44.1kHz") {
+		const auto path = ScratchPath("wav-s16.wav");
+		auto writer = std::make_unique<Audio::WavWriter>(path);
+		writer->Claim(44100, Audio::SampleFormat::SINT16, 2);
+
+		WHEN ("two blocks are written and the writer is destroyed") {
+			std::vector<std::byte> block(400, std::byte{0x12});
+			writer->Write(block);
+			writer->Write(block);
+			REQUIRE(writer->DataBytes() == 800);
+			writer = nullptr;
+
+			THEN ("the file has a PCM header with the right lengths, then the audio") {
+				auto bytes = ReadAll(path);
+				REQUIRE(bytes.size() == 44 + 800);
+				REQUIRE(std::string(bytes.begin(), bytes.begin() + 4) == "RIFF");
+				REQUIRE(GetLE(bytes, 4, 4) == 36 + 800);
+				REQUIRE(std::string(bytes.begin() + 8, bytes.begin() + 16) == "WAVEfmt ");
+				REQUIRE(GetLE(bytes, 20, 2) == 1);
+				REQUIRE(GetLE(bytes, 22, 2) == 2);
+				REQUIRE(GetLE(bytes, 24, 4) == 44100);
+				REQUIRE(GetLE(bytes, 28, 4) == 44100 * 4);
+				REQUIRE(GetLE(bytes, 32, 2) == 4);
+				REQUIRE(GetLE(bytes, 34, 2) == 16);
+				REQUIRE(std::string(bytes.begin() + 36, bytes.begin() + 40) == "data");
+				REQUIRE(GetLE(bytes, 40, 4) == 800);
+				REQUIRE(bytes.back() == 0x12);
+			}
+		}
+
+		WHEN ("it is claimed again for the same format") {
+			THEN ("nothing happens") {
+				REQUIRE_NOTHROW(writer->Claim(44100, Audio::SampleFormat::SINT16, 2));
+			}
+		}
+
+		WHEN ("it is claimed again for another format") {
+			THEN ("the claim fails") {
+				REQUIRE_THROWS_AS(writer->Claim(48000, Audio::SampleFormat::SINT16, 2), FileError);
+			}
+		}
+	}
+
+	GIVEN ("a WavWriter claimed for float mono") {
+		const auto path = ScratchPath("wav-f32.wav");
+		{
+			Audio::WavWriter writer{path};
+			writer.Claim(48000, Audio::SampleFormat::FLOAT32, 1);
+		}
+
+		THEN ("the header says IEEE float, and there is no audio") {
+			auto bytes = ReadAll(path);
+			REQUIRE(bytes.size() == 44);
+			REQUIRE(GetLE(bytes, 20, 2) == 3);
+			REQUIRE(GetLE(bytes, 34, 2) == 32);
+			REQUIRE(GetLE(bytes, 40, 4) == 0);
+		}
+	}
+
+	GIVEN ("a WavWriter claimed for signed 8-bit audio") {
+		const auto path = ScratchPath("wav-s8.wav");
+		{
+			Audio::WavWriter writer{path};
+			writer.Claim(8000, Audio::SampleFormat::SINT8, 1);
+			std::vector<std::byte> block{std::byte{0x00}, std::byte{0x7F}, std::byte{0x80}};
+			writer.Write(block);
+		}
+
+		THEN ("the samples are written as WAV's unsigned 8-bit") {
+			auto bytes = ReadAll(path);
+			REQUIRE(bytes.size() == 44 + 3);
+			REQUIRE(bytes[44] == 0x80);
+			REQUIRE(bytes[45] == 0xFF);
+			REQUIRE(bytes[46] == 0x00);
+		}
+	}
+}
+
+SCENARIO ("DeviceSink plays out through a ClockDevice", "[device]") {
+	GIVEN ("a DeviceSink on a ClockDevice writing to a WAV file, holding 2048 frames") {
+		DummyAudioSource source{"foo"};
+		const auto path = ScratchPath("wav-sink.wav");
+		auto writer = std::make_shared<Audio::WavWriter>(path);
+		Audio::DeviceFn open = [writer](int, const Audio::DeviceSpec &spec, Audio::Device::Callback callback) {
+			writer->Claim(spec.rate, spec.format, spec.channels);
+			return std::make_unique<Audio::ClockDevice>(spec, std::move(callback), writer);
+		};
+		Audio::DeviceSink sink{source, 0, open};
+
+		std::vector<std::byte> frames(2048 * source.BytesPerSample(), std::byte{1});
+		REQUIRE(sink.Transfer(frames) == frames.size());
+		sink.SourceOut();
+
+		WHEN ("it plays until it runs out") {
+			sink.Start();
+			for (int i = 0; i < 200 && sink.CurrentState() != Audio::Sink::State::AT_END; i++) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+
+			THEN ("it reaches the end, having played every frame") {
+				REQUIRE(sink.CurrentState() == Audio::Sink::State::AT_END);
+				REQUIRE(sink.Buffered() == 0);
+				INFO("round " << round << " buffered " << *sink.Buffered());
+				REQUIRE(sink.Position() == 2048);
+				REQUIRE(writer->DataBytes() >= frames.size());
+			}
+		}
+	}
+}
+
+SCENARIO ("DeviceSink positions follow seeks backwards while playing", "[device]") {
+	GIVEN ("a playing DeviceSink on a device calling back as fast as it can") {
+		DummyAudioSource source{"foo"};
+		Audio::DeviceFn open = [](int, const Audio::DeviceSpec &spec, Audio::Device::Callback callback) {
+			return std::make_unique<BusyDevice>(spec, std::move(callback));
+		};
+		Audio::DeviceSink sink{source, 0, open};
+		sink.Start();
+
+		WHEN ("it repeatedly seeks far forwards, then back to the start") {
+			// A seek only goes wrong if Position lands in a narrow gap in
+			// the callback, so give it plenty of chances to.  Nothing is
+			// transferred, so the position should stay wherever it's put.
+			bool went_back = true;
+			for (int round = 0; round < 200 && went_back; round++) {
+				sink.SetPosition(100000);
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				REQUIRE(sink.Position() == 100000);
+
+				sink.SetPosition(0);
+				const auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+				while (went_back && std::chrono::steady_clock::now() < until) went_back = sink.Position() == 0;
+			}
+
+			THEN ("the position always goes back with it") {
+				REQUIRE(went_back);
+			}
+		}
+	}
+}
+
+SCENARIO ("RenderDevice plays whatever its renderer says is due", "[device]") {
+	GIVEN ("a RenderDevice at 44.1kHz with 100-frame blocks, writing raw samples") {
+		auto renderer = std::make_shared<Audio::Renderer>();
+		const auto path = ScratchPath("render.raw");
+		auto writer = std::make_shared<Audio::WavWriter>(path, false);
+		writer->Claim(44100, Audio::SampleFormat::SINT16, 1);
+
+		std::vector<std::size_t> calls;
+		Audio::RenderDevice device{{44100, Audio::SampleFormat::SINT16, 1, 100},
+		                           [&](gsl::span<std::byte> dest) { calls.push_back(dest.size() / 2); },
+		                           renderer, writer};
+
+		THEN ("it doesn't play in real time, and has no latency") {
+			REQUIRE_FALSE(device.IsRealTime());
+			REQUIRE(device.Latency() == 0);
+		}
+
+		WHEN ("time passes while it is paused") {
+			renderer->Advance(std::chrono::milliseconds(5));
+
+			THEN ("it plays nothing") {
+				REQUIRE(calls.empty());
+			}
+		}
+
+		WHEN ("three lots of 5ms pass while it is unpaused") {
+			device.Pause(false);
+			for (int i = 0; i < 3; i++) renderer->Advance(std::chrono::milliseconds(5));
+
+			THEN ("it plays exactly the frames due, in blocks no bigger than asked") {
+				// 15ms at 44.1kHz is 661.5 frames; the half comes next time.
+				REQUIRE(calls == std::vector<std::size_t>{100, 100, 20, 100, 100, 21, 100, 100, 20});
+				REQUIRE(writer->DataBytes() == 661 * 2);
+			}
+		}
+
+		WHEN ("it is destroyed and time passes") {
+			{
+				Audio::RenderDevice other{{8000, Audio::SampleFormat::UINT8, 1, 0},
+				                          [&](gsl::span<std::byte>) { calls.push_back(0); }, renderer};
+				other.Pause(false);
+			}
+			renderer->Advance(std::chrono::milliseconds(5));
+
+			THEN ("the renderer no longer plays it") {
+				REQUIRE(calls.empty());
+			}
+		}
+	}
+}
+
+SCENARIO ("DeviceSink renders offline through a RenderDevice", "[device]") {
+	GIVEN ("a DeviceSink on a RenderDevice, holding 1000 frames") {
+		DummyAudioSource source{"foo"};
+		auto renderer = std::make_shared<Audio::Renderer>();
+		Audio::DeviceFn open = [renderer](int, const Audio::DeviceSpec &spec, Audio::Device::Callback callback) {
+			return std::make_unique<Audio::RenderDevice>(spec, std::move(callback), renderer);
+		};
+		Audio::DeviceSink sink{source, 0, open};
+
+		std::vector<std::byte> frames(1000 * source.BytesPerSample(), std::byte{1});
+		REQUIRE(sink.Transfer(frames) == frames.size());
+		sink.SourceOut();
+		sink.Start();
+
+		WHEN ("10ms pass") {
+			renderer->Advance(std::chrono::milliseconds(10));
+
+			THEN ("the position is exactly the frames played") {
+				REQUIRE(sink.CurrentState() == Audio::Sink::State::PLAYING);
+				REQUIRE(sink.Position() == 441);
+			}
+		}
+
+		WHEN ("enough time passes to play everything and then some") {
+			renderer->Advance(std::chrono::milliseconds(25));
+			renderer->Advance(std::chrono::milliseconds(5));
+
+			THEN ("the sink reaches the end, at the last frame") {
+				REQUIRE(sink.CurrentState() == Audio::Sink::State::AT_END);
+				REQUIRE(sink.Position() == 1000);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
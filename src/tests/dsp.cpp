@@ -0,0 +1,432 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the sample-processing kernels.
+ */
+
+#include "../audio/dsp.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/// Pi over 2, which M_PI would give us if it were standard.
+constexpr double HALF_PI = 1.57079632679489661923;
+
+SCENARIO ("Samples convert to floats", "[dsp]") {
+	GIVEN ("some signed 16-bit samples") {
+		std::vector<std::int16_t> in{0, 16384, -32768, 32767, -16384};
+		std::vector<std::byte> bytes(in.size() * sizeof(std::int16_t));
+		std::memcpy(bytes.data(), in.data(), bytes.size());
+
+		WHEN ("they are converted") {
+			std::vector<float> out(in.size());
+			Audio::ToFloat(bytes, Audio::SampleFormat::SINT16, out);
+
+			THEN ("they are scaled into [-1, 1]") {
+				REQUIRE(out == std::vector<float>{0.0f, 0.5f, -1.0f, 32767.0f / 32768.0f, -0.5f});
+			}
+		}
+	}
+
+	GIVEN ("some unsigned 8-bit samples") {
+		std::vector<std::byte> bytes{std::byte{128}, std::byte{0}, std::byte{192}};
+
+		WHEN ("they are converted") {
+			std::vector<float> out(bytes.size());
+			Audio::ToFloat(bytes, Audio::SampleFormat::UINT8, out);
+
+			THEN ("they are centred on 0") {
+				REQUIRE(out == std::vector<float>{0.0f, -1.0f, 0.5f});
+			}
+		}
+	}
+}
+
+SCENARIO ("Floats convert back to samples", "[dsp]") {
+	GIVEN ("some floats, some out of range and one not a number") {
+		std::vector<float> in{0.0f, 0.5f, -1.0f, 2.0f, -2.0f, std::numeric_limits<float>::quiet_NaN()};
+
+		WHEN ("they are converted to signed 16-bit samples") {
+			std::vector<std::byte> bytes(in.size() * sizeof(std::int16_t));
+			Audio::FromFloat(in, Audio::SampleFormat::SINT16, bytes);
+			std::vector<std::int16_t> out(in.size());
+			std::memcpy(out.data(), bytes.data(), bytes.size());
+
+			THEN ("they are scaled up, saturating, with the NaN silent") {
+				REQUIRE(out == std::vector<std::int16_t>{0, 16384, -32768, 32767, -32768, 0});
+			}
+		}
+
+		WHEN ("they are converted to unsigned 8-bit samples") {
+			std::vector<std::byte> bytes(in.size());
+			Audio::FromFloat(in, Audio::SampleFormat::UINT8, bytes);
+
+			THEN ("they are centred on 128") {
+				REQUIRE(bytes == std::vector<std::byte>{std::byte{128}, std::byte{192}, std::byte{0},
+				                                        std::byte{255}, std::byte{0}, std::byte{128}});
+			}
+		}
+
+		WHEN ("they are converted to signed 32-bit samples and back") {
+			std::vector<std::byte> bytes(in.size() * sizeof(std::int32_t));
+			Audio::FromFloat(in, Audio::SampleFormat::SINT32, bytes);
+			std::vector<float> out(in.size());
+			Audio::ToFloat(bytes, Audio::SampleFormat::SINT32, out);
+
+			THEN ("the in-range ones survive the round trip") {
+				REQUIRE(out[0] == 0.0f);
+				REQUIRE(out[1] == 0.5f);
+				REQUIRE(out[2] == -1.0f);
+				REQUIRE(out[3] == Approx(1.0f));
+				REQUIRE(out[5] == 0.0f);
+			}
+		}
+	}
+}
+
+SCENARIO ("MixInto adds scaled samples", "[dsp]") {
+	GIVEN ("two buffers of an awkward length") {
+		// Seven samples exercise both the vector and scalar paths.
+		std::vector<float> dest{1, 2, 3, 4, 5, 6, 7};
+		std::vector<float> src{1, 1, 1, 1, 1, 1, 2};
+
+		WHEN ("the second is mixed into the first at half gain") {
+			Audio::MixInto(dest, src, 0.5f);
+
+			THEN ("every sample has half the source added") {
+				REQUIRE(dest == std::vector<float>{1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 8.0f});
+			}
+		}
+	}
+}
+
+SCENARIO ("MixFade adds samples under a fade envelope", "[dsp]") {
+	GIVEN ("a silent buffer and a buffer of ones, five stereo frames long") {
+		// Five frames exercise both the vector and scalar paths.
+		std::vector<float> dest(10, 0.0f);
+		std::vector<float> src(10, 1.0f);
+
+		WHEN ("the ones are faded in linearly over four frames at half gain") {
+			Audio::MixFade(dest, src, 2, 0.5f, Audio::FadeCurve::LINEAR, 0.0f, 0.25f);
+
+			THEN ("each frame gets its step of the ramp, stopping at full gain") {
+				REQUIRE(dest == std::vector<float>{0.0f, 0.0f, 0.125f, 0.125f, 0.25f, 0.25f, 0.375f, 0.375f,
+				                                   0.5f, 0.5f});
+			}
+		}
+
+		WHEN ("the ones are faded out with an equal-power curve") {
+			Audio::MixFade(dest, src, 2, 1.0f, Audio::FadeCurve::EQUAL_POWER, 1.0f, -0.25f);
+
+			THEN ("each frame follows the cosine") {
+				for (std::size_t i = 0; i < dest.size(); i++) {
+					const auto expected = std::cos(static_cast<double>(i / 2) * 0.25 * HALF_PI);
+					REQUIRE(dest[i] == Approx(expected).margin(1e-5));
+				}
+			}
+		}
+	}
+
+	GIVEN ("a fade in and a fade out of the same length") {
+		std::vector<float> in(9, 0.0f);
+		std::vector<float> out(9, 0.0f);
+		std::vector<float> ones(9, 1.0f);
+
+		WHEN ("both are taken with an equal-power curve") {
+			Audio::MixFade(in, ones, 1, 1.0f, Audio::FadeCurve::EQUAL_POWER, 0.0f, 0.125f);
+			Audio::MixFade(out, ones, 1, 1.0f, Audio::FadeCurve::EQUAL_POWER, 1.0f, -0.125f);
+
+			THEN ("their power sums to 1 throughout") {
+				for (std::size_t i = 0; i < in.size(); i++) {
+					REQUIRE(in[i] * in[i] + out[i] * out[i] == Approx(1.0f).margin(1e-5));
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Packs some samples into bytes.
+ * @tparam T The type of each sample.
+ * @param samples The samples.
+ * @return The bytes.
+ */
+template <typename T>
+static std::vector<std::byte> Pack(const std::vector<T> &samples)
+{
+	std::vector<std::byte> bytes(samples.size() * sizeof(T));
+	std::memcpy(bytes.data(), samples.data(), bytes.size());
+	return bytes;
+}
+
+/**
+ * Unpacks some samples from bytes.
+ * @tparam T The type of each sample.
+ * @param bytes The bytes.
+ * @return The samples.
+ */
+template <typename T>
+static std::vector<T> Unpack(const std::vector<std::byte> &bytes)
+{
+	std::vector<T> samples(bytes.size() / sizeof(T));
+	std::memcpy(samples.data(), bytes.data(), bytes.size());
+	return samples;
+}
+
+SCENARIO ("ScaleSamples applies gain in each sample format", "[dsp]") {
+	GIVEN ("five stereo frames of signed 16-bit samples") {
+		// Ten samples exercise both the vector and scalar paths.
+		auto bytes = Pack<std::int16_t>({1000, -1000, 20000, -20000, 32767, -32768, 3, 0, 100, -100});
+
+		WHEN ("they are doubled") {
+			Audio::ScaleSamples(bytes, Audio::SampleFormat::SINT16, 2, 2.0f, 0.0f);
+
+			THEN ("they double, saturating rather than wrapping") {
+				REQUIRE(Unpack<std::int16_t>(bytes) ==
+				        std::vector<std::int16_t>{2000, -2000, 32767, -32768, 32767, -32768, 6, 0, 200, -200});
+			}
+		}
+
+		WHEN ("they are ramped down from unity") {
+			Audio::ScaleSamples(bytes, Audio::SampleFormat::SINT16, 2, 1.0f, -0.25f);
+
+			THEN ("each frame gets its step of the ramp") {
+				REQUIRE(Unpack<std::int16_t>(bytes) ==
+				        std::vector<std::int16_t>{1000, -1000, 15000, -15000, 16384, -16384, 1, 0, 0, 0});
+			}
+		}
+	}
+
+	GIVEN ("some unsigned 8-bit samples") {
+		auto bytes = Pack<std::uint8_t>({128, 0, 255, 192});
+
+		WHEN ("they are halved") {
+			Audio::ScaleSamples(bytes, Audio::SampleFormat::UINT8, 1, 0.5f, 0.0f);
+
+			THEN ("they are scaled about their centre, and rounded") {
+				REQUIRE(Unpack<std::uint8_t>(bytes) == std::vector<std::uint8_t>{128, 64, 192, 160});
+			}
+		}
+	}
+
+	GIVEN ("some signed 32-bit samples") {
+		auto bytes = Pack<std::int32_t>({1 << 30, -(1 << 30), 5, -5, 7});
+
+		WHEN ("they are quadrupled") {
+			Audio::ScaleSamples(bytes, Audio::SampleFormat::SINT32, 1, 4.0f, 0.0f);
+
+			THEN ("they saturate at the largest float below each limit") {
+				REQUIRE(Unpack<std::int32_t>(bytes) ==
+				        std::vector<std::int32_t>{2147483520, std::numeric_limits<std::int32_t>::min(), 20, -20, 28});
+			}
+		}
+	}
+
+	GIVEN ("some mono float samples") {
+		auto bytes = Pack<float>({1, 1, 1, 1, 1, 1, 1, 1, 1});
+
+		WHEN ("they are ramped up from silence") {
+			Audio::ScaleSamples(bytes, Audio::SampleFormat::FLOAT32, 1, 0.0f, 0.125f);
+
+			THEN ("each sample gets its step of the ramp") {
+				REQUIRE(Unpack<float>(bytes) ==
+				        std::vector<float>{0.0f, 0.125f, 0.25f, 0.375f, 0.5f, 0.625f, 0.75f, 0.875f, 1.0f});
+			}
+		}
+	}
+}
+
+SCENARIO ("GainRamp ramps to new gains", "[dsp]") {
+	GIVEN ("a gain ramp and six stereo frames of signed 16-bit samples") {
+		Audio::GainRamp gain;
+		auto bytes = Pack<std::int16_t>(std::vector<std::int16_t>(12, 1000));
+
+		WHEN ("nothing is set") {
+			gain.Apply(bytes, Audio::SampleFormat::SINT16, 2);
+
+			THEN ("the samples are untouched") {
+				REQUIRE(Unpack<std::int16_t>(bytes) == std::vector<std::int16_t>(12, 1000));
+			}
+		}
+
+		WHEN ("a new gain is set with a four-frame ramp") {
+			gain.Set(0.5f, 4);
+			gain.Apply(bytes, Audio::SampleFormat::SINT16, 2);
+
+			THEN ("the gain ramps to the new value by the fourth frame, then holds") {
+				REQUIRE(Unpack<std::int16_t>(bytes) == std::vector<std::int16_t>{875, 875, 750, 750, 625, 625,
+				                                                                  500, 500, 500, 500, 500, 500});
+			}
+		}
+
+		WHEN ("a new gain is set with a ramp longer than the samples") {
+			gain.Set(0.5f, 8);
+			gain.Apply(bytes, Audio::SampleFormat::SINT16, 2);
+			auto more = Pack<std::int16_t>(std::vector<std::int16_t>(6, 1000));
+			gain.Apply(more, Audio::SampleFormat::SINT16, 2);
+
+			THEN ("the ramp carries on into the next samples") {
+				REQUIRE(Unpack<std::int16_t>(more) == std::vector<std::int16_t>{562, 562, 500, 500, 500, 500});
+			}
+		}
+	}
+}
+
+SCENARIO ("Clip clamps samples into range", "[dsp]") {
+	GIVEN ("a buffer with samples in and out of range") {
+		const auto nan = std::numeric_limits<float>::quiet_NaN();
+		std::vector<float> buf{-2.0f, -1.0f, 0.25f, 1.0f, 3.0f, nan, -0.5f, 7.0f, nan};
+
+		WHEN ("it is clipped") {
+			Audio::Clip(buf);
+
+			THEN ("out-of-range samples are clamped, and NaNs become 1") {
+				REQUIRE(buf == std::vector<float>{-1.0f, -1.0f, 0.25f, 1.0f, 1.0f, 1.0f, -0.5f, 1.0f, 1.0f});
+			}
+		}
+	}
+}
+
+SCENARIO ("MinMax finds the range of samples", "[dsp]") {
+	GIVEN ("a buffer of an awkward length, with its extremes at either end") {
+		// Eleven samples exercise both the vector and scalar paths.
+		const auto nan = std::numeric_limits<float>::quiet_NaN();
+		std::vector<float> buf{-0.75f, 0.5f, nan, 0.25f, 0.0f, -0.5f, 0.125f, 0.5f, -0.25f, 0.0f, 0.875f};
+
+		WHEN ("its range is found from scratch") {
+			auto low = std::numeric_limits<float>::infinity();
+			auto high = -low;
+			Audio::MinMax(buf, low, high);
+
+			THEN ("the lowest and highest samples are found, ignoring NaNs") {
+				REQUIRE(low == -0.75f);
+				REQUIRE(high == 0.875f);
+			}
+		}
+
+		WHEN ("its range is added to a wider range") {
+			auto low = -1.0f;
+			auto high = 1.0f;
+			Audio::MinMax(buf, low, high);
+
+			THEN ("the range stays as it was") {
+				REQUIRE(low == -1.0f);
+				REQUIRE(high == 1.0f);
+			}
+		}
+	}
+}
+
+SCENARIO ("FirstAbove and LastAbove find loud samples", "[dsp]") {
+	GIVEN ("a buffer of an awkward length, loud in the middle") {
+		// Eleven samples exercise both the vector and scalar paths.
+		const auto nan = std::numeric_limits<float>::quiet_NaN();
+		std::vector<float> buf{0.0f, nan, 0.25f, 0.0f, 0.0f, -0.75f, 0.5f, 0.0f, 0.25f, 0.0f, nan};
+
+		WHEN ("it is searched with a threshold some samples exceed") {
+			THEN ("the first and last louder samples are found, ignoring NaNs") {
+				REQUIRE(Audio::FirstAbove(buf, 0.3f) == 5);
+				REQUIRE(Audio::LastAbove(buf, 0.3f) == 7);
+				REQUIRE(Audio::FirstAbove(buf, 0.1f) == 2);
+				REQUIRE(Audio::LastAbove(buf, 0.1f) == 9);
+			}
+		}
+
+		WHEN ("it is searched with a threshold no sample exceeds") {
+			THEN ("nothing is found") {
+				REQUIRE(Audio::FirstAbove(buf, 0.75f) == buf.size());
+				REQUIRE(Audio::LastAbove(buf, 0.75f) == 0);
+			}
+		}
+	}
+}
+
+SCENARIO ("MeasureLevels adds up each channel's peak and energy", "[dsp]") {
+	GIVEN ("five stereo frames of signed 16-bit samples") {
+		// Ten samples exercise both the vector and scalar paths.
+		const auto bytes = Pack<std::int16_t>({16384, 0, -16384, 8192, 16384, -32768, -16384, 0, 8192, 0});
+
+		WHEN ("they are measured") {
+			Audio::Levels levels;
+			Audio::MeasureLevels(bytes, Audio::SampleFormat::SINT16, 2, levels);
+
+			THEN ("each channel has its own peak and sum of squares") {
+				REQUIRE(levels.frames == 5);
+				REQUIRE(levels.channels == 2);
+				REQUIRE(levels.peak[0] == 0.5f);
+				REQUIRE(levels.peak[1] == 1.0f);
+				REQUIRE(levels.energy[0] == Approx(4 * 0.25 + 0.0625));
+				REQUIRE(levels.energy[1] == Approx(0.0625 + 1.0));
+			}
+		}
+	}
+
+	GIVEN ("some unsigned 8-bit samples in three channels") {
+		const auto bytes = Pack<std::uint8_t>({128, 0, 192, 64, 128, 255});
+
+		WHEN ("they are measured twice") {
+			Audio::Levels levels;
+			Audio::MeasureLevels(bytes, Audio::SampleFormat::UINT8, 3, levels);
+			Audio::MeasureLevels(bytes, Audio::SampleFormat::UINT8, 3, levels);
+
+			THEN ("they are measured about their centre, and the two add up") {
+				REQUIRE(levels.frames == 4);
+				REQUIRE(levels.peak[0] == 0.5f);
+				REQUIRE(levels.peak[1] == 1.0f);
+				REQUIRE(levels.peak[2] == Approx(127.0f / 128.0f));
+				REQUIRE(levels.energy[0] == Approx(2 * 0.25));
+			}
+		}
+	}
+
+	GIVEN ("some mono float samples") {
+		const auto bytes = Pack<float>({0.25f, -0.75f, 0.5f, 0.0f, -0.25f, 0.125f, 0.0f});
+
+		WHEN ("they are measured") {
+			Audio::Levels levels;
+			Audio::MeasureLevels(bytes, Audio::SampleFormat::FLOAT32, 1, levels);
+
+			THEN ("the peak is the largest magnitude") {
+				REQUIRE(levels.peak[0] == 0.75f);
+				REQUIRE(levels.energy[0] == Approx(0.0625 + 0.5625 + 0.25 + 0.0625 + 0.015625));
+			}
+		}
+	}
+}
+
+SCENARIO ("DesignTruePeakInterpolator designs one interpolator in either layout", "[dsp]") {
+	GIVEN ("a 12-tap, 4-phase interpolator in each layout") {
+		constexpr std::size_t taps = 12;
+		constexpr std::size_t oversample = 4;
+		const auto by_phase = Audio::DesignTruePeakInterpolator(taps, oversample, Audio::PhaseLayout::PHASE_MAJOR);
+		const auto by_tap = Audio::DesignTruePeakInterpolator(taps, oversample, Audio::PhaseLayout::TAP_MAJOR);
+
+		THEN ("each has a coefficient for every tap of every phase") {
+			REQUIRE(by_phase.size() == taps * oversample);
+			REQUIRE(by_tap.size() == taps * oversample);
+		}
+
+		THEN ("the layouts hold the same coefficients, transposed") {
+			for (std::size_t p = 0; p < oversample; p++) {
+				for (std::size_t k = 0; k < taps; k++) REQUIRE(by_phase[p * taps + k] == by_tap[k * oversample + p]);
+			}
+		}
+
+		THEN ("phase 0 passes the input sample half the taps back straight through") {
+			for (std::size_t k = 0; k < taps; k++) {
+				REQUIRE(by_phase[k] == Approx(k == taps / 2 ? 1.0 : 0.0).margin(1e-6));
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
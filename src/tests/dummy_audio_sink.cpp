@@ -49,4 +49,9 @@ size_t DummyAudioSink::Transfer(const gsl::span<const std::byte> src)
 	return src.size();
 }
 
+std::optional<Audio::Samples> DummyAudioSink::Buffered()
+{
+	return this->buffered;
+}
+
 } // namespace playd::tests
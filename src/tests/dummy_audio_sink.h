@@ -9,6 +9,7 @@
  */
 
 #include <cstdint>
+#include <optional>
 
 #include "../audio/sink.h"
 #include "../audio/source.h"
@@ -40,11 +41,16 @@ public:
 
 	size_t Transfer(gsl::span<const std::byte> src) override;
 
+	std::optional<Audio::Samples> Buffered() override;
+
 	/// The current state of the sink.
 	Audio::Sink::State state = Audio::Sink::State::STOPPED;
 
 	/// The current position, in samples.
 	uint64_t position = 0;
+
+	/// The number of samples Buffered reports, if any.
+	std::optional<Audio::Samples> buffered = std::nullopt;
 };
 
 } // namespace playd::tests
@@ -0,0 +1,172 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Input class.
+ */
+
+#include "../audio/input.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../errors.h"
+#include "catch.hpp"
+#include "scratch.h"
+
+namespace Playd::Tests
+{
+SCENARIO ("Inputs read files through their heads", "[input]") {
+	GIVEN ("an Input on a file larger than the head") {
+		const std::size_t size = Audio::Input::HEAD_SIZE * 3;
+		auto input = Audio::Input::Open(ScratchFile("input-large.bin", size));
+
+		THEN ("the length, head and position are correct") {
+			REQUIRE(input->Length() == size);
+			REQUIRE(input->Head().size() == Audio::Input::HEAD_SIZE);
+			REQUIRE(MatchesPattern(input->Head(), 0));
+			REQUIRE(input->Tell() == 0);
+		}
+
+		WHEN ("the whole file is read in one go") {
+			std::vector<std::byte> buf(size + 100);
+			auto nread = input->Read(buf);
+
+			THEN ("all of it, and only it, is read") {
+				REQUIRE(nread == size);
+				REQUIRE(MatchesPattern(gsl::make_span(buf.data(), nread), 0));
+				REQUIRE(input->Tell() == size);
+			}
+		}
+
+		WHEN ("a read straddles the end of the head") {
+			const auto start = Audio::Input::HEAD_SIZE - 10;
+			REQUIRE(input->Seek(start, SEEK_SET) == start);
+			std::vector<std::byte> buf(20);
+			auto nread = input->Read(buf);
+
+			THEN ("the bytes either side of the boundary are correct") {
+				REQUIRE(nread == 20);
+				REQUIRE(MatchesPattern(buf, start));
+			}
+		}
+
+		WHEN ("we seek back into the head after reading past it") {
+			std::vector<std::byte> buf(Audio::Input::HEAD_SIZE * 2);
+			input->Read(buf);
+			REQUIRE(input->Seek(-static_cast<std::int64_t>(size) + 5, SEEK_END) == 5);
+			std::vector<std::byte> again(10);
+			auto nread = input->Read(again);
+
+			THEN ("the bytes there are read again") {
+				REQUIRE(nread == 10);
+				REQUIRE(MatchesPattern(again, 5));
+			}
+		}
+
+		WHEN ("we seek before the start") {
+			THEN ("a FileError is thrown") {
+				REQUIRE_THROWS_AS(input->Seek(-1, SEEK_SET), FileError);
+			}
+		}
+	}
+
+	GIVEN ("an Input on a file smaller than the head") {
+		auto input = Audio::Input::Open(ScratchFile("input-small.bin", 100));
+
+		THEN ("the head is the whole file") {
+			REQUIRE(input->Length() == 100);
+			REQUIRE(input->Head().size() == 100);
+			REQUIRE(MatchesPattern(input->Head(), 0));
+		}
+
+		WHEN ("we read past the end") {
+			input->Seek(90, SEEK_SET);
+			std::vector<std::byte> buf(20);
+			auto nread = input->Read(buf);
+
+			THEN ("only the remaining bytes are read") {
+				REQUIRE(nread == 10);
+				REQUIRE(MatchesPattern(gsl::make_span(buf.data(), nread), 90));
+			}
+		}
+	}
+
+	GIVEN ("a path to a nonexistent file") {
+		THEN ("opening it throws a FileError") {
+			REQUIRE_THROWS_AS(Audio::Input::Open("/nonexistent/playd/file.mp3"), FileError);
+		}
+	}
+}
+
+SCENARIO ("FileInputs and MappedInputs read files identically", "[input]") {
+	GIVEN ("a file, and one Input of each kind on it") {
+		const std::size_t size = Audio::Input::HEAD_SIZE * 2 + 123;
+		auto path = ScratchFile("input-kinds.bin", size);
+		Audio::FileInput file{path};
+		Audio::MappedInput mapped{path};
+
+		WHEN ("both are prefetched, then read in awkwardly sized chunks") {
+			file.Prefetch(0, size);
+			mapped.Prefetch(100, size);
+
+			auto read_all = [](Audio::Input &input) {
+				std::vector<std::byte> out;
+				std::vector<std::byte> buf(1000);
+				for (std::size_t n = 0; (n = input.Read(buf)) != 0;) out.insert(out.end(), buf.begin(), buf.begin() + n);
+				return out;
+			};
+			auto from_file = read_all(file);
+			auto from_mapped = read_all(mapped);
+
+			THEN ("they read the same, correct bytes") {
+				REQUIRE(from_file.size() == size);
+				REQUIRE(from_file == from_mapped);
+				REQUIRE(MatchesPattern(from_mapped, 0));
+			}
+		}
+	}
+
+	GIVEN ("a sparse file of over 4GiB, with a few bytes at the end") {
+		const std::uint64_t size = (std::uint64_t{1} << 32) + 16;
+		auto path = ScratchPath("input-huge.bin");
+		{
+			std::ofstream out{path, std::ios::binary};
+			out.seekp(static_cast<std::streamoff>(size - 4));
+			out.write("tail", 4);
+		}
+		REQUIRE(std::filesystem::file_size(path) == size);
+		Audio::FileInput file{path};
+
+		WHEN ("its end is read") {
+			file.Seek(-4, SEEK_END);
+			std::vector<std::byte> buf(8);
+			const auto n = file.Read(buf);
+
+			THEN ("the bytes come from the end, not somewhere 32-bit short of it") {
+				REQUIRE(n == 4);
+				REQUIRE(std::string{reinterpret_cast<const char *>(buf.data()), n} == "tail");
+			}
+		}
+
+		std::filesystem::remove(path);
+	}
+
+	GIVEN ("an empty file") {
+		auto path = ScratchFile("input-empty.bin", 0);
+
+		THEN ("it can't be mapped, but can still be opened") {
+			REQUIRE_THROWS_AS(Audio::MappedInput{path}, FileError);
+			auto input = Audio::Input::Open(path);
+			REQUIRE(input->Length() == 0);
+			REQUIRE(input->Head().empty());
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,337 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the IO core, its channels, and the MetricsServer class.
+ */
+
+#include <array>
+#include <charconv>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../errors.h"
+#include "../io.h"
+#include "../metrics.h"
+#include "catch.hpp"
+#include "dummy_audio_sink.h"
+
+namespace Playd::Tests
+{
+/// A scrape of a MetricsServer, made on the same loop.
+struct Scrape {
+	uv_tcp_t tcp;              ///< The connection to the server.
+	uv_connect_t connect;      ///< The connection request.
+	uv_write_t write;          ///< The request for the HTTP request.
+	std::string request;       ///< The HTTP request.
+	std::string response;      ///< What the server has sent back.
+	IO::MetricsServer *server; ///< The server, shut down once it answers.
+};
+
+/**
+ * Scrapes a MetricsServer, running the loop until it has answered.
+ * @param loop The loop on which the server is listening.
+ * @param server The server, which this shuts down.
+ * @param request The HTTP request to send.
+ * @return The HTTP response.
+ */
+static std::string RunScrape(uv_loop_t *loop, IO::MetricsServer &server, std::string request)
+{
+	Scrape scrape{};
+	scrape.request = std::move(request);
+	scrape.server = &server;
+	uv_tcp_init(loop, &scrape.tcp);
+	scrape.tcp.data = &scrape;
+
+	struct sockaddr_in addr;
+	uv_ip4_addr("127.0.0.1", server.Port(), &addr);
+	uv_tcp_connect(&scrape.connect, &scrape.tcp, reinterpret_cast<const sockaddr *>(&addr), [](uv_connect_t *req, int) {
+		auto *scrape = static_cast<Scrape *>(req->handle->data);
+		auto buf = uv_buf_init(scrape->request.data(), scrape->request.size());
+		uv_write(&scrape->write, req->handle, &buf, 1, nullptr);
+		uv_read_start(
+		        req->handle,
+		        [](uv_handle_t *, size_t size, uv_buf_t *buf) { *buf = uv_buf_init(new char[size], size); },
+		        [](uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
+			        auto *scrape = static_cast<Scrape *>(stream->data);
+			        if (0 < nread) scrape->response.append(buf->base, nread);
+			        delete[] buf->base;
+			        if (nread < 0) {
+				        uv_close(reinterpret_cast<uv_handle_t *>(stream), nullptr);
+				        scrape->server->Shutdown();
+			        }
+		        });
+	});
+
+	uv_run(loop, UV_RUN_DEFAULT);
+	return scrape.response;
+}
+
+SCENARIO ("MetricsServer answers scrapes of the global metrics", "[io]") {
+	GIVEN ("a MetricsServer listening on a free local port") {
+		Metrics::Global().GetCounter("playd_test_scrapes_total", "Scrapes made by tests.").Add();
+
+		uv_loop_t loop;
+		uv_loop_init(&loop);
+		IO::MetricsServer server;
+		server.Listen(&loop, "127.0.0.1", 0);
+		REQUIRE(server.Port() != 0);
+
+		WHEN ("/metrics is scraped") {
+			auto response = RunScrape(&loop, server, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+
+			THEN ("the response is the metrics, in the Prometheus text format") {
+				REQUIRE(response.rfind("HTTP/1.1 200 OK\r\n", 0) == 0);
+				REQUIRE(response.find("Content-Type: text/plain; version=0.0.4") != std::string::npos);
+				REQUIRE(response.find("\n# TYPE playd_test_scrapes_total counter\n") != std::string::npos);
+				REQUIRE(response.find("\nplayd_test_scrapes_total 1\n") != std::string::npos);
+			}
+		}
+
+		WHEN ("another path is asked for") {
+			auto response = RunScrape(&loop, server, "GET / HTTP/1.0\r\n\r\n");
+
+			THEN ("the response is a 404") {
+				REQUIRE(response.rfind("HTTP/1.1 404 Not Found\r\n", 0) == 0);
+			}
+		}
+
+		uv_loop_close(&loop);
+	}
+}
+
+SCENARIO ("MetricsServer only answers GET and HEAD", "[io]") {
+	WHEN ("a HEAD request is answered") {
+		auto response = IO::MetricsServer::Answer("HEAD /metrics?x=1 HTTP/1.1\r\n\r\n");
+
+		THEN ("it has the headers of a GET, but no body") {
+			REQUIRE(response.rfind("HTTP/1.1 200 OK\r\n", 0) == 0);
+			REQUIRE(response.find("Content-Length: 0\r\n") == std::string::npos);
+			REQUIRE(response.substr(response.size() - 4) == "\r\n\r\n");
+		}
+	}
+
+	WHEN ("a POST request is answered") {
+		auto response = IO::MetricsServer::Answer("POST /metrics HTTP/1.1\r\n\r\n");
+
+		THEN ("it is refused") {
+			REQUIRE(response.rfind("HTTP/1.1 405 Method Not Allowed\r\n", 0) == 0);
+			REQUIRE(response.find("Allow: GET, HEAD\r\n") != std::string::npos);
+		}
+	}
+
+	WHEN ("a request with no request line is answered") {
+		THEN ("it is a bad request") {
+			REQUIRE(IO::MetricsServer::Answer("").rfind("HTTP/1.1 400 Bad Request\r\n", 0) == 0);
+		}
+	}
+}
+
+/**
+ * Makes a Player that plays into dummy sinks, and can load nothing.
+ * @return The player.
+ */
+static std::unique_ptr<Player> MakePlayer()
+{
+	return std::make_unique<Player>(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>,
+	                                std::map<std::string, Player::SourceFn>{});
+}
+
+/**
+ * Finds two consecutive local ports that are free, for an IO core with two
+ * channels to listen on.
+ * @return The first port, or 0 if none could be found.
+ */
+static std::uint16_t FreePortPair()
+{
+	for (int attempt = 0; attempt < 20; attempt++) {
+		uv_loop_t loop;
+		uv_loop_init(&loop);
+		std::array<uv_tcp_t, 2> servers;
+
+		std::uint16_t port = 0;
+		auto free = true;
+		for (std::size_t i = 0; i < servers.size(); i++) {
+			uv_tcp_init(&loop, &servers[i]);
+
+			struct sockaddr_in addr;
+			uv_ip4_addr("127.0.0.1", i == 0 ? 0 : port + 1, &addr);
+			uv_tcp_bind(&servers[i], reinterpret_cast<const sockaddr *>(&addr), 0);
+			if (uv_listen(reinterpret_cast<uv_stream_t *>(&servers[i]), 1, nullptr)) free = false;
+
+			if (i == 0) {
+				struct sockaddr_storage s;
+				int namelen = sizeof(s);
+				uv_tcp_getsockname(&servers[i], reinterpret_cast<sockaddr *>(&s), &namelen);
+				port = ntohs(reinterpret_cast<const sockaddr_in *>(&s)->sin_port);
+				if (port == UINT16_MAX) free = false;
+			}
+		}
+
+		for (auto &server : servers) uv_close(reinterpret_cast<uv_handle_t *>(&server), nullptr);
+		uv_run(&loop, UV_RUN_DEFAULT);
+		uv_loop_close(&loop);
+
+		if (free) return port;
+	}
+	return 0;
+}
+
+/// A client of one channel of an IO core, on the core's loop.
+struct Client {
+	uv_tcp_t tcp;         ///< The connection to the channel.
+	uv_connect_t connect; ///< The connection request.
+	std::string received; ///< What the channel has sent so far.
+};
+
+/// Two clients, one on each channel of a running IO core, and their script.
+struct Session {
+	IO::Core *core;                  ///< The core.
+	std::array<Player *, 2> players; ///< The core's players, in channel order.
+	std::array<Client, 2> clients;   ///< A client on each channel.
+	std::uint16_t port;              ///< The first channel's port.
+	uv_timer_t timer;                ///< Drives the script.
+	int ticks;                       ///< How often the timer has fired.
+	bool broadcast;                  ///< Whether player 0 has broadcast.
+};
+
+/**
+ * Moves a Session's script on: connects the clients, then has player 0
+ * broadcast once they've been welcomed, then quits.
+ * @param timer The session's timer.
+ */
+static void RunSession(uv_timer_t *timer)
+{
+	auto *session = static_cast<Session *>(timer->data);
+	const auto welcomed = [](const Client &client) {
+		return client.received.find("! ACK OK success") != std::string::npos;
+	};
+
+	session->ticks++;
+	if (session->ticks == 1) {
+		for (std::size_t i = 0; i < session->clients.size(); i++) {
+			auto &client = session->clients[i];
+			uv_tcp_init(timer->loop, &client.tcp);
+			client.tcp.data = &client;
+
+			struct sockaddr_in addr;
+			uv_ip4_addr("127.0.0.1", session->port + i, &addr);
+			uv_tcp_connect(&client.connect, &client.tcp, reinterpret_cast<const sockaddr *>(&addr),
+			               [](uv_connect_t *req, int status) {
+				               if (status != 0) return;
+				               uv_read_start(
+				                       req->handle,
+				                       [](uv_handle_t *, size_t size, uv_buf_t *buf) {
+					                       *buf = uv_buf_init(new char[size], size);
+				                       },
+				                       [](uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
+					                       auto *client = static_cast<Client *>(stream->data);
+					                       if (0 < nread) client->received.append(buf->base, nread);
+					                       delete[] buf->base;
+					                       if (nread < 0) uv_close(reinterpret_cast<uv_handle_t *>(stream), nullptr);
+				                       });
+			               });
+		}
+	} else if (!session->broadcast && welcomed(session->clients[0]) && welcomed(session->clients[1])) {
+		session->players[0]->Gain("tag", "-6");
+		session->broadcast = true;
+	} else if (session->broadcast || 300 < session->ticks) {
+		// Closing the channels waits for their writes, so no more need
+		// waiting for.
+		session->core->Quit();
+		uv_close(reinterpret_cast<uv_handle_t *>(timer), nullptr);
+	}
+}
+
+SCENARIO ("IO cores give each player its own channel", "[io]") {
+	GIVEN ("an IO core with two players") {
+		auto player0 = MakePlayer();
+		auto player1 = MakePlayer();
+		IO::Core core{{player0.get(), player1.get()}};
+
+		WHEN ("it is run with the last free port as the first channel's") {
+			THEN ("it refuses, as the second channel would have no port") {
+				REQUIRE_THROWS_AS(core.Run("127.0.0.1", "65535"), NetError);
+			}
+		}
+
+		WHEN ("it is run with a port that isn't one") {
+			THEN ("it refuses") {
+				REQUIRE_THROWS_AS(core.Run("127.0.0.1", "65536"), NetError);
+				REQUIRE_THROWS_AS(core.Run("127.0.0.1", "0"), NetError);
+				REQUIRE_THROWS_AS(core.Run("127.0.0.1", "1350x"), NetError);
+			}
+		}
+
+		WHEN ("it runs, player 1 has gain set first, and player 0 sets its gain later") {
+			REQUIRE(player1->Gain("tag", "-3").Pack() == "tag ACK OK success");
+
+			Session session{};
+			session.core = &core;
+			session.players = {player0.get(), player1.get()};
+			session.port = FreePortPair();
+			REQUIRE(session.port != 0);
+
+			uv_timer_init(uv_default_loop(), &session.timer);
+			session.timer.data = &session;
+			uv_timer_start(&session.timer, RunSession, 10, 10);
+			core.Run("127.0.0.1", std::to_string(session.port));
+
+			const auto &channel0 = session.clients[0].received;
+			const auto &channel1 = session.clients[1].received;
+
+			THEN ("each channel's client is welcomed by its own player") {
+				REQUIRE(channel0.find("! ACK OK success") != std::string::npos);
+				REQUIRE(channel1.find("! ACK OK success") != std::string::npos);
+				REQUIRE(channel0.find("! GAIN -3") == std::string::npos);
+				REQUIRE(channel1.find("! GAIN -3") != std::string::npos);
+			}
+
+			THEN ("player 0's broadcast reaches only channel 0") {
+				REQUIRE(channel0.find("! GAIN -6") != std::string::npos);
+				REQUIRE(channel1.find("! GAIN -6") == std::string::npos);
+			}
+		}
+	}
+}
+
+/**
+ * Parses a device ID as playd does for outputs other than SDL.
+ * @param arg The ID.
+ * @return The ID, or -1 if it isn't a whole, non-negative number.
+ */
+static int ParseID(std::string_view arg)
+{
+	auto id = -1;
+	auto [p, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), id);
+	return ec == std::errc{} && p == arg.data() + arg.size() && 0 <= id ? id : -1;
+}
+
+SCENARIO ("Channel lists parse into one device ID per channel", "[io]") {
+	THEN ("a single ID makes one channel") {
+		REQUIRE(IO::ParseChannelList("3", ParseID) == std::vector<int>{3});
+	}
+
+	THEN ("comma-separated IDs make a channel each, in order") {
+		REQUIRE(IO::ParseChannelList("0,1", ParseID) == std::vector<int>{0, 1});
+		REQUIRE(IO::ParseChannelList("2,0,7", ParseID) == std::vector<int>{2, 0, 7});
+	}
+
+	THEN ("a stray comma makes the whole list invalid") {
+		REQUIRE(IO::ParseChannelList("0,1,", ParseID).empty());
+		REQUIRE(IO::ParseChannelList(",0", ParseID).empty());
+		REQUIRE(IO::ParseChannelList("0,,1", ParseID).empty());
+		REQUIRE(IO::ParseChannelList("", ParseID).empty());
+	}
+
+	THEN ("one bad ID makes the whole list invalid") {
+		REQUIRE(IO::ParseChannelList("0,x,1", ParseID).empty());
+		REQUIRE(IO::ParseChannelList("0,1x", ParseID).empty());
+		REQUIRE(IO::ParseChannelList("0,-1", ParseID).empty());
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,83 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the LevelMeter class.
+ */
+
+#include "../audio/levels.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/**
+ * Makes the bytes of some constant mono float samples.
+ * @param frames The number of frames.
+ * @param value The value of every sample.
+ * @return The bytes.
+ */
+static std::vector<std::byte> ConstantFloats(std::size_t frames, float value)
+{
+	std::vector<float> samples(frames, value);
+	std::vector<std::byte> bytes(samples.size() * sizeof(float));
+	std::memcpy(bytes.data(), samples.data(), bytes.size());
+	return bytes;
+}
+
+SCENARIO ("LevelMeter hands levels over to one taker", "[levels]") {
+	GIVEN ("a fresh LevelMeter") {
+		Audio::LevelMeter meter{44100};
+
+		WHEN ("nothing has been measured") {
+			THEN ("there are no levels to take") {
+				REQUIRE_FALSE(meter.Take());
+			}
+		}
+
+		WHEN ("a block is measured and the levels taken") {
+			meter.Measure(ConstantFloats(4, 0.5f), Audio::SampleFormat::FLOAT32, 1);
+			auto levels = meter.Take();
+
+			THEN ("the levels are of that block") {
+				REQUIRE(levels);
+				REQUIRE(levels->channels == 1);
+				REQUIRE(levels->frames == 4);
+				REQUIRE(levels->peak[0] == 0.5f);
+				REQUIRE(levels->energy[0] == Approx(1.0));
+			}
+
+			THEN ("there are no more levels to take") {
+				REQUIRE_FALSE(meter.Take());
+			}
+		}
+
+		WHEN ("blocks are measured while earlier levels are still untaken") {
+			meter.Measure(ConstantFloats(4, 0.5f), Audio::SampleFormat::FLOAT32, 1);
+			meter.Measure(ConstantFloats(2, -0.25f), Audio::SampleFormat::FLOAT32, 1);
+			meter.Measure(ConstantFloats(2, 0.75f), Audio::SampleFormat::FLOAT32, 1);
+			auto first = meter.Take();
+			meter.Measure(ConstantFloats(0, 0.0f), Audio::SampleFormat::FLOAT32, 1);
+			auto empty = meter.Take();
+			meter.Measure(ConstantFloats(1, 0.0f), Audio::SampleFormat::FLOAT32, 1);
+			auto second = meter.Take();
+
+			THEN ("the later blocks are added up and handed over together") {
+				REQUIRE(first);
+				REQUIRE(first->frames == 4);
+				REQUIRE_FALSE(empty);
+				REQUIRE(second);
+				REQUIRE(second->frames == 5);
+				REQUIRE(second->peak[0] == 0.75f);
+				REQUIRE(second->energy[0] == Approx(2 * 0.0625 + 2 * 0.5625));
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,156 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Limiter class.
+ */
+
+#include "../audio/limiter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/// Two pi, which M_PI would give us if it were standard.
+constexpr double TWO_PI = 6.28318530717958647692;
+
+/**
+ * Makes some stereo sine, the same in both channels.
+ * @param frames The number of frames.
+ * @param cycle The number of frames per cycle.
+ * @param amplitude The peak amplitude of the wave.
+ * @param phase The phase at frame 0, in radians.
+ * @return The interleaved samples.
+ */
+static std::vector<float> Sine(std::size_t frames, double cycle, double amplitude, double phase = 0.0)
+{
+	std::vector<float> samples(frames * 2);
+	for (std::size_t i = 0; i < frames; i++) {
+		const auto x = amplitude * std::sin(TWO_PI * static_cast<double>(i) / cycle + phase);
+		samples[2 * i] = samples[2 * i + 1] = static_cast<float>(x);
+	}
+	return samples;
+}
+
+/**
+ * Finds the highest absolute sample in part of a buffer.
+ * @param samples The samples.
+ * @param from The first sample to look at.
+ * @return The peak.
+ */
+static float Peak(const std::vector<float> &samples, std::size_t from)
+{
+	float peak = 0.0f;
+	for (auto i = from; i < samples.size(); i++) peak = std::max(peak, std::abs(samples[i]));
+	return peak;
+}
+
+SCENARIO ("Limiter delays audio under its ceiling, and nothing else", "[limiter]") {
+	GIVEN ("a stereo limiter at 44.1kHz with a ceiling of full scale") {
+		Audio::Limiter limiter{44100, 2, 1.0f};
+
+		THEN ("its latency is the look-ahead, plus half the detector's length") {
+			REQUIRE(limiter.Latency() == 88 + 6);
+		}
+
+		WHEN ("a quiet sine goes through") {
+			const auto in = Sine(4096, 100.0, 0.5);
+			auto out = in;
+			limiter.Process(out);
+
+			THEN ("it comes out exactly as it went in, a latency late") {
+				const auto lag = 2 * limiter.Latency();
+				REQUIRE(std::all_of(out.begin(), out.begin() + lag, [](float x) { return x == 0.0f; }));
+				REQUIRE(std::equal(out.begin() + lag, out.end(), in.begin()));
+			}
+		}
+
+		WHEN ("non-finite samples go through") {
+			std::vector<float> out(2 * 200, std::numeric_limits<float>::quiet_NaN());
+			out[10] = std::numeric_limits<float>::infinity();
+			limiter.Process(out);
+
+			THEN ("they come out as silence") {
+				REQUIRE(std::all_of(out.begin(), out.end(), [](float x) { return x == 0.0f; }));
+			}
+		}
+	}
+}
+
+SCENARIO ("Limiter holds loud audio under its ceiling", "[limiter]") {
+	GIVEN ("a stereo limiter at 44.1kHz with a ceiling of -6dBTP") {
+		const auto ceiling = 0.5f;
+		Audio::Limiter limiter{44100, 2, ceiling};
+
+		WHEN ("a sine at twice full scale goes through") {
+			auto out = Sine(44100, 100.0, 2.0);
+			limiter.Process(out);
+
+			THEN ("nothing comes out over the ceiling") {
+				REQUIRE(Peak(out, 0) <= ceiling);
+			}
+
+			THEN ("once the gain has come down, the sine is just under the ceiling") {
+				REQUIRE(Peak(out, out.size() / 2) == Approx(ceiling).epsilon(0.01));
+			}
+		}
+
+		WHEN ("the same sine goes through a block at a time") {
+			auto whole = Sine(8192, 100.0, 2.0);
+			auto blocks = whole;
+			limiter.Process(whole);
+
+			Audio::Limiter other{44100, 2, ceiling};
+			for (std::size_t i = 0; i < blocks.size(); i += 2 * 100) {
+				const auto n = std::min<std::size_t>(2 * 100, blocks.size() - i);
+				other.Process(gsl::span<float>(blocks).subspan(i, n));
+			}
+
+			THEN ("it comes out the same as in one go") {
+				REQUIRE(blocks == whole);
+			}
+		}
+
+		WHEN ("the limiter is reset partway through") {
+			auto out = Sine(4096, 100.0, 2.0);
+			limiter.Process(out);
+			limiter.Reset();
+			std::vector<float> quiet(2 * 200, 0.25f);
+			limiter.Process(quiet);
+
+			THEN ("nothing from before the reset comes out") {
+				const auto lag = 2 * limiter.Latency();
+				REQUIRE(std::all_of(quiet.begin(), quiet.begin() + lag, [](float x) { return x == 0.0f; }));
+				REQUIRE(std::all_of(quiet.begin() + lag, quiet.end(), [](float x) { return x == 0.25f; }));
+			}
+		}
+	}
+
+	GIVEN ("a limiter with a ceiling just over a sine's sample peaks, but under its true peak") {
+		// A sine at a quarter of the sample rate, 45 degrees out, has every
+		// sample at 1/sqrt(2) of its true peak.
+		const auto ceiling = 0.9f;
+		Audio::Limiter limiter{44100, 2, ceiling};
+
+		WHEN ("the sine goes through") {
+			auto out = Sine(4410, 4.0, 1.0, TWO_PI / 8);
+			limiter.Process(out);
+
+			// 4x oversampling reads true peaks a little low, so allow a
+			// fraction of a decibel over.
+			THEN ("its samples are turned down so that its true peak is about the ceiling") {
+				REQUIRE(Peak(out, out.size() / 2) <= ceiling * 0.7072f * 1.01f);
+				REQUIRE(Peak(out, out.size() / 2) > ceiling * 0.68f);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,164 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Logger class and the PLAYD_LOG macro.
+ */
+
+#include "../log.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/**
+ * A stream buffer that holds up the first write until let go, so that tests
+ * can keep a Logger's writer busy.
+ */
+class GateBuf : public std::stringbuf
+{
+public:
+	/// Waits until the writer has started writing.
+	void WaitForWriter()
+	{
+		std::unique_lock<std::mutex> guard{this->lock};
+		this->wake.wait(guard, [this] { return this->writing; });
+	}
+
+	/// Lets the writer carry on.
+	void Open()
+	{
+		{
+			std::lock_guard<std::mutex> guard{this->lock};
+			this->open = true;
+		}
+		this->wake.notify_all();
+	}
+
+protected:
+	std::streamsize xsputn(const char *s, std::streamsize n) override
+	{
+		{
+			std::unique_lock<std::mutex> guard{this->lock};
+			this->writing = true;
+			this->wake.notify_all();
+			this->wake.wait(guard, [this] { return this->open; });
+		}
+		return std::stringbuf::xsputn(s, n);
+	}
+
+private:
+	std::mutex lock;              ///< Lock over the below.
+	std::condition_variable wake; ///< Signalled when either flag changes.
+	bool writing = false;         ///< Whether the writer has started.
+	bool open = false;            ///< Whether the writer may carry on.
+};
+
+/**
+ * Counts how many times it's called.
+ * @param calls The count.
+ * @return The count, after counting this call.
+ */
+static int Count(int &calls)
+{
+	return ++calls;
+}
+
+SCENARIO ("Loggers write messages at or above their level", "[log]") {
+	GIVEN ("a logger writing to a string") {
+		std::ostringstream os;
+		Logger logger{os};
+
+		THEN ("it writes INFO and above by default") {
+			REQUIRE_FALSE(logger.IsEnabled(LogLevel::DEBUG));
+			REQUIRE(logger.IsEnabled(LogLevel::INFO));
+			REQUIRE(logger.IsEnabled(LogLevel::ERROR));
+		}
+
+		WHEN ("its level is set to WARNING") {
+			logger.SetLevel(LogLevel::WARNING);
+
+			THEN ("INFO is off, but WARNING is on") {
+				REQUIRE_FALSE(logger.IsEnabled(LogLevel::INFO));
+				REQUIRE(logger.IsEnabled(LogLevel::WARNING));
+			}
+		}
+
+		WHEN ("two messages are logged, and the logger flushed") {
+			LogLine(logger, LogLevel::WARNING) << "loop stalled for" << 42 << "us";
+			LogLine(logger, LogLevel::INFO) << "hello";
+			logger.Flush();
+
+			THEN ("both are written, in order, with their levels") {
+				REQUIRE(os.str() == "WARNING: loop stalled for 42 us\nINFO: hello\n");
+			}
+		}
+	}
+
+	GIVEN ("a logger whose writer is stuck writing") {
+		GateBuf buf;
+		std::ostream os{&buf};
+		Logger logger{os};
+		LogLine(logger, LogLevel::INFO) << "first";
+		buf.WaitForWriter();
+
+		WHEN ("more messages are logged than can wait, and the writer gets going") {
+			for (std::size_t i = 0; i < Logger::CAPACITY + 3; i++) LogLine(logger, LogLevel::INFO) << i;
+			buf.Open();
+			logger.Flush();
+
+			THEN ("the messages that fit are written, and the rest counted") {
+				const auto out = buf.str();
+				REQUIRE(out.find("INFO: first\nINFO: 0\n") == 0);
+				REQUIRE(out.find("INFO: " + std::to_string(Logger::CAPACITY - 1) + "\n") != std::string::npos);
+				REQUIRE(out.find("INFO: " + std::to_string(Logger::CAPACITY) + "\n") == std::string::npos);
+				REQUIRE(out.find("WARNING: dropped 3 log messages\n") != std::string::npos);
+			}
+		}
+
+		buf.Open();
+	}
+}
+
+SCENARIO ("Log levels parse from their names", "[log]") {
+	THEN ("each level's name parses to it") {
+		REQUIRE(Logger::ParseLevel("debug") == LogLevel::DEBUG);
+		REQUIRE(Logger::ParseLevel("info") == LogLevel::INFO);
+		REQUIRE(Logger::ParseLevel("warning") == LogLevel::WARNING);
+		REQUIRE(Logger::ParseLevel("error") == LogLevel::ERROR);
+	}
+
+	THEN ("anything else doesn't") {
+		REQUIRE_FALSE(Logger::ParseLevel("").has_value());
+		REQUIRE_FALSE(Logger::ParseLevel("INFO").has_value());
+		REQUIRE_FALSE(Logger::ParseLevel("verbose").has_value());
+	}
+}
+
+SCENARIO ("PLAYD_LOG doesn't evaluate messages at levels that are off", "[log]") {
+	GIVEN ("the global logger at its default level") {
+		int calls = 0;
+
+		WHEN ("a DEBUG message is logged") {
+			PLAYD_LOG(DEBUG) << "called" << Count(calls);
+
+			THEN ("nothing in it was evaluated") {
+				REQUIRE(calls == 0);
+			}
+		}
+	}
+
+	THEN ("every level is built in by default") {
+		REQUIRE(Logger::IsCompiledIn(LogLevel::DEBUG));
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,254 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the LoudnessMeter class, and loudness analysis.
+ */
+
+#include "../audio/loudness.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+#include "scratch.h"
+
+namespace Playd::Tests
+{
+/// Tau, the angle of a whole turn.
+constexpr double TAU = 6.28318530717958647692;
+
+/**
+ * Makes a stereo sine wave.
+ * @param rate The sample rate, in Hz.
+ * @param freq The frequency of the wave, in Hz.
+ * @param dbfs The peak level of the wave, in dBFS.
+ * @param seconds The length of the wave.
+ * @param phase The starting phase, in radians.
+ * @return The interleaved samples.
+ */
+static std::vector<float> Sine(std::uint32_t rate, double freq, double dbfs, double seconds, double phase = 0)
+{
+	const auto amplitude = std::pow(10.0, dbfs / 20.0);
+	const auto frames = static_cast<std::size_t>(rate * seconds);
+	std::vector<float> samples(frames * 2);
+	for (std::size_t i = 0; i < frames; i++) {
+		samples[2 * i] = samples[2 * i + 1] = static_cast<float>(amplitude * std::sin(TAU * freq * i / rate + phase));
+	}
+	return samples;
+}
+
+SCENARIO ("LoudnessMeter measures EBU R128 loudness", "[loudness]") {
+	GIVEN ("a meter at 48kHz") {
+		Audio::LoudnessMeter meter{48000, 2};
+
+		WHEN ("it is fed a 1kHz stereo sine at -23dBFS") {
+			meter.Add(Sine(48000, 1000, -23, 20));
+			const auto result = meter.Result();
+
+			THEN ("the integrated loudness is -23LUFS") {
+				REQUIRE(result.integrated == Approx(-23.0).margin(0.1));
+			}
+
+			THEN ("the loudness range is 0LU") {
+				REQUIRE(result.range == Approx(0.0).margin(0.1));
+			}
+
+			THEN ("the true peak is the sine's peak") {
+				REQUIRE(result.true_peak == Approx(-23.0).margin(0.1));
+			}
+		}
+
+		WHEN ("it is fed 20s of sine at -20dBFS, then 20s at -30dBFS") {
+			meter.Add(Sine(48000, 1000, -20, 20));
+			meter.Add(Sine(48000, 1000, -30, 20));
+
+			THEN ("the loudness range is 10LU") {
+				REQUIRE(meter.Result().range == Approx(10.0).margin(1.0));
+			}
+		}
+
+		WHEN ("it is fed a sine whose peaks fall between samples") {
+			// At a quarter of the sample rate, shifted by an eighth of a
+			// turn, every sample is at 0.707 of the true peak.
+			meter.Add(Sine(48000, 12000, 0, 1, TAU / 8));
+
+			THEN ("the true peak is the sine's peak, not the highest sample") {
+				REQUIRE(meter.Result().true_peak == Approx(0.0).margin(0.2));
+			}
+		}
+
+		WHEN ("it is fed silence") {
+			meter.Add(std::vector<float>(48000 * 2 * 5, 0.0f));
+			const auto result = meter.Result();
+
+			THEN ("the loudness and true peak are -infinity") {
+				REQUIRE(std::isinf(result.integrated));
+				REQUIRE(result.integrated < 0);
+				REQUIRE(std::isinf(result.true_peak));
+				REQUIRE(result.range == 0.0);
+			}
+		}
+	}
+
+	GIVEN ("a meter at 44.1kHz") {
+		Audio::LoudnessMeter meter{44100, 2};
+
+		WHEN ("it is fed a 1kHz stereo sine at -23dBFS in small pieces") {
+			const auto sine = Sine(44100, 1000, -23, 20);
+			for (std::size_t i = 0; i < sine.size(); i += 2 * 1000) {
+				meter.Add(gsl::span<const float>{sine}.subspan(i, std::min<std::size_t>(2 * 1000, sine.size() - i)));
+			}
+
+			THEN ("the integrated loudness is still -23LUFS") {
+				REQUIRE(meter.Result().integrated == Approx(-23.0).margin(0.1));
+			}
+		}
+	}
+}
+
+/// A source of a 1kHz stereo sine wave at -23dBFS, for analysis tests.
+class SineSource : public Audio::Source
+{
+public:
+	/**
+	 * Constructs a SineSource.
+	 * @param path The path the source pretends to decode.
+	 */
+	explicit SineSource(std::string_view path) : Audio::Source{path}, samples{Sine(48000, 1000, -23, 5)}, done{false}
+	{
+	}
+
+	DecodeResult Decode() override
+	{
+		if (this->done) return std::make_pair(DecodeState::END_OF_FILE, DecodeVector{});
+		this->done = true;
+
+		DecodeVector bytes(this->samples.size() * sizeof(float));
+		std::memcpy(bytes.data(), this->samples.data(), bytes.size());
+		return std::make_pair(DecodeState::DECODING, std::move(bytes));
+	}
+
+	std::uint8_t ChannelCount() const override
+	{
+		return 2;
+	}
+
+	std::uint32_t SampleRate() const override
+	{
+		return 48000;
+	}
+
+	Audio::SampleFormat OutputSampleFormat() const override
+	{
+		return Audio::SampleFormat::FLOAT32;
+	}
+
+	std::uint64_t Seek(std::uint64_t) override
+	{
+		return 0;
+	}
+
+	std::uint64_t Length() const override
+	{
+		return this->samples.size() / 2;
+	}
+
+private:
+	std::vector<float> samples; ///< The samples.
+	bool done;                  ///< Whether Decode has given out the samples.
+};
+
+/**
+ * Waits for an analysis to finish.
+ * @param analysis The analysis.
+ * @return The result, or nullptr if the analysis took more than 10s.
+ */
+static const Audio::Loudness *Await(Audio::LoudnessAnalysis &analysis)
+{
+	for (int i = 0; i < 1000; i++) {
+		if (const auto *result = analysis.Take(); result) return result;
+		std::this_thread::sleep_for(std::chrono::milliseconds{10});
+	}
+	return nullptr;
+}
+
+SCENARIO ("LoudnessAnalysis analyses files in the background, once", "[loudness]") {
+	GIVEN ("a file, an empty cache, and a worker") {
+		auto dir = ScratchDir("loudness-analysis");
+		const auto path = (dir / "sine.raw").string();
+		std::ofstream{path} << "not really audio";
+
+		Cache cache{dir / "cache", "loud"};
+		WorkerPool pool{1};
+		int opens = 0;
+		auto open = [&opens, path]() -> std::unique_ptr<Audio::Source> {
+			opens++;
+			return std::make_unique<SineSource>(path);
+		};
+
+		WHEN ("the file is analysed") {
+			Audio::AnalysisPass pass{path, open};
+			auto analysis = pass.Add<Audio::LoudnessTraits>(cache);
+			pass.Start(pool);
+			const auto *result = Await(*analysis);
+
+			THEN ("the result arrives, once") {
+				REQUIRE(result != nullptr);
+				REQUIRE(result->integrated == Approx(-23.0).margin(0.1));
+				REQUIRE(analysis->Take() == nullptr);
+				REQUIRE(analysis->Result() != nullptr);
+			}
+
+			AND_WHEN ("the file is analysed again") {
+				Audio::AnalysisPass again{path, open};
+				auto cached = again.Add<Audio::LoudnessTraits>(cache);
+				again.Start(pool);
+
+				THEN ("the result comes straight from the cache") {
+					const auto *value = cached->Take();
+					REQUIRE(value != nullptr);
+					REQUIRE(value->integrated == result->integrated);
+					REQUIRE(opens == 1);
+				}
+			}
+		}
+
+		WHEN ("the file is analysed twice over in one pass") {
+			Audio::AnalysisPass pass{path, open};
+			auto first = pass.Add<Audio::LoudnessTraits>(cache);
+			auto second = pass.Add<Audio::LoudnessTraits>(Cache{dir / "other", "loud"});
+			pass.Start(pool);
+			const auto *a = Await(*first);
+			const auto *b = Await(*second);
+
+			THEN ("both results arrive from one decode") {
+				REQUIRE(a != nullptr);
+				REQUIRE(b != nullptr);
+				REQUIRE(a->integrated == b->integrated);
+				REQUIRE(opens == 1);
+			}
+		}
+
+		WHEN ("a file that doesn't exist is analysed") {
+			Audio::AnalysisPass pass{(dir / "nope.raw").string(), open};
+			auto analysis = pass.Add<Audio::LoudnessTraits>(cache);
+			pass.Start(pool);
+
+			THEN ("no analysis happens") {
+				std::this_thread::sleep_for(std::chrono::milliseconds{50});
+				REQUIRE(analysis->Result() == nullptr);
+				REQUIRE(opens == 0);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
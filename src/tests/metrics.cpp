@@ -0,0 +1,137 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Metrics registry.
+ */
+
+#include "../metrics.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "../errors.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("Metrics registries hand out named metrics", "[metrics]") {
+	GIVEN ("an empty registry") {
+		Metrics metrics;
+
+		WHEN ("a counter and a gauge are registered and updated") {
+			auto &counter = metrics.GetCounter("test_events_total", "Events.");
+			auto &gauge = metrics.GetGauge("test_level", "Level.");
+			counter.Add();
+			counter.Add(2);
+			gauge.Set(10);
+			gauge.Add(-3);
+
+			THEN ("the metrics hold the updated values") {
+				REQUIRE(counter.Value() == 3);
+				REQUIRE(gauge.Value() == 7);
+			}
+
+			THEN ("looking them up again returns the same metrics") {
+				REQUIRE(&metrics.GetCounter("test_events_total", "") == &counter);
+				REQUIRE(&metrics.GetGauge("test_level", "") == &gauge);
+			}
+
+			THEN ("looking one up as the wrong type throws InternalError") {
+				REQUIRE_THROWS_AS(metrics.GetGauge("test_events_total", ""), InternalError);
+			}
+
+			THEN ("a snapshot has both, in name order, with their help") {
+				auto samples = metrics.Snapshot();
+				REQUIRE(samples.size() == 2);
+				REQUIRE(samples[0].name == "test_events_total");
+				REQUIRE(samples[0].type == Metrics::Type::COUNTER);
+				REQUIRE(samples[0].help == "Events.");
+				REQUIRE(samples[0].value == 3);
+				REQUIRE(samples[1].name == "test_level");
+				REQUIRE(samples[1].type == Metrics::Type::GAUGE);
+				REQUIRE(samples[1].value == 7);
+			}
+		}
+	}
+}
+
+SCENARIO ("Histograms count observations into buckets", "[metrics]") {
+	GIVEN ("a histogram with doubling bounds from 10") {
+		Histogram histogram{Histogram::Doubling(10, 3)};
+
+		THEN ("the bounds double") {
+			REQUIRE(histogram.Bounds() == std::vector<std::uint64_t>{10, 20, 40});
+		}
+
+		WHEN ("values are observed on, between and past the bounds") {
+			for (const auto v : {0, 10, 11, 20, 39, 41, 1000}) histogram.Observe(v);
+
+			THEN ("each lands in the first bucket whose bound it doesn't exceed") {
+				REQUIRE(histogram.Counts() == std::vector<std::uint64_t>{2, 2, 1, 2});
+				REQUIRE(histogram.Sum() == 1121);
+			}
+		}
+	}
+}
+
+SCENARIO ("Log-linear histogram bounds split each doubling evenly", "[metrics]") {
+	WHEN ("bounds are made from 8, over 2 doublings, in 4 steps") {
+		auto bounds = Histogram::LogLinear(8, 2, 4);
+
+		THEN ("each doubling has 4 evenly spaced bounds") {
+			REQUIRE(bounds == std::vector<std::uint64_t>{8, 10, 12, 14, 16, 20, 24, 28, 32});
+		}
+	}
+}
+
+SCENARIO ("Metrics registries render in the Prometheus text format", "[metrics]") {
+	GIVEN ("a registry with one metric of each type") {
+		Metrics metrics;
+		metrics.GetCounter("test_events_total", "Events.").Add(3);
+		metrics.GetGauge("test_level", "Level, with a \\ and a\nnewline.").Set(-2);
+		auto &histogram = metrics.GetHistogram("test_took_us", "Took.", {10, 100});
+		histogram.Observe(5);
+		histogram.Observe(50);
+		histogram.Observe(500);
+
+		WHEN ("it is snapshotted") {
+			auto samples = metrics.Snapshot();
+
+			THEN ("the histogram has cumulative buckets, a count and a sum") {
+				REQUIRE(samples.size() == 3);
+				REQUIRE(samples[2].type == Metrics::Type::HISTOGRAM);
+				REQUIRE(samples[2].value == 3);
+				REQUIRE(samples[2].sum == 555);
+				REQUIRE(samples[2].buckets.size() == 2);
+				REQUIRE(samples[2].buckets[0].bound == 10);
+				REQUIRE(samples[2].buckets[0].count == 1);
+				REQUIRE(samples[2].buckets[1].bound == 100);
+				REQUIRE(samples[2].buckets[1].count == 2);
+			}
+		}
+
+		WHEN ("it is rendered") {
+			auto text = metrics.Prometheus();
+
+			THEN ("every metric has help and type lines, with help escaped") {
+				REQUIRE(text == "# HELP test_events_total Events.\n"
+				                "# TYPE test_events_total counter\n"
+				                "test_events_total 3\n"
+				                "# HELP test_level Level, with a \\\\ and a\\nnewline.\n"
+				                "# TYPE test_level gauge\n"
+				                "test_level -2\n"
+				                "# HELP test_took_us Took.\n"
+				                "# TYPE test_took_us histogram\n"
+				                "test_took_us_bucket{le=\"10\"} 1\n"
+				                "test_took_us_bucket{le=\"100\"} 2\n"
+				                "test_took_us_bucket{le=\"+Inf\"} 3\n"
+				                "test_took_us_sum 555\n"
+				                "test_took_us_count 3\n");
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
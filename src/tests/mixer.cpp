@@ -0,0 +1,187 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Mixer class.
+ */
+
+#include "../audio/mixer.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../errors.h"
+#include "catch.hpp"
+#include "dummy_audio_source.h"
+
+namespace Playd::Tests
+{
+/**
+ * Makes the bytes of some constant stereo 32-bit samples.
+ * @param frames The number of frames.
+ * @param value The value of every sample, as a fraction of full scale.
+ * @return The bytes.
+ */
+static std::vector<std::byte> ConstantFrames(std::size_t frames, float value)
+{
+	std::vector<std::int32_t> samples(frames * 2, static_cast<std::int32_t>(value * 2147483648.0f));
+	std::vector<std::byte> bytes(samples.size() * sizeof(std::int32_t));
+	std::memcpy(bytes.data(), samples.data(), bytes.size());
+	return bytes;
+}
+
+SCENARIO ("Mixer sums its strips", "[mixer]") {
+	GIVEN ("a mixer with two strips fed constant audio") {
+		DummyAudioSource source{"foo"};
+		auto mixer = std::make_shared<Audio::Mixer>(source.SampleRate());
+		auto a = mixer->MakeStrip(source);
+		auto b = mixer->MakeStrip(source);
+		REQUIRE(a->Transfer(ConstantFrames(4, 0.25f)) == 4 * source.BytesPerSample());
+		REQUIRE(b->Transfer(ConstantFrames(2, 0.5f)) == 2 * source.BytesPerSample());
+		std::vector<float> out(8);
+
+		WHEN ("neither strip is playing") {
+			mixer->Mix(out);
+
+			THEN ("the mix is silent") {
+				REQUIRE(out == std::vector<float>(8, 0.0f));
+			}
+		}
+
+		WHEN ("both strips are playing, one at half gain") {
+			a->Start();
+			b->Start();
+			b->SetGain(0.5f);
+			mixer->Mix(out);
+
+			THEN ("the mix is their scaled sum, for as long as each lasts") {
+				REQUIRE(out == std::vector<float>{0.5f, 0.5f, 0.5f, 0.5f, 0.25f, 0.25f, 0.25f, 0.25f});
+			}
+
+			THEN ("each strip's position counts the frames it played") {
+				REQUIRE(a->Position() == 4);
+				REQUIRE(b->Position() == 2);
+			}
+		}
+
+		WHEN ("both strips are playing and their sum overloads") {
+			a->Start();
+			b->Start();
+			b->SetGain(4.0f);
+			mixer->Mix(out);
+
+			THEN ("the mix clips") {
+				REQUIRE(out[0] == 1.0f);
+			}
+		}
+
+		WHEN ("a strip's source runs out and it is drained") {
+			b->Start();
+			b->SourceOut();
+			mixer->Mix(out);
+			mixer->Mix(out);
+
+			THEN ("the strip is at its end") {
+				REQUIRE(b->CurrentState() == Audio::Sink::State::AT_END);
+			}
+
+			AND_WHEN ("the strip is repositioned") {
+				b->SetPosition(100);
+
+				THEN ("it is stopped again, at the new position") {
+					REQUIRE(b->CurrentState() == Audio::Sink::State::STOPPED);
+					REQUIRE(b->Position() == 100);
+				}
+			}
+		}
+
+		WHEN ("a strip is destroyed") {
+			a->Start();
+			b->Start();
+			a.reset();
+			mixer->Mix(out);
+
+			THEN ("it no longer contributes to the mix") {
+				REQUIRE(out == std::vector<float>{0.5f, 0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f});
+			}
+		}
+	}
+}
+
+SCENARIO ("Mixer crossfades between strips on the exact frame", "[mixer]") {
+	GIVEN ("a mixer with one strip cued to crossfade into another") {
+		DummyAudioSource source{"foo"};
+		auto mixer = std::make_shared<Audio::Mixer>(source.SampleRate());
+		auto a = mixer->MakeStrip(source);
+		auto b = mixer->MakeStrip(source);
+		REQUIRE(a->Transfer(ConstantFrames(8, 0.5f)) == 8 * source.BytesPerSample());
+		REQUIRE(b->Transfer(ConstantFrames(8, 0.25f)) == 8 * source.BytesPerSample());
+		REQUIRE(a->CueCrossfade(b.get(), 2, 4, Audio::FadeCurve::LINEAR));
+		std::vector<float> out(16);
+
+		WHEN ("the first strip plays through its cue point") {
+			a->Start();
+			mixer->Mix(out);
+
+			THEN ("the second comes in on the cue frame, and the two fade across") {
+				REQUIRE(out == std::vector<float>{0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.4375f, 0.4375f, 0.375f,
+				                                  0.375f, 0.3125f, 0.3125f, 0.25f, 0.25f, 0.25f, 0.25f});
+			}
+
+			THEN ("the second strip is playing, from where it came in") {
+				REQUIRE(b->CurrentState() == Audio::Sink::State::PLAYING);
+				REQUIRE(b->Position() == 6);
+			}
+		}
+
+		WHEN ("the cue is cancelled before the first strip plays") {
+			REQUIRE(a->CueCrossfade(nullptr, 0, 0, Audio::FadeCurve::LINEAR));
+			a->Start();
+			mixer->Mix(out);
+
+			THEN ("the first strip plays alone, unfaded") {
+				REQUIRE(out == std::vector<float>(16, 0.5f));
+				REQUIRE(b->CurrentState() == Audio::Sink::State::STOPPED);
+			}
+		}
+
+		WHEN ("the second strip is destroyed before the cue point") {
+			b.reset();
+			a->Start();
+			mixer->Mix(out);
+
+			THEN ("the first strip plays alone, unfaded") {
+				REQUIRE(out == std::vector<float>(16, 0.5f));
+			}
+		}
+	}
+
+	GIVEN ("strips of two different mixers") {
+		DummyAudioSource source{"foo"};
+		auto a = std::make_shared<Audio::Mixer>(source.SampleRate())->MakeStrip(source);
+		auto b = std::make_shared<Audio::Mixer>(source.SampleRate())->MakeStrip(source);
+
+		WHEN ("one is cued to crossfade into the other") {
+			THEN ("the cue is refused") {
+				REQUIRE_FALSE(a->CueCrossfade(b.get(), 0, 10, Audio::FadeCurve::LINEAR));
+			}
+		}
+	}
+}
+
+SCENARIO ("Mixer refuses sources it can't mix", "[mixer]") {
+	GIVEN ("a mixer running at a different rate from a source") {
+		DummyAudioSource source{"foo"};
+		auto mixer = std::make_shared<Audio::Mixer>(48000);
+
+		WHEN ("a strip is made for the source") {
+			THEN ("a ConfigError is thrown") {
+				REQUIRE_THROWS_AS(mixer->MakeStrip(source), ConfigError);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
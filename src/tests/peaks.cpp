@@ -0,0 +1,102 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the PeakPyramid and PeakMeter classes.
+ */
+
+#include "../audio/peaks.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/// Shorthand for the frames in each pair at the base of a pyramid.
+constexpr std::size_t BASE{Audio::PeakPyramid::BASE_FRAMES};
+
+SCENARIO ("PeakMeter summarises audio into peaks", "[peaks]") {
+	GIVEN ("a stereo meter") {
+		Audio::PeakMeter meter{44100, 2};
+
+		WHEN ("it is fed two and a half pairs' worth of audio, in odd pieces") {
+			// First pair: a ramp from 0 to just under 0.5 on the left.
+			// Second pair: -1 on the right, once.  Last half-pair: 0.25.
+			std::vector<float> samples(BASE * 5, 0.0f);
+			for (std::size_t i = 0; i < BASE; i++) samples[2 * i] = 0.5f * i / BASE;
+			samples[2 * (BASE + 7) + 1] = -1.0f;
+			for (std::size_t i = 2 * BASE; i < BASE * 5 / 2; i++) samples[2 * i] = samples[2 * i + 1] = 0.25f;
+
+			for (std::size_t i = 0; i < samples.size(); i += 2 * 100) {
+				meter.Add(gsl::span<const float>{samples}.subspan(i, std::min<std::size_t>(2 * 100, samples.size() - i)));
+			}
+			const auto peaks = meter.Result();
+
+			THEN ("each pair covers the range of its frames, rounded outwards") {
+				REQUIRE(peaks.Frames() == BASE * 5 / 2);
+				REQUIRE(peaks.Base() == std::vector<Audio::PeakPair>{{0, 16320}, {-32767, 0}, {8191, 8192}});
+			}
+
+			THEN ("the whole file in one peak covers everything") {
+				REQUIRE(peaks.Range(0, peaks.Frames(), 1) == std::vector<Audio::PeakPair>{{-32767, 16320}});
+			}
+
+			THEN ("peaks narrower than a pair repeat the pair they fall in") {
+				REQUIRE(peaks.Range(BASE, 2 * BASE, 4) == std::vector<Audio::PeakPair>(4, {-32767, 0}));
+			}
+
+			THEN ("peaks past the end are silent") {
+				REQUIRE(peaks.Range(2 * BASE, 4 * BASE, 2) ==
+				        std::vector<Audio::PeakPair>{{8191, 8192}, {0, 0}});
+			}
+		}
+	}
+}
+
+SCENARIO ("PeakPyramid picks coarse levels for wide peaks", "[peaks]") {
+	GIVEN ("a pyramid with a loud pair at the end of a long, quiet file") {
+		std::vector<Audio::PeakPair> base(1000, {-1, 1});
+		base.back() = {-100, 100};
+		Audio::PeakPyramid peaks{44100, BASE * 1000, base};
+
+		WHEN ("the file is divided into a few peaks") {
+			const auto range = peaks.Range(0, peaks.Frames(), 3);
+
+			THEN ("only the last covers the loud pair") {
+				REQUIRE(range == std::vector<Audio::PeakPair>{{-1, 1}, {-1, 1}, {-100, 100}});
+			}
+		}
+
+		WHEN ("it is packed and unpacked") {
+			const auto unpacked = Audio::PeakTraits::Unpack(Audio::PeakTraits::Pack(peaks));
+
+			THEN ("it is the same pyramid") {
+				REQUIRE(unpacked.has_value());
+				REQUIRE(unpacked->SampleRate() == 44100);
+				REQUIRE(unpacked->Frames() == peaks.Frames());
+				REQUIRE(unpacked->Base() == peaks.Base());
+			}
+		}
+
+		WHEN ("it is packed, and its count of pairs corrupted to wrap around") {
+			auto data = Audio::PeakTraits::Pack(peaks);
+
+			// The count follows the version, rate and frames.
+			const auto at = sizeof(std::uint32_t) * 2 + sizeof(std::uint64_t);
+			std::uint64_t count = 0;
+			std::memcpy(&count, data.data() + at, sizeof(count));
+			count += ~std::uint64_t{0} / sizeof(Audio::PeakPair) + 1;
+			std::memcpy(data.data() + at, &count, sizeof(count));
+
+			THEN ("it doesn't unpack") {
+				REQUIRE_FALSE(Audio::PeakTraits::Unpack(data).has_value());
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
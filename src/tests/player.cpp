@@ -8,14 +8,26 @@
 
 #include "../player.h"
 
+#include <chrono>
+#include <filesystem>
 #include <sstream>
+#include <thread>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include "../audio/sources/stream.h"
 #include "../errors.h"
 #include "../messages.h"
+#include "../metrics.h"
 #include "catch.hpp"
 #include "dummy_audio_sink.h"
 #include "dummy_audio_source.h"
 #include "dummy_response_sink.h"
+#include "scratch.h"
 
 using namespace std::string_literals;
 
@@ -23,11 +35,17 @@ namespace Playd::Tests
 {
 const std::map<std::string, Player::SourceFn> DUMMY_SRCS{
         {"mp3",
-         [](std::string_view path) -> std::unique_ptr<Audio::Source> {
+         [](std::string_view path, std::unique_ptr<Audio::Input>, Audio::SourceUse) -> std::unique_ptr<Audio::Source> {
 	         return std::make_unique<DummyAudioSource, std::string_view>(std::move(path));
          }},
-        {"ogg", [](std::string_view) -> std::unique_ptr<Audio::Source> { throw FileError("test failure 1"); }},
-        {"flac", [](std::string_view) -> std::unique_ptr<Audio::Source> { throw InternalError("test failure 2"); }}};
+        {"ogg",
+         [](std::string_view, std::unique_ptr<Audio::Input>, Audio::SourceUse) -> std::unique_ptr<Audio::Source> {
+	         throw FileError("test failure 1");
+         }},
+        {"flac",
+         [](std::string_view, std::unique_ptr<Audio::Input>, Audio::SourceUse) -> std::unique_ptr<Audio::Source> {
+	         throw InternalError("test failure 2");
+         }}};
 
 SCENARIO ("Player announces changes in state correctly", "[player]") {
 	GIVEN ("a fresh Player using dummy audio sources and sinks") {
@@ -53,6 +71,25 @@ SCENARIO ("Player announces changes in state correctly", "[player]") {
 	}
 }
 
+SCENARIO ("Player reports metrics on request", "[player]") {
+	GIVEN ("a fresh Player, a dummy response sink, and a metric") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+		Metrics::Global().GetGauge("test_player_stat", "A test metric.").Set(42);
+
+		WHEN ("the stats are requested") {
+			auto rs = p.Stats(0, "tag");
+
+			THEN ("the metric is sent as a STAT response, and the request succeeds") {
+				REQUIRE(os.str().find("tag STAT test_player_stat 42\n") != std::string::npos);
+				REQUIRE(rs.Pack() == "tag ACK OK success");
+			}
+		}
+	}
+}
+
 SCENARIO ("Player accurately represents whether it is running", "[player]") {
 	GIVEN ("a fresh Player using dummy audio sources and sinks") {
 		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
@@ -246,6 +283,287 @@ SCENARIO ("Player handles End requests correctly", "[player]") {
 	}
 }
 
+SCENARIO ("Player follows a file with the next one", "[player]") {
+	GIVEN ("a loaded Player with a next file") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+
+		p.Load("tag", "blah.mp3");
+
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		auto rs = p.NLoad("tag", "next.mp3");
+
+		THEN ("the next file is announced") {
+			REQUIRE(rs.Pack() == "tag ACK OK success");
+			REQUIRE(os.str() == "! NLOAD next.mp3\n");
+		}
+
+		WHEN ("the current file is played and ends") {
+			p.SetPlaying("tag", true);
+			os.str("");
+			p.End("tag");
+
+			THEN ("END is sent, and the next file takes over, playing") {
+				REQUIRE(os.str() ==
+				        "! END\n"
+				        "! PLAY\n"
+				        "! FLOAD next.mp3\n"
+				        "! POS 0\n"
+				        "! LEN 0\n");
+			}
+		}
+
+		WHEN ("the current file ends without having been played") {
+			os.str("");
+			p.End("tag");
+
+			THEN ("the next file takes over, stopped") {
+				REQUIRE(os.str() ==
+				        "! END\n"
+				        "! STOP\n"
+				        "! FLOAD next.mp3\n"
+				        "! POS 0\n"
+				        "! LEN 0\n");
+			}
+		}
+
+		WHEN ("the current file is ejected") {
+			p.Eject("tag");
+			os.str("");
+			p.Dump(0, "tag");
+
+			THEN ("the next file goes too") {
+				REQUIRE(os.str() == "tag EJECT\n");
+			}
+		}
+	}
+
+	GIVEN ("an empty Player") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		WHEN ("a next file is loaded") {
+			p.NLoad("tag", "next.mp3");
+
+			THEN ("it is loaded as the current file") {
+				REQUIRE(os.str() == "! STOP\n! FLOAD next.mp3\n! POS 0\n! LEN 0\n");
+			}
+		}
+	}
+}
+
+SCENARIO ("Player sets crossfades", "[player]") {
+	GIVEN ("a Player") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		WHEN ("an equal-power crossfade is set") {
+			auto rs = p.Crossfade("tag", "2000000", "power");
+
+			THEN ("it is announced, and dumped afterwards") {
+				REQUIRE(rs.Pack() == "tag ACK OK success");
+				REQUIRE(os.str() == "! XFADE 2000000 power\n");
+				os.str("");
+				p.Dump(0, "tag");
+				REQUIRE(os.str() == "tag EJECT\ntag XFADE 2000000 power\n");
+			}
+		}
+
+		WHEN ("a crossfade with an unknown curve is set") {
+			auto rs = p.Crossfade("tag", "2000000", "wobbly");
+
+			THEN ("the request is invalid") {
+				REQUIRE(rs.Pack() == "tag ACK WHAT '"s + std::string{MSG_XFADE_BAD_CURVE} + "'");
+			}
+		}
+
+		WHEN ("a crossfade with a bad length is set") {
+			auto rs = p.Crossfade("tag", "-1", "linear");
+
+			THEN ("the request is invalid") {
+				REQUIRE(rs.Pack() == "tag ACK WHAT '"s + std::string{MSG_SEEK_INVALID_VALUE} + "'");
+			}
+		}
+	}
+}
+
+SCENARIO ("Player sets its gain", "[player]") {
+	GIVEN ("a loaded Player") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+		p.Load("tag", "blah.mp3");
+
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		WHEN ("a valid gain is set") {
+			auto rs = p.Gain("tag", "-6.5");
+
+			THEN ("it is announced, and dumped afterwards") {
+				REQUIRE(rs.Pack() == "tag ACK OK success");
+				REQUIRE(os.str() == "! GAIN -6.5\n");
+				os.str("");
+				p.Dump(0, "tag");
+				REQUIRE(os.str().find("tag GAIN -6.5\n") != std::string::npos);
+			}
+		}
+
+		WHEN ("invalid gains are set") {
+			for (const auto *gain : {"25", "-97", "loud", "3dB", "nan", ""}) {
+				auto rs = p.Gain("tag", gain);
+
+				THEN ("the request is invalid, and nothing is announced") {
+					REQUIRE(rs.Pack() == "tag ACK WHAT '"s + std::string{MSG_GAIN_INVALID_VALUE} + "'");
+					REQUIRE(os.str().empty());
+				}
+			}
+		}
+	}
+}
+
+SCENARIO ("Player sets its metering interval", "[player]") {
+	GIVEN ("a loaded Player") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+		p.Load("tag", "blah.mp3");
+
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		WHEN ("a valid interval is set") {
+			auto rs = p.Meter("tag", "50000");
+
+			THEN ("it is announced, and dumped afterwards") {
+				REQUIRE(rs.Pack() == "tag ACK OK success");
+				REQUIRE(os.str() == "! METER 50000\n");
+				os.str("");
+				p.Dump(0, "tag");
+				REQUIRE(os.str().find("tag METER 50000\n") != std::string::npos);
+			}
+
+			AND_WHEN ("metering is turned off") {
+				os.str("");
+				p.Meter("tag", "0");
+
+				THEN ("it is no longer dumped") {
+					os.str("");
+					p.Dump(0, "tag");
+					REQUIRE(os.str().find("METER") == std::string::npos);
+				}
+			}
+		}
+
+		WHEN ("invalid intervals are set") {
+			for (const auto *interval : {"9999", "-1", "often", ""}) {
+				auto rs = p.Meter("tag", interval);
+
+				THEN ("the request is invalid, and nothing is announced") {
+					REQUIRE(rs.Pack() == "tag ACK WHAT '"s + std::string{MSG_METER_INVALID_INTERVAL} + "'");
+					REQUIRE(os.str().empty());
+				}
+			}
+		}
+	}
+}
+
+/// A DummyAudioSink that has had one underrun, of 441 frames, a second in.
+class UnderrunSink : public DummyAudioSink
+{
+public:
+	using DummyAudioSink::DummyAudioSink;
+
+	std::optional<Audio::Underrun> TakeUnderrun() override
+	{
+		if (this->taken) return std::nullopt;
+		this->taken = true;
+		return Audio::Underrun{44100, 441, std::chrono::steady_clock::now()};
+	}
+
+	/// Whether the underrun has been taken.
+	bool taken = false;
+};
+
+SCENARIO ("Player broadcasts its sink's underruns", "[player]") {
+	GIVEN ("a Player whose sink has underrun") {
+		Player p(0, &std::make_unique<UnderrunSink, const Audio::Source &, int>, DUMMY_SRCS);
+		p.Load("tag", "blah.mp3");
+
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		WHEN ("the player updates") {
+			p.Update();
+			p.Update();
+
+			THEN ("the underrun is broadcast once, in microseconds, with the loop's gap") {
+				const auto out = os.str();
+				REQUIRE(out.rfind("! XRUN 1000000 10000 ", 0) == 0);
+				REQUIRE(out.find("XRUN", 3) == std::string::npos);
+			}
+		}
+	}
+}
+
+SCENARIO ("Player checks peaks requests", "[player]") {
+	GIVEN ("a Player with nothing loaded") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+
+		WHEN ("peaks are asked for") {
+			auto rs = p.Peaks(0, "tag", false, "0", "1000000", "100");
+
+			THEN ("the request is invalid") {
+				REQUIRE(rs.Pack() == "tag ACK WHAT '"s + std::string{MSG_CMD_NEEDS_LOADED} + "'");
+			}
+		}
+	}
+
+	GIVEN ("a loaded Player") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+		p.Load("tag", "blah.mp3");
+
+		WHEN ("peaks are asked for over a backwards range") {
+			auto rs = p.Peaks(0, "tag", false, "1000000", "0", "100");
+
+			THEN ("the request is invalid") {
+				REQUIRE(rs.Pack() == "tag ACK WHAT '"s + std::string{MSG_PEAKS_INVALID_RANGE} + "'");
+			}
+		}
+
+		WHEN ("too many peaks are asked for") {
+			auto rs = p.Peaks(0, "tag", false, "0", "1000000", "16385");
+
+			THEN ("the request is invalid") {
+				REQUIRE(rs.Pack() == "tag ACK WHAT '"s + std::string{MSG_PEAKS_INVALID_COUNT} + "'");
+			}
+		}
+
+		WHEN ("peaks are asked for from a next file that isn't there") {
+			auto rs = p.Peaks(0, "tag", true, "0", "1000000", "100");
+
+			THEN ("the request is invalid") {
+				REQUIRE(rs.Pack() == "tag ACK WHAT '"s + std::string{MSG_PEAKS_NO_NEXT} + "'");
+			}
+		}
+
+		WHEN ("peaks are asked for from a file that can't be analysed") {
+			auto rs = p.Peaks(0, "tag", false, "0", "1000000", "100");
+
+			THEN ("the request fails") {
+				REQUIRE(rs.Pack() == "tag ACK FAIL '"s + std::string{MSG_PEAKS_NOT_READY} + "'");
+			}
+		}
+	}
+}
+
 SCENARIO ("Player refuses commands when quitting", "[player]") {
 	GIVEN ("a loaded Player") {
 		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
@@ -345,4 +663,67 @@ SCENARIO ("Player handles load errors properly", "[seek]") {
 	}
 }
 
+#ifndef _WIN32
+SCENARIO ("Player loads streams without waiting for them to start", "[player][stream]") {
+	GIVEN ("a Player that can play streams, and a named pipe") {
+		const std::map<std::string, Player::SourceFn> srcs{{"stream", Audio::StreamSource::MakeUnique}};
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, srcs);
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		auto path = ScratchPath("player.fifo");
+		REQUIRE(mkfifo(path.c_str(), 0600) == 0);
+
+		WHEN ("the pipe is loaded, and no writer ever appears") {
+			const auto start = std::chrono::steady_clock::now();
+			auto rs = p.Load("tag", path);
+
+			THEN ("the load returns at once, but announces nothing yet") {
+				REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds{1});
+				REQUIRE(rs.Pack() == "tag ACK OK success");
+				REQUIRE(p.Update());
+				REQUIRE(os.str().empty());
+			}
+
+			THEN ("the stream can't be played yet") {
+				REQUIRE_FALSE(p.SetPlaying("tag", true).Pack() == "tag ACK OK success");
+			}
+
+			THEN ("ejecting drops the stream promptly") {
+				p.Eject("tag");
+				REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds{1});
+				REQUIRE(p.Update());
+				REQUIRE(os.str().empty());
+			}
+		}
+
+		WHEN ("the pipe is loaded, and a writer then starts the stream") {
+			REQUIRE(p.Load("tag", path).Pack() == "tag ACK OK success");
+
+			// Anything without a WAV header is raw CD audio.
+			std::thread writer{[&] {
+				const std::string audio(64, '\x12');
+				const auto fd = open(path.c_str(), O_WRONLY);
+				[[maybe_unused]] auto written = write(fd, audio.data(), audio.size());
+				close(fd);
+			}};
+			writer.join();
+
+			THEN ("a later update announces the load") {
+				for (int i = 0; i < 3000 && os.str().empty(); i++) {
+					REQUIRE(p.Update());
+					std::this_thread::sleep_for(std::chrono::milliseconds{1});
+				}
+				REQUIRE(os.str().find("! FLOAD " + path + "\n") != std::string::npos);
+			}
+		}
+
+		// Stop any reader before its pipe goes.
+		p.Eject("tag");
+		std::filesystem::remove(path);
+	}
+}
+#endif // _WIN32
+
 } // namespace Playd::Tests
@@ -0,0 +1,102 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the PrefetchInput class.
+ */
+
+#include "../audio/prefetch.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../errors.h"
+#include "../metrics.h"
+#include "catch.hpp"
+#include "scratch.h"
+
+namespace Playd::Tests
+{
+/// Waits, for up to a second, for a PrefetchInput to buffer some bytes.
+static bool WaitForBuffered(const Audio::PrefetchInput &input, std::uint64_t bytes)
+{
+	for (int i = 0; i < 1000 && input.Buffered() < bytes; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds{1});
+	}
+	return bytes <= input.Buffered();
+}
+
+SCENARIO ("PrefetchInputs read ahead within their window", "[prefetch]") {
+	GIVEN ("a PrefetchInput with a window smaller than its file") {
+		const std::size_t size = Audio::PrefetchInput::CHUNK_SIZE * 8;
+		const std::uint64_t window = Audio::PrefetchInput::CHUNK_SIZE * 2;
+		auto path = ScratchFile("prefetch.bin", size);
+		auto window_size = std::make_shared<std::atomic<std::uint64_t>>(window);
+		Audio::PrefetchInput input{Audio::Input::Open(path), window_size};
+
+		THEN ("it fills the window, and no more, without being read") {
+			REQUIRE(WaitForBuffered(input, window));
+			std::this_thread::sleep_for(std::chrono::milliseconds{20});
+			REQUIRE(input.Buffered() < window + Audio::PrefetchInput::CHUNK_SIZE);
+		}
+
+		THEN ("its buffer shows up in the prefetch metric") {
+			REQUIRE(WaitForBuffered(input, window));
+			auto &gauge = Metrics::Global().GetGauge("playd_prefetch_buffered_bytes", "");
+			REQUIRE(static_cast<std::uint64_t>(gauge.Value()) >= input.Buffered());
+		}
+
+		WHEN ("the whole file is read in odd-sized pieces") {
+			std::vector<std::byte> all;
+			std::vector<std::byte> buf(12345);
+			for (std::size_t n = 0; (n = input.Read(buf)) != 0;) all.insert(all.end(), buf.begin(), buf.begin() + n);
+
+			THEN ("every byte is read, correctly") {
+				REQUIRE(all.size() == size);
+				REQUIRE(MatchesPattern(all, 0));
+			}
+		}
+
+		WHEN ("we seek outside the window and read") {
+			const auto target = size - 1000;
+			REQUIRE(input.Seek(target, SEEK_SET) == target);
+			std::vector<std::byte> buf(2000);
+			auto nread = input.Read(buf);
+
+			THEN ("the data at the new position is read, up to the end") {
+				REQUIRE(nread == 1000);
+				REQUIRE(MatchesPattern(gsl::make_span(buf.data(), nread), target));
+				REQUIRE(input.Tell() == size);
+			}
+		}
+
+		WHEN ("we seek back into the head") {
+			std::vector<std::byte> buf(Audio::PrefetchInput::CHUNK_SIZE * 3);
+			input.Read(buf);
+			input.Seek(10, SEEK_SET);
+			std::vector<std::byte> again(100);
+			auto nread = input.Read(again);
+
+			THEN ("the earlier data is read again") {
+				REQUIRE(nread == 100);
+				REQUIRE(MatchesPattern(again, 10));
+			}
+		}
+
+		WHEN ("the window is enlarged") {
+			REQUIRE(WaitForBuffered(input, window));
+			window_size->store(size);
+			std::vector<std::byte> buf(1);
+			input.Read(buf);
+
+			THEN ("it reads ahead to the end of the file") {
+				REQUIRE(WaitForBuffered(input, size - 1));
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
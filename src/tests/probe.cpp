@@ -0,0 +1,101 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for audio format sniffing.
+ */
+
+#include "../audio/probe.h"
+
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+using namespace std::string_view_literals;
+
+/// Makes a byte vector from some text followed by some raw bytes.
+static std::vector<std::byte> Bytes(std::string_view text, std::initializer_list<int> raw = {})
+{
+	std::vector<std::byte> out;
+	for (const auto c : text) out.push_back(static_cast<std::byte>(c));
+	for (const auto b : raw) out.push_back(static_cast<std::byte>(b));
+	return out;
+}
+
+SCENARIO ("SniffFormat recognises container magic numbers", "[probe]") {
+	GIVEN ("the heads of various container formats") {
+		THEN ("each is recognised") {
+			REQUIRE(Audio::SniffFormat(Bytes("RIFF\x24\x00\x00\x00" "WAVEfmt "sv)) == "wav");
+			REQUIRE(Audio::SniffFormat(Bytes("RF64\xFF\xFF\xFF\xFF" "WAVEds64"sv)) == "wav");
+			REQUIRE(Audio::SniffFormat(Bytes("fLaC\x00\x00\x00\x22"sv)) == "flac");
+			REQUIRE(Audio::SniffFormat(Bytes("OggS\x00\x02"sv)) == "ogg");
+			REQUIRE(Audio::SniffFormat(Bytes("FORM\x00\x00\x00\x00" "AIFFCOMM"sv)) == "aiff");
+			REQUIRE(Audio::SniffFormat(Bytes("FORM\x00\x00\x00\x00" "AIFCFVER"sv)) == "aiff");
+		}
+	}
+
+	GIVEN ("a RIFF file that isn't WAVE") {
+		THEN ("it isn't recognised") {
+			REQUIRE(Audio::SniffFormat(Bytes("RIFF\x24\x00\x00\x00" "AVI LIST"sv)).empty());
+		}
+	}
+
+	GIVEN ("an empty or truncated head") {
+		THEN ("it isn't recognised") {
+			REQUIRE(Audio::SniffFormat({}).empty());
+			REQUIRE(Audio::SniffFormat(Bytes("fLa")).empty());
+			REQUIRE(Audio::SniffFormat(Bytes("RIFF")).empty());
+		}
+	}
+}
+
+SCENARIO ("SniffFormat recognises MPEG audio", "[probe]") {
+	GIVEN ("an MPEG-1 layer III frame header") {
+		auto head = Bytes("", {0xFF, 0xFB, 0x90, 0x64});
+
+		THEN ("it is recognised as MP3") {
+			REQUIRE(Audio::SniffFormat(head) == "mp3");
+		}
+	}
+
+	GIVEN ("an ADTS (AAC) frame header, which shares the sync word") {
+		auto head = Bytes("", {0xFF, 0xF1, 0x50, 0x80});
+
+		THEN ("it isn't recognised") {
+			REQUIRE(Audio::SniffFormat(head).empty());
+		}
+	}
+
+	GIVEN ("an ID3v2 tag followed by an MPEG frame") {
+		auto head = Bytes("ID3", {0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0xFF, 0xFB, 0x90, 0x64});
+
+		THEN ("it is recognised as MP3") {
+			REQUIRE(Audio::SniffFormat(head) == "mp3");
+		}
+	}
+
+	GIVEN ("an ID3v2 tag followed by a FLAC stream") {
+		auto head = Bytes("ID3", {0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00});
+		auto flac = Bytes("fLaC");
+		head.insert(head.end(), flac.begin(), flac.end());
+
+		THEN ("it is recognised as FLAC") {
+			REQUIRE(Audio::SniffFormat(head) == "flac");
+		}
+	}
+
+	GIVEN ("an ID3v2 tag larger than the head") {
+		auto head = Bytes("ID3", {0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00});
+
+		THEN ("it is assumed to be MP3") {
+			REQUIRE(Audio::SniffFormat(head) == "mp3");
+		}
+	}
+}
+
+} // namespace Playd::Tests
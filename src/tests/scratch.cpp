@@ -0,0 +1,88 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Scratch files and directories for tests.
+ * @see tests/scratch.h
+ */
+
+#include "scratch.h"
+
+#include <fstream>
+#include <random>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif // _WIN32
+
+namespace Playd::Tests
+{
+/// A scratch directory that removes itself when the run exits.
+struct ScratchRun {
+	std::filesystem::path dir; ///< The directory.
+
+	ScratchRun()
+	{
+#ifdef _WIN32
+		const auto pid = _getpid();
+#else
+		const auto pid = getpid();
+#endif // _WIN32
+
+		// The process ID alone would do, but for leftovers from a
+		// crashed run that had the same one.
+		const auto salt = std::random_device{}();
+		this->dir = std::filesystem::temp_directory_path() /
+		            ("playd-tests-" + std::to_string(pid) + "-" + std::to_string(salt));
+		std::filesystem::create_directories(this->dir);
+	}
+
+	~ScratchRun()
+	{
+		std::error_code ec;
+		std::filesystem::remove_all(this->dir, ec);
+	}
+};
+
+std::filesystem::path ScratchRoot()
+{
+	static ScratchRun run;
+	return run.dir;
+}
+
+std::filesystem::path ScratchDir(std::string_view name)
+{
+	auto dir = ScratchRoot() / std::string{name};
+	std::filesystem::remove_all(dir);
+	std::filesystem::create_directories(dir);
+	return dir;
+}
+
+std::string ScratchPath(std::string_view name)
+{
+	auto path = (ScratchRoot() / std::string{name}).string();
+	std::filesystem::remove(path);
+	return path;
+}
+
+std::string ScratchFile(std::string_view name, std::size_t size)
+{
+	auto path = ScratchPath(name);
+
+	std::ofstream out{path, std::ios::binary | std::ios::trunc};
+	for (std::size_t i = 0; i < size; i++) out.put(static_cast<char>(i % 251));
+	return path;
+}
+
+bool MatchesPattern(gsl::span<const std::byte> bytes, std::size_t offset)
+{
+	for (std::size_t i = 0; i < static_cast<std::size_t>(bytes.size()); i++) {
+		if (std::to_integer<std::size_t>(bytes[i]) != (offset + i) % 251) return false;
+	}
+	return true;
+}
+
+} // namespace Playd::Tests
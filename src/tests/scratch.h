@@ -0,0 +1,64 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Scratch files and directories for tests.
+ * @see tests/scratch.cpp
+ */
+
+#ifndef PLAYD_TESTS_SCRATCH_H
+#define PLAYD_TESTS_SCRATCH_H
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#undef max
+#include <gsl/gsl>
+
+namespace Playd::Tests
+{
+/**
+ * Gets this test run's scratch directory.
+ * Each run gets its own, so that runs in parallel don't clobber each
+ * other's files; it is made on first use, and removed when the run exits.
+ * @return The directory.
+ */
+std::filesystem::path ScratchRoot();
+
+/**
+ * Makes an empty scratch directory, removing anything already in it.
+ * @param name The name of the directory.
+ * @return The directory.
+ */
+std::filesystem::path ScratchDir(std::string_view name);
+
+/**
+ * Makes a path for a scratch file, removing any old one.
+ * @param name The name of the file.
+ * @return The path.
+ */
+std::string ScratchPath(std::string_view name);
+
+/**
+ * Writes a scratch file of the given size, whose byte at each offset is that
+ * offset modulo 251 (a prime, so the pattern doesn't line up with the head).
+ * @param name The name of the file.
+ * @param size The size of the file, in bytes.
+ * @return The path of the file.
+ */
+std::string ScratchFile(std::string_view name, std::size_t size);
+
+/**
+ * Checks that bytes follow the ScratchFile pattern.
+ * @param bytes The bytes.
+ * @param offset The offset in the file of the first byte.
+ * @return Whether the bytes match.
+ */
+bool MatchesPattern(gsl::span<const std::byte> bytes, std::size_t offset);
+
+} // namespace Playd::Tests
+
+#endif // PLAYD_TESTS_SCRATCH_H
@@ -0,0 +1,69 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the SilenceMeter class and cue points.
+ */
+
+#include "../audio/silence.h"
+
+#include <chrono>
+#include <vector>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("SilenceMeter finds where the sound starts and stops", "[silence]") {
+	GIVEN ("a stereo meter") {
+		Audio::SilenceMeter meter{1000, 2};
+
+		WHEN ("it is fed quiet noise, sound in one channel, and quiet noise again, in odd pieces") {
+			// Frames 0-299 and 700-999 stay below -60dBFS; only the right
+			// channel of frames 300 and 699 goes over it.
+			std::vector<float> samples(2 * 1000, 0.0005f);
+			samples[2 * 300 + 1] = -0.5f;
+			samples[2 * 699 + 1] = 0.002f;
+
+			const gsl::span<const float> all{samples};
+			for (std::size_t i = 0; i < samples.size(); i += 2 * 77) {
+				meter.Add(all.subspan(i, std::min<std::size_t>(2 * 77, samples.size() - i)));
+			}
+			const auto cues = meter.Result();
+
+			THEN ("the cue-in is the first loud frame, and the cue-out the frame after the last") {
+				REQUIRE_FALSE(cues.Silent());
+				REQUIRE(cues.in == 300);
+				REQUIRE(cues.out == 700);
+			}
+
+			THEN ("the cues convert to positions") {
+				REQUIRE(cues.In() == std::chrono::milliseconds{300});
+				REQUIRE(cues.Out() == std::chrono::milliseconds{700});
+			}
+
+			AND_WHEN ("the cues are packed and unpacked") {
+				const auto unpacked = Audio::SilenceTraits::Unpack(Audio::SilenceTraits::Pack(cues));
+
+				THEN ("they are the same cues") {
+					REQUIRE(unpacked.has_value());
+					REQUIRE(unpacked->rate == 1000);
+					REQUIRE(unpacked->in == 300);
+					REQUIRE(unpacked->out == 700);
+				}
+			}
+		}
+
+		WHEN ("it is fed nothing but silence") {
+			std::vector<float> samples(2 * 1000, 0.0f);
+			meter.Add(samples);
+
+			THEN ("the audio is silent throughout") {
+				REQUIRE(meter.Result().Silent());
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,241 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the StreamSource class.
+ */
+
+#ifndef _WIN32
+
+#include "../audio/sources/stream.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../errors.h"
+#include "catch.hpp"
+#include "scratch.h"
+
+namespace Playd::Tests
+{
+/// Appends a little-endian integer of N bytes to a byte vector.
+template <std::size_t N>
+static void AppendLE(std::vector<std::byte> &out, std::uint32_t value)
+{
+	for (std::size_t i = 0; i < N; i++) out.push_back(static_cast<std::byte>((value >> (8 * i)) & 0xFF));
+}
+
+/// Appends ASCII text to a byte vector.
+static void AppendText(std::vector<std::byte> &out, std::string_view text)
+{
+	for (const auto c : text) out.push_back(static_cast<std::byte>(c));
+}
+
+/// Makes a streaming WAV header (with unknown sizes) for the given format.
+static std::vector<std::byte> WavHeader(std::uint16_t tag, std::uint16_t channels, std::uint32_t rate,
+                                        std::uint16_t bits)
+{
+	std::vector<std::byte> out;
+	AppendText(out, "RIFF");
+	AppendLE<4>(out, 0xFFFFFFFF);
+	AppendText(out, "WAVE");
+	AppendText(out, "LIST");
+	AppendLE<4>(out, 3);
+	AppendText(out, "abc");
+	out.push_back(std::byte{0}); // padding
+	AppendText(out, "fmt ");
+	AppendLE<4>(out, 16);
+	AppendLE<2>(out, tag);
+	AppendLE<2>(out, channels);
+	AppendLE<4>(out, rate);
+	AppendLE<4>(out, rate * channels * bits / 8);
+	AppendLE<2>(out, channels * bits / 8);
+	AppendLE<2>(out, bits);
+	AppendText(out, "data");
+	AppendLE<4>(out, 0xFFFFFFFF);
+	return out;
+}
+
+/**
+ * Polls a stream until it is ready, giving up after a few seconds.
+ * @param source The stream to poll.
+ * @return Whether the stream became ready in time.
+ */
+static bool AwaitReady(const Audio::StreamSource &source)
+{
+	for (int i = 0; i < 3000; i++) {
+		if (source.IsReady()) return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds{1});
+	}
+	return false;
+}
+
+SCENARIO ("StreamSource works out stream formats from headers", "[stream]") {
+	std::size_t header_size = 99;
+
+	GIVEN ("a streaming WAV header for 48kHz mono float") {
+		auto head = WavHeader(3, 1, 48000, 32);
+
+		THEN ("the format and header size are read from it") {
+			auto format = Audio::StreamSource::ParseHeader(head, false, header_size);
+			REQUIRE(format.has_value());
+			REQUIRE(format->channels == 1);
+			REQUIRE(format->rate == 48000);
+			REQUIRE(format->format == Audio::SampleFormat::FLOAT32);
+			REQUIRE(header_size == head.size());
+		}
+
+		THEN ("a truncated copy of it needs more data") {
+			auto truncated = gsl::make_span(head).first(head.size() - 1);
+			REQUIRE_FALSE(Audio::StreamSource::ParseHeader(truncated, false, header_size).has_value());
+		}
+
+		THEN ("a truncated copy at the end of the stream is an error") {
+			auto truncated = gsl::make_span(head).first(head.size() - 1);
+			REQUIRE_THROWS_AS(Audio::StreamSource::ParseHeader(truncated, true, header_size), FileError);
+		}
+	}
+
+	GIVEN ("a WAV header with an unsupported sample format") {
+		auto head = WavHeader(1, 2, 44100, 24);
+
+		THEN ("parsing it throws FileError") {
+			REQUIRE_THROWS_AS(Audio::StreamSource::ParseHeader(head, false, header_size), FileError);
+		}
+	}
+
+	GIVEN ("the start of a raw PCM stream") {
+		std::vector<std::byte> head(100, std::byte{0x12});
+
+		THEN ("it is raw CD audio, with no header") {
+			auto format = Audio::StreamSource::ParseHeader(head, false, header_size);
+			REQUIRE(format.has_value());
+			REQUIRE(format->channels == 2);
+			REQUIRE(format->rate == 44100);
+			REQUIRE(format->format == Audio::SampleFormat::SINT16);
+			REQUIRE(header_size == 0);
+		}
+	}
+
+	GIVEN ("an empty stream") {
+		THEN ("more data is needed until it ends, when it is an error") {
+			REQUIRE_FALSE(Audio::StreamSource::ParseHeader({}, false, header_size).has_value());
+			REQUIRE_THROWS_AS(Audio::StreamSource::ParseHeader({}, true, header_size), FileError);
+		}
+	}
+}
+
+SCENARIO ("StreamSource plays audio from named pipes", "[stream]") {
+	GIVEN ("a named pipe") {
+		auto path = ScratchPath("stream.fifo");
+		REQUIRE(mkfifo(path.c_str(), 0600) == 0);
+
+		WHEN ("a writer sends a WAV header and some audio, then closes the pipe") {
+			// A bit more than the prebuffer, in 16-bit stereo at 8kHz.
+			const std::size_t samples = 2000;
+			std::thread writer{[&] {
+				auto data = WavHeader(1, 2, 8000, 16);
+				for (std::size_t i = 0; i < samples * 4; i++) data.push_back(static_cast<std::byte>(i % 256));
+
+				const auto fd = open(path.c_str(), O_WRONLY);
+				[[maybe_unused]] auto written = write(fd, data.data(), data.size());
+				close(fd);
+			}};
+			Audio::StreamSource source{path, nullptr};
+			writer.join();
+			REQUIRE(AwaitReady(source));
+
+			THEN ("the source is live, with the format from the header") {
+				REQUIRE(source.IsLive());
+				REQUIRE(source.Length() == 0);
+				REQUIRE(source.ChannelCount() == 2);
+				REQUIRE(source.SampleRate() == 8000);
+				REQUIRE(source.OutputSampleFormat() == Audio::SampleFormat::SINT16);
+			}
+
+			THEN ("all of the audio decodes, and then the stream ends") {
+				std::vector<std::byte> decoded;
+				for (int i = 0; i < 1000; i++) {
+					auto [state, bytes] = source.Decode();
+					decoded.insert(decoded.end(), bytes.begin(), bytes.end());
+					if (state == Audio::Source::DecodeState::END_OF_FILE) break;
+					std::this_thread::sleep_for(std::chrono::milliseconds{1});
+				}
+				std::vector<std::byte> expected(samples * 4);
+				for (std::size_t i = 0; i < expected.size(); i++) expected[i] = static_cast<std::byte>(i % 256);
+				REQUIRE(decoded == expected);
+			}
+
+			THEN ("seeking throws SeekError") {
+				REQUIRE_THROWS_AS(source.Seek(0), SeekError);
+			}
+		}
+
+		WHEN ("a writer sends a header the source can't play") {
+			std::thread writer{[&] {
+				auto data = WavHeader(1, 2, 44100, 24);
+				const auto fd = open(path.c_str(), O_WRONLY);
+				[[maybe_unused]] auto written = write(fd, data.data(), data.size());
+				close(fd);
+			}};
+			Audio::StreamSource source{path, nullptr};
+			writer.join();
+
+			THEN ("the source eventually reports that it won't ever be ready") {
+				REQUIRE_THROWS_AS(AwaitReady(source), FileError);
+			}
+		}
+
+		WHEN ("no writer ever appears") {
+			const auto start = std::chrono::steady_clock::now();
+			auto source = std::make_unique<Audio::StreamSource>(path, nullptr);
+
+			THEN ("the source is built at once, but isn't ready, and decodes nothing") {
+				REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds{1});
+				REQUIRE_FALSE(source->IsReady());
+				auto [state, bytes] = source->Decode();
+				REQUIRE(state == Audio::Source::DecodeState::DECODING);
+				REQUIRE(bytes.empty());
+			}
+
+			THEN ("it can be destroyed promptly") {
+				source.reset();
+				REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds{1});
+			}
+		}
+
+		WHEN ("a writer sends a header, then stalls") {
+			const auto writer = std::make_shared<int>(-1);
+			std::thread opener{[&] {
+				*writer = open(path.c_str(), O_WRONLY);
+				auto data = WavHeader(1, 1, 8000, 16);
+				[[maybe_unused]] auto written = write(*writer, data.data(), data.size());
+			}};
+
+			THEN ("the source waits to prebuffer, and can be destroyed promptly") {
+				{
+					Audio::StreamSource source{path, nullptr};
+					auto [state, bytes] = source.Decode();
+					REQUIRE(state == Audio::Source::DecodeState::DECODING);
+					REQUIRE(bytes.empty());
+				}
+				opener.join();
+				close(*writer);
+			}
+		}
+
+		std::filesystem::remove(path);
+	}
+}
+
+} // namespace Playd::Tests
+
+#endif // _WIN32
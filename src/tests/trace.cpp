@@ -0,0 +1,192 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Tracer class.
+ */
+
+#include "../trace.h"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+#include "scratch.h"
+
+namespace Playd::Tests
+{
+SCENARIO ("Tracers record each thread's events", "[trace]") {
+	GIVEN ("a tracer that hasn't been enabled") {
+		Tracer tracer;
+
+		WHEN ("events are recorded") {
+			tracer.NameThread("test");
+			tracer.Mark(TraceEvent::UNDERRUN, 1);
+
+			THEN ("nothing is kept") {
+				REQUIRE_FALSE(tracer.IsEnabled());
+				REQUIRE(tracer.Snapshot().empty());
+				REQUIRE_FALSE(tracer.Dump());
+			}
+		}
+	}
+
+	GIVEN ("an enabled tracer, with no dump path") {
+		Tracer tracer;
+		tracer.Enable();
+		const auto start = Tracer::Clock::now();
+
+		WHEN ("two threads record events") {
+			tracer.NameThread("main");
+			tracer.Record(TraceEvent::DECODE, start, start + std::chrono::nanoseconds(1500), 4096);
+			tracer.Mark(TraceEvent::UNDERRUN, UINT64_C(1) << 30);
+			std::thread{[&] {
+				tracer.Record(TraceEvent::CALLBACK, start, start + std::chrono::microseconds(20), 512);
+			}}.join();
+			auto threads = tracer.Snapshot();
+
+			THEN ("each thread's events come out under that thread, in order") {
+				REQUIRE(threads.size() == 2);
+
+				REQUIRE(threads[0].name == "main");
+				REQUIRE(threads[0].records.size() == 2);
+				REQUIRE(threads[0].records[0].event == TraceEvent::DECODE);
+				REQUIRE(threads[0].records[0].duration == 1500);
+				REQUIRE(threads[0].records[0].arg == 4096);
+				REQUIRE(threads[0].records[1].event == TraceEvent::UNDERRUN);
+				REQUIRE(threads[0].records[1].duration == 0);
+				REQUIRE(threads[0].records[0].start <= threads[0].records[1].start);
+
+				REQUIRE(threads[1].name.empty());
+				REQUIRE(threads[1].id != threads[0].id);
+				REQUIRE(threads[1].records.size() == 1);
+				REQUIRE(threads[1].records[0].event == TraceEvent::CALLBACK);
+				REQUIRE(threads[1].records[0].duration == 20000);
+			}
+
+			THEN ("arguments too big to keep are capped") {
+				REQUIRE(threads[0].records[1].arg == Tracer::MAX_ARG);
+			}
+
+			THEN ("there is nowhere to dump them") {
+				REQUIRE_FALSE(tracer.Dump());
+			}
+		}
+
+		WHEN ("a thread records more events than its ring holds") {
+			const std::uint64_t extra = 10;
+			for (std::uint64_t i = 0; i < Tracer::CAPACITY + extra; i++) tracer.Mark(TraceEvent::WRITE, i);
+			auto threads = tracer.Snapshot();
+
+			THEN ("only the newest events are kept") {
+				REQUIRE(threads.size() == 1);
+				REQUIRE(threads[0].records.size() == Tracer::CAPACITY);
+				REQUIRE(threads[0].records.front().arg == extra);
+				REQUIRE(threads[0].records.back().arg == Tracer::CAPACITY + extra - 1);
+			}
+		}
+
+		WHEN ("a thread records events and exits, then another starts") {
+			std::thread{[&] {
+				tracer.NameThread("old");
+				tracer.Mark(TraceEvent::COMMAND, 1);
+			}}.join();
+			auto before = tracer.Snapshot();
+			std::thread{[&] {
+				tracer.NameThread("new");
+				tracer.Mark(TraceEvent::COMMAND, 2);
+			}}.join();
+			auto after = tracer.Snapshot();
+
+			THEN ("the first thread's events outlive it") {
+				REQUIRE(before.size() == 1);
+				REQUIRE(before[0].name == "old");
+			}
+
+			THEN ("the second thread takes over its ring, afresh") {
+				REQUIRE(after.size() == 1);
+				REQUIRE(after[0].name == "new");
+				REQUIRE(after[0].id != before[0].id);
+				REQUIRE(after[0].records.size() == 1);
+				REQUIRE(after[0].records[0].arg == 2);
+			}
+		}
+	}
+}
+
+SCENARIO ("Tracers write Chrome traces", "[trace]") {
+	GIVEN ("a named thread with a span and an instant, and an unnamed thread") {
+		std::vector<TraceThread> threads{
+		        {1, "loop", {{1234567, 2000, TraceEvent::DECODE, 4096}, {5000000, 0, TraceEvent::UNDERRUN, 12}}},
+		        {2, "", {{42, 999, TraceEvent::UPDATE, 0}}},
+		};
+
+		WHEN ("they are written as JSON") {
+			std::ostringstream os;
+			Tracer::WriteJson(os, threads);
+			const auto json = os.str();
+
+			THEN ("each thread gets a name") {
+				REQUIRE(json.find(R"({"name":"thread_name","ph":"M","pid":1,"tid":1,"args":{"name":"loop"}})") !=
+				        std::string::npos);
+				REQUIRE(json.find(R"("tid":2,"args":{"name":"thread 2"})") != std::string::npos);
+			}
+
+			THEN ("spans are complete events, in microseconds, with their arguments") {
+				REQUIRE(json.find(R"({"name":"decode","ph":"X","pid":1,"tid":1,"ts":1234.567,"dur":2.000,)"
+				                  R"("args":{"bytes":4096}})") != std::string::npos);
+				REQUIRE(json.find(R"({"name":"update","ph":"X","pid":1,"tid":2,"ts":0.042,"dur":0.999})") !=
+				        std::string::npos);
+			}
+
+			THEN ("instants are thread-scoped instant events") {
+				REQUIRE(json.find(R"({"name":"underrun","ph":"i","pid":1,"tid":1,"ts":5000.000,"s":"t",)"
+				                  R"("args":{"frames":12}})") != std::string::npos);
+			}
+
+			THEN ("the whole is one JSON object") {
+				REQUIRE(json.rfind(R"({"displayTimeUnit":"ms","traceEvents":[)", 0) == 0);
+				REQUIRE(json.substr(json.size() - 4) == "\n]}\n");
+			}
+		}
+	}
+}
+
+SCENARIO ("Tracers dump the latest snapshot", "[trace]") {
+	GIVEN ("an enabled tracer with a dump path") {
+		const auto path = ScratchPath("trace.json");
+		Tracer tracer;
+		tracer.Enable(path);
+
+		WHEN ("a dump is asked for, then another straight after, with an event in between") {
+			tracer.Mark(TraceEvent::COMMAND, 1);
+			const auto first = tracer.Dump();
+			tracer.Mark(TraceEvent::COMMAND, 2);
+			const auto second = tracer.Dump();
+			tracer.Flush();
+
+			std::ifstream in{path};
+			const std::string json{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+
+			THEN ("both are taken, rather than the second waiting on the first") {
+				REQUIRE(first);
+				REQUIRE(second);
+			}
+
+			THEN ("the file ends up with the second, whole") {
+				REQUIRE(json.find(R"("args":{"connection":1})") != std::string::npos);
+				REQUIRE(json.find(R"("args":{"connection":2})") != std::string::npos);
+				REQUIRE(json.substr(json.size() - 4) == "\n]}\n");
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
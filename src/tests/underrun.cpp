@@ -0,0 +1,94 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the UnderrunDetector class.
+ */
+
+#include "../audio/underrun.h"
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("UnderrunDetector finds gaps in a sink's audio", "[underrun]") {
+	GIVEN ("a fresh UnderrunDetector") {
+		Audio::UnderrunDetector underruns;
+
+		WHEN ("the sink has nothing to play before it has played anything") {
+			underruns.Played(0, 1024, 0);
+			underruns.Played(0, 1024, 1024);
+
+			THEN ("no underrun is recorded") {
+				REQUIRE_FALSE(underruns.Take());
+			}
+		}
+
+		WHEN ("the sink runs short, then dry, then recovers") {
+			underruns.Played(0, 1024, 1024);
+			underruns.Played(1024, 1024, 1000);
+			underruns.Played(2024, 1024, 0);
+
+			THEN ("nothing is handed over while the underrun continues") {
+				REQUIRE_FALSE(underruns.Take());
+			}
+
+			AND_WHEN ("audio comes back") {
+				underruns.Played(2024, 1024, 1024);
+
+				THEN ("one underrun is handed over, from where the audio stopped") {
+					auto underrun = underruns.Take();
+					REQUIRE(underrun);
+					REQUIRE(underrun->position == 2024);
+					REQUIRE(underrun->frames == 24 + 1024);
+					REQUIRE_FALSE(underruns.Take());
+				}
+			}
+		}
+
+		WHEN ("the sink runs dry because its source has ended") {
+			underruns.Played(0, 1024, 1024);
+			underruns.Played(1024, 100, 100);
+			underruns.Played(1124, 0, 0);
+
+			THEN ("no underrun is recorded") {
+				REQUIRE_FALSE(underruns.Take());
+			}
+		}
+
+		WHEN ("the detector is disarmed partway through an underrun") {
+			underruns.Played(0, 1024, 1024);
+			underruns.Played(1024, 1024, 0);
+			underruns.Disarm();
+			underruns.Played(50000, 1024, 0);
+
+			THEN ("the underrun so far is handed over, and the gap after isn't") {
+				auto underrun = underruns.Take();
+				REQUIRE(underrun);
+				REQUIRE(underrun->frames == 1024);
+				REQUIRE_FALSE(underruns.Take());
+			}
+		}
+
+		WHEN ("more underruns happen than the loop takes") {
+			underruns.Played(0, 1, 1);
+			for (Audio::Samples i = 0; i < 100; i++) {
+				underruns.Played(i, 2, 1);
+				underruns.Played(i, 1, 1);
+			}
+
+			THEN ("the oldest are kept, in order, up to a limit") {
+				Audio::Samples taken = 0;
+				while (auto underrun = underruns.Take()) {
+					REQUIRE(underrun->position == taken + 1);
+					taken++;
+				}
+				REQUIRE(0 < taken);
+				REQUIRE(taken < 100);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
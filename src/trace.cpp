@@ -0,0 +1,359 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Tracer and TraceSpan classes.
+ * @see trace.h
+ */
+
+#include "trace.h"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <utility>
+
+#include "log.h"
+
+namespace Playd
+{
+/// The number of each tracer, so threads can tell which their ring is for.
+static std::atomic<std::uint64_t> next_tracer{1};
+
+/// How each kind of event appears in a Chrome trace.
+struct EventInfo {
+	const char *name; ///< The event's name.
+	const char *arg;  ///< The name of the event's argument, or nullptr.
+	bool instant;     ///< Whether the event takes no time.
+};
+
+/// How each TraceEvent appears in a Chrome trace, in order.
+static constexpr std::array<EventInfo, 7> EVENT_INFO{{
+        {"update", nullptr, false},
+        {"decode", "bytes", false},
+        {"transfer", "bytes", false},
+        {"callback", "bytes", false},
+        {"write", "bytes", false},
+        {"command", "connection", false},
+        {"underrun", "frames", true},
+}};
+
+/**
+ * A thread's ring of events.
+ *
+ * Each event takes two words, so that the ring can be atomics throughout
+ * and copied out while written.  The writer bumps claimed before it starts
+ * overwriting a slot and written once it has finished; a reader that copies
+ * between reading written and claimed knows that any slot claimed since may
+ * be torn.
+ */
+struct Tracer::Ring {
+	/// The events: each one's start, then its duration, kind and argument.
+	std::array<std::atomic<std::uint64_t>, 2 * CAPACITY> words{};
+
+	std::atomic<std::uint64_t> claimed{0}; ///< Events ever started.
+	std::atomic<std::uint64_t> written{0}; ///< Events ever finished.
+
+	/// Whether a thread is still recording into this ring.
+	std::atomic<bool> in_use{true};
+
+	// The following are under the tracer's lock.
+
+	std::uint32_t thread; ///< The thread's number in the trace.
+	std::string name;     ///< The thread's name, if it gave one.
+};
+
+Tracer::Tracer()
+    : id{next_tracer.fetch_add(1)},
+      epoch{Clock::now()},
+      enabled{false},
+      next_thread{1},
+      writing{false},
+      quit{false}
+{
+}
+
+Tracer::~Tracer()
+{
+	{
+		std::lock_guard<std::mutex> guard{this->dump_lock};
+		this->quit = true;
+	}
+	this->dump_wake.notify_all();
+	if (this->writer.joinable()) this->writer.join();
+}
+
+/* static */ Tracer &Tracer::Global()
+{
+	static Tracer tracer;
+	return tracer;
+}
+
+void Tracer::Enable(std::string new_dump_path)
+{
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		this->dump_path = std::move(new_dump_path);
+	}
+	this->enabled.store(true, std::memory_order_relaxed);
+}
+
+bool Tracer::IsEnabled() const
+{
+	return this->enabled.load(std::memory_order_relaxed);
+}
+
+void Tracer::Record(TraceEvent event, Clock::time_point start, Clock::time_point end, std::uint64_t arg)
+{
+	if (!this->IsEnabled()) return;
+
+	const auto since = std::chrono::duration_cast<std::chrono::nanoseconds>(start - this->epoch).count();
+	const auto took = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	const auto duration = std::clamp<std::int64_t>(took, 0, std::numeric_limits<std::uint32_t>::max());
+
+	const auto packed = static_cast<std::uint64_t>(duration) | static_cast<std::uint64_t>(event) << 32U |
+	                    std::min<std::uint64_t>(arg, MAX_ARG) << 40U;
+
+	auto &ring = this->ThreadRing();
+	const auto n = ring.claimed.load(std::memory_order_relaxed);
+	ring.claimed.store(n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	const auto slot = 2 * (n % CAPACITY);
+	ring.words[slot].store(static_cast<std::uint64_t>(std::max<std::int64_t>(since, 0)), std::memory_order_relaxed);
+	ring.words[slot + 1].store(packed, std::memory_order_relaxed);
+	ring.written.store(n + 1, std::memory_order_release);
+}
+
+void Tracer::Mark(TraceEvent event, std::uint64_t arg)
+{
+	if (!this->IsEnabled()) return;
+
+	const auto now = Clock::now();
+	this->Record(event, now, now, arg);
+}
+
+void Tracer::NameThread(std::string_view name)
+{
+	if (!this->IsEnabled()) return;
+
+	auto &ring = this->ThreadRing();
+	std::lock_guard<std::mutex> guard{this->lock};
+	if (ring.name.empty()) ring.name = name;
+}
+
+Tracer::Ring &Tracer::ThreadRing()
+{
+	// Hands the ring back for reuse when the thread exits.
+	struct Holder {
+		std::uint64_t tracer = 0;
+		std::shared_ptr<Ring> ring;
+
+		~Holder()
+		{
+			if (this->ring) this->ring->in_use.store(false, std::memory_order_release);
+		}
+	};
+	static thread_local Holder holder;
+
+	if (holder.tracer == this->id) return *holder.ring;
+
+	std::lock_guard<std::mutex> guard{this->lock};
+	if (holder.ring) holder.ring->in_use.store(false, std::memory_order_release);
+
+	// Take over a ring whose thread has gone, if there is one.  Nobody
+	// else touches a ring out of use, and snapshots hold the lock.
+	auto free = std::find_if(this->rings.begin(), this->rings.end(), [](const std::shared_ptr<Ring> &ring) {
+		return !ring->in_use.load(std::memory_order_acquire);
+	});
+	if (free == this->rings.end()) {
+		free = this->rings.insert(this->rings.end(), std::make_shared<Ring>());
+	} else {
+		(*free)->claimed.store(0, std::memory_order_relaxed);
+		(*free)->written.store(0, std::memory_order_relaxed);
+		(*free)->in_use.store(true, std::memory_order_relaxed);
+		(*free)->name.clear();
+	}
+	(*free)->thread = this->next_thread++;
+
+	holder.tracer = this->id;
+	holder.ring = *free;
+	return *holder.ring;
+}
+
+std::vector<TraceThread> Tracer::Snapshot()
+{
+	std::vector<TraceThread> threads;
+	std::vector<std::uint64_t> words(2 * CAPACITY);
+
+	std::lock_guard<std::mutex> guard{this->lock};
+	for (const auto &ring : this->rings) {
+		const auto written = ring->written.load(std::memory_order_acquire);
+		auto first = CAPACITY < written ? written - CAPACITY : 0;
+		for (auto n = first; n < written; n++) {
+			const auto slot = 2 * (n % CAPACITY);
+			words[slot] = ring->words[slot].load(std::memory_order_relaxed);
+			words[slot + 1] = ring->words[slot + 1].load(std::memory_order_relaxed);
+		}
+
+		// Anything the writer started on while we copied may have
+		// overwritten the oldest events we copied.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const auto claimed = ring->claimed.load(std::memory_order_relaxed);
+		if (CAPACITY < claimed) first = std::max(first, claimed - CAPACITY);
+		if (written <= first) continue;
+
+		auto &thread = threads.emplace_back(TraceThread{ring->thread, ring->name, {}});
+		thread.records.reserve(written - first);
+		for (auto n = first; n < written; n++) {
+			const auto slot = 2 * (n % CAPACITY);
+			const auto packed = words[slot + 1];
+			thread.records.push_back(TraceRecord{words[slot], static_cast<std::uint32_t>(packed),
+			                                     static_cast<TraceEvent>((packed >> 32U) & 0xFFU),
+			                                     static_cast<std::uint32_t>(packed >> 40U)});
+		}
+	}
+
+	return threads;
+}
+
+/**
+ * Writes a time in nanoseconds as the microseconds Chrome traces use.
+ * @param out The stream to which to write.
+ * @param ns The time.
+ */
+static void WriteMicros(std::ostream &out, std::uint64_t ns)
+{
+	const auto fraction = ns % 1000;
+	out << ns / 1000 << '.' << fraction / 100 << fraction / 10 % 10 << fraction % 10;
+}
+
+/* static */ void Tracer::WriteJson(std::ostream &out, const std::vector<TraceThread> &threads)
+{
+	out << R"({"displayTimeUnit":"ms","traceEvents":[)";
+
+	auto first = true;
+	for (const auto &thread : threads) {
+		// Thread names are ours, so need no escaping.
+		const auto name = thread.name.empty() ? "thread " + std::to_string(thread.id) : thread.name;
+		out << (first ? "\n" : ",\n") << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << thread.id
+		    << R"(,"args":{"name":")" << name << R"("}})";
+		first = false;
+
+		for (const auto &record : thread.records) {
+			const auto &info = EVENT_INFO.at(static_cast<std::size_t>(record.event));
+			out << ",\n" << R"({"name":")" << info.name << R"(","ph":")" << (info.instant ? "i" : "X")
+			    << R"(","pid":1,"tid":)" << thread.id << R"(,"ts":)";
+			WriteMicros(out, record.start);
+			if (info.instant) {
+				out << R"(,"s":"t")";
+			} else {
+				out << R"(,"dur":)";
+				WriteMicros(out, record.duration);
+			}
+			if (info.arg != nullptr) out << R"(,"args":{")" << info.arg << R"(":)" << record.arg << '}';
+			out << '}';
+		}
+	}
+
+	out << "\n]}\n";
+}
+
+bool Tracer::Dump()
+{
+	if (!this->IsEnabled()) return false;
+
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		if (this->dump_path.empty()) return false;
+	}
+
+	// Snapshotting here catches the moment; writing the file can wait.
+	// Only the newest snapshot matters, so one the writer hasn't got to
+	// yet is simply replaced.
+	auto threads = this->Snapshot();
+	{
+		std::lock_guard<std::mutex> guard{this->dump_lock};
+		this->waiting = std::move(threads);
+		if (!this->writer.joinable()) this->writer = std::thread{&Tracer::RunWriter, this};
+	}
+	this->dump_wake.notify_one();
+	return true;
+}
+
+void Tracer::Flush()
+{
+	std::unique_lock<std::mutex> guard{this->dump_lock};
+	this->dump_idle.wait(guard, [this] { return !this->waiting && !this->writing; });
+}
+
+void Tracer::RunWriter()
+{
+	std::unique_lock<std::mutex> guard{this->dump_lock};
+	while (true) {
+		this->dump_wake.wait(guard, [this] { return this->waiting || this->quit; });
+		if (!this->waiting) break;
+
+		const auto threads = std::move(*this->waiting);
+		this->waiting.reset();
+
+		this->writing = true;
+		guard.unlock();
+		this->Write(threads);
+		guard.lock();
+		this->writing = false;
+
+		this->dump_idle.notify_all();
+	}
+	this->dump_idle.notify_all();
+}
+
+void Tracer::Write(const std::vector<TraceThread> &threads)
+{
+	std::string path;
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		path = this->dump_path;
+	}
+
+	// Write to a temporary file and rename it over the dump, so that
+	// nobody sees a half-written trace.
+	const auto tmp_path = path + ".tmp";
+	{
+		std::ofstream out{tmp_path, std::ios::trunc};
+		WriteJson(out, threads);
+		if (!out) {
+			PLAYD_LOG(ERROR) << "trace: can't write" << tmp_path;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tmp_path, path, ec);
+	if (ec) {
+		PLAYD_LOG(ERROR) << "trace: can't replace" << path << ":" << ec.message();
+	}
+}
+
+//
+// TraceSpan
+//
+
+TraceSpan::TraceSpan(TraceEvent event, std::uint64_t arg) : event{event}, arg{arg}, start{}
+{
+	if (Tracer::Global().IsEnabled()) this->start = Tracer::Clock::now();
+}
+
+TraceSpan::~TraceSpan()
+{
+	if (this->start) Tracer::Global().Record(this->event, *this->start, Tracer::Clock::now(), this->arg);
+}
+
+void TraceSpan::SetArg(std::uint64_t new_arg)
+{
+	this->arg = new_arg;
+}
+
+} // namespace Playd
@@ -0,0 +1,235 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Tracer and TraceSpan classes.
+ * @see trace.cpp
+ */
+
+#ifndef PLAYD_TRACE_H
+#define PLAYD_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace Playd
+{
+/// The kinds of event in a trace.
+enum class TraceEvent : std::uint8_t {
+	UPDATE,   ///< The loop updating the players.
+	DECODE,   ///< Decoding a frame; the argument is the bytes decoded.
+	TRANSFER, ///< Moving a frame into a sink; the bytes moved.
+	CALLBACK, ///< An audio device callback; the bytes asked for.
+	WRITE,    ///< Queueing a response to a client; the bytes queued.
+	COMMAND,  ///< Running a client's command; the connection's ID.
+	UNDERRUN  ///< A sink starting to run dry (an instant); the frames missed.
+};
+
+/// One event in a trace.
+struct TraceRecord {
+	std::uint64_t start;    ///< When it started, in ns since the tracer was made.
+	std::uint32_t duration; ///< How long it took, in ns; 0 for instants.
+	TraceEvent event;       ///< What happened.
+	std::uint32_t arg;      ///< The event's argument, capped at Tracer::MAX_ARG.
+};
+
+/// The events one thread has recorded, as taken by Tracer::Snapshot.
+struct TraceThread {
+	std::uint32_t id;                 ///< The thread's number in the trace.
+	std::string name;                 ///< The thread's name, if it gave one.
+	std::vector<TraceRecord> records; ///< The events, oldest first.
+};
+
+/**
+ * Records timed events, per thread, for working out what led to a dropout.
+ *
+ * Each thread that records events gets a ring of the last CAPACITY of them.
+ * Only that thread writes to its ring, so recording is lock-free and never
+ * allocates, except for the ring itself on the thread's first event; when
+ * tracing is off, it costs one atomic load.  Rings outlive their threads,
+ * until another thread takes them over, so a trace can still show what an
+ * audio device's thread did after the device has closed.
+ *
+ * Snapshot copies the rings out without stopping their writers, keeping only
+ * the events it can be sure weren't being overwritten as it copied.  Dump
+ * writes a snapshot, in the Chrome trace format (which Perfetto and
+ * chrome://tracing read), from a thread of its own; this runs at normal
+ * priority, so a dump isn't held up by the very load it is meant to show.
+ */
+class Tracer
+{
+public:
+	/// The clock events are timed by.
+	using Clock = std::chrono::steady_clock;
+
+	/// The number of events each thread's ring holds.
+	static constexpr std::size_t CAPACITY = 8192;
+
+	/// The largest argument an event can carry.
+	static constexpr std::uint32_t MAX_ARG = (1U << 24) - 1;
+
+	/// Constructs a Tracer, disabled.
+	Tracer();
+
+	/// Destructs a Tracer.
+	~Tracer();
+
+	/// Deleted copy constructor.
+	Tracer(const Tracer &) = delete;
+
+	/// Deleted copy-assignment.
+	Tracer &operator=(const Tracer &) = delete;
+
+	/**
+	 * Gets the process-wide tracer.
+	 * @return The tracer.
+	 */
+	static Tracer &Global();
+
+	/**
+	 * Starts recording events.
+	 * @param dump_path The file Dump writes to; if empty, Dump does nothing.
+	 */
+	void Enable(std::string dump_path = "");
+
+	/**
+	 * Gets whether events are being recorded.
+	 * @return Whether the tracer is enabled.
+	 */
+	bool IsEnabled() const;
+
+	/**
+	 * Records an event that took some time, if enabled.
+	 * @param event What happened.
+	 * @param start When it started.
+	 * @param end When it ended.
+	 * @param arg The event's argument; see TraceEvent.
+	 */
+	void Record(TraceEvent event, Clock::time_point start, Clock::time_point end, std::uint64_t arg = 0);
+
+	/**
+	 * Records an event that happened now, and took no time, if enabled.
+	 * @param event What happened.
+	 * @param arg The event's argument; see TraceEvent.
+	 */
+	void Mark(TraceEvent event, std::uint64_t arg = 0);
+
+	/**
+	 * Names the calling thread in traces, if enabled and it isn't named yet.
+	 * This takes a lock, so call it once, as the thread starts.
+	 * @param name The name.
+	 */
+	void NameThread(std::string_view name);
+
+	/**
+	 * Copies out the events recorded so far.
+	 * @return Each thread's events, for the threads that recorded any.
+	 */
+	std::vector<TraceThread> Snapshot();
+
+	/**
+	 * Writes events as a Chrome trace (JSON).
+	 * @param out The stream to which to write.
+	 * @param threads The events, as taken by Snapshot.
+	 */
+	static void WriteJson(std::ostream &out, const std::vector<TraceThread> &threads);
+
+	/**
+	 * Takes a snapshot now, and has the writer write it to the dump path,
+	 * replacing the file whole.  If an earlier snapshot is still waiting
+	 * to be written, this one replaces it, so the file ends up with the
+	 * latest.
+	 * @return Whether a dump was queued: not if disabled, or without a dump
+	 *   path.
+	 */
+	bool Dump();
+
+	/// Waits until every dump queued so far has been written.
+	void Flush();
+
+private:
+	/// A thread's ring of events.
+	struct Ring;
+
+	const std::uint64_t id;        ///< Tells tracers apart, for ThreadRing.
+	const Clock::time_point epoch; ///< What event times count from.
+	std::atomic<bool> enabled;     ///< Whether events are being recorded.
+
+	std::mutex lock;                          ///< Lock over the below.
+	std::string dump_path;                    ///< Where Dump writes.
+	std::vector<std::shared_ptr<Ring>> rings; ///< Every thread's ring.
+	std::uint32_t next_thread;                ///< The next thread's number.
+
+	std::mutex dump_lock;                            ///< Lock over the below.
+	std::condition_variable dump_wake;               ///< Signalled on new dumps or quitting.
+	std::condition_variable dump_idle;               ///< Signalled when the writer catches up.
+	std::optional<std::vector<TraceThread>> waiting; ///< The newest snapshot to write.
+	bool writing;                                    ///< Whether the writer is mid-write.
+	bool quit;                                       ///< Whether the writer should stop.
+	std::thread writer;                              ///< The writer, once Dump starts it.
+
+	/**
+	 * Gets the calling thread's ring, setting one up on first use.
+	 * @return The ring.
+	 */
+	Ring &ThreadRing();
+
+	/// The body of the writer thread.
+	void RunWriter();
+
+	/**
+	 * Writes a snapshot to the dump path.
+	 * @param threads The snapshot.
+	 */
+	void Write(const std::vector<TraceThread> &threads);
+};
+
+/**
+ * Records, with the process-wide Tracer, the time from its construction to
+ * its destruction as an event.
+ */
+class TraceSpan
+{
+public:
+	/**
+	 * Constructs a TraceSpan, starting the clock if tracing is enabled.
+	 * @param event What is happening.
+	 * @param arg The event's argument; see TraceEvent.
+	 */
+	explicit TraceSpan(TraceEvent event, std::uint64_t arg = 0);
+
+	/// Destructs a TraceSpan, recording its event.
+	~TraceSpan();
+
+	/// Deleted copy constructor.
+	TraceSpan(const TraceSpan &) = delete;
+
+	/// Deleted copy-assignment.
+	TraceSpan &operator=(const TraceSpan &) = delete;
+
+	/**
+	 * Changes the event's argument, for when it isn't known up front.
+	 * @param new_arg The argument.
+	 */
+	void SetArg(std::uint64_t new_arg);
+
+private:
+	TraceEvent event;                               ///< What is happening.
+	std::uint64_t arg;                              ///< The event's argument.
+	std::optional<Tracer::Clock::time_point> start; ///< When, if tracing.
+};
+
+} // namespace Playd
+
+#endif // PLAYD_TRACE_H
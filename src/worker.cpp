@@ -0,0 +1,107 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the WorkerPool class.
+ * @see worker.h
+ */
+
+#include "worker.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif // _WIN32
+
+#include "metrics.h"
+
+namespace Playd
+{
+/// @return The gauge of jobs waiting for a worker.
+static Gauge &QueuedGauge()
+{
+	static auto &gauge = Metrics::Global().GetGauge("playd_worker_jobs_queued", "Background jobs waiting to run.");
+	return gauge;
+}
+
+/**
+ * Drops the calling thread to the lowest priority we can get.
+ * Failure isn't fatal; the thread just competes on equal terms.
+ */
+static void LowerThreadPriority()
+{
+#if defined(_WIN32)
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+	// SCHED_IDLE threads only run when nothing else on the CPU wants to.
+	sched_param param{};
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#else
+	sched_param param{};
+	param.sched_priority = sched_get_priority_min(SCHED_OTHER);
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+#endif
+}
+
+WorkerPool::WorkerPool(std::size_t threads) : stop{false}
+{
+	for (std::size_t i = 0; i < threads; i++) this->threads.emplace_back(&WorkerPool::Run, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		this->stop = true;
+		QueuedGauge().Add(-static_cast<std::int64_t>(this->jobs.size()));
+		this->jobs.clear();
+	}
+	this->wake.notify_all();
+
+	for (auto &thread : this->threads) thread.join();
+}
+
+/* static */ WorkerPool &WorkerPool::Background()
+{
+	static WorkerPool pool{1};
+	return pool;
+}
+
+void WorkerPool::Submit(Job job)
+{
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		this->jobs.push_back(std::move(job));
+		QueuedGauge().Add(1);
+	}
+	this->wake.notify_one();
+}
+
+void WorkerPool::Run()
+{
+	LowerThreadPriority();
+
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> guard{this->lock};
+			this->wake.wait(guard, [this] { return this->stop || !this->jobs.empty(); });
+			if (this->stop) return;
+
+			job = std::move(this->jobs.front());
+			this->jobs.pop_front();
+			QueuedGauge().Add(-1);
+		}
+
+		job(this->stop);
+	}
+}
+
+} // namespace Playd
@@ -0,0 +1,85 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the WorkerPool class.
+ * @see worker.cpp
+ */
+
+#ifndef PLAYD_WORKER_H
+#define PLAYD_WORKER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Playd
+{
+/**
+ * A pool of threads that run jobs in the background, at low priority.
+ *
+ * Workers run at the lowest priority the platform offers (SCHED_IDLE on
+ * Linux), so that their jobs (such as analysing whole files) only get CPU
+ * time that the audio and IO threads don't want.
+ */
+class WorkerPool
+{
+public:
+	/**
+	 * Type of jobs.
+	 * Long jobs should check the flag they're given now and again, and
+	 * return early once it is set: the pool is shutting down.
+	 */
+	using Job = std::function<void(const std::atomic<bool> &stop)>;
+
+	/**
+	 * Constructs a WorkerPool, and starts its threads.
+	 * @param threads The number of threads in the pool.
+	 */
+	explicit WorkerPool(std::size_t threads);
+
+	/**
+	 * Destructs a WorkerPool.
+	 * Jobs still queued are dropped; this waits for running jobs to stop.
+	 */
+	~WorkerPool();
+
+	/// Deleted copy constructor.
+	WorkerPool(const WorkerPool &) = delete;
+
+	/// Deleted copy-assignment.
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	/**
+	 * Queues a job to run on the next free thread.
+	 * @param job The job.
+	 */
+	void Submit(Job job);
+
+	/**
+	 * Gets the process-wide pool for background analysis.
+	 * It has one thread, started on first use.
+	 * @return The pool.
+	 */
+	static WorkerPool &Background();
+
+private:
+	std::mutex lock;                   ///< Lock over the queue.
+	std::condition_variable wake;      ///< Signalled on new jobs or stopping.
+	std::deque<Job> jobs;              ///< Jobs waiting for a thread.
+	std::atomic<bool> stop;            ///< Whether the pool is shutting down.
+	std::vector<std::thread> threads;  ///< The worker threads.
+
+	/// The body of each worker thread.
+	void Run();
+};
+
+} // namespace Playd
+
+#endif // PLAYD_WORKER_H